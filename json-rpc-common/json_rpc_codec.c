@@ -0,0 +1,572 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json_rpc_codec.h"
+#include "json_rpc_common.h"
+#include "utlist.h"
+
+#define MSGPACK_NIL 0xc0
+#define MSGPACK_FALSE 0xc2
+#define MSGPACK_TRUE 0xc3
+#define MSGPACK_FLOAT32 0xca
+#define MSGPACK_FLOAT64 0xcb
+#define MSGPACK_UINT8 0xcc
+#define MSGPACK_UINT16 0xcd
+#define MSGPACK_UINT32 0xce
+#define MSGPACK_UINT64 0xcf
+#define MSGPACK_INT8 0xd0
+#define MSGPACK_INT16 0xd1
+#define MSGPACK_INT32 0xd2
+#define MSGPACK_INT64 0xd3
+#define MSGPACK_STR8 0xd9
+#define MSGPACK_STR16 0xda
+#define MSGPACK_STR32 0xdb
+#define MSGPACK_ARRAY16 0xdc
+#define MSGPACK_ARRAY32 0xdd
+#define MSGPACK_MAP16 0xde
+#define MSGPACK_MAP32 0xdf
+#define MSGPACK_KEY_BUFFER_SIZE 128 /* Map keys up to this size are terminated on the stack. */
+
+static pthread_mutex_t g_arrays_mutex = PTHREAD_MUTEX_INITIALIZER;
+static rpc_codec_array_t *g_arrays = NULL; /* Arrays with their own encoder. */
+static int g_arrays_count = 0;             /* Read without the lock, the list is only searched when not 0. */
+
+/**
+ * @brief Cursor of the decoder.
+ */
+typedef struct msgpack_reader_t
+{
+    const unsigned char *data; /* Next byte to read. */
+    const unsigned char *end;  /* End of the message. */
+} msgpack_reader_t;
+
+/**
+ * @brief Append a type byte followed by a big endian value of `size` bytes.
+ */
+static int msgpack_put(rpc_frame_buffer_t *buf, unsigned char type, uint64_t value, int size)
+{
+    unsigned char wire[9];
+    wire[0] = type;
+    for (int i = 0; i < size; ++i)
+    {
+        wire[size - i] = (unsigned char)(value >> (8 * i));
+    }
+    return json_rpc_frame_buffer_append(buf, (const char *)wire, size + 1);
+}
+
+/**
+ * @brief Append the header of a string, array or map of `count` entries.
+ * @param fix type byte of the short form, the count is or-ed in
+ * @param limit of the count in the short form
+ * @param type byte of the forms with a count of 8 (0 if none), 16 and 32 bits
+ */
+static int msgpack_put_header(rpc_frame_buffer_t *buf, size_t count, unsigned char fix, size_t limit,
+                              unsigned char type8, unsigned char type16, unsigned char type32)
+{
+    if (count < limit)
+    {
+        return msgpack_put(buf, fix | (unsigned char)count, 0, 0);
+    }
+    if (type8 != 0 && count <= UINT8_MAX)
+    {
+        return msgpack_put(buf, type8, count, 1);
+    }
+    if (count <= UINT16_MAX)
+    {
+        return msgpack_put(buf, type16, count, 2);
+    }
+    if (count <= UINT32_MAX)
+    {
+        return msgpack_put(buf, type32, count, 4);
+    }
+    return RETURN_ERR;
+}
+
+/**
+ * @brief Append a string.
+ */
+static int msgpack_put_string(rpc_frame_buffer_t *buf, const char *str, size_t len)
+{
+    if (msgpack_put_header(buf, len, 0xa0, 32, MSGPACK_STR8, MSGPACK_STR16, MSGPACK_STR32) != RETURN_OK)
+    {
+        return RETURN_ERR;
+    }
+    return json_rpc_frame_buffer_append(buf, str, len);
+}
+
+/**
+ * @brief Append an integer in its shortest form.
+ */
+static int msgpack_put_int(rpc_frame_buffer_t *buf, int64_t value)
+{
+    if (value >= 0)
+    {
+        if (value < 0x80)
+        {
+            return msgpack_put(buf, (unsigned char)value, 0, 0);
+        }
+        if (value <= UINT8_MAX)
+        {
+            return msgpack_put(buf, MSGPACK_UINT8, (uint64_t)value, 1);
+        }
+        if (value <= UINT16_MAX)
+        {
+            return msgpack_put(buf, MSGPACK_UINT16, (uint64_t)value, 2);
+        }
+        if (value <= UINT32_MAX)
+        {
+            return msgpack_put(buf, MSGPACK_UINT32, (uint64_t)value, 4);
+        }
+        return msgpack_put(buf, MSGPACK_UINT64, (uint64_t)value, 8);
+    }
+    if (value >= -32)
+    {
+        return msgpack_put(buf, (unsigned char)value, 0, 0);
+    }
+    if (value >= INT8_MIN)
+    {
+        return msgpack_put(buf, MSGPACK_INT8, (uint64_t)value & 0xff, 1);
+    }
+    if (value >= INT16_MIN)
+    {
+        return msgpack_put(buf, MSGPACK_INT16, (uint64_t)value & 0xffff, 2);
+    }
+    if (value >= INT32_MIN)
+    {
+        return msgpack_put(buf, MSGPACK_INT32, (uint64_t)value & 0xffffffff, 4);
+    }
+    return msgpack_put(buf, MSGPACK_INT64, (uint64_t)value, 8);
+}
+
+/**
+ * @brief Append a json value and its members.
+ */
+static int msgpack_put_value(rpc_frame_buffer_t *buf, json_object *jobj)
+{
+    rpc_codec_array_t *array;
+    double dvalue;
+    uint64_t bits;
+    int count;
+
+    switch (json_object_get_type(jobj))
+    {
+        case json_type_null:
+            return msgpack_put(buf, MSGPACK_NIL, 0, 0);
+        case json_type_boolean:
+            return msgpack_put(buf, json_object_get_boolean(jobj) ? MSGPACK_TRUE : MSGPACK_FALSE, 0, 0);
+        case json_type_int:
+            return msgpack_put_int(buf, json_object_get_int64(jobj));
+        case json_type_double:
+            dvalue = json_object_get_double(jobj);
+            memcpy(&bits, &dvalue, sizeof(bits));
+            return msgpack_put(buf, MSGPACK_FLOAT64, bits, 8);
+        case json_type_string:
+            return msgpack_put_string(buf, json_object_get_string(jobj), json_object_get_string_len(jobj));
+        case json_type_array:
+            count = json_object_array_length(jobj);
+            if (count == 0 && (array = json_rpc_codec_find_array(jobj)) != NULL)
+            {
+                return array->encode(array, buf);
+            }
+            if (msgpack_put_header(buf, count, 0x90, 16, 0, MSGPACK_ARRAY16, MSGPACK_ARRAY32) != RETURN_OK)
+            {
+                return RETURN_ERR;
+            }
+            for (int i = 0; i < count; ++i)
+            {
+                if (msgpack_put_value(buf, json_object_array_get_idx(jobj, i)) != RETURN_OK)
+                {
+                    return RETURN_ERR;
+                }
+            }
+            return RETURN_OK;
+        case json_type_object:
+            count = json_object_object_length(jobj);
+            if (msgpack_put_header(buf, count, 0x80, 16, 0, MSGPACK_MAP16, MSGPACK_MAP32) != RETURN_OK)
+            {
+                return RETURN_ERR;
+            }
+            {
+                json_object_object_foreach(jobj, key, value)
+                {
+                    if (msgpack_put_string(buf, key, strlen(key)) != RETURN_OK || msgpack_put_value(buf, value) != RETURN_OK)
+                    {
+                        return RETURN_ERR;
+                    }
+                }
+            }
+            return RETURN_OK;
+        default:
+            return RETURN_ERR;
+    }
+}
+
+/**
+ * @brief Read a big endian value of `size` bytes.
+ */
+static int msgpack_get(msgpack_reader_t *reader, int size, uint64_t *value)
+{
+    if (reader->end - reader->data < size)
+    {
+        return RETURN_ERR;
+    }
+    *value = 0;
+    for (int i = 0; i < size; ++i)
+    {
+        *value = (*value << 8) | *reader->data++;
+    }
+    return RETURN_OK;
+}
+
+/**
+ * @brief Read a value and its members.
+ * @param reader
+ * @param nesting of the value
+ * @param (OUT) value, NULL for nil
+ * @return RETURN_OK on success , RETURN_ERR if the message is invalid.
+ */
+static int msgpack_get_value(msgpack_reader_t *reader, int depth, json_object **jvalue);
+
+/**
+ * @brief Read the entries of an array or a map.
+ */
+static int msgpack_get_members(msgpack_reader_t *reader, int depth, uint64_t count, int map, json_object **jvalue)
+{
+    char key_buffer[MSGPACK_KEY_BUFFER_SIZE];
+    json_object *container;
+    json_object *member;
+    uint64_t key_len;
+    uint64_t type;
+
+    if (depth >= RPC_CODEC_MAX_DEPTH || count > (uint64_t)(reader->end - reader->data))
+    {
+        return RETURN_ERR;
+    }
+    container = map ? json_object_new_object() : json_object_new_array();
+    if (container == NULL)
+    {
+        return RETURN_ERR;
+    }
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        char *key = key_buffer;
+        if (map)
+        {
+            /* json-c wants terminated keys. */
+            if (msgpack_get(reader, 1, &type) != RETURN_OK)
+            {
+                goto ERROR;
+            }
+            if ((type & 0xe0) == 0xa0)
+            {
+                key_len = type & 0x1f;
+            }
+            else if (type < MSGPACK_STR8 || type > MSGPACK_STR32 ||
+                     msgpack_get(reader, 1 << (type - MSGPACK_STR8), &key_len) != RETURN_OK)
+            {
+                goto ERROR;
+            }
+            if (key_len > (uint64_t)(reader->end - reader->data))
+            {
+                goto ERROR;
+            }
+            if (key_len >= sizeof(key_buffer) && (key = (char *)malloc(key_len + 1)) == NULL)
+            {
+                goto ERROR;
+            }
+            memcpy(key, reader->data, key_len);
+            key[key_len] = '\0';
+            reader->data += key_len;
+        }
+        if (msgpack_get_value(reader, depth + 1, &member) != RETURN_OK)
+        {
+            if (key != key_buffer)
+            {
+                free(key);
+            }
+            goto ERROR;
+        }
+        if (map)
+        {
+            json_object_object_add(container, key, member);
+            if (key != key_buffer)
+            {
+                free(key);
+            }
+        }
+        else
+        {
+            json_object_array_add(container, member);
+        }
+    }
+    *jvalue = container;
+    return RETURN_OK;
+
+ERROR:
+    json_object_put(container);
+    return RETURN_ERR;
+}
+
+static int msgpack_get_value(msgpack_reader_t *reader, int depth, json_object **jvalue)
+{
+    uint64_t type;
+    uint64_t value;
+    uint32_t bits32;
+    float fvalue;
+    double dvalue;
+
+    *jvalue = NULL;
+    if (msgpack_get(reader, 1, &type) != RETURN_OK)
+    {
+        return RETURN_ERR;
+    }
+    if (type < 0x80 || type >= 0xe0)
+    {
+        /* Positive and negative fixint. */
+        *jvalue = json_object_new_int64((type >= 0xe0) ? (int64_t)(int8_t)type : (int64_t)type);
+        return (*jvalue != NULL) ? RETURN_OK : RETURN_ERR;
+    }
+    if (type < 0x90)
+    {
+        return msgpack_get_members(reader, depth, type & 0x0f, TRUE, jvalue);
+    }
+    if (type < 0xa0)
+    {
+        return msgpack_get_members(reader, depth, type & 0x0f, FALSE, jvalue);
+    }
+    if (type < 0xc0 || (type >= MSGPACK_STR8 && type <= MSGPACK_STR32))
+    {
+        value = type & 0x1f;
+        if (type >= 0xc0 && msgpack_get(reader, 1 << (type - MSGPACK_STR8), &value) != RETURN_OK)
+        {
+            return RETURN_ERR;
+        }
+        if (value > (uint64_t)(reader->end - reader->data))
+        {
+            return RETURN_ERR;
+        }
+        *jvalue = json_object_new_string_len((const char *)reader->data, (int)value);
+        reader->data += value;
+        return (*jvalue != NULL) ? RETURN_OK : RETURN_ERR;
+    }
+
+    switch (type)
+    {
+        case MSGPACK_NIL:
+            return RETURN_OK;
+        case MSGPACK_FALSE:
+        case MSGPACK_TRUE:
+            *jvalue = json_object_new_boolean(type == MSGPACK_TRUE);
+            break;
+        case MSGPACK_FLOAT32:
+            if (msgpack_get(reader, 4, &value) != RETURN_OK)
+            {
+                return RETURN_ERR;
+            }
+            bits32 = (uint32_t)value;
+            memcpy(&fvalue, &bits32, sizeof(fvalue));
+            *jvalue = json_object_new_double(fvalue);
+            break;
+        case MSGPACK_FLOAT64:
+            if (msgpack_get(reader, 8, &value) != RETURN_OK)
+            {
+                return RETURN_ERR;
+            }
+            memcpy(&dvalue, &value, sizeof(dvalue));
+            *jvalue = json_object_new_double(dvalue);
+            break;
+        case MSGPACK_UINT8:
+        case MSGPACK_UINT16:
+        case MSGPACK_UINT32:
+        case MSGPACK_UINT64:
+            if (msgpack_get(reader, 1 << (type - MSGPACK_UINT8), &value) != RETURN_OK)
+            {
+                return RETURN_ERR;
+            }
+            *jvalue = json_object_new_int64((value > INT64_MAX) ? INT64_MAX : (int64_t)value);
+            break;
+        case MSGPACK_INT8:
+            if (msgpack_get(reader, 1, &value) != RETURN_OK)
+            {
+                return RETURN_ERR;
+            }
+            *jvalue = json_object_new_int64((int8_t)value);
+            break;
+        case MSGPACK_INT16:
+            if (msgpack_get(reader, 2, &value) != RETURN_OK)
+            {
+                return RETURN_ERR;
+            }
+            *jvalue = json_object_new_int64((int16_t)value);
+            break;
+        case MSGPACK_INT32:
+            if (msgpack_get(reader, 4, &value) != RETURN_OK)
+            {
+                return RETURN_ERR;
+            }
+            *jvalue = json_object_new_int64((int32_t)value);
+            break;
+        case MSGPACK_INT64:
+            if (msgpack_get(reader, 8, &value) != RETURN_OK)
+            {
+                return RETURN_ERR;
+            }
+            *jvalue = json_object_new_int64((int64_t)value);
+            break;
+        case MSGPACK_ARRAY16:
+        case MSGPACK_ARRAY32:
+            if (msgpack_get(reader, (type == MSGPACK_ARRAY16) ? 2 : 4, &value) != RETURN_OK)
+            {
+                return RETURN_ERR;
+            }
+            return msgpack_get_members(reader, depth, value, FALSE, jvalue);
+        case MSGPACK_MAP16:
+        case MSGPACK_MAP32:
+            if (msgpack_get(reader, (type == MSGPACK_MAP16) ? 2 : 4, &value) != RETURN_OK)
+            {
+                return RETURN_ERR;
+            }
+            return msgpack_get_members(reader, depth, value, TRUE, jvalue);
+        default:
+            /* bin and ext types are never sent. */
+            return RETURN_ERR;
+    }
+    return (*jvalue != NULL) ? RETURN_OK : RETURN_ERR;
+}
+
+/**
+ * @brief Check whether a message starts with a map or an array, as every MessagePack message does.
+ */
+static int msgpack_is_message(const char *data, size_t len)
+{
+    unsigned char first;
+
+    if (data == NULL || len == 0)
+    {
+        return FALSE;
+    }
+    first = (unsigned char)data[0];
+    return (first >= 0x80 && first <= 0x9f) || (first >= MSGPACK_ARRAY16 && first <= MSGPACK_MAP32);
+}
+
+int json_rpc_codec_encode(json_object *jobj, rpc_frame_buffer_t *buf)
+{
+    POINTER_ASSERT(jobj != NULL);
+    POINTER_ASSERT(buf != NULL);
+
+    size_t len = buf->len;
+    if (msgpack_put_value(buf, jobj) != RETURN_OK)
+    {
+        buf->len = len;
+        return RETURN_ERR;
+    }
+    return RETURN_OK;
+}
+
+int json_rpc_codec_encode_map(rpc_frame_buffer_t *buf, size_t count)
+{
+    POINTER_ASSERT(buf != NULL);
+
+    return msgpack_put_header(buf, count, 0x80, 16, 0, MSGPACK_MAP16, MSGPACK_MAP32);
+}
+
+int json_rpc_codec_encode_string(rpc_frame_buffer_t *buf, const char *str, size_t len)
+{
+    POINTER_ASSERT(buf != NULL);
+    POINTER_ASSERT(str != NULL);
+
+    return msgpack_put_string(buf, str, len);
+}
+
+int json_rpc_codec_encode_array(rpc_frame_buffer_t *buf, size_t count)
+{
+    POINTER_ASSERT(buf != NULL);
+
+    return msgpack_put_header(buf, count, 0x90, 16, 0, MSGPACK_ARRAY16, MSGPACK_ARRAY32);
+}
+
+int json_rpc_codec_encode_int(rpc_frame_buffer_t *buf, int64_t value)
+{
+    POINTER_ASSERT(buf != NULL);
+
+    return msgpack_put_int(buf, value);
+}
+
+int json_rpc_codec_encode_boolean(rpc_frame_buffer_t *buf, int value)
+{
+    POINTER_ASSERT(buf != NULL);
+
+    return msgpack_put(buf, value ? MSGPACK_TRUE : MSGPACK_FALSE, 0, 0);
+}
+
+void json_rpc_codec_register_array(rpc_codec_array_t *array)
+{
+    pthread_mutex_lock(&g_arrays_mutex);
+    DL_APPEND(g_arrays, array);
+    __atomic_add_fetch(&g_arrays_count, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_arrays_mutex);
+}
+
+void json_rpc_codec_unregister_array(rpc_codec_array_t *array)
+{
+    pthread_mutex_lock(&g_arrays_mutex);
+    DL_DELETE(g_arrays, array);
+    __atomic_sub_fetch(&g_arrays_count, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_arrays_mutex);
+}
+
+rpc_codec_array_t *json_rpc_codec_find_array(json_object *jarray)
+{
+    rpc_codec_array_t *array = NULL;
+
+    /* An array registered by this thread is always seen, it is the only one searched for. */
+    if (__atomic_load_n(&g_arrays_count, __ATOMIC_ACQUIRE) == 0)
+    {
+        return NULL;
+    }
+    pthread_mutex_lock(&g_arrays_mutex);
+    DL_SEARCH_SCALAR(g_arrays, array, jarray, jarray);
+    pthread_mutex_unlock(&g_arrays_mutex);
+    return array;
+}
+
+json_object *json_rpc_codec_decode(const char *data, size_t len)
+{
+    msgpack_reader_t reader;
+    json_object *jobj = NULL;
+
+    if (msgpack_is_message(data, len) == FALSE)
+    {
+        return NULL;
+    }
+    reader.data = (const unsigned char *)data;
+    reader.end = reader.data + len;
+    if (msgpack_get_value(&reader, 0, &jobj) != RETURN_OK || reader.data != reader.end)
+    {
+        LOGERROR("Invalid MessagePack message of %zu bytes", len);
+        json_object_put(jobj);
+        return NULL;
+    }
+    return jobj;
+}
@@ -0,0 +1,156 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef _JSON_RPC_CODEC_H
+#define _JSON_RPC_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <json-c/json.h>
+#include "json_rpc_frame.h"
+
+/**
+ * Binary encoding of the messages, MessagePack.
+ *
+ * A connection starts with text json. A framed client can offer another encoding
+ * with a RPC_FRAME_TYPE_CODEC_OFFER frame, the server answers with the encoding it
+ * agreed to in a RPC_FRAME_TYPE_CODEC_ACCEPT frame, and both sides send their messages
+ * with it from then on. Every message carries its encoding, binary messages are sent
+ * in RPC_FRAME_TYPE_MSGPACK frames and text ones in RPC_FRAME_TYPE_JSON frames, and
+ * the records of the shared memory rings hold the same frame type. Receivers decode
+ * each message by that type, so the messages already on their way while the encoding
+ * changes are read right.
+ *
+ * The json types map one to one: null, boolean, integer (64 bits), double, string,
+ * array, and object as a map with string keys.
+ */
+
+#define RPC_CODEC_MAX_DEPTH 32 /* Nesting accepted by the decoder, as json_tokener. */
+
+/**
+ * @brief Encodings of the messages, the value is the payload of the codec frames.
+ */
+typedef enum rpc_codec_t
+{
+    RPC_CODEC_JSON = 0,    /* Text json. */
+    RPC_CODEC_MSGPACK = 1, /* MessagePack. */
+} rpc_codec_t;
+
+/**
+ * @brief Frame type of the messages of an encoding.
+ */
+#define RPC_CODEC_FRAME_TYPE(codec) (((codec) == RPC_CODEC_MSGPACK) ? RPC_FRAME_TYPE_MSGPACK : RPC_FRAME_TYPE_JSON)
+
+/**
+ * @brief Encoding of the messages of a frame type.
+ */
+#define RPC_FRAME_TYPE_CODEC(type) (((type) == RPC_FRAME_TYPE_MSGPACK) ? RPC_CODEC_MSGPACK : RPC_CODEC_JSON)
+
+/**
+ * @brief Array whose members are kept out of json-c, as the params of a reply writer.
+ *
+ * The json array stays empty and writes its members as text with its own serializer.
+ * Registered with json_rpc_codec_register_array(), the encoder writes the whole array
+ * in its place when a message holding it is encoded.
+ */
+typedef struct rpc_codec_array_t
+{
+    json_object *jarray; /* Array of the message standing for the members. */
+    int (*encode)(struct rpc_codec_array_t *array, rpc_frame_buffer_t *buf); /* Appends the array, header included. */
+    struct rpc_codec_array_t *prev; /* Registered arrays. */
+    struct rpc_codec_array_t *next;
+} rpc_codec_array_t;
+
+/**
+ * @brief Append the MessagePack encoding of a json message to a buffer.
+ * @param json message
+ * @param buffer, grown as required
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_codec_encode(json_object *jobj, rpc_frame_buffer_t *buf);
+
+/**
+ * @brief Append the header of a map, its members follow as key and value pairs.
+ * @param buffer, grown as required
+ * @param number of members
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_codec_encode_map(rpc_frame_buffer_t *buf, size_t count);
+
+/**
+ * @brief Append a string, used for the keys of a map as well.
+ * @param buffer, grown as required
+ * @param string
+ * @param number of bytes of the string
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_codec_encode_string(rpc_frame_buffer_t *buf, const char *str, size_t len);
+
+/**
+ * @brief Append the header of an array, its members follow.
+ * @param buffer, grown as required
+ * @param number of members
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_codec_encode_array(rpc_frame_buffer_t *buf, size_t count);
+
+/**
+ * @brief Append an integer.
+ * @param buffer, grown as required
+ * @param integer
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_codec_encode_int(rpc_frame_buffer_t *buf, int64_t value);
+
+/**
+ * @brief Append a boolean.
+ * @param buffer, grown as required
+ * @param TRUE or FALSE
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_codec_encode_boolean(rpc_frame_buffer_t *buf, int value);
+
+/**
+ * @brief Have an array encoded by its own encoder, until it is unregistered.
+ * @param array, with jarray and encode set, kept by the caller until it is unregistered
+ */
+void json_rpc_codec_register_array(rpc_codec_array_t *array);
+
+/**
+ * @brief Stop encoding an array with its own encoder, before the json array is freed.
+ * @param array registered
+ */
+void json_rpc_codec_unregister_array(rpc_codec_array_t *array);
+
+/**
+ * @brief Find the registration of a json array.
+ * @param json array
+ * @return registration, NULL if the array is a plain one.
+ */
+rpc_codec_array_t *json_rpc_codec_find_array(json_object *jarray);
+
+/**
+ * @brief Decode a MessagePack message.
+ * @param message
+ * @param message length, the message has to fill it exactly
+ * @return json message owned by the caller, NULL if the message is invalid.
+ */
+json_object *json_rpc_codec_decode(const char *data, size_t len);
+
+#endif //_JSON_RPC_CODEC_H
@@ -41,6 +41,7 @@
 #define JSON_RPC_FIELD_ACTION "action"
 #define JSON_RPC_FIELD_ID "reqId"
 #define JSON_RPC_FIELD_PARAMS "params"
+#define JSON_RPC_FIELD_DEADLINE "deadline"
 #define JSON_RPC_FIELD_PARAM_NAME "name"
 #define JSON_RPC_FIELD_PARAM_VALUE "value"
 #define JSON_RPC_FIELD_PARAM_TYPE "type"
@@ -73,10 +74,12 @@
 #define JSON_RPC_STATUS_SUCCESS "Success"
 #define JSON_RPC_PARAM_STATUS_FIELD "Status"
 #define JSON_RPC_STATUS_NOT_SUPPORTED "Not Supported"
+#define JSON_RPC_STATUS_BUSY "Busy"
 
 #define JSON_RPC_ACTION_GET_PARAM "getParameters"
 #define JSON_RPC_ACTION_GET_PARAM_RESPONSE "getParametersResponse"
 #define JSON_RPC_ACTION_RESULT "result"
+#define JSON_RPC_ACTION_CANCEL "cancel"
 #define JSON_RPC_ACTION_GET_SCHEMA "getSchema"
 #define JSON_RPC_ACTION_GET_SCHEMA_RESPONSE "getSchemaResponse"
 
@@ -84,6 +87,7 @@
 #define BUF_64 64
 #define BUF_128 128
 #define BUF_256 256
+#define BUF_1024 1024
 #define MAX_BUFFER_SIZE 65536
 #define MAX_FUNCTION_LEN 64
 #define DEFAULT_SEQ_START_NUMBER 100
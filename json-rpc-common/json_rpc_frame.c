@@ -0,0 +1,396 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "json_rpc_frame.h"
+#include "json_rpc_common.h"
+
+/**
+ * @brief Encode the frame header into its wire format.
+ */
+static void frame_header_encode(unsigned char *wire, uint8_t type, uint8_t flags, uint32_t len)
+{
+    uint32_t nlen = htonl(len);
+    memcpy(wire, &nlen, sizeof(nlen));
+    wire[4] = type;
+    wire[5] = flags;
+    wire[6] = 0;
+    wire[7] = 0;
+}
+
+/**
+ * @brief Drop the frames consumed, moving the bytes left to the start of the buffer.
+ */
+static void frame_buffer_compact(rpc_frame_buffer_t *buf)
+{
+    if (buf->offset > 0)
+    {
+        memmove(buf->data, buf->data + buf->offset, buf->len - buf->offset);
+        buf->len -= buf->offset;
+        buf->offset = 0;
+    }
+}
+
+int json_rpc_frame_recv(int sockfd, rpc_frame_buffer_t *buf)
+{
+    return json_rpc_frame_recv_fds(sockfd, buf, NULL, NULL);
+}
+
+int json_rpc_frame_recv_fds(int sockfd, rpc_frame_buffer_t *buf, int *fds, int *fd_count)
+{
+    POINTER_ASSERT(buf != NULL);
+    union
+    {
+        char buf[CMSG_SPACE(RPC_FRAME_MAX_FDS * sizeof(int))];
+        struct cmsghdr align; /* Control data must be aligned for the cmsg macros. */
+    } control;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    rpc_frame_header_t header;
+    size_t wanted;
+    int rc;
+
+    frame_buffer_compact(buf);
+    wanted = buf->len + RPC_FRAME_BUFFER_MIN_SIZE;
+
+    /* A record that does not fit the buffer would be truncated by the kernel. */
+    if (buf->record_size > RPC_FRAME_BUFFER_MIN_SIZE)
+    {
+        wanted = buf->len + buf->record_size;
+    }
+
+    /* Grow up front to the size of the pending frame, so it is received in as few reads as possible. */
+    if (json_rpc_frame_next(buf, &header) == FALSE && buf->len >= RPC_FRAME_HEADER_SIZE)
+    {
+        if (RPC_FRAME_HEADER_SIZE + (size_t)header.length > wanted)
+        {
+            wanted = RPC_FRAME_HEADER_SIZE + (size_t)header.length;
+        }
+    }
+    if (json_rpc_frame_buffer_reserve(buf, wanted) != RETURN_OK)
+    {
+        errno = ENOMEM;
+        return RETURN_ERR;
+    }
+
+    if (fds == NULL)
+    {
+        do
+        {
+            rc = recv(sockfd, buf->data + buf->len, buf->size - buf->len, 0);
+        } while (rc < 0 && errno == EINTR);
+    }
+    else
+    {
+        *fd_count = 0;
+        iov.iov_base = buf->data + buf->len;
+        iov.iov_len = buf->size - buf->len;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        do
+        {
+            rc = recvmsg(sockfd, &msg, MSG_CMSG_CLOEXEC);
+        } while (rc < 0 && errno == EINTR);
+
+        for (cmsg = (rc >= 0) ? CMSG_FIRSTHDR(&msg) : NULL; cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            {
+                int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                for (int i = 0; i < count; ++i)
+                {
+                    int fd;
+                    memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                    if (*fd_count < RPC_FRAME_MAX_FDS)
+                    {
+                        fds[(*fd_count)++] = fd;
+                    }
+                    else
+                    {
+                        close(fd);
+                    }
+                }
+            }
+        }
+    }
+
+    if (rc > 0)
+    {
+        buf->len += rc;
+    }
+    return rc;
+}
+
+int json_rpc_frame_next(const rpc_frame_buffer_t *buf, rpc_frame_header_t *header)
+{
+    POINTER_ASSERT(buf != NULL);
+    POINTER_ASSERT(header != NULL);
+    const char *frame = buf->data + buf->offset;
+    size_t len = buf->len - buf->offset;
+    uint32_t nlen;
+
+    if (len < RPC_FRAME_HEADER_SIZE)
+    {
+        return FALSE;
+    }
+
+    memcpy(&nlen, frame, sizeof(nlen));
+    header->length = ntohl(nlen);
+    header->type = (uint8_t)frame[4];
+    header->flags = (uint8_t)frame[5];
+    if (header->length > RPC_FRAME_MAX_PAYLOAD)
+    {
+        LOGERROR("Invalid frame length %u", header->length);
+        return RETURN_ERR;
+    }
+
+    return (len - RPC_FRAME_HEADER_SIZE >= header->length) ? TRUE : FALSE;
+}
+
+void json_rpc_frame_consume(rpc_frame_buffer_t *buf, const rpc_frame_header_t *header)
+{
+    size_t frame_len = RPC_FRAME_HEADER_SIZE + (size_t)header->length;
+
+    if (buf->offset + frame_len >= buf->len)
+    {
+        buf->len = 0;
+        buf->offset = 0;
+        /* Do not hold on to the memory of a large message once it is processed. */
+        if (buf->size > RPC_FRAME_BUFFER_KEEP_SIZE)
+        {
+            json_rpc_frame_buffer_free(buf);
+        }
+        return;
+    }
+
+    buf->offset += frame_len;
+}
+
+void json_rpc_frame_buffer_free(rpc_frame_buffer_t *buf)
+{
+    if (buf != NULL)
+    {
+        free(buf->data);
+        buf->data = NULL;
+        buf->len = 0;
+        buf->size = 0;
+        buf->offset = 0;
+        /* record_size describes the socket, it survives the buffer. */
+    }
+}
+
+int json_rpc_frame_buffer_reserve(rpc_frame_buffer_t *buf, size_t size)
+{
+    POINTER_ASSERT(buf != NULL);
+
+    if (size <= buf->size)
+    {
+        return RETURN_OK;
+    }
+
+    size_t new_size = buf->size ? buf->size : RPC_FRAME_BUFFER_MIN_SIZE;
+    while (new_size < size)
+    {
+        new_size *= 2;
+    }
+    char *data = (char *)realloc(buf->data, new_size);
+    POINTER_ASSERT(data != NULL);
+    buf->data = data;
+    buf->size = new_size;
+    return RETURN_OK;
+}
+
+int json_rpc_frame_buffer_append(rpc_frame_buffer_t *buf, const char *data, size_t len)
+{
+    POINTER_ASSERT(buf != NULL);
+    POINTER_ASSERT(data != NULL || len == 0);
+
+    frame_buffer_compact(buf);
+    if (json_rpc_frame_buffer_reserve(buf, buf->len + len) != RETURN_OK)
+    {
+        return RETURN_ERR;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    return RETURN_OK;
+}
+
+int json_rpc_frame_encode(rpc_frame_buffer_t *buf, uint8_t type, uint8_t flags, const char *payload, uint32_t len)
+{
+    POINTER_ASSERT(buf != NULL);
+    POINTER_ASSERT(payload != NULL);
+
+    if (len > RPC_FRAME_MAX_PAYLOAD)
+    {
+        LOGERROR("Frame payload of %u bytes is too large", len);
+        return RETURN_ERR;
+    }
+    if (json_rpc_frame_buffer_reserve(buf, buf->len + RPC_FRAME_HEADER_SIZE + len) != RETURN_OK)
+    {
+        return RETURN_ERR;
+    }
+    frame_header_encode((unsigned char *)buf->data + buf->len, type, flags, len);
+    memcpy(buf->data + buf->len + RPC_FRAME_HEADER_SIZE, payload, len);
+    buf->len += RPC_FRAME_HEADER_SIZE + len;
+    return RETURN_OK;
+}
+
+int json_rpc_frame_send_fds(int sockfd, uint8_t type, const char *payload, uint32_t len, const int *fds, int fd_count)
+{
+    POINTER_ASSERT(payload != NULL || len == 0);
+    POINTER_ASSERT(fds != NULL && fd_count > 0 && fd_count <= RPC_FRAME_MAX_FDS);
+    unsigned char wire[RPC_FRAME_HEADER_SIZE];
+    union
+    {
+        char buf[CMSG_SPACE(RPC_FRAME_MAX_FDS * sizeof(int))];
+        struct cmsghdr align; /* Control data must be aligned for the cmsg macros. */
+    } control;
+    struct cmsghdr *cmsg;
+    struct iovec iov[2];
+    struct msghdr msg;
+    ssize_t ret;
+
+    if (len > RPC_FRAME_MAX_RECORD - RPC_FRAME_HEADER_SIZE)
+    {
+        LOGERROR("Frame payload of %u bytes is too large to pass descriptors", len);
+        return RETURN_ERR;
+    }
+    frame_header_encode(wire, type, RPC_FRAME_FLAG_NONE, len);
+    iov[0].iov_base = wire;
+    iov[0].iov_len = sizeof(wire);
+    iov[1].iov_base = (void *)payload;
+    iov[1].iov_len = len;
+
+    memset(&control, 0, sizeof(control));
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (len > 0) ? 2 : 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(fd_count * sizeof(int));
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fd_count * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, fd_count * sizeof(int));
+
+    while (TRUE)
+    {
+        ret = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+        if (ret >= 0 || errno != EINTR)
+        {
+            break;
+        }
+    }
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        /* Non-blocking socket, wait once until the socket is writable. */
+        struct pollfd pfd = {.fd = sockfd, .events = POLLOUT};
+        if (poll(&pfd, 1, -1) > 0)
+        {
+            ret = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+        }
+    }
+    /* The frame fits a single record, so it is either sent whole or not at all. */
+    if (ret != (ssize_t)(sizeof(wire) + len))
+    {
+        LOGERROR("Failed to send the frame with descriptors over socket, Error : %s", strerror(errno));
+        return RETURN_ERR;
+    }
+    return RETURN_OK;
+}
+
+int json_rpc_frame_send(int sockfd, uint8_t type, uint8_t flags, const char *payload, uint32_t len)
+{
+    POINTER_ASSERT(payload != NULL);
+    unsigned char wire[RPC_FRAME_HEADER_SIZE];
+    struct iovec iov[2];
+    struct iovec chunk[2];
+    struct msghdr msg;
+    int iov_index = 0;
+    ssize_t ret;
+
+    frame_header_encode(wire, type, flags, len);
+    iov[0].iov_base = wire;
+    iov[0].iov_len = sizeof(wire);
+    iov[1].iov_base = (void *)payload;
+    iov[1].iov_len = len;
+
+    while (iov_index < 2)
+    {
+        /* Never hand more than RPC_FRAME_MAX_RECORD bytes to one call. */
+        size_t budget = RPC_FRAME_MAX_RECORD;
+        int chunk_count = 0;
+        for (int i = iov_index; i < 2 && budget > 0; ++i)
+        {
+            chunk[chunk_count].iov_base = iov[i].iov_base;
+            chunk[chunk_count].iov_len = (iov[i].iov_len < budget) ? iov[i].iov_len : budget;
+            budget -= chunk[chunk_count].iov_len;
+            chunk_count++;
+        }
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = chunk;
+        msg.msg_iovlen = chunk_count;
+        /* A peer that went away must fail the send, not raise SIGPIPE in the application. */
+        ret = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                /* Non-blocking socket, wait until the socket is writable. */
+                struct pollfd pfd = {.fd = sockfd, .events = POLLOUT};
+                if (poll(&pfd, 1, -1) >= 0 || errno == EINTR)
+                {
+                    continue;
+                }
+            }
+            LOGERROR("Failed to send the frame over socket, Error : %s", strerror(errno));
+            return RETURN_ERR;
+        }
+
+        /* Skip what has been sent, handles partial writes of either iovec. */
+        while (iov_index < 2 && (size_t)ret >= iov[iov_index].iov_len)
+        {
+            ret -= iov[iov_index].iov_len;
+            iov_index++;
+        }
+        if (iov_index < 2)
+        {
+            iov[iov_index].iov_base = (char *)iov[iov_index].iov_base + ret;
+            iov[iov_index].iov_len -= ret;
+        }
+    }
+    return RETURN_OK;
+}
@@ -0,0 +1,200 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef _JSON_RPC_FRAME_H
+#define _JSON_RPC_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Length prefixed message framing shared by the client and server transports.
+ *
+ * In framed mode every message on the socket is preceded by a fixed
+ * rpc_frame_header_t. The receiver appends socket data into a per connection
+ * growable buffer and hands over one complete payload at a time, so messages
+ * split across reads or glued together are delivered exactly once.
+ *
+ * Frames are written in chunks of at most RPC_FRAME_MAX_RECORD bytes. On a
+ * SOCK_SEQPACKET socket every chunk is one record, and a record is never split
+ * by the receiver as long as it reads with RPC_FRAME_MAX_RECORD bytes of free
+ * space, see rpc_frame_buffer_t.record_size.
+ */
+
+#define RPC_FRAME_HEADER_SIZE 8
+#define RPC_FRAME_MAX_PAYLOAD (16 * 1024 * 1024) /* Frames above this size are treated as a protocol error. */
+#define RPC_FRAME_BUFFER_MIN_SIZE 4096           /* Initial size of the receive buffer. */
+#define RPC_FRAME_BUFFER_KEEP_SIZE 65536         /* Larger buffers are released once drained. */
+#define RPC_FRAME_MAX_RECORD (32 * 1024)          /* Largest chunk handed to a single send call. */
+
+/**
+ * @brief Message type carried in the frame header.
+ */
+typedef enum rpc_frame_type_t
+{
+    RPC_FRAME_TYPE_JSON = 1,       /* Payload is a json message. */
+    RPC_FRAME_TYPE_SHM_OFFER = 2,  /* Client offers shared memory rings, see json_rpc_shm.h. */
+    RPC_FRAME_TYPE_SHM_ACCEPT = 3, /* Server maps the offered rings and reads and writes them from now on. */
+    RPC_FRAME_TYPE_MSGPACK = 4,    /* Payload is a MessagePack message, see json_rpc_codec.h. */
+    RPC_FRAME_TYPE_CODEC_OFFER = 5,  /* Client offers to switch to the encoding given in the payload byte. */
+    RPC_FRAME_TYPE_CODEC_ACCEPT = 6, /* Server answers with the encoding both sides use from now on. */
+} rpc_frame_type_t;
+
+/**
+ * Maximum number of file descriptors passed along with a frame.
+ */
+#define RPC_FRAME_MAX_FDS 4
+
+/**
+ * @brief Frame flags.
+ */
+#define RPC_FRAME_FLAG_NONE 0x00
+
+/**
+ * @brief Decoded frame header. On the wire the length is sent in network byte order.
+ */
+typedef struct rpc_frame_header_t
+{
+    uint32_t length; /* Payload length in bytes, header not included. */
+    uint8_t type;    /* Message type, one of rpc_frame_type_t. */
+    uint8_t flags;   /* Frame flags. */
+} rpc_frame_header_t;
+
+/**
+ * @brief Growable receive buffer used to reassemble frames of a connection.
+ */
+typedef struct rpc_frame_buffer_t
+{
+    char *data;    /* Buffered bytes. */
+    size_t len;    /* Number of valid bytes in data. */
+    size_t size;   /* Allocated size of data. */
+    size_t offset; /* Bytes at the start of data consumed already, dropped by the next read. */
+    size_t record_size; /* Free space kept available for each read, RPC_FRAME_MAX_RECORD for
+                           record oriented (SOCK_SEQPACKET) sockets, 0 for stream sockets. */
+} rpc_frame_buffer_t;
+
+/**
+ * @brief Payload of the frame at the start of the buffer, see json_rpc_frame_next().
+ */
+#define RPC_FRAME_PAYLOAD(buf) ((buf)->data + (buf)->offset + RPC_FRAME_HEADER_SIZE)
+
+/**
+ * @brief Receive the available socket data into the frame buffer.
+ * The frames consumed are dropped first, the buffer grows as required to hold
+ * the pending frame.
+ * @param socket file descriptor to read from
+ * @param frame buffer of the connection
+ * @return number of bytes received, 0 if the peer closed the connection or
+ * RETURN_ERR on failure (errno is preserved).
+ */
+int json_rpc_frame_recv(int sockfd, rpc_frame_buffer_t *buf);
+
+/**
+ * @brief Receive the available socket data into the frame buffer, along with the
+ * file descriptors passed over a unix domain socket.
+ * @param socket file descriptor to read from
+ * @param frame buffer of the connection
+ * @param (OUT) received file descriptors, owned by the caller
+ * @param (OUT) number of received file descriptors, at most RPC_FRAME_MAX_FDS
+ * @return number of bytes received, 0 if the peer closed the connection or
+ * RETURN_ERR on failure (errno is preserved).
+ */
+int json_rpc_frame_recv_fds(int sockfd, rpc_frame_buffer_t *buf, int *fds, int *fd_count);
+
+/**
+ * @brief Check whether a complete frame is available at the start of the buffer.
+ * @param frame buffer of the connection
+ * @param (OUT) decoded frame header
+ * @return TRUE if a complete frame is buffered, FALSE if more data is required
+ * and RETURN_ERR if the header is invalid.
+ */
+int json_rpc_frame_next(const rpc_frame_buffer_t *buf, rpc_frame_header_t *header);
+
+/**
+ * @brief Skip the first frame of the buffer once it has been processed. Its bytes are
+ * only dropped by the next read, or append, so the frames of a read are not moved.
+ * @param frame buffer of the connection
+ * @param header of the processed frame
+ */
+void json_rpc_frame_consume(rpc_frame_buffer_t *buf, const rpc_frame_header_t *header);
+
+/**
+ * @brief Release the memory held by the frame buffer.
+ * @param frame buffer of the connection
+ */
+void json_rpc_frame_buffer_free(rpc_frame_buffer_t *buf);
+
+/**
+ * @brief Make sure the buffer can hold at least `size` bytes.
+ * @param frame buffer
+ * @param number of bytes
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_frame_buffer_reserve(rpc_frame_buffer_t *buf, size_t size);
+
+/**
+ * @brief Append raw bytes at the end of the buffer, growing it as required.
+ * The frames consumed are dropped first.
+ * @param frame buffer
+ * @param bytes to append
+ * @param number of bytes
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_frame_buffer_append(rpc_frame_buffer_t *buf, const char *data, size_t len);
+
+/**
+ * @brief Append a frame header followed by the payload at the end of the buffer.
+ * Used to queue outgoing frames that are written to the socket later.
+ * @param frame buffer
+ * @param message type
+ * @param frame flags
+ * @param payload to append
+ * @param payload length
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_frame_encode(rpc_frame_buffer_t *buf, uint8_t type, uint8_t flags, const char *payload, uint32_t len);
+
+/**
+ * @brief Send a payload over the socket, preceded by a frame header.
+ * Header and payload are sent with one sendmsg() call where possible, a frame
+ * above RPC_FRAME_MAX_RECORD bytes is sent in several chunks. Waits for
+ * the socket to become writable if it is non-blocking and its buffer is full.
+ * @param socket file descriptor to use
+ * @param message type
+ * @param frame flags
+ * @param payload to send
+ * @param payload length
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_frame_send(int sockfd, uint8_t type, uint8_t flags, const char *payload, uint32_t len);
+
+/**
+ * @brief Send a small frame together with file descriptors over a unix domain socket.
+ * Header, payload and descriptors go out with a single sendmsg() call.
+ * @param socket file descriptor to use
+ * @param message type
+ * @param payload to send, at most RPC_FRAME_MAX_RECORD - RPC_FRAME_HEADER_SIZE bytes
+ * @param payload length
+ * @param file descriptors to pass
+ * @param number of file descriptors, at most RPC_FRAME_MAX_FDS
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_frame_send_fds(int sockfd, uint8_t type, const char *payload, uint32_t len, const int *fds, int fd_count);
+
+#endif //_JSON_RPC_FRAME_H
@@ -0,0 +1,192 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <stdint.h>
+#include "json_rpc_scan.h"
+#include "json_rpc_common.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_BLOCK_SIZE 32
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_BLOCK_SIZE 16
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SCAN_BLOCK_SIZE 16
+#else
+#define SCAN_BLOCK_SIZE 16
+#endif
+
+/* Or-ing 0x20 maps '[' on '{' and ']' on '}', no other byte. */
+#define SCAN_CASE_BIT 0x20
+
+/**
+ * @brief Mask of the quotes, backslashes, braces and brackets of up to a block of bytes.
+ * @return bit i set if byte i is one of them.
+ */
+static uint32_t scan_bytes(const unsigned char *data, size_t len)
+{
+    uint32_t mask = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        unsigned char folded = data[i] | SCAN_CASE_BIT;
+        if (data[i] == '"' || data[i] == '\\' || folded == '{' || folded == '}')
+        {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+/**
+ * @brief Mask of the quotes, backslashes, braces and brackets of a full block.
+ * @return bit i set if byte i is one of them.
+ */
+static uint32_t scan_block(const unsigned char *data)
+{
+#if defined(__AVX2__)
+    __m256i bytes = _mm256_loadu_si256((const __m256i *)data);
+    __m256i folded = _mm256_or_si256(bytes, _mm256_set1_epi8(SCAN_CASE_BIT));
+    __m256i found = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('"')),
+                                    _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\\')));
+    found = _mm256_or_si256(found, _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')));
+    found = _mm256_or_si256(found, _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}')));
+    return (uint32_t)_mm256_movemask_epi8(found);
+#elif defined(__SSE2__)
+    __m128i bytes = _mm_loadu_si128((const __m128i *)data);
+    __m128i folded = _mm_or_si128(bytes, _mm_set1_epi8(SCAN_CASE_BIT));
+    __m128i found = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('"')),
+                                 _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\\')));
+    found = _mm_or_si128(found, _mm_cmpeq_epi8(folded, _mm_set1_epi8('{')));
+    found = _mm_or_si128(found, _mm_cmpeq_epi8(folded, _mm_set1_epi8('}')));
+    return (uint32_t)_mm_movemask_epi8(found);
+#elif defined(__ARM_NEON)
+    static const uint8_t weight[SCAN_BLOCK_SIZE] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t bytes = vld1q_u8(data);
+    uint8x16_t folded = vorrq_u8(bytes, vdupq_n_u8(SCAN_CASE_BIT));
+    uint8x16_t found = vorrq_u8(vceqq_u8(bytes, vdupq_n_u8('"')), vceqq_u8(bytes, vdupq_n_u8('\\')));
+    found = vorrq_u8(found, vceqq_u8(folded, vdupq_n_u8('{')));
+    found = vorrq_u8(found, vceqq_u8(folded, vdupq_n_u8('}')));
+    /* No movemask, the weighted bytes of each half are added pairwise down to one byte. */
+    found = vandq_u8(found, vld1q_u8(weight));
+    uint8x8_t sum = vpadd_u8(vget_low_u8(found), vget_high_u8(found));
+    sum = vpadd_u8(sum, sum);
+    sum = vpadd_u8(sum, sum);
+    return (uint32_t)vget_lane_u8(sum, 0) | ((uint32_t)vget_lane_u8(sum, 1) << 8);
+#else
+    return scan_bytes(data, SCAN_BLOCK_SIZE);
+#endif
+}
+
+/**
+ * @brief Find where the first json message of a buffer ends.
+ * @param text json data
+ * @param number of bytes of the data
+ * @param TRUE to check the full blocks with the vector code, FALSE to check every byte on its own
+ * @return length of the message, 0 if the data ends before the message does.
+ */
+static inline size_t scan_message(const char *data, size_t len, int vector)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    size_t pos = 0;
+    int depth = 0;
+    int in_string = FALSE;
+    int escaped = FALSE;
+
+    if (data == NULL)
+    {
+        return 0;
+    }
+
+    while (pos < len && (bytes[pos] == ' ' || bytes[pos] == '\t' || bytes[pos] == '\n' || bytes[pos] == '\r'))
+    {
+        pos++;
+    }
+    if (pos == len)
+    {
+        return 0;
+    }
+    if (bytes[pos] != '{' && bytes[pos] != '[')
+    {
+        return len;
+    }
+
+    while (pos < len)
+    {
+        size_t block_len = (len - pos < SCAN_BLOCK_SIZE) ? len - pos : SCAN_BLOCK_SIZE;
+        uint32_t mask = (vector && block_len == SCAN_BLOCK_SIZE) ? scan_block(bytes + pos) : scan_bytes(bytes + pos, block_len);
+
+        /* The byte after a backslash ending the previous block is escaped. */
+        if (escaped)
+        {
+            mask &= ~1u;
+            escaped = FALSE;
+        }
+        while (mask != 0)
+        {
+            unsigned int bit = __builtin_ctz(mask);
+            unsigned char c = bytes[pos + bit];
+            mask &= mask - 1;
+
+            if (in_string)
+            {
+                if (c == '"')
+                {
+                    in_string = FALSE;
+                }
+                else if (c == '\\')
+                {
+                    if (bit + 1 < block_len)
+                    {
+                        mask &= ~(1u << (bit + 1));
+                    }
+                    else
+                    {
+                        escaped = TRUE;
+                    }
+                }
+            }
+            else if (c == '"')
+            {
+                in_string = TRUE;
+            }
+            else if ((c | SCAN_CASE_BIT) == '{')
+            {
+                depth++;
+            }
+            else if ((c | SCAN_CASE_BIT) == '}' && --depth == 0)
+            {
+                return pos + bit + 1;
+            }
+        }
+        pos += block_len;
+    }
+    return 0;
+}
+
+size_t json_rpc_scan_message(const char *data, size_t len)
+{
+    return scan_message(data, len, TRUE);
+}
+
+size_t json_rpc_scan_message_scalar(const char *data, size_t len)
+{
+    return scan_message(data, len, FALSE);
+}
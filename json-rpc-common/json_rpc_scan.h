@@ -0,0 +1,59 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef _JSON_RPC_SCAN_H
+#define _JSON_RPC_SCAN_H
+
+#include <stddef.h>
+
+/**
+ * Boundaries of the json messages received glued together.
+ *
+ * Text json messages read from a stream can come several in one buffer. The
+ * scanner finds where each one ends without parsing it, by following the
+ * quotes, escapes, braces and brackets, so that every message is parsed once
+ * on its own. Blocks of the buffer are checked for these bytes with SSE2 or
+ * AVX2 on x86, NEON on ARM and byte by byte elsewhere; the bytes in between,
+ * most of a message, are skipped a block at a time.
+ *
+ * The scanner does not validate the messages, json-c does it when parsing them.
+ */
+
+/**
+ * @brief Find where the first json message of a buffer ends.
+ * Leading whitespace belongs to the message. A message that is not an object or
+ * an array extends to the end of the buffer, there is no telling where it ends.
+ * @param text json data
+ * @param number of bytes of the data
+ * @return length of the message, 0 if the data ends before the message does or
+ * holds whitespace only.
+ */
+size_t json_rpc_scan_message(const char *data, size_t len);
+
+/**
+ * @brief Same as json_rpc_scan_message(), checking the bytes one at a time.
+ * The reference of the vector code, for the tests.
+ * @param text json data
+ * @param number of bytes of the data
+ * @return length of the message, 0 if the data ends before the message does or
+ * holds whitespace only.
+ */
+size_t json_rpc_scan_message_scalar(const char *data, size_t len);
+
+#endif //_JSON_RPC_SCAN_H
@@ -0,0 +1,330 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#define _GNU_SOURCE /* memfd_create() */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "json_rpc_shm.h"
+#include "json_rpc_common.h"
+
+/**
+ * Length stored in place of a message to make the consumer skip to the start of the ring.
+ */
+#define SHM_WRAP_MARKER 0xFFFFFFFFu
+
+/**
+ * Size of the length field in front of every message.
+ */
+#define SHM_LENGTH_SIZE sizeof(uint32_t)
+
+/**
+ * Size of the length and type fields in front of every message.
+ */
+#define SHM_HEADER_SIZE (2 * sizeof(uint32_t))
+
+/**
+ * @brief Ring space taken by a message of the given payload length.
+ */
+static uint32_t shm_record_size(uint32_t len)
+{
+    return (uint32_t)SHM_HEADER_SIZE + ((len + 3u) & ~3u);
+}
+
+/**
+ * @brief Size of the memfd holding both rings.
+ */
+static size_t shm_map_size(uint32_t ring_size)
+{
+    return 2 * (sizeof(rpc_shm_ring_t) + (size_t)ring_size);
+}
+
+/**
+ * @brief Point the channel at the rings of the mapping.
+ * The request ring comes first, the response ring second.
+ */
+static void shm_bind_rings(rpc_shm_channel_t *ch, uint32_t ring_size, int client)
+{
+    rpc_shm_ring_t *request = (rpc_shm_ring_t *)ch->base;
+    rpc_shm_ring_t *response = (rpc_shm_ring_t *)((char *)ch->base + sizeof(rpc_shm_ring_t) + ring_size);
+
+    ch->tx = (client == TRUE) ? request : response;
+    ch->rx = (client == TRUE) ? response : request;
+}
+
+int json_rpc_shm_create(rpc_shm_channel_t *ch, uint32_t ring_size)
+{
+    POINTER_ASSERT(ch != NULL);
+    uint32_t size = RPC_SHM_RING_MIN_SIZE;
+
+    while (size < ring_size && size < RPC_SHM_RING_MAX_SIZE)
+    {
+        size *= 2;
+    }
+
+    memset(ch, 0, sizeof(*ch));
+    ch->tx_doorbell = -1;
+    ch->rx_doorbell = -1;
+    ch->map_size = shm_map_size(size);
+    ch->memfd = memfd_create("json_hal_shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (ch->memfd < 0)
+    {
+        LOGERROR("memfd_create() failed, Error : %s", strerror(errno));
+        return RETURN_ERR;
+    }
+    /* Sealed, so the peer can rely on the mapping not being truncated under it. */
+    if (ftruncate(ch->memfd, ch->map_size) < 0 ||
+        fcntl(ch->memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)
+    {
+        LOGERROR("Failed to size the shared memory, Error : %s", strerror(errno));
+        goto ERROR;
+    }
+    ch->base = mmap(NULL, ch->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, ch->memfd, 0);
+    if (ch->base == MAP_FAILED)
+    {
+        ch->base = NULL;
+        LOGERROR("Failed to map the shared memory, Error : %s", strerror(errno));
+        goto ERROR;
+    }
+    ch->tx_doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ch->rx_doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ch->tx_doorbell < 0 || ch->rx_doorbell < 0)
+    {
+        LOGERROR("Failed to create the doorbells, Error : %s", strerror(errno));
+        goto ERROR;
+    }
+
+    shm_bind_rings(ch, size, TRUE);
+    ch->ring_size = size;
+    ch->tx->size = size;
+    ch->rx->size = size;
+    /* Both consumers start asleep, the first message rings the doorbell. */
+    ch->tx->waiting = 1;
+    ch->rx->waiting = 1;
+    return RETURN_OK;
+
+ERROR:
+    json_rpc_shm_close(ch);
+    return RETURN_ERR;
+}
+
+int json_rpc_shm_attach(rpc_shm_channel_t *ch, int memfd, int request_doorbell, int response_doorbell, uint32_t ring_size)
+{
+    POINTER_ASSERT(ch != NULL);
+    struct stat st;
+    int seals;
+
+    memset(ch, 0, sizeof(*ch));
+    ch->memfd = -1;
+    ch->tx_doorbell = -1;
+    ch->rx_doorbell = -1;
+
+    if (ring_size < RPC_SHM_RING_MIN_SIZE || ring_size > RPC_SHM_RING_MAX_SIZE || (ring_size & (ring_size - 1)) != 0)
+    {
+        LOGERROR("Invalid shared memory ring size %u", ring_size);
+        return RETURN_ERR;
+    }
+    seals = fcntl(memfd, F_GET_SEALS);
+    if (fstat(memfd, &st) < 0 || (size_t)st.st_size != shm_map_size(ring_size) ||
+        seals < 0 || (seals & F_SEAL_SHRINK) == 0)
+    {
+        LOGERROR("Shared memory offered is not a sealed memfd of the announced size");
+        return RETURN_ERR;
+    }
+    ch->map_size = shm_map_size(ring_size);
+    ch->base = mmap(NULL, ch->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (ch->base == MAP_FAILED)
+    {
+        ch->base = NULL;
+        LOGERROR("Failed to map the shared memory, Error : %s", strerror(errno));
+        return RETURN_ERR;
+    }
+
+    shm_bind_rings(ch, ring_size, FALSE);
+    if (ch->tx->size != ring_size || ch->rx->size != ring_size)
+    {
+        LOGERROR("Shared memory ring header does not match the offer");
+        munmap(ch->base, ch->map_size);
+        ch->base = NULL;
+        return RETURN_ERR;
+    }
+    ch->ring_size = ring_size;
+    ch->memfd = memfd;
+    ch->tx_doorbell = response_doorbell;
+    ch->rx_doorbell = request_doorbell;
+    return RETURN_OK;
+}
+
+void json_rpc_shm_close(rpc_shm_channel_t *ch)
+{
+    if (ch == NULL)
+    {
+        return;
+    }
+    if (ch->base != NULL)
+    {
+        munmap(ch->base, ch->map_size);
+        ch->base = NULL;
+    }
+    if (ch->memfd >= 0)
+    {
+        close(ch->memfd);
+        ch->memfd = -1;
+    }
+    if (ch->tx_doorbell >= 0)
+    {
+        close(ch->tx_doorbell);
+        ch->tx_doorbell = -1;
+    }
+    if (ch->rx_doorbell >= 0)
+    {
+        close(ch->rx_doorbell);
+        ch->rx_doorbell = -1;
+    }
+    ch->tx = NULL;
+    ch->rx = NULL;
+}
+
+int json_rpc_shm_send(rpc_shm_channel_t *ch, uint8_t type, const char *payload, uint32_t len)
+{
+    POINTER_ASSERT(ch != NULL && ch->tx != NULL);
+    POINTER_ASSERT(payload != NULL);
+    rpc_shm_ring_t *ring = ch->tx;
+    uint32_t size = ch->ring_size;
+    uint32_t record = shm_record_size(len);
+    uint32_t tail = ring->tail;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t pos = tail & (size - 1);
+    uint32_t skip = 0;
+    uint32_t record_type = type;
+    uint64_t value = 1;
+
+    if (len >= size)
+    {
+        return RETURN_ERR;
+    }
+    if (record > size - pos)
+    {
+        /* Does not fit before the end of the ring, start over at its beginning. */
+        skip = size - pos;
+    }
+    if (skip + record > size - (tail - head))
+    {
+        return RETURN_ERR;
+    }
+    if (skip > 0)
+    {
+        uint32_t marker = SHM_WRAP_MARKER;
+        memcpy(ring->data + pos, &marker, SHM_LENGTH_SIZE);
+        tail += skip;
+        pos = 0;
+    }
+    memcpy(ring->data + pos, &len, SHM_LENGTH_SIZE);
+    memcpy(ring->data + pos + SHM_LENGTH_SIZE, &record_type, sizeof(record_type));
+    memcpy(ring->data + pos + SHM_HEADER_SIZE, payload, len);
+    __atomic_store_n(&ring->tail, tail + record, __ATOMIC_RELEASE);
+
+    /* Pairs with json_rpc_shm_prepare_wait(), either the consumer sees the
+     * message or we see it waiting. */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->waiting, __ATOMIC_RELAXED) != 0 &&
+        __atomic_exchange_n(&ring->waiting, 0, __ATOMIC_SEQ_CST) != 0)
+    {
+        if (write(ch->tx_doorbell, &value, sizeof(value)) != sizeof(value) && errno != EAGAIN)
+        {
+            LOGERROR("Failed to ring the shared memory doorbell, Error : %s", strerror(errno));
+        }
+    }
+    return RETURN_OK;
+}
+
+int json_rpc_shm_next(rpc_shm_channel_t *ch, uint8_t *type, char **payload, uint32_t *len)
+{
+    POINTER_ASSERT(ch != NULL && ch->rx != NULL);
+    POINTER_ASSERT(type != NULL);
+    POINTER_ASSERT(payload != NULL);
+    POINTER_ASSERT(len != NULL);
+    rpc_shm_ring_t *ring = ch->rx;
+    uint32_t size = ch->ring_size;
+    uint32_t head = ring->head;
+    uint32_t tail, pos, length, record_type;
+
+    while (TRUE)
+    {
+        tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (head == tail)
+        {
+            return FALSE;
+        }
+        pos = head & (size - 1);
+        memcpy(&length, ring->data + pos, SHM_LENGTH_SIZE);
+        if (length != SHM_WRAP_MARKER)
+        {
+            break;
+        }
+        head += size - pos;
+        __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+    }
+
+    if (length >= size || shm_record_size(length) > size - pos || shm_record_size(length) > tail - head)
+    {
+        LOGERROR("Invalid message of %u bytes in the shared memory ring", length);
+        return RETURN_ERR;
+    }
+    memcpy(&record_type, ring->data + pos + SHM_LENGTH_SIZE, sizeof(record_type));
+    *type = (uint8_t)record_type;
+    *payload = ring->data + pos + SHM_HEADER_SIZE;
+    *len = length;
+    ch->rx_pending = shm_record_size(length);
+    return TRUE;
+}
+
+void json_rpc_shm_consume(rpc_shm_channel_t *ch)
+{
+    if (ch != NULL && ch->rx != NULL && ch->rx_pending > 0)
+    {
+        __atomic_store_n(&ch->rx->head, ch->rx->head + ch->rx_pending, __ATOMIC_RELEASE);
+        ch->rx_pending = 0;
+    }
+}
+
+int json_rpc_shm_prepare_wait(rpc_shm_channel_t *ch)
+{
+    POINTER_ASSERT(ch != NULL && ch->rx != NULL);
+    rpc_shm_ring_t *ring = ch->rx;
+    uint64_t value;
+
+    if (read(ch->rx_doorbell, &value, sizeof(value)) < 0 && errno != EAGAIN)
+    {
+        LOGERROR("Failed to read the shared memory doorbell, Error : %s", strerror(errno));
+    }
+    __atomic_store_n(&ring->waiting, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) != ring->head)
+    {
+        __atomic_store_n(&ring->waiting, 0, __ATOMIC_RELAXED);
+        return FALSE;
+    }
+    return TRUE;
+}
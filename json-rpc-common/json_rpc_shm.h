@@ -0,0 +1,145 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef _JSON_RPC_SHM_H
+#define _JSON_RPC_SHM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Shared memory transport between a client and a server on the same host.
+ *
+ * The client creates a memfd holding two single producer, single consumer
+ * rings, one for the requests and one for the responses, plus one eventfd
+ * doorbell per ring. It offers them to the server over the unix domain socket
+ * (RPC_FRAME_TYPE_SHM_OFFER, fds passed with SCM_RIGHTS) and keeps sending over
+ * the socket until the server answered with RPC_FRAME_TYPE_SHM_ACCEPT.
+ *
+ * Every message is a 4 byte length and a 4 byte type, the RPC_FRAME_TYPE_JSON or
+ * RPC_FRAME_TYPE_MSGPACK of a frame, followed by the payload, padded to 4 bytes.
+ * A message never wraps around the end of the ring, the producer skips the
+ * rest of the ring with a wrap marker instead, so the consumer reads every
+ * payload in place. The doorbell is only written when the consumer announced
+ * that it is about to sleep, a busy consumer is never woken up by a system call.
+ * Messages that do not fit the free space of the ring are sent over the socket.
+ */
+
+#define RPC_SHM_RING_MIN_SIZE 4096               /* Smallest ring size accepted. */
+#define RPC_SHM_RING_MAX_SIZE (64 * 1024 * 1024) /* Largest ring size accepted. */
+
+/**
+ * @brief Ring header, lives in the shared memory in front of the ring data.
+ * Producer and consumer fields are kept on separate cache lines.
+ */
+typedef struct rpc_shm_ring_t
+{
+    uint32_t head;      /* Consumer position, free running. */
+    uint32_t waiting;   /* Set by the consumer before it sleeps on the doorbell. */
+    char pad0[56];
+    uint32_t tail;      /* Producer position, free running. */
+    char pad1[60];
+    uint32_t size;      /* Ring data size in bytes, a power of 2. */
+    char pad2[60];
+    char data[];        /* Ring data. */
+} rpc_shm_ring_t;
+
+/**
+ * @brief One side of a shared memory channel.
+ */
+typedef struct rpc_shm_channel_t
+{
+    int memfd;            /* memfd holding both rings. */
+    void *base;           /* Mapping of the memfd. */
+    size_t map_size;      /* Size of the mapping. */
+    uint32_t ring_size;   /* Data size of each ring, not read back from the shared memory. */
+    rpc_shm_ring_t *tx;   /* Ring this side produces into. */
+    rpc_shm_ring_t *rx;   /* Ring this side consumes. */
+    int tx_doorbell;      /* eventfd written to wake up the consumer of tx. */
+    int rx_doorbell;      /* eventfd the producer of rx writes, readable when rx got data. */
+    uint32_t rx_pending;  /* Length of the message taken by json_rpc_shm_next(), 0 if none. */
+} rpc_shm_channel_t;
+
+/**
+ * @brief Client side, create the memfd with both rings and the doorbells.
+ * The client produces into the request ring and consumes the response ring.
+ * @param (OUT) channel
+ * @param size of each ring, rounded up to a power of 2
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_shm_create(rpc_shm_channel_t *ch, uint32_t ring_size);
+
+/**
+ * @brief Server side, map the rings offered by a client.
+ * The server produces into the response ring and consumes the request ring.
+ * On success the channel owns the fds, on failure the caller still does.
+ * @param (OUT) channel
+ * @param memfd holding the rings
+ * @param doorbell of the request ring
+ * @param doorbell of the response ring
+ * @param size of each ring, as announced by the client
+ * @return RETURN_OK on success , RETURN_ERR if the offer is invalid.
+ */
+int json_rpc_shm_attach(rpc_shm_channel_t *ch, int memfd, int request_doorbell, int response_doorbell, uint32_t ring_size);
+
+/**
+ * @brief Unmap the rings and close the fds of the channel.
+ * @param channel
+ */
+void json_rpc_shm_close(rpc_shm_channel_t *ch);
+
+/**
+ * @brief Copy a message into the tx ring and ring the doorbell if the consumer sleeps.
+ * Producers of one channel must be serialised by the caller.
+ * @param channel
+ * @param frame type of the payload
+ * @param payload
+ * @param payload length
+ * @return RETURN_OK on success , RETURN_ERR if the message does not fit the free space.
+ */
+int json_rpc_shm_send(rpc_shm_channel_t *ch, uint8_t type, const char *payload, uint32_t len);
+
+/**
+ * @brief Take the next message of the rx ring. The payload stays in the ring
+ * until json_rpc_shm_consume() is called.
+ * @param channel
+ * @param (OUT) frame type of the payload
+ * @param (OUT) payload, points into the shared memory
+ * @param (OUT) payload length
+ * @return TRUE if a message is available, FALSE if the ring is empty and
+ * RETURN_ERR if the ring content is invalid.
+ */
+int json_rpc_shm_next(rpc_shm_channel_t *ch, uint8_t *type, char **payload, uint32_t *len);
+
+/**
+ * @brief Release the message taken by json_rpc_shm_next() to the producer.
+ * @param channel
+ */
+void json_rpc_shm_consume(rpc_shm_channel_t *ch);
+
+/**
+ * @brief Announce that the consumer is about to sleep on the rx doorbell.
+ * Clears the doorbell first. If a message arrived meanwhile the announcement
+ * is withdrawn and the rx ring has to be processed again.
+ * @param channel
+ * @return TRUE if the consumer may sleep, FALSE if the rx ring is not empty.
+ */
+int json_rpc_shm_prepare_wait(rpc_shm_channel_t *ch);
+
+#endif //_JSON_RPC_SHM_H
@@ -0,0 +1,145 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "json_rpc_table.h"
+#include "json_rpc_common.h"
+
+/**
+ * @brief FNV-1a hash of a name.
+ */
+static uint32_t table_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    while (*name != '\0')
+    {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Fill the first free slot of the probe sequence of the hash.
+ * The value is published last so that a concurrent lookup never sees a half filled slot.
+ */
+static void table_slots_put(rpc_table_slots_t *slots, uint32_t hash, const char *name, void *value)
+{
+    uint32_t i = hash & slots->mask;
+    while (slots->slot[i].value != NULL)
+    {
+        i = (i + 1) & slots->mask;
+    }
+    slots->slot[i].hash = hash;
+    slots->slot[i].name = name;
+    __atomic_store_n(&slots->slot[i].value, value, __ATOMIC_RELEASE);
+    slots->count++;
+}
+
+/**
+ * @brief Allocate a generation of `size` slots holding the entries of the previous one.
+ */
+static rpc_table_slots_t *table_slots_grow(rpc_table_slots_t *old, uint32_t size)
+{
+    rpc_table_slots_t *slots = (rpc_table_slots_t *)calloc(1, sizeof(rpc_table_slots_t) + size * sizeof(rpc_table_slot_t));
+    if (slots == NULL)
+    {
+        return NULL;
+    }
+
+    slots->mask = size - 1;
+    slots->retired = old;
+    if (old != NULL)
+    {
+        uint32_t i;
+        for (i = 0; i <= old->mask; i++)
+        {
+            if (old->slot[i].value != NULL)
+            {
+                table_slots_put(slots, old->slot[i].hash, old->slot[i].name, old->slot[i].value);
+            }
+        }
+    }
+    return slots;
+}
+
+int json_rpc_table_insert(rpc_table_t *table, const char *name, void *value)
+{
+    if (table == NULL || name == NULL || value == NULL)
+    {
+        return RETURN_ERR;
+    }
+
+    rpc_table_slots_t *slots = table->slots;
+    if (slots == NULL || (slots->count + 1) * 2 > slots->mask + 1)
+    {
+        slots = table_slots_grow(slots, slots == NULL ? RPC_TABLE_MIN_SIZE : (slots->mask + 1) * 2);
+        if (slots == NULL)
+        {
+            return RETURN_ERR;
+        }
+        table_slots_put(slots, table_hash(name), name, value);
+        __atomic_store_n(&table->slots, slots, __ATOMIC_RELEASE);
+        return RETURN_OK;
+    }
+
+    table_slots_put(slots, table_hash(name), name, value);
+    return RETURN_OK;
+}
+
+void *json_rpc_table_lookup(const rpc_table_t *table, const char *name)
+{
+    rpc_table_slots_t *slots = __atomic_load_n(&table->slots, __ATOMIC_ACQUIRE);
+    if (slots == NULL || name == NULL)
+    {
+        return NULL;
+    }
+
+    /* At most half of the slots are filled, the probing always ends on an empty one. */
+    uint32_t hash = table_hash(name);
+    uint32_t i = hash & slots->mask;
+    void *value;
+    while ((value = __atomic_load_n(&slots->slot[i].value, __ATOMIC_ACQUIRE)) != NULL)
+    {
+        if (slots->slot[i].hash == hash && !strcmp(slots->slot[i].name, name))
+        {
+            return value;
+        }
+        i = (i + 1) & slots->mask;
+    }
+    return NULL;
+}
+
+void json_rpc_table_free(rpc_table_t *table)
+{
+    if (table == NULL)
+    {
+        return;
+    }
+
+    rpc_table_slots_t *slots = table->slots;
+    while (slots != NULL)
+    {
+        rpc_table_slots_t *retired = slots->retired;
+        free(slots);
+        slots = retired;
+    }
+    table->slots = NULL;
+}
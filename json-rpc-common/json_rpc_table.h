@@ -0,0 +1,92 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef _JSON_RPC_TABLE_H
+#define _JSON_RPC_TABLE_H
+
+#include <stdint.h>
+
+/**
+ * Name indexed table used to dispatch the requests to their action.
+ *
+ * Open addressing with linear probing, kept at most half full. Entries are
+ * never removed, so a slot does not change once it is filled: lookups take
+ * no lock and can run on any thread while one thread inserts. When the table
+ * has to grow, the entries are copied into a table twice as big which is then
+ * published; the previous one stays readable until json_rpc_table_free().
+ */
+
+#define RPC_TABLE_MIN_SIZE 16 /* Number of slots of the first table, a power of 2. */
+
+/**
+ * @brief Table slot, empty as long as value is NULL.
+ */
+typedef struct rpc_table_slot_t
+{
+    uint32_t hash;    /* Hash of the name. */
+    const char *name; /* Name the value is stored for, owned by the caller. */
+    void *value;      /* Stored value, written last. */
+} rpc_table_slot_t;
+
+/**
+ * @brief Slots of one table generation.
+ */
+typedef struct rpc_table_slots_t
+{
+    uint32_t mask;                     /* Number of slots - 1. */
+    uint32_t count;                    /* Number of filled slots. */
+    struct rpc_table_slots_t *retired; /* Previous generation, released along with this one. */
+    rpc_table_slot_t slot[];           /* Slots. */
+} rpc_table_slots_t;
+
+/**
+ * @brief Name indexed table, zero initialised before use.
+ */
+typedef struct rpc_table_t
+{
+    rpc_table_slots_t *slots; /* Current generation, NULL while the table is empty. */
+} rpc_table_t;
+
+/**
+ * @brief Insert a value, the name must not be in the table yet.
+ * Callers inserting from several threads have to serialise the inserts,
+ * lookups can run at the same time.
+ * @param table
+ * @param name, must stay valid until the table is freed
+ * @param value to store, not NULL
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_table_insert(rpc_table_t *table, const char *name, void *value);
+
+/**
+ * @brief Find the value stored for a name, without taking any lock.
+ * @param table
+ * @param name to look for
+ * @return value stored for the name, NULL if not found.
+ */
+void *json_rpc_table_lookup(const rpc_table_t *table, const char *name);
+
+/**
+ * @brief Release all the generations of the table, no lookup may be running.
+ * The stored values are not released.
+ * @param table
+ */
+void json_rpc_table_free(rpc_table_t *table);
+
+#endif //_JSON_RPC_TABLE_H
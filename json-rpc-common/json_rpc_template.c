@@ -0,0 +1,369 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json_rpc_template.h"
+#include "json_rpc_common.h"
+
+#define TEMPLATE_HEADER_MEMBERS 2 /* Module and version, the members every message starts with. */
+
+/**
+ * @brief Status values of the `Result` bodies serialised up front.
+ */
+static const char *const g_template_status[RPC_TEMPLATE_STATUS_COUNT] = {
+    JSON_RPC_STATUS_SUCCESS,
+    JSON_RPC_STATUS_FAILED,
+    JSON_RPC_STATUS_NOT_SUPPORTED,
+    JSON_RPC_STATUS_BUSY,
+};
+
+/**
+ * @brief Append a json value in text json and in MessagePack.
+ */
+static int template_serialise(json_object *jobj, rpc_frame_buffer_t *text, rpc_frame_buffer_t *packed)
+{
+    const char *str = json_object_to_json_string_ext(jobj, JSON_C_TO_STRING_PLAIN);
+    if (str == NULL || json_rpc_frame_buffer_append(text, str, strlen(str)) != RETURN_OK)
+    {
+        return RETURN_ERR;
+    }
+    return json_rpc_codec_encode(jobj, packed);
+}
+
+/**
+ * @brief Check whether a message starts with the module and version of the template.
+ */
+static int template_matches(const rpc_template_t *tpl, json_object *jmsg)
+{
+    const char *expected = NULL;
+    int index = 0;
+
+    if (tpl->text.data == NULL || !json_object_is_type(jmsg, json_type_object))
+    {
+        return FALSE;
+    }
+
+    json_object_object_foreach(jmsg, key, jvalue)
+    {
+        expected = (index == 0) ? JSON_RPC_FIELD_MODULE : JSON_RPC_FIELD_VERSION;
+        if (strcmp(key, expected) != 0 || !json_object_is_type(jvalue, json_type_string))
+        {
+            return FALSE;
+        }
+        expected = (index == 0) ? tpl->module : tpl->version;
+        if (strcmp(json_object_get_string(jvalue), expected) != 0)
+        {
+            return FALSE;
+        }
+        if (++index == TEMPLATE_HEADER_MEMBERS)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * @brief Find the serialised `Result` body equal to a value.
+ * @return index of the body, -1 if none.
+ */
+static int template_find_status(json_object *jvalue)
+{
+    json_object *jstatus = NULL;
+    const char *status = NULL;
+
+    if (!json_object_is_type(jvalue, json_type_object) || json_object_object_length(jvalue) != 1 ||
+        !json_object_object_get_ex(jvalue, JSON_RPC_PARAM_STATUS_FIELD, &jstatus) ||
+        !json_object_is_type(jstatus, json_type_string))
+    {
+        return -1;
+    }
+    status = json_object_get_string(jstatus);
+    for (int i = 0; i < RPC_TEMPLATE_STATUS_COUNT; ++i)
+    {
+        if (strcmp(status, g_template_status[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Append a member of a message in text json, preceded by its separator.
+ */
+static int template_put_text_member(const rpc_template_t *tpl, const char *key, json_object *jvalue, rpc_frame_buffer_t *buf)
+{
+    const char *value = NULL;
+    size_t key_len = strlen(key);
+    size_t value_len = 0;
+    size_t room = 0;
+    int status = -1;
+
+    if (json_object_is_type(jvalue, json_type_string))
+    {
+        /* Escaped below, straight into the buffer. */
+        value_len = json_object_get_string_len(jvalue);
+        room = value_len * 6 + 2;
+    }
+    else
+    {
+        status = template_find_status(jvalue);
+        if (status >= 0)
+        {
+            value = tpl->status_text[status].data;
+            value_len = tpl->status_text[status].len;
+        }
+        else
+        {
+            value = json_object_to_json_string_ext(jvalue, JSON_C_TO_STRING_PLAIN);
+            value_len = (value != NULL) ? strlen(value) : 0;
+        }
+        room = value_len;
+    }
+    /* Separator, quoted key and colon. */
+    if (json_rpc_frame_buffer_reserve(buf, buf->len + key_len * 6 + 4 + room) != RETURN_OK)
+    {
+        return RETURN_ERR;
+    }
+
+    buf->data[buf->len++] = ',';
+    buf->len += json_rpc_template_escape(buf->data + buf->len, key, key_len);
+    buf->data[buf->len++] = ':';
+    if (value == NULL)
+    {
+        buf->len += json_rpc_template_escape(buf->data + buf->len, json_object_get_string(jvalue), value_len);
+    }
+    else
+    {
+        memcpy(buf->data + buf->len, value, value_len);
+        buf->len += value_len;
+    }
+    return RETURN_OK;
+}
+
+/**
+ * @brief Append a message in text json.
+ */
+static int template_put_text(const rpc_template_t *tpl, json_object *jmsg, rpc_frame_buffer_t *buf)
+{
+    int index = 0;
+
+    if (json_rpc_frame_buffer_append(buf, tpl->text.data, tpl->text.len) != RETURN_OK)
+    {
+        return RETURN_ERR;
+    }
+    json_object_object_foreach(jmsg, key, jvalue)
+    {
+        if (index++ < TEMPLATE_HEADER_MEMBERS)
+        {
+            continue;
+        }
+        if (template_put_text_member(tpl, key, jvalue, buf) != RETURN_OK)
+        {
+            return RETURN_ERR;
+        }
+    }
+    return json_rpc_frame_buffer_append(buf, "}", 1);
+}
+
+/**
+ * @brief Append a message in MessagePack.
+ */
+static int template_put_packed(const rpc_template_t *tpl, json_object *jmsg, rpc_frame_buffer_t *buf)
+{
+    int index = 0;
+    int status = -1;
+
+    if (json_rpc_codec_encode_map(buf, json_object_object_length(jmsg)) != RETURN_OK ||
+        json_rpc_frame_buffer_append(buf, tpl->packed.data, tpl->packed.len) != RETURN_OK)
+    {
+        return RETURN_ERR;
+    }
+    json_object_object_foreach(jmsg, key, jvalue)
+    {
+        if (index++ < TEMPLATE_HEADER_MEMBERS)
+        {
+            continue;
+        }
+        /* Members without a value are left to the whole message encoding. */
+        if (jvalue == NULL || json_rpc_codec_encode_string(buf, key, strlen(key)) != RETURN_OK)
+        {
+            return RETURN_ERR;
+        }
+        status = template_find_status(jvalue);
+        if (status >= 0)
+        {
+            if (json_rpc_frame_buffer_append(buf, tpl->status_packed[status].data, tpl->status_packed[status].len) != RETURN_OK)
+            {
+                return RETURN_ERR;
+            }
+        }
+        else if (json_rpc_codec_encode(jvalue, buf) != RETURN_OK)
+        {
+            return RETURN_ERR;
+        }
+    }
+    return RETURN_OK;
+}
+
+int json_rpc_template_init(rpc_template_t *tpl, const char *module, const char *version)
+{
+    POINTER_ASSERT(tpl != NULL);
+    POINTER_ASSERT(module != NULL);
+    POINTER_ASSERT(version != NULL);
+
+    json_object *jheader = json_object_new_object();
+    json_object *jresult = NULL;
+    int rc = RETURN_OK;
+
+    tpl->module = strdup(module);
+    tpl->version = strdup(version);
+    json_object_object_add(jheader, JSON_RPC_FIELD_MODULE, json_object_new_string(module));
+    json_object_object_add(jheader, JSON_RPC_FIELD_VERSION, json_object_new_string(version));
+    if (tpl->module == NULL || tpl->version == NULL || template_serialise(jheader, &tpl->text, &tpl->packed) != RETURN_OK)
+    {
+        rc = RETURN_ERR;
+    }
+    json_object_put(jheader);
+
+    if (rc == RETURN_OK)
+    {
+        /* The members that follow go before the closing brace, and after the map header
+         * counting them. A map of two members has a one byte header. */
+        tpl->text.len--;
+        tpl->packed.len--;
+        memmove(tpl->packed.data, tpl->packed.data + 1, tpl->packed.len);
+    }
+
+    for (int i = 0; rc == RETURN_OK && i < RPC_TEMPLATE_STATUS_COUNT; ++i)
+    {
+        jresult = json_object_new_object();
+        json_object_object_add(jresult, JSON_RPC_PARAM_STATUS_FIELD, json_object_new_string(g_template_status[i]));
+        rc = template_serialise(jresult, &tpl->status_text[i], &tpl->status_packed[i]);
+        json_object_put(jresult);
+    }
+
+    if (rc != RETURN_OK)
+    {
+        LOGERROR("Failed to serialise the message template of module %s", module);
+        json_rpc_template_free(tpl);
+    }
+    return rc;
+}
+
+void json_rpc_template_free(rpc_template_t *tpl)
+{
+    if (tpl == NULL)
+    {
+        return;
+    }
+
+    free(tpl->module);
+    free(tpl->version);
+    tpl->module = NULL;
+    tpl->version = NULL;
+    json_rpc_frame_buffer_free(&tpl->text);
+    json_rpc_frame_buffer_free(&tpl->packed);
+    for (int i = 0; i < RPC_TEMPLATE_STATUS_COUNT; ++i)
+    {
+        json_rpc_frame_buffer_free(&tpl->status_text[i]);
+        json_rpc_frame_buffer_free(&tpl->status_packed[i]);
+    }
+}
+
+int json_rpc_template_encode(const rpc_template_t *tpl, json_object *jmsg, rpc_codec_t codec, int flags, rpc_frame_buffer_t *buf)
+{
+    POINTER_ASSERT(tpl != NULL);
+    POINTER_ASSERT(jmsg != NULL);
+    POINTER_ASSERT(buf != NULL);
+
+    const char *text = NULL;
+    size_t len = buf->len;
+    int rc = RETURN_ERR;
+
+    /* Pretty printing indents the members by their depth, only plain text is spliced. */
+    if ((codec == RPC_CODEC_MSGPACK || flags == JSON_C_TO_STRING_PLAIN) && template_matches(tpl, jmsg))
+    {
+        rc = (codec == RPC_CODEC_MSGPACK) ? template_put_packed(tpl, jmsg, buf) : template_put_text(tpl, jmsg, buf);
+        if (rc != RETURN_OK)
+        {
+            buf->len = len;
+        }
+    }
+
+    if (rc != RETURN_OK)
+    {
+        if (codec == RPC_CODEC_MSGPACK)
+        {
+            return json_rpc_codec_encode(jmsg, buf);
+        }
+        text = json_object_to_json_string_ext(jmsg, flags);
+        rc = (text != NULL) ? json_rpc_frame_buffer_append(buf, text, strlen(text)) : RETURN_ERR;
+    }
+
+    if (rc == RETURN_OK && codec != RPC_CODEC_MSGPACK)
+    {
+        rc = json_rpc_frame_buffer_append(buf, "", 1);
+        buf->len--;
+    }
+    return rc;
+}
+
+size_t json_rpc_template_escape(char *out, const char *str, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char *c = (const unsigned char *)str;
+    char *start = out;
+
+    *out++ = '"';
+    for (size_t i = 0; i < len; ++i, ++c)
+    {
+        switch (*c)
+        {
+            case '"':  *out++ = '\\'; *out++ = '"'; break;
+            case '\\': *out++ = '\\'; *out++ = '\\'; break;
+            case '/':  *out++ = '\\'; *out++ = '/'; break;
+            case '\b': *out++ = '\\'; *out++ = 'b'; break;
+            case '\f': *out++ = '\\'; *out++ = 'f'; break;
+            case '\n': *out++ = '\\'; *out++ = 'n'; break;
+            case '\r': *out++ = '\\'; *out++ = 'r'; break;
+            case '\t': *out++ = '\\'; *out++ = 't'; break;
+            default:
+                if (*c < 0x20)
+                {
+                    *out++ = '\\';
+                    *out++ = 'u';
+                    *out++ = '0';
+                    *out++ = '0';
+                    *out++ = hex[*c >> 4];
+                    *out++ = hex[*c & 0xf];
+                }
+                else
+                {
+                    *out++ = *c;
+                }
+                break;
+        }
+    }
+    *out++ = '"';
+    return out - start;
+}
@@ -0,0 +1,93 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef _JSON_RPC_TEMPLATE_H
+#define _JSON_RPC_TEMPLATE_H
+
+#include <stddef.h>
+#include <json-c/json.h>
+#include "json_rpc_frame.h"
+#include "json_rpc_codec.h"
+
+/**
+ * Messages encoded around their constant parts.
+ *
+ * Every message of a module starts with the same `module` and `version` members,
+ * and most replies carry one of a few `Result` bodies. These are serialised once,
+ * in text json and in MessagePack, when the template is set up. Encoding a message
+ * then copies them and only serialises the members left, the request id and the
+ * params most of the time. The output is the one of json-c, byte for byte.
+ *
+ * The template is read only once set up, any thread can encode with it.
+ */
+
+#define RPC_TEMPLATE_STATUS_COUNT 4 /* Number of `Result` bodies serialised up front. */
+
+/**
+ * @brief Constant parts of the messages of a module.
+ */
+typedef struct rpc_template_t
+{
+    char *module;                                           /* Module name of the messages. */
+    char *version;                                          /* Module version of the messages. */
+    rpc_frame_buffer_t text;                                /* Module and version members in text json, without the closing brace. */
+    rpc_frame_buffer_t packed;                              /* Module and version members in MessagePack, without the map header. */
+    rpc_frame_buffer_t status_text[RPC_TEMPLATE_STATUS_COUNT];   /* `Result` bodies in text json. */
+    rpc_frame_buffer_t status_packed[RPC_TEMPLATE_STATUS_COUNT]; /* `Result` bodies in MessagePack. */
+} rpc_template_t;
+
+/**
+ * @brief Serialise the constant parts of the messages of a module.
+ * @param template, zero initialised
+ * @param module name
+ * @param module version
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_template_init(rpc_template_t *tpl, const char *module, const char *version);
+
+/**
+ * @brief Release the serialised parts, the template can be set up again.
+ * @param template
+ */
+void json_rpc_template_free(rpc_template_t *tpl);
+
+/**
+ * @brief Append the encoding of a message to a buffer.
+ * Messages starting with the module and version of the template get the serialised
+ * parts spliced in, any other message, or a pretty printed one, is encoded as a whole.
+ * Text messages are NUL terminated, the terminator is not counted in the length.
+ * @param template, one never set up encodes every message as a whole
+ * @param json message
+ * @param encoding
+ * @param json-c flags of the text encoding
+ * @param buffer, grown as required
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_template_encode(const rpc_template_t *tpl, json_object *jmsg, rpc_codec_t codec, int flags, rpc_frame_buffer_t *buf);
+
+/**
+ * @brief Write a json string, quoted and escaped as json-c does it.
+ * @param output with room for 6 bytes per character and 2 quotes
+ * @param NUL terminated string
+ * @param number of bytes of the string
+ * @return number of bytes written.
+ */
+size_t json_rpc_template_escape(char *out, const char *str, size_t len);
+
+#endif //_JSON_RPC_TEMPLATE_H
@@ -0,0 +1,387 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include "json_rpc_uring.h"
+#include "json_rpc_common.h"
+
+/**
+ * Number of opcodes asked for when probing the kernel.
+ */
+#define URING_PROBE_OPS 256
+
+/**
+ * @brief io_uring_setup(2).
+ */
+static int uring_setup(unsigned entries, struct io_uring_params *params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+/**
+ * @brief io_uring_enter(2).
+ */
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+/**
+ * @brief io_uring_register(2).
+ */
+static int uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * @brief Number of queued submissions the kernel has not consumed yet.
+ */
+static unsigned uring_sq_pending(rpc_uring_t *ring)
+{
+    return __atomic_load_n(ring->sq_tail, __ATOMIC_RELAXED) - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+}
+
+int json_rpc_uring_supported(void)
+{
+    struct io_uring_params params;
+    struct io_uring_probe *probe;
+    int supported = FALSE;
+    int fd;
+
+    memset(&params, 0, sizeof(params));
+    fd = uring_setup(4, &params);
+    if (fd < 0)
+    {
+        /* ENOSYS on old kernels, EPERM when disabled by sysctl or a seccomp filter. */
+        return FALSE;
+    }
+
+    probe = (struct io_uring_probe *)calloc(1, sizeof(*probe) + URING_PROBE_OPS * sizeof(struct io_uring_probe_op));
+    if (probe != NULL && uring_register(fd, IORING_REGISTER_PROBE, probe, URING_PROBE_OPS) == 0)
+    {
+        /* IORING_OP_SEND_ZC came with Linux 6.0, the first release with multishot recv. */
+        supported = (probe->last_op >= IORING_OP_SEND_ZC &&
+                     (probe->ops[IORING_OP_ACCEPT].flags & IO_URING_OP_SUPPORTED) &&
+                     (probe->ops[IORING_OP_RECV].flags & IO_URING_OP_SUPPORTED) &&
+                     (probe->ops[IORING_OP_POLL_ADD].flags & IO_URING_OP_SUPPORTED) &&
+                     (probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED) &&
+                     (params.features & IORING_FEAT_NODROP))
+                        ? TRUE
+                        : FALSE;
+    }
+    free(probe);
+    close(fd);
+    return supported;
+}
+
+int json_rpc_uring_init(rpc_uring_t *ring, unsigned entries)
+{
+    POINTER_ASSERT(ring != NULL);
+    struct io_uring_params params;
+    unsigned char *sq_ring, *cq_ring;
+
+    memset(ring, 0, sizeof(*ring));
+    pthread_mutex_init(&ring->sq_lock, NULL);
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+    ring->fd = uring_setup(entries, &params);
+    if (ring->fd < 0)
+    {
+        LOGERROR("io_uring_setup() failed, Error : %s", strerror(errno));
+        return RETURN_ERR;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->cq_ring_size > ring->sq_ring_size)
+        {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED)
+    {
+        ring->sq_ring = NULL;
+        goto ERROR;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->cq_ring = ring->sq_ring;
+    }
+    else
+    {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED)
+        {
+            ring->cq_ring = NULL;
+            goto ERROR;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        ring->sqes = NULL;
+        goto ERROR;
+    }
+
+    sq_ring = (unsigned char *)ring->sq_ring;
+    cq_ring = (unsigned char *)ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq_ring + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq_ring + params.sq_off.tail);
+    ring->sq_array = (unsigned *)(sq_ring + params.sq_off.array);
+    ring->sq_mask = *(unsigned *)(sq_ring + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->cq_head = (unsigned *)(cq_ring + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq_ring + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq_ring + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq_ring + params.cq_off.cqes);
+
+    /* Submission slot i always uses entry i, the index array never changes. */
+    for (unsigned i = 0; i < ring->sq_entries; ++i)
+    {
+        ring->sq_array[i] = i;
+    }
+    return RETURN_OK;
+
+ERROR:
+    LOGERROR("Failed to map the io_uring queues, Error : %s", strerror(errno));
+    json_rpc_uring_free(ring);
+    return RETURN_ERR;
+}
+
+int json_rpc_uring_setup_buffers(rpc_uring_t *ring, uint16_t group, unsigned count, unsigned size)
+{
+    POINTER_ASSERT(ring != NULL);
+    struct io_uring_buf_reg reg;
+    void *mem;
+
+    if (count == 0 || (count & (count - 1)) != 0 || count > 32768)
+    {
+        LOGERROR("Invalid provided buffer count %u", count);
+        return RETURN_ERR;
+    }
+
+    ring->buf_ring_size = count * sizeof(struct io_uring_buf);
+    mem = mmap(NULL, ring->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+    {
+        LOGERROR("Failed to allocate the buffer ring, Error : %s", strerror(errno));
+        return RETURN_ERR;
+    }
+    ring->buf_base = (char *)malloc((size_t)count * size);
+    if (ring->buf_base == NULL)
+    {
+        LOGERROR("Failed to allocate %u receive buffers", count);
+        munmap(mem, ring->buf_ring_size);
+        return RETURN_ERR;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)mem;
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        LOGERROR("Failed to register the buffer ring, Error : %s", strerror(errno));
+        free(ring->buf_base);
+        ring->buf_base = NULL;
+        munmap(mem, ring->buf_ring_size);
+        return RETURN_ERR;
+    }
+
+    ring->buf_ring = (struct io_uring_buf_ring *)mem;
+    ring->buf_count = count;
+    ring->buf_size = size;
+    ring->buf_group = group;
+    for (unsigned i = 0; i < count; ++i)
+    {
+        struct io_uring_buf *buf = &ring->buf_ring->bufs[i];
+        buf->addr = (uint64_t)(uintptr_t)(ring->buf_base + (size_t)i * size);
+        buf->len = size;
+        buf->bid = (uint16_t)i;
+    }
+    __atomic_store_n(&ring->buf_ring->tail, (uint16_t)count, __ATOMIC_RELEASE);
+    return RETURN_OK;
+}
+
+void json_rpc_uring_free(rpc_uring_t *ring)
+{
+    if (ring == NULL)
+    {
+        return;
+    }
+    if (ring->buf_ring != NULL)
+    {
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.bgid = ring->buf_group;
+        uring_register(ring->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    }
+    if (ring->fd >= 0)
+    {
+        /* Cancels the requests still in flight. */
+        close(ring->fd);
+        ring->fd = -1;
+    }
+    if (ring->buf_ring != NULL)
+    {
+        munmap(ring->buf_ring, ring->buf_ring_size);
+        ring->buf_ring = NULL;
+    }
+    free(ring->buf_base);
+    ring->buf_base = NULL;
+    if (ring->sqes != NULL)
+    {
+        munmap(ring->sqes, ring->sqes_size);
+        ring->sqes = NULL;
+    }
+    if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring)
+    {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    ring->cq_ring = NULL;
+    if (ring->sq_ring != NULL)
+    {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+        ring->sq_ring = NULL;
+    }
+    pthread_mutex_destroy(&ring->sq_lock);
+}
+
+int json_rpc_uring_queue(rpc_uring_t *ring, const struct io_uring_sqe *sqe, int submit)
+{
+    POINTER_ASSERT(ring != NULL);
+    POINTER_ASSERT(sqe != NULL);
+    unsigned tail;
+
+    pthread_mutex_lock(&ring->sq_lock);
+    while (uring_sq_pending(ring) >= ring->sq_entries)
+    {
+        /* Submission queue is full, hand what is there to the kernel first. */
+        if (uring_enter(ring->fd, ring->sq_entries, 0, 0) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            LOGERROR("io_uring_enter() failed, Error : %s", strerror(errno));
+            pthread_mutex_unlock(&ring->sq_lock);
+            return RETURN_ERR;
+        }
+    }
+    tail = *ring->sq_tail;
+    ring->sqes[tail & ring->sq_mask] = *sqe;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    if (submit == TRUE)
+    {
+        while (uring_enter(ring->fd, uring_sq_pending(ring), 0, 0) < 0)
+        {
+            if (errno != EINTR)
+            {
+                /* Still queued, submitted with the next call. */
+                LOGERROR("io_uring_enter() failed, Error : %s", strerror(errno));
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&ring->sq_lock);
+    return RETURN_OK;
+}
+
+int json_rpc_uring_wait(rpc_uring_t *ring)
+{
+    POINTER_ASSERT(ring != NULL);
+
+    /* The kernel submits at most what is queued, other threads may have submitted in between. */
+    if (uring_enter(ring->fd, uring_sq_pending(ring), 1, IORING_ENTER_GETEVENTS) < 0)
+    {
+        return RETURN_ERR;
+    }
+    return RETURN_OK;
+}
+
+int json_rpc_uring_next(rpc_uring_t *ring, struct io_uring_cqe *cqe)
+{
+    unsigned head = *ring->cq_head;
+
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        return FALSE;
+    }
+    *cqe = ring->cqes[head & ring->cq_mask];
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return TRUE;
+}
+
+char *json_rpc_uring_buffer(rpc_uring_t *ring, uint16_t bid)
+{
+    return ring->buf_base + (size_t)bid * ring->buf_size;
+}
+
+void json_rpc_uring_recycle_buffer(rpc_uring_t *ring, uint16_t bid)
+{
+    uint16_t tail = ring->buf_ring->tail;
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[tail & (ring->buf_count - 1)];
+
+    buf->addr = (uint64_t)(uintptr_t)json_rpc_uring_buffer(ring, bid);
+    buf->len = ring->buf_size;
+    buf->bid = bid;
+    __atomic_store_n(&ring->buf_ring->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+}
+
+void json_rpc_uring_prep_accept(struct io_uring_sqe *sqe, int fd, uint64_t user_data)
+{
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = user_data;
+}
+
+void json_rpc_uring_prep_recv(struct io_uring_sqe *sqe, int fd, uint16_t group, uint64_t user_data)
+{
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = group;
+    sqe->user_data = user_data;
+}
+
+void json_rpc_uring_prep_poll(struct io_uring_sqe *sqe, int fd, unsigned events, uint64_t user_data)
+{
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = user_data;
+}
@@ -0,0 +1,169 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef _JSON_RPC_URING_H
+#define _JSON_RPC_URING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <linux/io_uring.h>
+
+/**
+ * Minimal io_uring support built on the raw system calls, so no liburing is needed.
+ *
+ * Submissions can be queued from several threads, the submission queue is
+ * protected by a mutex. The completion queue and the provided receive buffers
+ * are only used by the thread owning the ring. Provided buffers are registered
+ * once as a buffer ring, a multishot recv picks one per completion and the
+ * owner hands it back with json_rpc_uring_recycle_buffer() once processed.
+ */
+
+/**
+ * @brief io_uring instance.
+ */
+typedef struct rpc_uring_t
+{
+    int fd;                           /* io_uring file descriptor. */
+    unsigned *sq_head;                /* Submission queue head, advanced by the kernel. */
+    unsigned *sq_tail;                /* Submission queue tail. */
+    unsigned *sq_array;               /* Submission queue index array. */
+    unsigned sq_mask;                 /* Submission queue index mask. */
+    unsigned sq_entries;              /* Number of submission queue entries. */
+    struct io_uring_sqe *sqes;        /* Submission queue entries. */
+    unsigned *cq_head;                /* Completion queue head. */
+    unsigned *cq_tail;                /* Completion queue tail, advanced by the kernel. */
+    unsigned cq_mask;                 /* Completion queue index mask. */
+    struct io_uring_cqe *cqes;        /* Completion queue entries. */
+    void *sq_ring;                    /* Mapping of the submission queue. */
+    size_t sq_ring_size;              /* Size of the sq_ring mapping. */
+    void *cq_ring;                    /* Mapping of the completion queue, sq_ring if shared. */
+    size_t cq_ring_size;              /* Size of the cq_ring mapping. */
+    size_t sqes_size;                 /* Size of the sqes mapping. */
+    pthread_mutex_t sq_lock;          /* Serialises the submitting threads. */
+    struct io_uring_buf_ring *buf_ring; /* Provided buffer ring, NULL if not set up. */
+    size_t buf_ring_size;             /* Size of the buf_ring mapping. */
+    char *buf_base;                   /* Memory of the provided buffers. */
+    unsigned buf_count;               /* Number of provided buffers, a power of 2. */
+    unsigned buf_size;                /* Size of one provided buffer. */
+    uint16_t buf_group;               /* Buffer group id of the provided buffers. */
+} rpc_uring_t;
+
+/**
+ * @brief Check whether the running kernel offers everything the server needs:
+ * multishot accept and recv with a provided buffer ring (Linux 6.0).
+ * @return TRUE if io_uring can be used, FALSE else.
+ */
+int json_rpc_uring_supported(void);
+
+/**
+ * @brief Create an io_uring instance and map its queues.
+ * @param ring to initialise
+ * @param number of submission queue entries, the completion queue holds four times as many.
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_uring_init(rpc_uring_t *ring, unsigned entries);
+
+/**
+ * @brief Allocate the provided receive buffers and register them as a buffer ring.
+ * @param ring
+ * @param buffer group id used by the recv requests
+ * @param number of buffers, must be a power of 2
+ * @param size of one buffer
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_uring_setup_buffers(rpc_uring_t *ring, uint16_t group, unsigned count, unsigned size);
+
+/**
+ * @brief Close the io_uring instance and release its memory.
+ * Requests still in flight are cancelled.
+ * @param ring
+ */
+void json_rpc_uring_free(rpc_uring_t *ring);
+
+/**
+ * @brief Copy a prepared submission into the submission queue.
+ * Can be called from any thread.
+ * @param ring
+ * @param prepared submission
+ * @param TRUE to submit it right away, FALSE to leave it for the next json_rpc_uring_wait()
+ * of the owning thread.
+ * @return RETURN_OK once queued , RETURN_ERR if the submission queue stays full.
+ */
+int json_rpc_uring_queue(rpc_uring_t *ring, const struct io_uring_sqe *sqe, int submit);
+
+/**
+ * @brief Submit the queued requests and wait until at least one completion is available,
+ * with a single system call.
+ * @param ring
+ * @return RETURN_OK on success , RETURN_ERR else (errno is preserved).
+ */
+int json_rpc_uring_wait(rpc_uring_t *ring);
+
+/**
+ * @brief Take the next completion from the completion queue.
+ * @param ring
+ * @param (OUT) copy of the completion
+ * @return TRUE if a completion was taken, FALSE if the queue is empty.
+ */
+int json_rpc_uring_next(rpc_uring_t *ring, struct io_uring_cqe *cqe);
+
+/**
+ * @brief Provided buffer a completion refers to.
+ * @param ring
+ * @param buffer id, taken from the completion flags
+ * @return buffer start.
+ */
+char *json_rpc_uring_buffer(rpc_uring_t *ring, uint16_t bid);
+
+/**
+ * @brief Hand a provided buffer back to the kernel once its data is processed.
+ * @param ring
+ * @param buffer id
+ */
+void json_rpc_uring_recycle_buffer(rpc_uring_t *ring, uint16_t bid);
+
+/**
+ * @brief Prepare a multishot accept, one completion per accepted connection.
+ * The accepted sockets are non-blocking and close-on-exec.
+ * @param (OUT) submission
+ * @param listening socket fd
+ * @param user data returned with the completions
+ */
+void json_rpc_uring_prep_accept(struct io_uring_sqe *sqe, int fd, uint64_t user_data);
+
+/**
+ * @brief Prepare a multishot recv into the provided buffers of the group.
+ * @param (OUT) submission
+ * @param socket fd
+ * @param buffer group id
+ * @param user data returned with the completions
+ */
+void json_rpc_uring_prep_recv(struct io_uring_sqe *sqe, int fd, uint16_t group, uint64_t user_data);
+
+/**
+ * @brief Prepare a one shot poll.
+ * @param (OUT) submission
+ * @param file descriptor
+ * @param poll events (POLLIN, POLLOUT, ...)
+ * @param user data returned with the completion
+ */
+void json_rpc_uring_prep_poll(struct io_uring_sqe *sqe, int fd, unsigned events, uint64_t user_data);
+
+#endif //_JSON_RPC_URING_H
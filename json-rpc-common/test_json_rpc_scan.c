@@ -0,0 +1,194 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#include "json_rpc_scan.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_BUFFER_SIZE 512
+#define TEST_MAX_SHIFT 64 /* Start offsets tried, two blocks of the widest vector code. */
+#define TEST_RANDOM_ROUNDS 20000
+
+static int failures = 0;
+
+/**
+ * @brief Scan a message placed at every offset of a buffer, compare the vector
+ * and the scalar scanners with the expected length.
+ */
+static void check_scan(const char *name, const char *data, size_t len, size_t expected)
+{
+    static char buffer[TEST_BUFFER_SIZE + TEST_MAX_SHIFT];
+
+    if (len > TEST_BUFFER_SIZE)
+    {
+        printf("FAIL %s: message too large for the test buffer \n", name);
+        failures++;
+        return;
+    }
+    for (size_t shift = 0; shift < TEST_MAX_SHIFT; ++shift)
+    {
+        memcpy(buffer + shift, data, len);
+        size_t vector = json_rpc_scan_message(buffer + shift, len);
+        size_t scalar = json_rpc_scan_message_scalar(buffer + shift, len);
+        if (vector != expected || scalar != expected)
+        {
+            printf("FAIL %s at offset %zu: vector %zu, scalar %zu, expected %zu \n", name, shift, vector, scalar, expected);
+            failures++;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Check a string of escapes and quotes ending right on and around every block boundary.
+ */
+static void check_block_boundaries(void)
+{
+    static const char *tails[] = {"\\\"", "\\\\", "\\\\\\\"", "", "\\n"};
+    char message[TEST_BUFFER_SIZE];
+    char name[64];
+
+    for (size_t t = 0; t < sizeof(tails) / sizeof(tails[0]); ++t)
+    {
+        for (size_t pad = 0; pad < 70; ++pad)
+        {
+            size_t len = 0;
+            len += sprintf(message + len, "{\"k\":\"");
+            memset(message + len, 'a', pad);
+            len += pad;
+            len += sprintf(message + len, "%s}]\",\"n\":[{}]}", tails[t]);
+            snprintf(name, sizeof(name), "boundary tail %zu pad %zu", t, pad);
+            check_scan(name, message, len, len);
+
+            /* The same message followed by the next one. */
+            len += sprintf(message + len, "{\"next\":1}");
+            check_scan(name, message, len, len - strlen("{\"next\":1}"));
+        }
+    }
+}
+
+/**
+ * @brief Reference scanner, a byte at a time without any block.
+ */
+static size_t reference_scan(const char *data, size_t len)
+{
+    size_t pos = 0;
+    int depth = 0;
+    int in_string = 0;
+
+    while (pos < len && strchr(" \t\n\r", data[pos]) != NULL && data[pos] != '\0')
+    {
+        pos++;
+    }
+    if (pos == len)
+    {
+        return 0;
+    }
+    if (data[pos] != '{' && data[pos] != '[')
+    {
+        return len;
+    }
+    for (; pos < len; ++pos)
+    {
+        if (in_string)
+        {
+            if (data[pos] == '\\')
+            {
+                pos++;
+            }
+            else if (data[pos] == '"')
+            {
+                in_string = 0;
+            }
+        }
+        else if (data[pos] == '"')
+        {
+            in_string = 1;
+        }
+        else if (data[pos] == '{' || data[pos] == '[')
+        {
+            depth++;
+        }
+        else if ((data[pos] == '}' || data[pos] == ']') && --depth == 0)
+        {
+            return pos + 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Random runs of the bytes the scanner looks for.
+ */
+static void check_random(void)
+{
+    static const char alphabet[] = "\"\\{}[]a \"\\{}";
+    char message[TEST_BUFFER_SIZE];
+
+    srand(1);
+    for (int round = 0; round < TEST_RANDOM_ROUNDS; ++round)
+    {
+        size_t len = 1 + (size_t)rand() % 200;
+        message[0] = (rand() & 1) ? '{' : '[';
+        for (size_t i = 1; i < len; ++i)
+        {
+            message[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+        }
+        check_scan("random", message, len, reference_scan(message, len));
+        if (failures > 0)
+        {
+            return;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    const char *glued = "{\"a\":1}[1,[2]]  {\"b\":\"}\"}";
+    const char *strings = "{\"a\":\"}}]]{{[[\",\"b\":[1,{\"c\":\"]\"}],\"d\":\"\\\\\"}";
+
+    check_scan("object", "{\"a\":1}", 7, 7);
+    check_scan("array", "[{\"a\":1},[2,3]]", 15, 15);
+    check_scan("glued arrays", "[1][2]", 6, 3);
+    check_scan("glued", glued, strlen(glued), 7);
+    check_scan("glued second", glued + 7, strlen(glued + 7), 7);
+    check_scan("glued third", glued + 14, strlen(glued + 14), strlen(glued + 14));
+    check_scan("strings", strings, strlen(strings), strlen(strings));
+    check_scan("leading whitespace", " \r\n\t{}", 6, 6);
+    check_scan("whitespace only", " \n ", 3, 0);
+    check_scan("scalar message", "12 {}", 5, 5);
+    check_scan("truncated", "{\"a\":[1,2", 9, 0);
+    check_scan("truncated in string", "{\"a\":\"}", 7, 0);
+    check_scan("truncated after escape", "{\"a\":\"\\", 7, 0);
+    check_scan("truncated trailing message", "{\"a\":1}{\"b\":", 12, 7);
+    check_scan("truncated trailing only", "{\"b\":", 5, 0);
+    check_block_boundaries();
+    check_random();
+
+    if (failures > 0)
+    {
+        printf("json_rpc_scan: %d failures \n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("json_rpc_scan: all checks passed \n");
+    return EXIT_SUCCESS;
+}
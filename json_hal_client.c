@@ -23,6 +23,8 @@
 #include <unistd.h>
 #include "json_hal_client.h"
 #include "tcp_client.h"
+#include "json_rpc_template.h"
+#include "json_rpc_scan.h"
 #include "utlist.h"
 #include <json-c/json_tokener.h>
 #include <json-c/json_util.h>
@@ -31,11 +33,23 @@
 #define json_tokener_get_parse_end(tok) ((tok)->char_offset)
 #endif
 
-//Ticker timeout for aprox. 10s (40 x 250ms)
-#define SEND_MSG_TICKER_TIMEOUT         40
+//Default request timeout, 10s
+#define SEND_MSG_TIMEOUT_MS             10000
 
+//Upper limit of the request timeout, 120s
+#define SEND_MSG_MAX_TIMEOUT_MS         120000
 
-/* global variable to keep connection state. */
+/* Upper limit of the number of client connections. */
+#define MAX_CLIENT_CONNECTIONS 16
+
+/* Connection the event subscriptions are pinned to, the events are published on it. */
+#define EVENT_CONNECTION 0
+
+/* Let the pool pick the connection of a request. */
+#define ANY_CONNECTION -1
+
+
+/* global variable to keep connection state of the event connection. */
 static int g_connected = FALSE;
 
 /* Global variable which is used as sequence number and returned to client. */
@@ -49,10 +63,12 @@ typedef struct request_msg_tracking_t
     int sequence;                        /* Sequence number of the request message. */
     pthread_mutex_t lock;                /* Mutex lock associated with the request message. */
     pthread_cond_t msg_rcvd;             /* Conditional wait associated with the request message. */
-    char buffer[MAX_BUFFER_SIZE];        /* String holds the request/response message. */
-    int len;                             /* Length of the buffer. */
+    json_object *reply;                  /* Parsed response message, handed over to the caller. */
     int rc;                              /* Return code, RETURN_OK if response got else RETURN_ERR. */
-    int ticker;                          /* Ticket to manage the timeout value. */
+    uint64_t deadline;                   /* Time the request expires at, from json_rpc_client_now_ms(). */
+    int connection;                      /* Index of the connection the request was sent on. */
+    char req_id[BUF_64];                 /* Request id, as sent in the request message. */
+    int cancel;                          /* Flag indicates the request timed out or was cancelled, the server is told to drop it. */
     struct request_msg_tracking_t *next; /* Pointer to the next request in the request's linked list. */
 } request_msg_tracking_t;
 
@@ -67,10 +83,31 @@ typedef struct event_tracking_t
     struct event_tracking_t *next;         /* Pointer to the next request in the request's linked list. */
 } event_tracking_t;
 
+/**
+ * @brief Structure to keep one connection of the client connection pool.
+ */
+typedef struct client_connection_t
+{
+    rpc_client_data_t rpc; /* Socket connection, served by its own client thread. */
+    int connected;         /* Flag indicates the connection is established. */
+    int in_flight;         /* Number of requests waiting for their reply on this connection. */
+} client_connection_t;
+
 /*
- * @brief Global structure object to keep tracking of client socket management.
+ * @brief Global connection pool, requests are spread over the connections.
+ * The in_flight counters are protected by gm_request_msg_tracking_lock.
  */
-static rpc_client_data_t g_rpc_client;
+static client_connection_t *g_connections = NULL;
+
+/*
+ * @brief Number of connections in g_connections.
+ */
+static int g_connection_count = 0;
+
+/*
+ * @brief Connection the search for the least busy connection starts at, so idle connections take turns.
+ */
+static int g_next_connection = 0;
 
 /*
  * @brief Global structure object to keep tracking of client's requests.
@@ -98,10 +135,15 @@ static pthread_mutex_t gm_event_tracking_lock = PTHREAD_MUTEX_INITIALIZER;
 static hal_config_t g_hal_client_config = {0};
 
 /**
- * @brief Callback function to monitor for the timeout expired for the
- * rpc request.
+ * @brief Constant parts of the requests, serialised once the configuration is loaded.
+ */
+static rpc_template_t g_message_template = {0};
+
+/**
+ * @brief Timer callback to expire the rpc requests whose deadline passed.
+ * @return deadline of the next request to expire, 0 if none is pending.
  */
-static int request_idle_cb();
+static uint64_t request_timer_cb(void);
 
 /**
  * @brief Callback which is notfied when a client connection
@@ -123,9 +165,18 @@ static int client_disconnected_cb(const int fd);
  * @param fd of the connected client
  * @param buffer contains the response in json format
  * @param length of the output buffer
+ * @param encoding of the response, text json or MessagePack
+ * @return RETURN_OK if callback executed successfull else return RETURN_ERR
+ */
+static int response_parse_cb(const int fd, const char *buffer, const int len, rpc_codec_t codec);
+
+/**
+ * @brief Hand a received message to the request waiting for it, or to the
+ * callbacks of the event it publishes.
+ * @param json message, owned by the call
  * @return RETURN_OK if callback executed successfull else return RETURN_ERR
  */
-static int response_parse_cb(const int fd, const char *buffer, const int len);
+static int dispatch_message(json_object *jobj);
 
 /**
  * @brief Delete the rpc request from the list.
@@ -136,9 +187,10 @@ static int request_delete_cb(const int sequence);
 
 /**
  * @brief Check the rpc request is expired wthout getting response.
- * @return RETURN_OK if method executed successfull else return RETURN_ERR
+ * @param current time from json_rpc_client_now_ms()
+ * @return deadline of the next request to expire, 0 if none is pending.
  */
-static int request_tracking_cb();
+static uint64_t request_tracking_cb(uint64_t now);
 
 /**
  * @brief Send the json formatted request to server.
@@ -147,7 +199,21 @@ static int request_tracking_cb();
  * @param Json request message
  * @return RETURN_OK if method executed successfull else return RETURN_ERR
  */
-static int json_message_send(const rpc_client_data_t *s, const json_object *jmsg);
+static int json_message_send(rpc_client_data_t *s, const json_object *jmsg);
+
+/**
+ * @brief Find the pool connection a client socket fd belongs to.
+ * @param fd of the client socket
+ * @return index of the connection, RETURN_ERR if none.
+ */
+static int find_connection(const int fd);
+
+/**
+ * @brief Pick the connected connection with the fewest requests in flight
+ * and account the new request to it. gm_request_msg_tracking_lock must be held.
+ * @return index of the connection, EVENT_CONNECTION if none is connected.
+ */
+static int select_connection(void);
 
 /**
  * @brief Get a random number to assign as sequence number for the
@@ -164,6 +230,13 @@ static unsigned int get_req_id();
  */
 static json_object *create_event_subscription_message(const char *event_dml_path, const char *event_notification_type);
 
+/**
+ * @brief Tell the server to drop a request nobody waits for any more.
+ * @param index of the connection the request was sent on
+ * @param request id
+ */
+static void send_cancel(int connection, const char *req_id);
+
 
 /**
  * @brief Send the request message to the server socket, sync the response
@@ -174,13 +247,14 @@ static json_object *create_event_subscription_message(const char *event_dml_path
  * response from the server or timed out happened.
  *
  * @param (IN)  Json object pointing to the request
- * @param (IN)  the message timeout tick
+ * @param (IN)  the message timeout in milliseconds
+ * @param (IN)  index of the connection to use, ANY_CONNECTION to let the pool pick it
  * @param (OUT) Json object stores the response message
  * @return RETURN_OK if message has been send to server and get response from server
  * @note This is a blocking call, and will unblock if client get response from server or
  * timeout happened because no data received from server.
  */
-static int client_send_and_get_reply(const json_object *jrequest_msg, int tick_timeout, json_object **reply_msg);
+static int client_send_and_get_reply(const json_object *jrequest_msg, int timeout_ms, int connection, json_object **reply_msg);
 
 int json_hal_client_init(const char *hal_conf_path)
 {
@@ -197,13 +271,41 @@ int json_hal_client_init(const char *hal_conf_path)
         LOGERROR("Failed to initialize client library \n");
         return ret;
     }
-    g_hal_client_config.request_timeout_period = IDLE_TIMEOUT_PERIOD;
-    g_rpc_client.port = g_hal_client_config.server_port_number;
-    strcpy(g_rpc_client.host, SERVER_HOST);
-    g_rpc_client.func_idle = request_idle_cb;
-    g_rpc_client.func_connected = client_connected_cb;
-    g_rpc_client.func_disconnected = client_disconnected_cb;
-    g_rpc_client.func_parse = response_parse_cb;
+
+    /* Without it the requests are encoded as a whole, it is not fatal. */
+    json_rpc_template_free(&g_message_template);
+    if (json_rpc_template_init(&g_message_template, g_hal_client_config.hal_module_name, g_hal_client_config.hal_module_version) != RETURN_OK)
+    {
+        LOGERROR("Failed to prepare the message template \n");
+    }
+
+    g_connection_count = g_hal_client_config.client_connections;
+    if (g_connection_count > MAX_CLIENT_CONNECTIONS)
+    {
+        g_connection_count = MAX_CLIENT_CONNECTIONS;
+    }
+    g_connections = (client_connection_t *)calloc(g_connection_count, sizeof(client_connection_t));
+    if (g_connections == NULL)
+    {
+        LOGERROR("Failed to allocate the client connections \n");
+        g_connection_count = 0;
+        return RETURN_ERR;
+    }
+    for (int i = 0; i < g_connection_count; ++i)
+    {
+        rpc_client_data_t *client = &g_connections[i].rpc;
+        client->port = g_hal_client_config.server_port_number;
+        client->framing = g_hal_client_config.message_framing;
+        strncpy(client->socket_path, g_hal_client_config.server_socket_path, sizeof(client->socket_path) - 1);
+        client->shm_ring_size = g_hal_client_config.shared_memory_ring_size;
+        client->codec_offer = (rpc_codec_t)g_hal_client_config.wire_encoding;
+        strcpy(client->host, SERVER_HOST);
+        /* Only one thread expires the requests, their deadlines arm its timer. */
+        client->func_timer = (i == EVENT_CONNECTION) ? request_timer_cb : NULL;
+        client->func_connected = client_connected_cb;
+        client->func_disconnected = client_disconnected_cb;
+        client->func_parse = response_parse_cb;
+    }
 
     return ret;
 }
@@ -211,35 +313,86 @@ int json_hal_client_init(const char *hal_conf_path)
 int json_hal_client_run()
 {
     int rc = RETURN_OK;
-    rc = json_rpc_client_run(&g_rpc_client);
-    if (rc != RETURN_OK)
+    for (int i = 0; i < g_connection_count && rc == RETURN_OK; ++i)
     {
-        LOGERROR("Failed to start client socket thread");
+        rc = json_rpc_client_run(&g_connections[i].rpc);
+        if (rc != RETURN_OK)
+        {
+            LOGERROR("Failed to start client socket thread %d", i);
+        }
     }
     return rc;
 }
 
-static int request_idle_cb()
+static uint64_t request_timer_cb(void)
 {
-    request_tracking_cb();
-    usleep(g_hal_client_config.request_timeout_period);
-    return RETURN_OK;
+    return request_tracking_cb(json_rpc_client_now_ms());
 }
 
 static int client_connected_cb(const int fd)
 {
+    int connection = find_connection(fd);
+
     LOGINFO("connect on fd=%d", fd);
-    g_connected = TRUE;
+    if (connection >= 0)
+    {
+        g_connections[connection].connected = TRUE;
+    }
+    if (connection == EVENT_CONNECTION)
+    {
+        g_connected = TRUE;
+    }
     return RETURN_OK;
 }
 
 static int client_disconnected_cb(const int fd)
 {
+    int connection = find_connection(fd);
+
     LOGINFO("disconnected on fd=%d", fd);
-    g_connected = FALSE;
+    if (connection >= 0)
+    {
+        g_connections[connection].connected = FALSE;
+    }
+    if (connection == EVENT_CONNECTION)
+    {
+        g_connected = FALSE;
+    }
     return RETURN_OK;
 }
 
+static int find_connection(const int fd)
+{
+    for (int i = 0; i < g_connection_count; ++i)
+    {
+        if (g_connections[i].rpc.sock == fd)
+        {
+            return i;
+        }
+    }
+    return RETURN_ERR;
+}
+
+static int select_connection(void)
+{
+    int selected = EVENT_CONNECTION;
+    int found = FALSE;
+
+    for (int n = 0; n < g_connection_count; ++n)
+    {
+        int i = (g_next_connection + n) % g_connection_count;
+        if (g_connections[i].connected == TRUE &&
+            (found == FALSE || g_connections[i].in_flight < g_connections[selected].in_flight))
+        {
+            selected = i;
+            found = TRUE;
+        }
+    }
+    g_next_connection = (selected + 1) % g_connection_count;
+    g_connections[selected].in_flight++;
+    return selected;
+}
+
 #ifdef JSON_BLOCKING_SUBSCRIBE_EVENT
 /**
  * @brief Enum to identify the response type for the request.
@@ -327,7 +480,7 @@ static inline void get_token(json_tokener **pp_token)
 
     return;
 }
-static int response_parse_cb(const int fd, const char *buffer, const int len)
+static int response_parse_cb(const int fd, const char *buffer, const int len, rpc_codec_t codec)
 {
 
     if (NULL == buffer)
@@ -336,15 +489,22 @@ static int response_parse_cb(const int fd, const char *buffer, const int len)
         return RETURN_ERR;
     }
 
-    json_object *returnObj = NULL;
-    int id = 0;
-    const char *action_name = NULL;
     json_tokener* tok = NULL;
     json_object* jobj = NULL;
-    const char *event_buf = NULL;
-    int event_buf_len = 0;
-    int parse_end_expected = len;
-    char* aterr = "";
+    size_t start_pos = 0;
+    size_t message_len = 0;
+
+    if (codec == RPC_CODEC_MSGPACK)
+    {
+        /* One MessagePack message per frame or ring entry. */
+        jobj = json_rpc_codec_decode(buffer, len);
+        if (jobj == NULL)
+        {
+            LOGERROR("Invalid MessagePack message of %d bytes\n", len);
+            return RETURN_ERR;
+        }
+        return dispatch_message(jobj);
+    }
 
     get_token(&tok);
     if (NULL == tok)
@@ -353,193 +513,181 @@ static int response_parse_cb(const int fd, const char *buffer, const int len)
         return RETURN_ERR;
     }
 
-    int start_pos = 0;
-    while (start_pos != len)
+    /* JSON messages glued together are split first, each one is parsed once. */
+    while ((message_len = json_rpc_scan_message(&buffer[start_pos], len - start_pos)) > 0)
     {
-        jobj = json_tokener_parse_ex(tok, &buffer[start_pos], parse_end_expected - start_pos);
-        enum json_tokener_error jerr = json_tokener_get_error(tok);
-        int parse_end = json_tokener_get_parse_end(tok);
-        aterr = (start_pos + parse_end < parse_end_expected)
-            ? &buffer[start_pos + parse_end]
-            : "";
-
-        /* If JSON messages glue together, need to parse multiple messages from one buffer */
-        if ((jobj == NULL) &&
-            (jerr == json_tokener_error_parse_unexpected) &&
-            (aterr[0]=='{'))
+        jobj = json_tokener_parse_ex(tok, &buffer[start_pos], message_len);
+        if (jobj == NULL)
         {
-            parse_end_expected = parse_end;
-            LOGERROR("Continue to parse again from %d to %d with new token",
-                start_pos, parse_end_expected);
+            enum json_tokener_error jerr = json_tokener_get_error(tok);
+            LOGERROR("Failed at offset %d: %s\n", (int)(start_pos + json_tokener_get_parse_end(tok)), json_tokener_error_desc(jerr));
             json_tokener_free(tok);
-            get_token(&tok);
-            if (NULL == tok)
-            {
-                LOGERROR("Invalid token\n");
-                return RETURN_ERR;
-            }
-            continue;
+            return RETURN_ERR;
         }
-        else if (jobj == NULL && jerr != json_tokener_continue)
+        json_tokener_reset(tok);
+
+        if (dispatch_message(jobj) != RETURN_OK)
         {
-            fflush(stdout);
-            int fail_offset = start_pos + parse_end;
-            LOGERROR("Failed at offset %d: %s %c\n", fail_offset, json_tokener_error_desc(jerr), aterr[0]);
             json_tokener_free(tok);
             return RETURN_ERR;
         }
+        start_pos += message_len;
+    }
+
+    json_tokener_free(tok);
+    return RETURN_OK;
+}
 
-        if (jobj != NULL)
+static int dispatch_message(json_object *jobj)
+{
+    json_object *returnObj = NULL;
+    int id = 0;
+    const char *action_name = NULL;
+    const char *event_buf = NULL;
+    int event_buf_len = 0;
+
+    /**
+     * Parse the response json message to identify event publish or response
+     * for rpc request. In case of event `"action": "publishEvent"` is contained
+     * in the response message. In case of event, invoke the registered callback function.
+     *
+     */
+    if (json_object_object_get_ex(jobj, JSON_RPC_FIELD_ACTION, &returnObj))
+    {
+        action_name = json_object_get_string(returnObj);
+        if (strncmp(action_name, JSON_RPC_PUBLISH_EVENT_ACTION_NAME, strlen(JSON_RPC_PUBLISH_EVENT_ACTION_NAME)) == 0)
         {
+            LOGINFO("Event response found");
+            json_object* jevent_msg_param = NULL;
+
             /**
-             * Parse the response json message to identify event publish or response
-             * for rpc request. In case of event `"action": "publishEvent"` is contained
-             * in the response message. In case of event, invoke the registered callback function.
-             *
+             * Parse `params` field, find the event name. Compare event  name with susbcribed
+             * list and invoke callback if a match found.
              */
-            if (json_object_object_get_ex(jobj, JSON_RPC_FIELD_ACTION, &returnObj))
+            if (json_object_object_get_ex(jobj, JSON_RPC_FIELD_PARAMS, &jevent_msg_param))
             {
-                action_name = json_object_get_string(returnObj);
-                if (strncmp(action_name, JSON_RPC_PUBLISH_EVENT_ACTION_NAME, strlen(JSON_RPC_PUBLISH_EVENT_ACTION_NAME)) == 0)
+                json_object* jevent_param_array = json_object_array_get_idx(jevent_msg_param, JSON_RPC_PARAM_ARR_INDEX);
+                json_object* jevent_msg_param_val = NULL;
+                if (json_object_object_get_ex(jevent_param_array, JSON_RPC_FIELD_PARAM_NAME, &jevent_msg_param_val))
                 {
-                    LOGINFO("Event response found");
-                    json_object* jevent_msg_param = NULL;
-
-                    /**
-                     * Parse `params` field, find the event name. Compare event  name with susbcribed
-                     * list and invoke callback if a match found.
-                     */
-                    if (json_object_object_get_ex(jobj, JSON_RPC_FIELD_PARAMS, &jevent_msg_param))
+                    char event_name[BUF_512] = { '\0' };
+                    strncpy(event_name, json_object_get_string(jevent_msg_param_val), sizeof(event_name));
+                    LOGINFO("Event name = %s", event_name);
+                    event_tracking_t* events = NULL;
+                    pthread_mutex_lock(&gm_event_tracking_lock);
+                    LL_FOREACH(g_event_tracking, events)
                     {
-                        json_object* jevent_param_array = json_object_array_get_idx(jevent_msg_param, JSON_RPC_PARAM_ARR_INDEX);
-                        json_object* jevent_msg_param_val = NULL;
-                        if (json_object_object_get_ex(jevent_param_array, JSON_RPC_FIELD_PARAM_NAME, &jevent_msg_param_val))
+                        if (!strncmp(events->event_name, event_name, strlen(event_name)))
                         {
-                            char event_name[BUF_512] = { '\0' };
-                            strncpy(event_name, json_object_get_string(jevent_msg_param_val), sizeof(event_name));
-                            LOGINFO("Event name = %s", event_name);
-                            event_tracking_t* events = NULL;
-                            pthread_mutex_lock(&gm_event_tracking_lock);
-                            LL_FOREACH(g_event_tracking, events)
+                            if (events->event_cb != NULL)
                             {
-                                if (!strncmp(events->event_name, event_name, strlen(event_name)))
-                                {
-                                    if (events->event_cb != NULL)
-                                    {
-                                        LOGINFO("Event callback invoked");
-                                        event_buf = json_object_to_json_string_ext(jobj, JSON_C_TO_STRING_PRETTY);
-                                        event_buf_len = strlen(event_buf);
+                                LOGINFO("Event callback invoked");
+                                event_buf = json_object_to_json_string_ext(jobj, json_hal_get_wire_flags(g_hal_client_config.wire_format));
+                                event_buf_len = strlen(event_buf);
 #ifdef DEBUG_ENABLED
-                                        LOGINFO("Event Msg = %s \n", event_buf);
+                                LOGINFO("Event Msg = %s \n", event_buf);
 #endif
-                                        events->event_cb(event_buf, event_buf_len);
-                                        event_buf = NULL; // reset buffer.
+                                events->event_cb(event_buf, event_buf_len);
+                                event_buf = NULL; // reset buffer.
 
 #ifdef JSON_BLOCKING_SUBSCRIBE_EVENT
-                                        /**
-                                         * Notify the result back to requester.
-                                         */
-                                        /* Retrieve message request id (sequence number). */
-                                        if (!json_object_object_get_ex(jobj, JSON_RPC_FIELD_ID, &returnObj))
-                                        {
-                                            LOGERROR("Json request doesn't have sequence number/id.");
-                                            json_object_put(jobj);
-                                            continue;
-                                        }
-                                        
-                                        /* Get reqid. */
-                                        char req_id[BUF_64] = {'\0'};
-                                        strncpy(req_id, json_object_get_string(returnObj), sizeof(req_id));
-                                         
-                                         
-                                        json_object *jreply_msg = create_json_reply_event_msg(event_name, req_id, RESPONSE_SUCCESS);
-                                        if(json_message_send(&g_rpc_client, jreply_msg) != RETURN_OK)
-                                        {
-                                            LOGERROR("Failed to send the data to client \n");
-                                        }
-
-                                        json_object_put(jreply_msg);
+                                /**
+                                 * Notify the result back to requester.
+                                 */
+                                /* Retrieve message request id (sequence number). */
+                                if (!json_object_object_get_ex(jobj, JSON_RPC_FIELD_ID, &returnObj))
+                                {
+                                    LOGERROR("Json request doesn't have sequence number/id.");
+                                    json_object_put(jobj);
+                                    continue;
+                                }
+                                
+                                /* Get reqid. */
+                                char req_id[BUF_64] = {'\0'};
+                                strncpy(req_id, json_object_get_string(returnObj), sizeof(req_id));
+                                 
+                                 
+                                json_object *jreply_msg = create_json_reply_event_msg(event_name, req_id, RESPONSE_SUCCESS);
+                                if(json_message_send(&g_connections[EVENT_CONNECTION].rpc, jreply_msg) != RETURN_OK)
+                                {
+                                    LOGERROR("Failed to send the data to client \n");
+                                }
+
+                                json_object_put(jreply_msg);
 #endif //JSON_BLOCKING_SUBSCRIBE_EVENT
 
-                                    }
-                                }
                             }
-                            pthread_mutex_unlock(&gm_event_tracking_lock);
                         }
                     }
-                    else
-                    {
-                        LOGERROR("not found any event subscription for this event");
-                    }
+                    pthread_mutex_unlock(&gm_event_tracking_lock);
                 }
-                else
+            }
+            else
+            {
+                LOGERROR("not found any event subscription for this event");
+            }
+        }
+        else
+        {
+            /* Response for RPC  request. */
+            if (json_object_object_get_ex(jobj, JSON_RPC_FIELD_ID, &returnObj))
+            {
+                id = (int)strtol(json_object_get_string(returnObj), NULL, 16);
+            }
+            else
+            {
+                json_object_put(jobj);
+                return RETURN_ERR;
+            }
+            /* Check for the list to identify the rpc request
+            * and if a matching id found, fill its buffer with response
+            * and send the msg_rcd signal.
+            */
+            pthread_mutex_lock(&gm_request_msg_tracking_lock);
+            request_msg_tracking_t* tmp, * rpc;
+            LL_FOREACH_SAFE(g_request_msg_tracking, rpc, tmp)
+            {
+                if (rpc->sequence == id)
                 {
-                    /* Response for RPC  request. */
-                    if (json_object_object_get_ex(jobj, JSON_RPC_FIELD_ID, &returnObj))
-                    {
-                        id = (int)strtol(json_object_get_string(returnObj), NULL, 16);
-                    }
-                    else
-                    {
-                        json_object_put(jobj);
-                        json_tokener_free(tok);
-                        return RETURN_ERR;
-                    }
-                    /* Check for the list to identify the rpc request
-                    * and if a matching id found, fill its buffer with response
-                    * and send the msg_rcd signal.
-                    */
-                    pthread_mutex_lock(&gm_request_msg_tracking_lock);
-                    request_msg_tracking_t* tmp, * rpc;
-                    LL_FOREACH_SAFE(g_request_msg_tracking, rpc, tmp)
-                    {
-                        if (rpc->sequence == id)
-                        {
-                            LL_DELETE(g_request_msg_tracking, rpc);
-                            memset(rpc->buffer, 0, len + 1);
-                            strncpy(rpc->buffer, buffer, len);
-                            rpc->rc = RETURN_OK;
-                            rpc->len = len;
-                            pthread_mutex_lock(&rpc->lock);
-                            pthread_cond_signal(&rpc->msg_rcvd);
-                            pthread_mutex_unlock(&rpc->lock);
-                            break;
-                        }
-                    }
-                    pthread_mutex_unlock(&gm_request_msg_tracking_lock);
+                    LL_DELETE(g_request_msg_tracking, rpc);
+                    /* Hand the parsed reply over to the caller instead of copying the raw buffer. */
+                    rpc->reply = json_object_get(jobj);
+                    rpc->rc = RETURN_OK;
+                    pthread_mutex_lock(&rpc->lock);
+                    pthread_cond_signal(&rpc->msg_rcvd);
+                    pthread_mutex_unlock(&rpc->lock);
+                    break;
                 }
             }
-            json_object_put(jobj);
-        } /* End of jobj != NULL */
-
-        start_pos += json_tokener_get_parse_end(tok);
-        parse_end_expected = len;
-        if (start_pos >= len)
-        {
-            json_tokener_free(tok);
-            return RETURN_OK;
+            pthread_mutex_unlock(&gm_request_msg_tracking_lock);
         }
-    } /* End of while */
-
-    json_tokener_free(tok);
+    }
+    json_object_put(jobj);
     return RETURN_OK;
 }
 
 
 /* Keep tracking the requests whether its getting a response within a timeout period,
  * else unlock its mutex and returned. */
-static int request_tracking_cb()
+static uint64_t request_tracking_cb(uint64_t now)
 {
     request_msg_tracking_t *tmp, *rpc;
+    uint64_t next = 0;
     pthread_mutex_lock(&gm_request_msg_tracking_lock);
     LL_FOREACH_SAFE(g_request_msg_tracking, rpc, tmp)
     {
-        rpc->ticker--;
-        if (rpc->ticker <= 0)
+        if (rpc->deadline > now)
+        {
+            if (next == 0 || rpc->deadline < next)
+            {
+                next = rpc->deadline;
+            }
+        }
+        else
         {
             LL_DELETE(g_request_msg_tracking, rpc);
             rpc->rc = RETURN_ERR;
-            rpc->len = INVALD_LENGTH;
+            rpc->cancel = TRUE;
             pthread_mutex_lock(&rpc->lock);
             pthread_cond_signal(&rpc->msg_rcvd);
             pthread_mutex_unlock(&rpc->lock);
@@ -548,7 +696,7 @@ static int request_tracking_cb()
         }
     }
     pthread_mutex_unlock(&gm_request_msg_tracking_lock);
-    return RETURN_OK;
+    return next;
 }
 
 /* Delete the rpc request from the list. */
@@ -582,16 +730,12 @@ static int request_delete_cb(const int sequence)
  */
 int json_hal_client_send_and_get_reply_with_timeout(const json_object *jrequest_msg, int timeout, json_object **reply_msg)
 {
-	int tick = (timeout*1000000)/LOOP_TIMEOUT;
-	if(tick < SEND_MSG_TICKER_TIMEOUT)
-	{
-		tick = SEND_MSG_TICKER_TIMEOUT;
-	}
-	else if(tick > 480 )/*120s*/
+	int timeout_ms = (timeout > SEND_MSG_MAX_TIMEOUT_MS / 1000) ? SEND_MSG_MAX_TIMEOUT_MS : timeout * 1000;
+	if(timeout_ms < SEND_MSG_TIMEOUT_MS)
 	{
-		tick = 480;
+		timeout_ms = SEND_MSG_TIMEOUT_MS;
 	}
-	return client_send_and_get_reply(jrequest_msg,tick,reply_msg);
+	return client_send_and_get_reply(jrequest_msg,timeout_ms,ANY_CONNECTION,reply_msg);
 }
 
 /**
@@ -607,7 +751,7 @@ int json_hal_client_send_and_get_reply_with_timeout(const json_object *jrequest_
  */
 int json_hal_client_send_and_get_reply(const json_object *jrequest_msg, json_object **reply_msg)
 {
-	return client_send_and_get_reply(jrequest_msg,SEND_MSG_TICKER_TIMEOUT,reply_msg);
+	return client_send_and_get_reply(jrequest_msg,SEND_MSG_TIMEOUT_MS,ANY_CONNECTION,reply_msg);
 }
 
 /**
@@ -621,11 +765,17 @@ int json_hal_client_send_and_get_reply(const json_object *jrequest_msg, json_obj
  * Internally it maintains a mutex lock and send the data to server. This mutex
  * lock unlocked once we get response from server or when the timeout period expired.
  */
-static int client_send_and_get_reply(const json_object *jrequest_msg, int tick_timeout, json_object **reply_msg)
+static int client_send_and_get_reply(const json_object *jrequest_msg, int timeout_ms, int connection, json_object **reply_msg)
 {
     POINTER_ASSERT(jrequest_msg != NULL);
+    if (g_connection_count == 0)
+    {
+        LOGERROR("Client library is not initialized \n");
+        return RETURN_ERR;
+    }
 
     request_msg_tracking_t *rpc;
+    json_object *jsent_msg = NULL;
     int rc = RETURN_ERR;
 
     rpc = (request_msg_tracking_t *)calloc(1, sizeof(request_msg_tracking_t));
@@ -640,6 +790,7 @@ static int client_send_and_get_reply(const json_object *jrequest_msg, int tick_t
     if (json_object_object_get_ex(jrequest_msg, JSON_RPC_FIELD_ID, &jrequest_msg_param))
     {
         request_msg_req_id = (int)strtol(json_object_get_string(jrequest_msg_param), NULL, 16);
+        strncpy(rpc->req_id, json_object_get_string(jrequest_msg_param), sizeof(rpc->req_id) - 1);
     }
     else
     {
@@ -656,15 +807,43 @@ static int client_send_and_get_reply(const json_object *jrequest_msg, int tick_t
     rpc->sequence = request_msg_req_id;
 
     //Timeout period.
-    rpc->ticker = tick_timeout;
+    rpc->deadline = json_rpc_client_now_ms() + timeout_ms;
     rpc->rc = RETURN_ERR;
+    /* The server drops the request once nobody waits for its reply, client and server share the clock.
+     * The deadline goes in a copy sharing the members of the request, the caller's is left as it is. */
+    jsent_msg = json_object_new_object();
+    POINTER_ASSERT(jsent_msg != NULL);
+    json_object_object_foreach((json_object *)jrequest_msg, key, value)
+    {
+        json_object_object_add(jsent_msg, key, json_object_get(value));
+    }
+    json_object_object_add(jsent_msg, JSON_RPC_FIELD_DEADLINE, json_object_new_int64((int64_t)rpc->deadline));
 
+    pthread_mutex_lock(&gm_request_msg_tracking_lock);
+    if (connection == ANY_CONNECTION)
+    {
+        connection = select_connection();
+    }
+    else
+    {
+        g_connections[connection].in_flight++;
+    }
+    rpc->connection = connection;
     LL_APPEND(g_request_msg_tracking, rpc);
+    pthread_mutex_unlock(&gm_request_msg_tracking_lock);
+    json_rpc_client_set_timer(&g_connections[EVENT_CONNECTION].rpc, rpc->deadline);
 
-    rc = json_message_send(&g_rpc_client, jrequest_msg);
+    rc = json_message_send(&g_connections[connection].rpc, jsent_msg);
+    json_object_put(jsent_msg);
     if (rc != RETURN_OK)
     {
         LOGERROR("Failed to send the request to server");
+        pthread_mutex_lock(&gm_request_msg_tracking_lock);
+        if (connection < g_connection_count)
+        {
+            g_connections[connection].in_flight--;
+        }
+        pthread_mutex_unlock(&gm_request_msg_tracking_lock);
         pthread_mutex_unlock(&rpc->lock);
         pthread_mutex_destroy(&rpc->lock);
         pthread_cond_destroy(&rpc->msg_rcvd);
@@ -683,12 +862,24 @@ static int client_send_and_get_reply(const json_object *jrequest_msg, int tick_t
     pthread_mutex_destroy(&rpc->lock);
     pthread_cond_destroy(&rpc->msg_rcvd);
     request_delete_cb(request_msg_req_id);
+    pthread_mutex_lock(&gm_request_msg_tracking_lock);
+    if (connection < g_connection_count)
+    {
+        g_connections[connection].in_flight--;
+    }
+    pthread_mutex_unlock(&gm_request_msg_tracking_lock);
+
+    /* Sent from the calling thread, the client thread does not block on it. */
+    if (rpc->cancel == TRUE && connection < g_connection_count)
+    {
+        send_cancel(connection, rpc->req_id);
+    }
 
     rc = rpc->rc;
     /* Got response and fill it back for requester. */
     if (rpc->rc >= 0)
     {
-        *reply_msg = json_tokener_parse(rpc->buffer);
+        *reply_msg = rpc->reply;
     }
     else
     {
@@ -702,6 +893,48 @@ static int client_send_and_get_reply(const json_object *jrequest_msg, int tick_t
     }
     return rc;
 }
+int json_hal_client_cancel(const char *req_id)
+{
+    POINTER_ASSERT(req_id != NULL);
+    request_msg_tracking_t *tmp, *rpc;
+    int sequence = (int)strtol(req_id, NULL, 16);
+    int rc = RETURN_ERR;
+
+    pthread_mutex_lock(&gm_request_msg_tracking_lock);
+    LL_FOREACH_SAFE(g_request_msg_tracking, rpc, tmp)
+    {
+        if (rpc->sequence == sequence)
+        {
+            LL_DELETE(g_request_msg_tracking, rpc);
+            rpc->rc = RETURN_ERR;
+            rpc->cancel = TRUE;
+            pthread_mutex_lock(&rpc->lock);
+            pthread_cond_signal(&rpc->msg_rcvd);
+            pthread_mutex_unlock(&rpc->lock);
+            rc = RETURN_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&gm_request_msg_tracking_lock);
+    return rc;
+}
+
+static void send_cancel(int connection, const char *req_id)
+{
+    json_object *jmsg = json_hal_client_get_request_header(JSON_RPC_ACTION_CANCEL);
+    json_object *jparams = NULL;
+    json_object *jparam = json_object_new_object();
+
+    json_object_object_add(jparam, JSON_RPC_FIELD_PARAM_NAME, json_object_new_string(req_id));
+    json_object_object_get_ex(jmsg, JSON_RPC_FIELD_PARAMS, &jparams);
+    json_object_array_add(jparams, jparam);
+    if (json_message_send(&g_connections[connection].rpc, jmsg) != RETURN_OK)
+    {
+        LOGERROR("Failed to cancel request [%s] \n", req_id);
+    }
+    json_object_put(jmsg);
+}
+
 /* Event callback register. */
 int json_hal_client_subscribe_event(event_callback eventcb, const char *event_path_name, const char *event_notification_type)
 {
@@ -714,7 +947,8 @@ int json_hal_client_subscribe_event(event_callback eventcb, const char *event_pa
     POINTER_ASSERT(jsubs_msg != NULL);
 
     LOGINFO("Event subscription message = %s", json_object_to_json_string_ext(jsubs_msg, JSON_C_TO_STRING_PRETTY));
-    rc = json_hal_client_send_and_get_reply(jsubs_msg, &reply_msg);
+    /* The server publishes the event on the connection the subscription came from. */
+    rc = client_send_and_get_reply(jsubs_msg, SEND_MSG_TIMEOUT_MS, EVENT_CONNECTION, &reply_msg);
     if (rc < 0)
     {
         LOGERROR("Failed to subscribe event %s \n", event_path_name);
@@ -753,8 +987,11 @@ int json_hal_is_client_connected()
 int json_hal_client_terminate()
 {
 
-    /* Stop client socket thread. */
-    g_rpc_client.RUNNING = FALSE;
+    /* Stop client socket threads. */
+    for (int i = 0; i < g_connection_count; ++i)
+    {
+        json_rpc_client_stop(&g_connections[i].rpc);
+    }
 
     /**
      * Make sure server thread stopped and closed all client sockets.
@@ -791,6 +1028,19 @@ int json_hal_client_terminate()
         free(g_request_msg_tracking);
         g_request_msg_tracking = NULL;
     }
+
+    /* The connections are only released once their threads exited. */
+    if (json_rpc_client_is_running() == FALSE)
+    {
+        for (int i = 0; i < g_connection_count; ++i)
+        {
+            pthread_mutex_destroy(&g_connections[i].rpc.send_lock);
+        }
+        free(g_connections);
+        g_connections = NULL;
+        g_connection_count = 0;
+        json_rpc_template_free(&g_message_template);
+    }
     pthread_mutex_unlock(&gm_request_msg_tracking_lock);
 
     /* Delete event subscription list. */
@@ -815,24 +1065,37 @@ int json_hal_client_terminate()
     return RETURN_OK;
 }
 
-static int json_message_send(const rpc_client_data_t *client_sock, const json_object *jmsg)
+static int json_message_send(rpc_client_data_t *client_sock, const json_object *jmsg)
 {
 
     POINTER_ASSERT(jmsg != NULL);
     POINTER_ASSERT(client_sock != NULL);
 
-    const char *response_msg_buffer = NULL;
+    rpc_frame_buffer_t buf;
+    rpc_codec_t codec = RPC_CODEC_JSON;
     int rc = RETURN_ERR;
-    response_msg_buffer = json_object_to_json_string_ext(jmsg, JSON_C_TO_STRING_PRETTY);
-    POINTER_ASSERT(response_msg_buffer != NULL);
+#ifdef DEBUG_ENABLED
+    /* Before the wire string, both share the buffer of the message. */
+    LOGINFO("Message sent = %s \n", json_object_to_json_string_ext((json_object *)jmsg, JSON_C_TO_STRING_PRETTY));
+#endif
+    if (client_sock->RUNNING != TRUE)
+    {
+        return rc;
+    }
 
-    if (client_sock->RUNNING == TRUE)
+    /* Switched by the client thread, a message encoded just before is sent with its own encoding. */
+    codec = __atomic_load_n(&client_sock->codec, __ATOMIC_RELAXED);
+    memset(&buf, 0, sizeof(buf));
+    rc = json_rpc_template_encode(&g_message_template, (json_object *)jmsg, codec,
+                                  json_hal_get_wire_flags(g_hal_client_config.wire_format), &buf);
+    if (rc == RETURN_OK)
     {
-        rc = json_rpc_client_send_data(client_sock->sock, response_msg_buffer);
-        if (rc != RETURN_OK)
-        {
-            LOGERROR("Failed to send the request to server");
-        }
+        rc = json_rpc_client_send_message(client_sock, buf.data, buf.len, codec);
+    }
+    json_rpc_frame_buffer_free(&buf);
+    if (rc != RETURN_OK)
+    {
+        LOGERROR("Failed to send the request to server");
     }
     return rc;
 }
@@ -911,6 +1174,24 @@ int json_hal_get_result_status(const json_object *jobj, json_bool *status)
         return RETURN_ERR;
     }
 
+    eResult_t result = RESULT_FAILURE;
+    int rc = json_hal_get_result(jobj, &result);
+
+    if (rc == RETURN_OK)
+    {
+        *status = (result == RESULT_SUCCESS) ? TRUE : FALSE;
+    }
+    return rc;
+}
+
+int json_hal_get_result(const json_object *jobj, eResult_t *result)
+{
+    if (jobj == NULL || result == NULL)
+    {
+        LOGERROR("Invalid argument");
+        return RETURN_ERR;
+    }
+
     int rc = RETURN_ERR;
     json_object *jreturnObj = NULL;
 
@@ -919,14 +1200,22 @@ int json_hal_get_result_status(const json_object *jobj, json_bool *status)
         json_object *jresult = NULL;
         if (json_object_object_get_ex(jreturnObj, JSON_RPC_PARAM_STATUS_FIELD, &jresult))
         {
-            const char *result = json_object_get_string(jresult);
-            if (strncmp(result, JSON_RPC_STATUS_SUCCESS, strlen(JSON_RPC_STATUS_SUCCESS)) == 0)
+            const char *status = json_object_get_string(jresult);
+            if (strncmp(status, JSON_RPC_STATUS_SUCCESS, strlen(JSON_RPC_STATUS_SUCCESS)) == 0)
+            {
+                *result = RESULT_SUCCESS;
+            }
+            else if (strcmp(status, JSON_RPC_STATUS_BUSY) == 0)
+            {
+                *result = RESULT_BUSY;
+            }
+            else if (strcmp(status, JSON_RPC_STATUS_NOT_SUPPORTED) == 0)
             {
-                *status = TRUE;
+                *result = RESULT_NOT_SUPPORTED;
             }
             else
             {
-                *status = FALSE;
+                *result = RESULT_FAILURE;
             }
 
             rc = RETURN_OK;
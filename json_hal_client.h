@@ -73,7 +73,9 @@ int json_hal_client_run ();
  * @param (OUT) Json object stores the response message
  * @return RETURN_OK if message has been send to server and get response from server
  * @note This is a blocking call, and will unblock if client get response from server or
- * timeout happened because no data received from server.
+ * timeout happened because no data received from server. The request is stamped with
+ * a `deadline` field at the end of the timeout, the server does not run it any more
+ * past that time.
  */
 int json_hal_client_send_and_get_reply(const json_object *request, json_object** reply);
 
@@ -90,7 +92,9 @@ int json_hal_client_send_and_get_reply(const json_object *request, json_object**
  * @param (OUT) Json object stores the response message
  * @return RETURN_OK if message has been send to server and get response from server
  * @note This is a blocking call, and will unblock if client get response from server or
- * timeout happened because no data received from server.
+ * timeout happened because no data received from server. The request is stamped with
+ * a `deadline` field at the end of the timeout, the server does not run it any more
+ * past that time.
  */
 int json_hal_client_send_and_get_reply_with_timeout(const json_object *jrequest_msg, int timeout, json_object **reply_msg);
 /**
@@ -115,6 +119,18 @@ json_object *json_hal_client_get_request_header(const char *action_name);
  */
 int json_hal_client_subscribe_event(event_callback callback, const char* event_name, const char* event_notification_type);
 
+/**
+ * @brief Cancel a request waiting for its reply.
+ *
+ * The caller blocked in json_hal_client_send_and_get_reply() for this request returns
+ * RETURN_ERR, and the server is told to drop the request. A request that timed out is
+ * cancelled on the server the same way.
+ *
+ * @param (IN) reqId of the request
+ * @return RETURN_OK if the request was waiting for its reply else RETURN_ERR.
+ */
+int json_hal_client_cancel(const char *req_id);
+
 /**
  * @brief Clean up function
  *
@@ -143,6 +159,16 @@ int json_hal_is_client_connected();
  */
 int json_hal_get_result_status(const json_object *json_msg, json_bool *status);
 
+/**
+ * @brief Get the status of a Result message.
+ * @param (IN) json_msg  - Json message
+ * @param (OUT) result - RESULT_SUCCESS, RESULT_BUSY when the server turned the request
+ *        down for the limits of its action and it can be retried later, RESULT_NOT_SUPPORTED
+ *        when the server has no callback for the action, RESULT_FAILURE for any other status
+ * @return RETURN_OK in success case else RETURN_ERR.
+ */
+int json_hal_get_result(const json_object *json_msg, eResult_t *result);
+
 /**
  * @brief Application can use this API to get
  *        total number of params embedded in json request/response
@@ -18,6 +18,7 @@
 */
 
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include "json_hal_common.h"
@@ -141,6 +142,144 @@ int json_hal_get_param(json_object *jmsg, int index, eActionType action, hal_par
     return RETURN_OK;
 }
 
+/**
+ * @brief Type names of the params, in the order json_hal_get_param() checks them.
+ */
+static const struct
+{
+    const char *name;
+    eParamType type;
+} g_param_types[] = {
+    {JSON_RPC_FIELD_TYPE_STRING, PARAM_STRING},
+    {JSON_RPC_FIELD_TYPE_HEX_BINARY, PARAM_HEXBINARY},
+    {JSON_RPC_FIELD_TYPE_BASE64, PARAM_BASE64},
+    {JSON_RPC_FIELD_TYPE_BOOLEAN, PARAM_BOOLEAN},
+    {JSON_RPC_FIELD_TYPE_INTEGER, PARAM_INTEGER},
+    {JSON_RPC_FIELD_TYPE_UNSIGNED_INTEGER, PARAM_UNSIGNED_INTEGER},
+    {JSON_RPC_FIELD_TYPE_LONG, PARAM_LONG},
+    {JSON_RPC_FIELD_TYPE_UNSIGNED_LONG, PARAM_UNSIGNED_LONG},
+};
+
+int json_hal_get_param_view(json_object *jmsg, int index, eActionType action, hal_param_view_t *view)
+{
+    json_object *jparams = NULL;
+    json_object *jparam = NULL;
+    json_object *jname = NULL;
+    json_object *jtype = NULL;
+    json_object *jvalue = NULL;
+    const char *param_type = NULL;
+
+    if (jmsg == NULL || view == NULL)
+    {
+        return RETURN_ERR;
+    }
+
+    view->name = NULL;
+    view->name_len = 0;
+    view->value = NULL;
+    view->value_len = 0;
+    view->type = 0;
+    view->typed.unsigned_integer = 0;
+
+    if (!json_object_object_get_ex(jmsg, JSON_RPC_FIELD_PARAMS, &jparams) || !json_object_is_type(jparams, json_type_array))
+    {
+        return RETURN_ERR;
+    }
+    jparam = json_object_array_get_idx(jparams, index);
+
+    switch (action)
+    {
+        case GET_REQUEST_MESSAGE:
+        case DELETE_REQUEST_MESSAGE:
+        case SET_REQUEST_MESSAGE:
+        case GET_RESPONSE_MESSAGE:
+            if (!json_object_is_type(jparam, json_type_object))
+            {
+                return RETURN_ERR;
+            }
+            /* A param has a few members, comparing their keys is cheaper than hashing three lookups. */
+            json_object_object_foreach(jparam, key, jmember)
+            {
+                if (strcmp(key, JSON_RPC_FIELD_PARAM_NAME) == 0)
+                {
+                    jname = jmember;
+                }
+                else if (strcmp(key, JSON_RPC_FIELD_PARAM_TYPE) == 0)
+                {
+                    jtype = jmember;
+                }
+                else if (strcmp(key, JSON_RPC_FIELD_PARAM_VALUE) == 0)
+                {
+                    jvalue = jmember;
+                }
+            }
+            if (jname == NULL)
+            {
+                return RETURN_ERR;
+            }
+            view->name = json_object_get_string(jname);
+            view->name_len = (view->name != NULL) ? strlen(view->name) : 0;
+            if (action == GET_REQUEST_MESSAGE || action == DELETE_REQUEST_MESSAGE)
+            {
+                break;
+            }
+
+            if (jtype == NULL)
+            {
+                return RETURN_ERR;
+            }
+            param_type = json_object_get_string(jtype);
+            for (size_t i = 0; param_type != NULL && i < sizeof(g_param_types) / sizeof(g_param_types[0]); ++i)
+            {
+                if (strncmp(param_type, g_param_types[i].name, strlen(g_param_types[i].name)) == 0)
+                {
+                    view->type = g_param_types[i].type;
+                    break;
+                }
+            }
+
+            if (jvalue == NULL)
+            {
+                /* Only the string values are required, as with json_hal_get_param(). */
+                if (view->type == PARAM_STRING || view->type == PARAM_HEXBINARY || view->type == PARAM_BASE64)
+                {
+                    return RETURN_ERR;
+                }
+                break;
+            }
+            if (json_object_is_type(jvalue, json_type_string))
+            {
+                view->value = json_object_get_string(jvalue);
+                view->value_len = json_object_get_string_len(jvalue);
+            }
+
+            switch (view->type)
+            {
+                case PARAM_BOOLEAN:
+                    view->typed.boolean = json_object_get_boolean(jvalue) ? TRUE : FALSE;
+                    break;
+                case PARAM_INTEGER:
+                case PARAM_LONG:
+                    view->typed.integer = json_object_get_int64(jvalue);
+                    break;
+                case PARAM_UNSIGNED_INTEGER:
+                case PARAM_UNSIGNED_LONG:
+                    view->typed.unsigned_integer = (uint64_t)json_object_get_int64(jvalue);
+                    break;
+                default:
+                    break;
+            }
+            break;
+
+        case PUBLISHEVENT_RESPONSE_MESSAGE:
+        default:
+            LOGINFO("No action required!!!\n");
+            break;
+    }
+
+    return RETURN_OK;
+}
+
 int json_hal_add_param(json_object *jreply, eActionType action, hal_param_t *param)
 {
     json_object *jparams = NULL;
@@ -246,11 +385,27 @@ int json_hal_load_config(const char *config_file, hal_config_t *config)
     POINTER_ASSERT(config != NULL);
 
     FILE *fp = NULL;
-    char buffer[BUF_256] = {0};
+    char *buffer = NULL;
+    struct stat config_stat;
+    size_t num_bytes_read = 0;
 
     json_object *parsed_json = NULL;
     json_object *schema = NULL;
     json_object *port = NULL;
+    json_object *framing = NULL;
+    json_object *socket_path = NULL;
+    json_object *queue_size = NULL;
+    json_object *queue_policy = NULL;
+    json_object *wire_format = NULL;
+    json_object *wire_encoding = NULL;
+    json_object *threads = NULL;
+    json_object *ring_size = NULL;
+    json_object *connections = NULL;
+    json_object *workers = NULL;
+    json_object *out_of_order = NULL;
+    json_object *control = NULL;
+    json_object *limits = NULL;
+    json_object *single_flight = NULL;
 
     fp = fopen(config_file, "r");
     if (fp == NULL)
@@ -258,18 +413,41 @@ int json_hal_load_config(const char *config_file, hal_config_t *config)
         LOGERROR("json file not found %s \n", config_file);
         return RETURN_ERR;
     }
-    if (fread(buffer, sizeof(buffer), 1, fp) != 1)
+    /* Sized from the file, action limits and action lists make it grow past a fixed buffer. */
+    if (fstat(fileno(fp), &config_stat) != 0 || !S_ISREG(config_stat.st_mode))
     {
-        // LOGERROR("Unexpected amount read from configuration file\n");
+        LOGERROR("Failed to get the size of configuration file %s \n", config_file);
+        fclose(fp);
+        return RETURN_ERR;
+    }
+    buffer = (char *)malloc((size_t)config_stat.st_size + 1);
+    if (buffer == NULL)
+    {
+        LOGERROR("Failed to allocate memory to hold configuration file %s \n", config_file);
+        fclose(fp);
+        return RETURN_ERR;
     }
+    num_bytes_read = fread(buffer, 1, (size_t)config_stat.st_size, fp);
     fclose(fp);
+    if (num_bytes_read != (size_t)config_stat.st_size)
+    {
+        LOGERROR("Unexpected amount read from configuration file %s [%zu of %lld bytes]\n", config_file, num_bytes_read, (long long)config_stat.st_size);
+        free(buffer);
+        return RETURN_ERR;
+    }
+    buffer[num_bytes_read] = '\0';
 
     /**
      * Read schema path and server port number from
      * config file.
      */
     parsed_json = json_tokener_parse(buffer);
-    POINTER_ASSERT(parsed_json != NULL);
+    free(buffer);
+    if (parsed_json == NULL)
+    {
+        LOGERROR("Failed to parse configuration file %s \n", config_file);
+        return RETURN_ERR;
+    }
 
     if (json_object_object_get_ex(parsed_json, HAL_SCHEMA_PATH, &schema))
     {
@@ -282,16 +460,260 @@ int json_hal_load_config(const char *config_file, hal_config_t *config)
         return RETURN_ERR;
     }
 
+    /* Optional, selects the unix domain socket transport. The TCP port is not required then. */
+    memset(config->server_socket_path, 0, sizeof(config->server_socket_path));
+    if (json_object_object_get_ex(parsed_json, SERVER_SOCKET_PATH, &socket_path))
+    {
+        if (strlen(json_object_get_string(socket_path)) >= sizeof(config->server_socket_path))
+        {
+            LOGERROR("Server socket path is too long in configuration file \n");
+            json_object_put(parsed_json);
+            return RETURN_ERR;
+        }
+        strncpy(config->server_socket_path, json_object_get_string(socket_path), sizeof(config->server_socket_path) - 1);
+    }
+
     if (json_object_object_get_ex(parsed_json, SERVER_PORT, &port))
     {
         config->server_port_number = json_object_get_int(port);
     }
+    else if (config->server_socket_path[0] != '\0')
+    {
+        config->server_port_number = 0;
+    }
     else
     {
         LOGERROR("Failed to get server port from configuration file \n");
         json_object_put(parsed_json);
         return RETURN_ERR;
     }
+
+    /* Optional, both client and server must use the same setting. */
+    config->message_framing = FALSE;
+    if (json_object_object_get_ex(parsed_json, MESSAGE_FRAMING, &framing))
+    {
+        config->message_framing = json_object_get_boolean(framing);
+    }
+    if (config->server_socket_path[0] != '\0')
+    {
+        /* The unix domain socket transport is always framed. */
+        config->message_framing = TRUE;
+    }
+
+    /* Optional, server side outbound queue of every client. */
+    config->write_queue_size = WRITE_QUEUE_DEFAULT_SIZE;
+    if (json_object_object_get_ex(parsed_json, WRITE_QUEUE_SIZE, &queue_size))
+    {
+        int size = json_object_get_int(queue_size);
+        config->write_queue_size = (size > 0) ? (size_t)size : 0;
+    }
+    config->write_queue_policy = WRITE_QUEUE_POLICY_BLOCK;
+    if (json_object_object_get_ex(parsed_json, WRITE_QUEUE_POLICY, &queue_policy))
+    {
+        const char *policy = json_object_get_string(queue_policy);
+        if (!strcmp(policy, "drop"))
+        {
+            config->write_queue_policy = WRITE_QUEUE_POLICY_DROP;
+        }
+        else if (!strcmp(policy, "block"))
+        {
+            config->write_queue_policy = WRITE_QUEUE_POLICY_BLOCK;
+        }
+        else if (!strcmp(policy, "disconnect"))
+        {
+            config->write_queue_policy = WRITE_QUEUE_POLICY_DISCONNECT;
+        }
+        else
+        {
+            LOGERROR("Invalid write queue policy %s in configuration file \n", policy);
+            json_object_put(parsed_json);
+            return RETURN_ERR;
+        }
+    }
+
+    /* Optional, messages are sent without whitespace unless asked to be readable. */
+    config->wire_format = WIRE_FORMAT_PLAIN;
+    if (json_object_object_get_ex(parsed_json, WIRE_FORMAT, &wire_format))
+    {
+        const char *format = json_object_get_string(wire_format);
+        if (!strcmp(format, "plain"))
+        {
+            config->wire_format = WIRE_FORMAT_PLAIN;
+        }
+        else if (!strcmp(format, "pretty"))
+        {
+            config->wire_format = WIRE_FORMAT_PRETTY;
+        }
+        else
+        {
+            LOGERROR("Invalid wire format %s in configuration file \n", format);
+            json_object_put(parsed_json);
+            return RETURN_ERR;
+        }
+    }
+
+    /* Optional, only used on framed connections, the other ones stay text json. */
+    config->wire_encoding = WIRE_ENCODING_JSON;
+    if (json_object_object_get_ex(parsed_json, WIRE_ENCODING, &wire_encoding))
+    {
+        const char *encoding = json_object_get_string(wire_encoding);
+        if (!strcmp(encoding, "json"))
+        {
+            config->wire_encoding = WIRE_ENCODING_JSON;
+        }
+        else if (!strcmp(encoding, "msgpack"))
+        {
+            config->wire_encoding = WIRE_ENCODING_MSGPACK;
+        }
+        else
+        {
+            LOGERROR("Invalid wire encoding %s in configuration file \n", encoding);
+            json_object_put(parsed_json);
+            return RETURN_ERR;
+        }
+    }
+
+    /* Optional, connections are shared by this many server threads. */
+    config->server_threads = 1;
+    if (json_object_object_get_ex(parsed_json, SERVER_THREADS, &threads))
+    {
+        config->server_threads = json_object_get_int(threads);
+        if (config->server_threads < 1)
+        {
+            LOGERROR("Invalid number of server threads in configuration file \n");
+            json_object_put(parsed_json);
+            return RETURN_ERR;
+        }
+    }
+
+    /* Optional, the client offers shared memory rings to a unix domain socket server. */
+    config->shared_memory_ring_size = 0;
+    if (json_object_object_get_ex(parsed_json, SHARED_MEMORY_RING_SIZE, &ring_size))
+    {
+        config->shared_memory_ring_size = json_object_get_int(ring_size);
+        if (config->shared_memory_ring_size < 0)
+        {
+            LOGERROR("Invalid shared memory ring size in configuration file \n");
+            json_object_put(parsed_json);
+            return RETURN_ERR;
+        }
+        if (config->shared_memory_ring_size > 0 && config->server_socket_path[0] == '\0')
+        {
+            LOGINFO("Shared memory rings require server_socket_path, not used \n");
+            config->shared_memory_ring_size = 0;
+        }
+    }
+
+    /* Optional, the client spreads its requests over this many connections. */
+    config->client_connections = 1;
+    if (json_object_object_get_ex(parsed_json, CLIENT_CONNECTIONS, &connections))
+    {
+        config->client_connections = json_object_get_int(connections);
+        if (config->client_connections < 1)
+        {
+            LOGERROR("Invalid number of client connections in configuration file \n");
+            json_object_put(parsed_json);
+            return RETURN_ERR;
+        }
+    }
+
+    /* Optional, action callbacks run on this many worker threads, 0 runs them on the server threads. */
+    config->worker_threads = 0;
+    if (json_object_object_get_ex(parsed_json, WORKER_THREADS, &workers))
+    {
+        config->worker_threads = json_object_get_int(workers);
+        if (config->worker_threads < 0)
+        {
+            LOGERROR("Invalid number of worker threads in configuration file \n");
+            json_object_put(parsed_json);
+            return RETURN_ERR;
+        }
+    }
+    config->out_of_order_replies = FALSE;
+    if (json_object_object_get_ex(parsed_json, OUT_OF_ORDER_REPLIES, &out_of_order))
+    {
+        config->out_of_order_replies = json_object_get_boolean(out_of_order);
+    }
+
+    /* Optional, requests of these actions and the events go ahead of the other traffic. */
+    config->control_action_count = 0;
+    if (json_object_object_get_ex(parsed_json, CONTROL_ACTIONS, &control))
+    {
+        int count = json_object_is_type(control, json_type_array) ? json_object_array_length(control) : -1;
+        if (count < 0 || count > MAX_CONTROL_ACTIONS)
+        {
+            LOGERROR("Invalid list of control actions in configuration file \n");
+            json_object_put(parsed_json);
+            return RETURN_ERR;
+        }
+        for (int i = 0; i < count; ++i)
+        {
+            const char *name = json_object_get_string(json_object_array_get_idx(control, i));
+            if (name == NULL || strlen(name) >= MAX_ACTION_NAME_LEN)
+            {
+                LOGERROR("Invalid control action in configuration file \n");
+                json_object_put(parsed_json);
+                return RETURN_ERR;
+            }
+            strncpy(config->control_actions[config->control_action_count++], name, MAX_ACTION_NAME_LEN - 1);
+        }
+    }
+
+    /* Optional, { "action": { "max_in_flight": n, "max_queued": n } }, requests above the limits are answered Busy. */
+    config->action_limit_count = 0;
+    if (json_object_object_get_ex(parsed_json, ACTION_LIMITS, &limits))
+    {
+        if (!json_object_is_type(limits, json_type_object) || json_object_object_length(limits) > MAX_ACTION_LIMITS)
+        {
+            LOGERROR("Invalid list of action limits in configuration file \n");
+            json_object_put(parsed_json);
+            return RETURN_ERR;
+        }
+        json_object_object_foreach(limits, name, jlimit)
+        {
+            hal_action_limit_t *limit = &config->action_limits[config->action_limit_count++];
+            json_object *value = NULL;
+            if (strlen(name) >= MAX_ACTION_NAME_LEN || !json_object_is_type(jlimit, json_type_object))
+            {
+                LOGERROR("Invalid limits of action [%s] in configuration file \n", name);
+                json_object_put(parsed_json);
+                return RETURN_ERR;
+            }
+            strncpy(limit->action_name, name, MAX_ACTION_NAME_LEN - 1);
+            limit->max_in_flight = json_object_object_get_ex(jlimit, ACTION_MAX_IN_FLIGHT, &value) ? json_object_get_int(value) : 0;
+            limit->max_queued = json_object_object_get_ex(jlimit, ACTION_MAX_QUEUED, &value) ? json_object_get_int(value) : 0;
+            if (limit->max_in_flight < 0 || limit->max_queued < 0)
+            {
+                LOGERROR("Invalid limits of action [%s] in configuration file \n", name);
+                json_object_put(parsed_json);
+                return RETURN_ERR;
+            }
+        }
+    }
+
+    /* Optional, identical requests of these actions arriving while one is in flight share its reply. */
+    config->single_flight_action_count = 0;
+    if (json_object_object_get_ex(parsed_json, SINGLE_FLIGHT_ACTIONS, &single_flight))
+    {
+        int count = json_object_is_type(single_flight, json_type_array) ? json_object_array_length(single_flight) : -1;
+        if (count < 0 || count > MAX_SINGLE_FLIGHT_ACTIONS)
+        {
+            LOGERROR("Invalid list of single flight actions in configuration file \n");
+            json_object_put(parsed_json);
+            return RETURN_ERR;
+        }
+        for (int i = 0; i < count; ++i)
+        {
+            const char *name = json_object_get_string(json_object_array_get_idx(single_flight, i));
+            if (name == NULL || strlen(name) >= MAX_ACTION_NAME_LEN)
+            {
+                LOGERROR("Invalid single flight action in configuration file \n");
+                json_object_put(parsed_json);
+                return RETURN_ERR;
+            }
+            strncpy(config->single_flight_actions[config->single_flight_action_count++], name, MAX_ACTION_NAME_LEN - 1);
+        }
+    }
     json_object_put(parsed_json);
 
     /**
@@ -327,7 +749,6 @@ int json_hal_load_config(const char *config_file, hal_config_t *config)
         return RETURN_ERR;
     }
 
-    size_t num_bytes_read = 0;
     num_bytes_read = fread(buf, 1, buffer_length, fp);
     buf[num_bytes_read] = '\0';
     fclose(fp);
@@ -390,3 +811,8 @@ int json_hal_load_config(const char *config_file, hal_config_t *config)
     json_object_put(jparsed);
     return RETURN_OK;
 }
+
+int json_hal_get_wire_flags(wire_format_t format)
+{
+    return (format == WIRE_FORMAT_PRETTY) ? JSON_C_TO_STRING_PRETTY : JSON_C_TO_STRING_PLAIN;
+}
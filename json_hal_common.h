@@ -20,6 +20,7 @@
 #define _JSON_HAL_COMMON_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include <json-c/json.h>
 
 #ifndef TRUE
@@ -40,6 +41,67 @@
 
 #define HAL_SCHEMA_PATH "hal_schema_path"
 #define SERVER_PORT "server_port"
+#define MESSAGE_FRAMING "message_framing"
+#define SERVER_SOCKET_PATH "server_socket_path"
+#define WRITE_QUEUE_SIZE "write_queue_size"
+#define WRITE_QUEUE_POLICY "write_queue_policy"
+#define WRITE_QUEUE_DEFAULT_SIZE (1024 * 1024)
+#define WIRE_FORMAT "wire_format"
+#define WIRE_ENCODING "wire_encoding"
+#define SERVER_THREADS "server_threads"
+#define SHARED_MEMORY_RING_SIZE "shared_memory_ring_size"
+#define CLIENT_CONNECTIONS "client_connections"
+#define WORKER_THREADS "worker_threads"
+#define OUT_OF_ORDER_REPLIES "out_of_order_replies"
+#define CONTROL_ACTIONS "control_actions"
+#define ACTION_LIMITS "action_limits"
+#define ACTION_MAX_IN_FLIGHT "max_in_flight"
+#define ACTION_MAX_QUEUED "max_queued"
+#define SINGLE_FLIGHT_ACTIONS "single_flight_actions"
+#define MAX_CONTROL_ACTIONS 16
+#define MAX_SINGLE_FLIGHT_ACTIONS 16
+#define MAX_ACTION_LIMITS 16
+#define MAX_ACTION_NAME_LEN 64
+
+/**
+ * @brief Action taken when a message does not fit the outbound queue of a client.
+ * Values match rpc_write_queue_policy_t.
+ */
+typedef enum _write_queue_policy_t
+{
+    WRITE_QUEUE_POLICY_DROP = 0,   /* "drop" : message is dropped. */
+    WRITE_QUEUE_POLICY_BLOCK,      /* "block" : publisher waits for the client to read. */
+    WRITE_QUEUE_POLICY_DISCONNECT, /* "disconnect" : client is disconnected. */
+} write_queue_policy_t;
+
+/**
+ * @brief Layout of the json messages written to the socket.
+ */
+typedef enum _wire_format_t
+{
+    WIRE_FORMAT_PLAIN = 0, /* "plain" : no whitespace. */
+    WIRE_FORMAT_PRETTY,    /* "pretty" : indented, to read the traffic while debugging. */
+} wire_format_t;
+
+/**
+ * @brief Encoding of the messages on a framed connection, negotiated with the server.
+ * Values match rpc_codec_t.
+ */
+typedef enum _wire_encoding_t
+{
+    WIRE_ENCODING_JSON = 0, /* "json" : text json, laid out by the wire format. */
+    WIRE_ENCODING_MSGPACK,  /* "msgpack" : MessagePack, if the other side agrees to it. */
+} wire_encoding_t;
+
+/**
+ * @brief Limits of the requests of one action handled at once, 0 for no limit.
+ */
+typedef struct _hal_action_limit_t
+{
+    char action_name[MAX_ACTION_NAME_LEN]; /* Action the limits apply to. */
+    int max_in_flight;                     /* Requests being run at once. */
+    int max_queued;                        /* Requests waiting for a worker thread. */
+} hal_action_limit_t;
 
 /**
  * @brief This structure is used to hold the client/server configuration
@@ -52,6 +114,23 @@ typedef struct _hal_config_t
     char hal_schema_path[256];   /* HAL JSON schema Path. */
     int server_port_number;      /* Server Port Number. */
     int request_timeout_period; /* Timeout period for request. */
+    int message_framing;         /* Optional, TRUE if messages are sent as length prefixed frames. */
+    char server_socket_path[108]; /* Optional, unix domain socket path used instead of the TCP port. */
+    size_t write_queue_size;     /* Optional, outbound queue limit per client in bytes, 0 for no limit. */
+    write_queue_policy_t write_queue_policy; /* Optional, action taken when the outbound queue is full. */
+    wire_format_t wire_format;   /* Optional, layout of the messages sent. */
+    wire_encoding_t wire_encoding; /* Optional, encoding offered or agreed to on framed connections. */
+    int server_threads;          /* Optional, number of server reactor threads. */
+    int shared_memory_ring_size; /* Optional, client side size of the shared memory rings, 0 to disable. */
+    int client_connections;      /* Optional, number of client connections requests are spread over. */
+    int worker_threads;          /* Optional, number of server threads running the action callbacks, 0 for none. */
+    int out_of_order_replies;    /* Optional, TRUE if worker replies may overtake earlier requests of the client. */
+    char control_actions[MAX_CONTROL_ACTIONS][MAX_ACTION_NAME_LEN]; /* Optional, actions served on the control lane. */
+    int control_action_count;    /* Optional, number of entries in control_actions. */
+    hal_action_limit_t action_limits[MAX_ACTION_LIMITS]; /* Optional, per action limits, requests above them are answered Busy. */
+    int action_limit_count;      /* Optional, number of entries in action_limits. */
+    char single_flight_actions[MAX_SINGLE_FLIGHT_ACTIONS][MAX_ACTION_NAME_LEN]; /* Optional, actions whose identical requests in flight share one reply. */
+    int single_flight_action_count; /* Optional, number of entries in single_flight_actions. */
 } hal_config_t;
 
 typedef enum _ParamType
@@ -69,7 +148,9 @@ typedef enum _ParamType
 typedef enum _eResult_t
 {
     RESULT_SUCCESS = 0,
-    RESULT_FAILURE
+    RESULT_FAILURE,
+    RESULT_NOT_SUPPORTED, /* No callback registered for the action. */
+    RESULT_BUSY           /* Request turned down for the limits of its action, it can be retried. */
 }eResult_t;
 
 typedef enum _eActionType
@@ -88,6 +169,24 @@ typedef struct _hal_param_t
     eParamType type;
 }hal_param_t;
 
+/**
+ * @brief Parameter of a message read in place, the pointers stay valid as long as the message.
+ */
+typedef struct _hal_param_view_t
+{
+    const char *name;            /* Parameter name, NUL terminated. */
+    size_t name_len;             /* Length of the name. */
+    const char *value;           /* Value sent as a json string, NUL terminated, NULL for a number or a boolean. */
+    size_t value_len;            /* Length of the value. */
+    eParamType type;             /* Parameter type, 0 for get and delete requests. */
+    union
+    {
+        int boolean;             /* PARAM_BOOLEAN value, TRUE or FALSE. */
+        int64_t integer;         /* PARAM_INTEGER and PARAM_LONG value. */
+        uint64_t unsigned_integer; /* PARAM_UNSIGNED_INTEGER and PARAM_UNSIGNED_LONG value. */
+    } typed;                     /* Value of the numeric and boolean parameters. */
+}hal_param_view_t;
+
 
 /**
  * @brief Application can use this API to unpack get/set/configure/delete JSON request
@@ -99,6 +198,17 @@ typedef struct _hal_param_t
  */
 int json_hal_get_param(json_object *jmsg, int index, eActionType action, hal_param_t *param);
 
+/**
+ * @brief Application can use this API to read get/set/configure/delete JSON request
+ *        params in place, without copying their name and value as json_hal_get_param() does.
+ * @param (IN) jmsg -  Pointer to JSON input object
+ * @param (IN) index - Index of the param in JSON request
+ * @action (IN) action - Action type
+ * @param (OUT) view - Pointer to hal_param_view_t structure, pointing into jmsg
+ * @return RETURN_OK in success case else RETURN_ERR.
+ */
+int json_hal_get_param_view(json_object *jmsg, int index, eActionType action, hal_param_view_t *view);
+
 /**
  * @brief Application can use this API to pack
           JSON response message for get/set/configure/delete requests
@@ -116,4 +226,11 @@ int json_hal_add_param(json_object *jreply, eActionType action, hal_param_t *par
  * @return RETURN_OK in success case else RETURN_ERR.
  */
 int json_hal_load_config(const char *config_file, hal_config_t *config);
+
+/**
+ * @brief json-c flags serialising the messages in a wire format.
+ * @param (IN) wire format
+ * @return JSON_C_TO_STRING_* flags.
+ */
+int json_hal_get_wire_flags(wire_format_t format);
 #endif
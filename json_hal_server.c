@@ -19,17 +19,24 @@
 #include "json_hal_server.h"
 #include "tcp_server.h"
 #include "json_rpc_common.h"
+#include "json_rpc_table.h"
+#include "json_rpc_template.h"
+#include "json_rpc_scan.h"
 #include "json_schema_validator_wrapper.h"
 #include "utlist.h"
 #include <string.h>
+#include <inttypes.h>
 #include <pthread.h>
 #include <limits.h>
 #include <stdbool.h>
 #include <json-c/json.h>
 #include <json-c/json_tokener.h>
 #include <json-c/json_util.h>
+#include <json-c/printbuf.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
+#include <assert.h>
 
 
 #ifndef HAVE_JSON_TOKENER_GET_PARSE_END
@@ -57,7 +64,15 @@ typedef struct action_callback_list_t
 {
     char function_name[MAX_FUNCTION_LEN]; /* Method name */
     action_callback cb;                   /* Callback function invoked when server receive a message. Passed string formatted message buffer.*/
-    struct action_callback_list_t *next;  /* Pointer to the next node in the linked list. */
+    async_action_callback async_cb;       /* Asynchronous callback function, used when cb is NULL. */
+    int timeout_ms;                       /* Time given to complete a request of async_cb. */
+    rpc_lane_t lane;                      /* Traffic class of the requests, from `control_actions`. */
+    int max_in_flight;                    /* Requests run at once, 0 for no limit. */
+    int max_queued;                       /* Requests waiting for a worker, 0 for no limit. */
+    int in_flight;                        /* Requests counted against max_in_flight, under gm_job_lock. */
+    int queued;                           /* Requests waiting for a worker, under gm_job_lock. */
+    int single_flight;                    /* Flag indicates identical requests in flight share one reply. */
+    struct action_callback_list_t *next;  /* Pointer to the next node in the linked list, used to release the entries. */
 } action_callback_list_t;
 
 
@@ -79,12 +94,68 @@ typedef struct event_subscription_msg_status
 typedef struct event_subscriptions_list_t
 {
     int fd;                                     /* Client socket fd. */
+    uint64_t conn_id;                           /* Id of the client connection, tells a reused fd apart. */
     char event[BUF_512];                        /* Event name. */
     eNotificationType_t event_type;             /* Notification Type */
     event_subscription_msg_status_t last_msg;   /* Status of the last event message sent*/
     struct event_subscriptions_list_t *next;    /* Pointer to the next node in the linked list. */
 } event_subscriptions_list_t;
 
+/**
+ * @brief Event message waiting to be sent to a subscribed client.
+ */
+typedef struct publish_event_msg_t
+{
+    int fd;           /* Client socket fd. */
+    uint64_t conn_id; /* Id of the client connection. */
+    json_object *msg; /* Event message. */
+} publish_event_msg_t;
+
+/**
+ * @brief Request run by a worker thread. Jobs stay on the pending list in the order
+ * the requests arrived until their reply was handed to the server thread.
+ */
+typedef struct action_job_t
+{
+    int fd;                            /* Client socket fd, -1 once the client disconnected. */
+    json_object *request;              /* Request message, owned by the job. */
+    action_callback_list_t *rpc;       /* Action callback to run, NULL for a batch or a reply that is ready already. */
+    int batch;                         /* Flag indicates the request is an array of requests. */
+    rpc_lane_t lane;                   /* Traffic class, control jobs are run and replied to first. */
+    int in_flight;                     /* Flag indicates the job is counted in the in_flight of its action. */
+    int queued;                        /* Flag indicates the job waits on a worker queue. */
+    int cancelled;                     /* Flag indicates the client cancelled the request, it gets no reply. */
+    char req_id[BUF_64];               /* Request id. */
+    char action_name[BUF_64];          /* Action name. */
+    int done;                          /* Flag indicates the reply is ready to be sent. */
+    char *reply;                       /* Serialised reply message. */
+    size_t reply_len;                  /* Length of the serialised reply, which may be binary. */
+    rpc_codec_t reply_codec;           /* Encoding of the serialised reply. */
+    json_object *reply_msg;            /* Reply filled by an asynchronous action callback. */
+    uint64_t deadline;                 /* Time in milliseconds the request has to be answered by, 0 for none. */
+    struct action_flight_t *flight;    /* Identical requests waiting for the reply of this one, NULL if it is not shared. */
+    int held;                          /* Flag indicates the application still holds the completion handle. */
+    int released;                      /* Flag indicates the job left the pending list while still held. */
+    struct action_job_t *timer_prev;   /* Previous asynchronous request, by deadline or on the expired list. */
+    struct action_job_t *timer_next;   /* Next asynchronous request, by deadline or on the expired list. */
+    struct action_job_t *queue_prev;   /* Previous job waiting for a worker, or for the reply of its flight. */
+    struct action_job_t *queue_next;   /* Next job waiting for a worker, or for the reply of its flight. */
+    struct action_job_t *prev;         /* Previous job on the pending list. */
+    struct action_job_t *next;         /* Next job on the pending list. */
+} action_job_t;
+
+/**
+ * @brief Request of a single flight action being run, identical requests arriving
+ * meanwhile wait for its reply instead of running the callback again.
+ */
+typedef struct action_flight_t
+{
+    action_callback_list_t *rpc;     /* Action of the request. */
+    char *key;                       /* Serialised params of the request. */
+    action_job_t *followers;         /* Requests waiting for the reply, linked by queue_prev/queue_next. */
+    struct action_flight_t *next;    /* Next flight in the linked list. */
+} action_flight_t;
+
 /**
  * @brief Structure used to hold the details client connections to the server.
  */
@@ -94,6 +165,49 @@ typedef struct client_connections_t
     struct client_connections_t *next; /*  Pointer to the next node in the linked list. */
 } client_connections_t;
 
+/**
+ * @brief How the value of a reply writer record is written.
+ */
+typedef enum reply_writer_value_t
+{
+    REPLY_WRITER_VALUE_NONE = 0, /* No type nor value, only the name. */
+    REPLY_WRITER_VALUE_STRING,   /* String following the name in the record. */
+    REPLY_WRITER_VALUE_BOOLEAN,  /* Boolean held by number. */
+    REPLY_WRITER_VALUE_NUMBER    /* Integer held by number. */
+} reply_writer_value_t;
+
+/**
+ * @brief Param added by a reply writer, followed by its NUL terminated name and
+ * string value. Records are 8 bytes aligned one after the other.
+ */
+typedef struct reply_writer_record_t
+{
+    const char *type;   /* Name of the type, NULL when the param has none. */
+    int64_t number;     /* Value of the booleans and integers. */
+    uint32_t size;      /* Size of the record with its strings. */
+    uint32_t name_len;  /* Length of the name. */
+    uint32_t value_len; /* Length of the string value. */
+    int kind;           /* reply_writer_value_t of the value. */
+} reply_writer_record_t;
+
+#define REPLY_WRITER_RECORD_NAME(record) ((char *)((record) + 1))
+#define REPLY_WRITER_RECORD_VALUE(record) (REPLY_WRITER_RECORD_NAME(record) + (record)->name_len + 1)
+
+/**
+ * @brief Params of a reply writer, owned by its params array and registered with the
+ * codec so that the array is written from the records in both encodings.
+ */
+typedef struct _json_hal_reply_records_t
+{
+    rpc_codec_array_t array; /* Registration of the params array, first member. */
+    json_object *added;      /* Params of the reply from before the writer, NULL if none. */
+    char *data;              /* Records one after the other. */
+    size_t len;              /* Bytes of records. */
+    size_t size;             /* Allocated size of data. */
+    size_t count;            /* Number of records. */
+    size_t text_size;        /* Room needed by the json text of the records. */
+} reply_writer_records_t;
+
 /**
  * @brief Enum to identify the response type for the request.
  */
@@ -101,7 +215,8 @@ typedef enum response_msg_type_t
 {
     RESPONSE_SUCCESS = 0,
     RESPONSE_FAILURE,
-    RESPONSE_NOT_SUPPORTED
+    RESPONSE_NOT_SUPPORTED,
+    RESPONSE_BUSY
 } response_msg_type_t;
 
 /**
@@ -109,16 +224,37 @@ typedef enum response_msg_type_t
  */
 pthread_mutex_t gm_subscription_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/**
+ * @brief Mutex to serialise the action registrations. Requests are dispatched
+ * from all the server threads without lock, through g_action_table.
+ */
+static pthread_mutex_t gm_action_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Mutex to protect the event sequence number.
+ */
+static pthread_mutex_t gm_seqnumber_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * Global structure instance to store HAL server initial configuration.
  */
 static hal_config_t g_server_config ={0};
 
+/**
+ * @brief Constant parts of the messages sent, serialised once the configuration is loaded.
+ */
+static rpc_template_t g_message_template = {0};
+
 /**
  * @brief Global structure pointer to hold all the client rpc connections
  */
 static action_callback_list_t *g_hal_functions_list = NULL;
 
+/**
+ * @brief Registered actions indexed by name.
+ */
+static rpc_table_t g_action_table = {0};
+
 /**
  * @brief Global structure pointer to hold all the client rpc event subscriptions.
  */
@@ -131,6 +267,100 @@ static rpc_server_data_t g_rpc_server;
 /* Global variable which is used as sequence number and returned to client. */
 static int g_seqnumber = DEFAULT_SEQ_START_NUMBER;
 
+/**
+ * @brief Worker threads running the action callbacks, none if they run on the server threads.
+ */
+static pthread_t *g_workers = NULL;
+
+/**
+ * @brief Number of entries in g_workers.
+ */
+static int g_worker_count = 0;
+
+/**
+ * @brief Flag indicates the worker threads keep running.
+ */
+static int g_workers_running = FALSE;
+
+/**
+ * @brief Jobs waiting for a worker thread per traffic class, oldest first.
+ */
+static action_job_t *g_job_queues[RPC_LANE_COUNT] = {NULL};
+
+/**
+ * @brief Number of jobs in g_job_queues, and the highest it reached.
+ */
+static unsigned int g_queued_jobs[RPC_LANE_COUNT] = {0};
+static unsigned int g_max_queued_jobs[RPC_LANE_COUNT] = {0};
+
+/**
+ * @brief Number of requests answered Busy per traffic class.
+ */
+static uint64_t g_busy_replies[RPC_LANE_COUNT] = {0};
+
+/**
+ * @brief Number of requests dropped past their deadline per traffic class.
+ */
+static uint64_t g_expired_requests[RPC_LANE_COUNT] = {0};
+
+/**
+ * @brief Number of requests cancelled by their client per traffic class.
+ */
+static uint64_t g_cancelled_requests[RPC_LANE_COUNT] = {0};
+
+/**
+ * @brief Requests of single flight actions, and the ones among them answered with
+ * the reply of an identical request in flight, per traffic class.
+ */
+static uint64_t g_single_flight_requests[RPC_LANE_COUNT] = {0};
+static uint64_t g_coalesced_requests[RPC_LANE_COUNT] = {0};
+
+/**
+ * @brief Single flight requests being run, under gm_job_lock.
+ */
+static action_flight_t *g_flights = NULL;
+
+/**
+ * @brief Jobs whose reply was not handed to the server thread yet, in the order the requests arrived.
+ */
+static action_job_t *g_pending_jobs = NULL;
+
+/**
+ * @brief Mutex to protect the worker jobs.
+ */
+static pthread_mutex_t gm_job_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Signalled when a job was queued or the workers have to stop.
+ */
+static pthread_cond_t g_job_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * @brief Asynchronous requests not completed yet, earliest deadline first.
+ */
+static action_job_t *g_async_jobs = NULL;
+
+/**
+ * @brief Asynchronous requests replied to at their deadline, waiting for the application to complete them.
+ */
+static action_job_t *g_expired_jobs = NULL;
+
+/**
+ * @brief Thread replying to the asynchronous requests whose deadline passed.
+ */
+static pthread_t g_async_timer;
+
+/**
+ * @brief Flag indicates the deadline thread keeps running.
+ */
+static int g_async_timer_running = FALSE;
+
+/**
+ * @brief Signalled when the earliest deadline changed or the deadline thread has to stop,
+ * uses CLOCK_MONOTONIC.
+ */
+static pthread_cond_t g_async_cond;
+
 /**
  * @brief Utility API to respond `Not Supported` response to client if a registered method
  * not found for the action from vendor software.
@@ -190,10 +420,10 @@ static void add_event_subscription_to_list(event_subscriptions_list_t *subs);
 static void remove_event_subscription_from_list(int fd);
 
 /**
- * @brief Retreive rpc handler function from the list
- * Traverse through the list and if a match found with the
- * compared function, returned the structure object. This
- * contains the callback handler for the rpc function.
+ * @brief Retreive rpc handler function from the table
+ * Look up the registered actions by name without lock, if a match
+ * found returned the structure object. This contains the callback
+ * handler for the rpc function.
  *
  * @param  (IN) Function name indicates rpc function.
  * @return Pointer to action_callback_list_t struct which contains the callback handler.
@@ -219,8 +449,26 @@ static int client_disconnected_cb(int fd);
  * @param fd of the requested client.
  * @param buffer contains the json formatted data.
  * @param length of the buffer
+ * @param encoding of the data, text json or MessagePack
+ */
+static int message_process_cb(int fd, char *buffer, int len, rpc_codec_t codec);
+
+/**
+ * @brief Handle one received message, a request or a batch of requests.
+ * @param client socket fd
+ * @param json message, owned by the call
+ */
+static void process_message(int fd, json_object *jobj);
+
+/**
+ * @brief Serialise a message in the encoding agreed with the client.
+ * @param client socket fd
+ * @param json message
+ * @param (OUT) length of the serialised message
+ * @param (OUT) encoding of the serialised message, to send along with it
+ * @return serialised message to free, NULL on failure.
  */
-static int message_process_cb(int fd, char *buffer, int len);
+static char *encode_message(int fd, const json_object *jmsg, size_t *len, rpc_codec_t *codec);
 
 /**
  * @brief Send the data packet to the client
@@ -229,7 +477,61 @@ static int message_process_cb(int fd, char *buffer, int len);
  * @param json message
  * @return RETURN_OK on success , RETURN_ERR else.
  */
-static int socket_send(const int sockfd, const json_object *jmsg);
+static int socket_send(const int sockfd, const json_object *jmsg, rpc_lane_t lane);
+
+/**
+ * @brief Send the data packet to a given client connection, dropped if the fd got reused.
+ *
+ * @param socket file descriptor to use
+ * @param id of the connection, 0 for the one on the fd
+ * @param json message
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+static int socket_send_to(const int sockfd, uint64_t conn_id, const json_object *jmsg, rpc_lane_t lane);
+
+/**
+ * @brief Add a job to the worker queue of its traffic class.
+ * Must be called with gm_job_lock held.
+ * @param job
+ */
+static void push_job(action_job_t *job);
+
+/**
+ * @brief Take the first queued job whose action is below its in flight limit, control jobs first.
+ * Must be called with gm_job_lock held.
+ * @return job, NULL if none can run.
+ */
+static action_job_t *pop_job(void);
+
+/**
+ * @brief Count a request run on the calling thread against the in flight limit of its action.
+ * @param action
+ * @return RETURN_OK if the request can run, RETURN_ERR if the action is busy.
+ */
+static int take_action_slot(action_callback_list_t *rpc);
+
+/**
+ * @brief Release the slot taken by take_action_slot().
+ * @param action
+ */
+static void release_action_slot(action_callback_list_t *rpc);
+
+/**
+ * @brief Create the reply to a request above the limits of its action.
+ * @param action
+ * @param request id
+ * @return json reply with the status Busy.
+ */
+static json_object *create_busy_reply(const action_callback_list_t *rpc, const char *req_id);
+
+/**
+ * @brief Lane the reply to a request of an action is written on.
+ * With worker threads and in order replies everything stays on the bulk lane,
+ * a control reply must not overtake the earlier replies of its client.
+ * @param action, NULL for a reply not coming from an action
+ * @return lane of the reply.
+ */
+static rpc_lane_t get_reply_lane(const action_callback_list_t *rpc);
 
 /**
  * @brief Get a random number to assign as sequence number for the
@@ -247,6 +549,247 @@ static unsigned int get_sequence_number(void);
  */
 static json_object *prepare_json_response_header(const char *action_name, const char *req_id);
 
+/**
+ * @brief Number of parameters of a request.
+ * @param (IN) Json request message
+ * @return length of its params array, 0 if it has none.
+ */
+static int get_request_param_count(const json_object *jobj);
+
+/**
+ * @brief Check the reply filled by an action callback.
+ * Replies with a failure if the callback failed and with NotSupported if the reply
+ * does not validate against the schema, the filled reply is released then.
+ * @param (IN) Reply filled by the callback
+ * @param (IN) Return code of the callback
+ * @param (IN) String hold the sequence id of the request.
+ * @param (OUT) TRUE if the callback succeeded, FALSE else.
+ * @return json reply message.
+ */
+static json_object *check_action_reply(json_object *jreply_msg, int cb_rc, const char *req_id, int *succeeded);
+
+/**
+ * @brief Run the registered action callback of a request and build its reply.
+ * Replies with a failure if the callback failed and with NotSupported if the reply
+ * does not validate against the schema.
+ * @param (IN) Json request message
+ * @param (IN) Registered action
+ * @param (IN) String hold the request action name
+ * @param (IN) String hold the sequence id of the request.
+ * @param (OUT) TRUE if the callback succeeded, FALSE else.
+ * @return json reply message.
+ */
+static json_object *run_action_callback(const json_object *jobj, const action_callback_list_t *rpc, const char *action_name, const char *req_id, int *succeeded);
+
+/**
+ * @brief Run the requests of a batch one after the other.
+ * Every request is dispatched and validated on its own, asynchronous actions are
+ * answered with a failure. Requests without reqId or action get no reply.
+ * @param (IN) client fd
+ * @param (IN) Json array of request messages
+ * @param (IN) Worker job running the batch, NULL on a server thread
+ * @return json array of the replies, NULL if there is none.
+ */
+static json_object *run_batch(int fd, const json_object *jbatch, action_job_t *job);
+
+/**
+ * @brief Run one request of a batch.
+ * @param (IN) client fd
+ * @param (IN) Json request message
+ * @param (IN) Worker job running the batch, NULL on a server thread
+ * @return json reply message, NULL if the request gets no reply.
+ */
+static json_object *run_batch_request(int fd, const json_object *jobj, action_job_t *job);
+
+/**
+ * @brief Add the client to the event subscriptions of a subscribeEvent request.
+ * @param (IN) client fd
+ * @param (IN) Json subscribeEvent request message
+ */
+static void subscribe_client(int fd, const json_object *jobj);
+
+/**
+ * @brief Send the reply of a request. With worker threads it waits on the pending list
+ * for the replies of the earlier requests of the client, unless out of order replies
+ * are allowed.
+ * @param (IN) client fd
+ * @param (IN) json reply message
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+static int send_reply(int fd, const json_object *jreply);
+
+/**
+ * @brief Hand a request to the worker threads.
+ * @param (IN) client fd
+ * @param (IN) Json request message, owned by the job afterwards
+ * @param (IN) Registered action
+ * @param (IN) String hold the request action name
+ * @param (IN) String hold the sequence id of the request.
+ */
+static void queue_action_job(int fd, json_object *jobj, action_callback_list_t *rpc, const char *action_name, const char *req_id);
+
+/**
+ * @brief Join the flight of an identical request of a single flight action, or start one.
+ * A request joining a flight waits on the pending list for the reply of the flight.
+ * @param (IN) client fd
+ * @param (IN) Json request message, owned by the waiting job if the request joined a flight
+ * @param (IN) Registered action
+ * @param (IN) String hold the request action name
+ * @param (IN) String hold the sequence id of the request.
+ * @param (OUT) Flight started for the request, NULL if none
+ * @return TRUE if the request joined a flight, FALSE if it has to be run.
+ */
+static int join_flight(int fd, json_object *jobj, action_callback_list_t *rpc, const char *action_name, const char *req_id, action_flight_t **flight);
+
+/**
+ * @brief Answer the requests that joined a flight with a copy of its reply, then free the flight.
+ * @param (IN) flight
+ * @param (IN) Reply of the request run for the flight, its reqId is overwritten. NULL to answer with a failure.
+ */
+static void land_flight(action_flight_t *flight, json_object *jreply_msg);
+
+/**
+ * @brief Hand a batch of requests to the worker threads.
+ * @param (IN) client fd
+ * @param (IN) Json array of request messages, owned by the job afterwards
+ */
+static void queue_batch_job(int fd, json_object *jbatch);
+
+/**
+ * @brief Invoke the asynchronous action callback of a request. The request waits on
+ * the pending list for json_hal_server_complete() or its deadline.
+ * @param (IN) client fd
+ * @param (IN) Json request message, owned by the job afterwards
+ * @param (IN) Registered action
+ * @param (IN) String hold the request action name
+ * @param (IN) String hold the sequence id of the request.
+ */
+static void start_async_action(int fd, json_object *jobj, action_callback_list_t *rpc, const char *action_name, const char *req_id);
+
+/**
+ * @brief Register an action, synchronous or asynchronous.
+ * @param (IN) Action name
+ * @param (IN) Callback, NULL for an asynchronous action
+ * @param (IN) Asynchronous callback, NULL for a synchronous action
+ * @param (IN) Time in milliseconds given to complete an asynchronous request
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+static int register_action(const char *action_name, const action_callback callback, const async_action_callback async_callback, int timeout_ms);
+
+/**
+ * @brief Current time of the request deadlines.
+ * @return CLOCK_MONOTONIC time in milliseconds.
+ */
+static uint64_t get_time_ms(void);
+
+/**
+ * @brief Deadline the client stamped the request with.
+ * @param request message
+ * @return CLOCK_MONOTONIC time in milliseconds, 0 if the request has none.
+ */
+static uint64_t get_request_deadline(const json_object *jobj);
+
+/**
+ * @brief Check whether the client gave up on a request already, and count it if so.
+ * @param deadline of the request, 0 for none
+ * @param action
+ * @param request id
+ * @return TRUE if the deadline passed, FALSE else.
+ */
+static int is_request_expired(uint64_t deadline, const action_callback_list_t *rpc, const char *req_id);
+
+/**
+ * @brief Cancel the requests of a client listed in a cancel message.
+ * A request waiting for a worker is dropped, an asynchronous one is released
+ * and a running one is not answered.
+ * @param client socket fd
+ * @param cancel message, its params name the reqId of the requests
+ */
+static void cancel_requests(int fd, const json_object *jobj);
+
+/**
+ * @brief Deadline thread routine, replies with a failure to the asynchronous requests
+ * not completed in time.
+ * @param unused
+ */
+static void *async_timer_handler(void *arg);
+
+/**
+ * @brief Start the deadline thread. gm_action_lock must be held.
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+static int start_async_timer(void);
+
+/**
+ * @brief Stop the deadline thread.
+ */
+static void stop_async_timer(void);
+
+/**
+ * @brief Post the replies that are ready to be sent after the job completed, and
+ * free their jobs. gm_job_lock must be held.
+ * @param (IN) completed job
+ */
+static void release_replies(action_job_t *job);
+
+/**
+ * @brief Free a job and its messages.
+ * @param (IN) job
+ */
+static void free_action_job(action_job_t *job);
+
+/**
+ * @brief Forget the client in its pending jobs, their replies are dropped.
+ * @param (IN) disconnected client fd
+ */
+static void drop_client_jobs(int fd);
+
+/**
+ * @brief Worker thread routine, runs the jobs until the workers are stopped.
+ * @param unused
+ */
+static void *worker_handler(void *arg);
+
+/**
+ * @brief Start the worker threads.
+ * @param (IN) number of threads
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+static int start_workers(int count);
+
+/**
+ * @brief Stop the worker threads.
+ */
+static void stop_workers(void);
+
+/**
+ * @brief Free the jobs left once no thread runs them any more.
+ */
+static void free_pending_jobs(void);
+
+/**
+ * @brief Make room for a record in the buffer of a reply writer.
+ * @param (IN) records of the writer
+ * @param (IN) size of the record
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+static int reply_writer_reserve(reply_writer_records_t *records, size_t extra);
+
+/**
+ * @brief Serialiser of the params array of a reply writer, writes the records as json text.
+ */
+static int reply_writer_to_json_string(json_object *jparams, struct printbuf *pb, int level, int flags);
+
+/**
+ * @brief Encoder of the params array of a reply writer, writes the records as MessagePack.
+ */
+static int reply_writer_encode(rpc_codec_array_t *array, rpc_frame_buffer_t *buf);
+
+/**
+ * @brief Free the records of a reply writer along with its params array.
+ */
+static void reply_writer_free(json_object *jparams, void *userdata);
+
 int json_hal_server_init(const char *hal_conf_path)
 {
     POINTER_ASSERT (hal_conf_path != NULL);
@@ -265,6 +808,13 @@ int json_hal_server_init(const char *hal_conf_path)
         return ret_code;
     }
 
+    /* Without it the messages are encoded as a whole, it is not fatal. */
+    json_rpc_template_free(&g_message_template);
+    if (json_rpc_template_init(&g_message_template, g_server_config.hal_module_name, g_server_config.hal_module_version) != RETURN_OK)
+    {
+        LOGERROR("Failed to prepare the message template \n");
+    }
+
     /**
      * Initialise g_rpc_server global object for the server socket
      * connection management.
@@ -272,6 +822,15 @@ int json_hal_server_init(const char *hal_conf_path)
     memset(&g_rpc_server, 0, sizeof(g_rpc_server));
     g_rpc_server.port = g_server_config.server_port_number;
     g_rpc_server.running = FALSE;
+    g_rpc_server.wakeup_fd = -1;
+    g_rpc_server.framing = g_server_config.message_framing;
+    strncpy(g_rpc_server.socket_path, g_server_config.server_socket_path, sizeof(g_rpc_server.socket_path) - 1);
+    g_rpc_server.write_queue_size = g_server_config.write_queue_size;
+    g_rpc_server.write_queue_high_watermark = (g_server_config.write_queue_size / 4) * 3;
+    g_rpc_server.write_queue_low_watermark = g_server_config.write_queue_size / 4;
+    g_rpc_server.write_queue_policy = (rpc_write_queue_policy_t)g_server_config.write_queue_policy;
+    g_rpc_server.thread_count = g_server_config.server_threads;
+    g_rpc_server.codec = (rpc_codec_t)g_server_config.wire_encoding;
 
     /* Callback initialisation. */
     g_rpc_server.func_connect = (void *)client_connected_cb;
@@ -288,6 +847,11 @@ int json_hal_server_init(const char *hal_conf_path)
 int json_hal_server_run()
 {
     int rc = RETURN_OK;
+    if (g_server_config.worker_threads > 0 && start_workers(g_server_config.worker_threads) != RETURN_OK)
+    {
+        LOGERROR("Failed to start the worker threads \n");
+        return RETURN_ERR;
+    }
     rc = json_rpc_server_run(&g_rpc_server);
     if (rc != RETURN_OK)
     {
@@ -310,11 +874,13 @@ static int client_connected_cb(int fd)
 static int client_disconnected_cb(int fd)
 {
     LOGINFO("Client connection disconnected");
+    /* Before the subscriptions, a worker adds a subscription only while its client is known. */
+    drop_client_jobs(fd);
     remove_event_subscription_from_list(fd);
     return RETURN_OK;
 }
 
-static int message_process_cb(int fd, char *buffer, int len)
+static int message_process_cb(int fd, char *buffer, int len, rpc_codec_t codec)
 {
 
     if (NULL == buffer)
@@ -323,15 +889,24 @@ static int message_process_cb(int fd, char *buffer, int len)
         return RETURN_ERR;
     }
 
-    json_object *returnObj = NULL;
-    action_callback_list_t *rpc = NULL;
-    char req_id[BUF_64] = {'\0'};
-    char action_name[BUF_64] = {'\0'};
-    int ret_code = RETURN_OK;
-    json_object *jreply_msg = NULL;
     int depth = JSON_TOKENER_DEFAULT_DEPTH;
     json_tokener* tok = NULL;
     json_object* jobj = NULL;
+    size_t start_pos = 0;
+    size_t message_len = 0;
+
+    if (codec == RPC_CODEC_MSGPACK)
+    {
+        /* One MessagePack message per frame or ring entry. */
+        jobj = json_rpc_codec_decode(buffer, len);
+        if (jobj == NULL)
+        {
+            LOGERROR("Invalid MessagePack message of %d bytes\n", len);
+            return RETURN_ERR;
+        }
+        process_message(fd, jobj);
+        return RETURN_OK;
+    }
 
     tok = json_tokener_new_ex(depth);
     if (!tok)
@@ -346,253 +921,1274 @@ static int message_process_cb(int fd, char *buffer, int len)
 #endif
     );
 
-    for(int start_pos = 0; start_pos < len; start_pos += json_tokener_get_parse_end(tok))
+    /* JSON messages glued together are split first, each one is parsed once. */
+    while ((message_len = json_rpc_scan_message(&buffer[start_pos], len - start_pos)) > 0)
     {
-        jobj = json_tokener_parse_ex(tok, &buffer[start_pos], len - start_pos);
-        enum json_tokener_error jerr = json_tokener_get_error(tok);
-        int parse_end = json_tokener_get_parse_end(tok);
-        if (jobj == NULL && jerr != json_tokener_continue)
+        jobj = json_tokener_parse_ex(tok, &buffer[start_pos], message_len);
+        if (jobj == NULL)
         {
-            char* aterr = (start_pos + parse_end < len)
-                ? &buffer[start_pos + parse_end]
-                : "";
-            fflush(stdout);
-            int fail_offset = start_pos + parse_end;
-            LOGERROR("Failed at offset %d: %s %c\n", fail_offset, json_tokener_error_desc(jerr), aterr[0]);
+            enum json_tokener_error jerr = json_tokener_get_error(tok);
+            LOGERROR("Failed at offset %d: %s\n", (int)(start_pos + json_tokener_get_parse_end(tok)), json_tokener_error_desc(jerr));
             json_tokener_free(tok);
             return RETURN_ERR;
         }
+        json_tokener_reset(tok);
 
+        /* The message belongs to process_message() from now on. */
+        process_message(fd, jobj);
+        start_pos += message_len;
+    }
 
-        if (jobj != NULL)
-        {
+    json_tokener_free(tok);
 
-            /**
-             * Parse the response json message to identify event publish or response
-             * for rpc request. In case of event `"action": "publishEvent"` is contained
-             * in the response message. In case of event, invoke the registered callback function.
-             *
-             */
-            if (!json_object_object_get_ex(jobj, JSON_RPC_FIELD_ID, &returnObj))
-            {
-                LOGERROR("Json request doesn't have sequence number/id.");
-                json_object_put(jobj);
-                continue;
-            }
-            /* Got reqid. */
-            strncpy(req_id, json_object_get_string(returnObj), sizeof(req_id));
+    return RETURN_OK;
+}
+
+static void process_message(int fd, json_object *jobj)
+{
+    json_object *returnObj = NULL;
+    action_callback_list_t *rpc = NULL;
+    char req_id[BUF_64] = {'\0'};
+    char action_name[BUF_64] = {'\0'};
+    json_object *jreply_msg = NULL;
 
-            /* Retrieve action name. */
-            if (!json_object_object_get_ex(jobj, JSON_RPC_FIELD_ACTION, &returnObj))
+    if (json_object_is_type(jobj, json_type_array))
+    {
+        /**
+         * Batch of requests, answered with one array of replies.
+         */
+        if (g_worker_count > 0)
+        {
+            /* The job owns the batch from now on. */
+            queue_batch_job(fd, jobj);
+            return;
+        }
+        jreply_msg = run_batch(fd, jobj, NULL);
+        if (jreply_msg != NULL)
+        {
+            if (socket_send(fd, jreply_msg, RPC_LANE_BULK) != RETURN_OK)
             {
-                LOGERROR("Json request doesn't contain the action field");
-                json_object_put(jobj);
-                continue;
+                LOGERROR("Failed to send response back to client");
             }
-            /* Got action name. */
-            strncpy(action_name, json_object_get_string(returnObj), sizeof(action_name));
+            json_object_put(jreply_msg);
+        }
+        json_object_put(jobj);
+    }
+    else
+    {
 
-            /* Retrieve any callback regsitered from this action. */
-            rpc = get_registered_rpc_action_by_name(action_name);
-            if (rpc == NULL)
-            {
-                
+        /**
+         * Parse the response json message to identify event publish or response
+         * for rpc request. In case of event `"action": "publishEvent"` is contained
+         * in the response message. In case of event, invoke the registered callback function.
+         *
+         */
+        if (!json_object_object_get_ex(jobj, JSON_RPC_FIELD_ID, &returnObj))
+        {
+            LOGERROR("Json request doesn't have sequence number/id.");
+            json_object_put(jobj);
+            return;
+        }
+        /* Got reqid. */
+        strncpy(req_id, json_object_get_string(returnObj), sizeof(req_id));
+
+        /* Retrieve action name. */
+        if (!json_object_object_get_ex(jobj, JSON_RPC_FIELD_ACTION, &returnObj))
+        {
+            LOGERROR("Json request doesn't contain the action field");
+            json_object_put(jobj);
+            return;
+        }
+        /* Got action name. */
+        strncpy(action_name, json_object_get_string(returnObj), sizeof(action_name));
+
+        if (strcmp(action_name, JSON_RPC_ACTION_CANCEL) == 0)
+        {
+            /* The client gave up on earlier requests, it expects no reply. */
+            cancel_requests(fd, jobj);
+            json_object_put(jobj);
+            return;
+        }
+
+        /* Retrieve any callback regsitered from this action. */
+        rpc = get_registered_rpc_action_by_name(action_name);
+        if (rpc == NULL)
+        {
+            
 #ifdef JSON_BLOCKING_SUBSCRIBE_EVENT
-                if (strncmp(action_name, JSON_RPC_ACTION_RESULT, strlen(JSON_RPC_ACTION_RESULT)) == 0)
+            if (strncmp(action_name, JSON_RPC_ACTION_RESULT, strlen(JSON_RPC_ACTION_RESULT)) == 0)
+            {
+                /**
+                 * Case-1: Action Result.
+                 * In this case, we check the reqid and update the request status.
+                 */
+                event_subscriptions_list_t event_subs;
+                event_subscriptions_list_t *subs = NULL;
+                memset(&event_subs, 0, sizeof(event_subs));
+                int ret_code = get_event_reply_data_from_msg(jobj, &event_subs);
+                if (ret_code != RETURN_OK)
                 {
-                    /**
-                     * Case-1: Action Result.
-                     * In this case, we check the reqid and update the request status.
-                     */
-                    event_subscriptions_list_t event_subs;
-                    event_subscriptions_list_t *subs = NULL;
-                    memset(&event_subs, 0, sizeof(event_subs));
-                    ret_code = get_event_reply_data_from_msg(jobj, &event_subs);
-                    if (ret_code != RETURN_OK)
-                    {
-                        LOGERROR("Failed to get event data from request message ");
-                        json_object_put(jobj);
-                        continue;
-                    }
+                    LOGERROR("Failed to get event data from request message ");
+                    json_object_put(jobj);
+                    return;
+                }
 
-                    pthread_mutex_lock(&gm_subscription_mutex);
+                pthread_mutex_lock(&gm_subscription_mutex);
 
-                    //Check all events subscribed
-                    LL_FOREACH(g_event_subscriptions_list, subs)
+                //Check all events subscribed
+                LL_FOREACH(g_event_subscriptions_list, subs)
+                {
+                    if (!strncmp(subs->event, event_subs.event, strlen(event_subs.event)))
                     {
-                        if (!strncmp(subs->event, event_subs.event, strlen(event_subs.event)))
+                        if(subs->fd == fd)
                         {
-                            if(subs->fd == fd)
+                            if (!strncmp(subs->last_msg.req_id, event_subs.last_msg.req_id, strlen(event_subs.last_msg.req_id)))
                             {
-                                if (!strncmp(subs->last_msg.req_id, event_subs.last_msg.req_id, strlen(event_subs.last_msg.req_id)))
-                                {
-                                    subs->last_msg.status = event_subs.last_msg.status;
-                                }
+                                subs->last_msg.status = event_subs.last_msg.status;
                             }
                         }
                     }
-                    pthread_mutex_unlock(&gm_subscription_mutex);
-
                 }
-                else
+                pthread_mutex_unlock(&gm_subscription_mutex);
+
+            }
+            else
 #endif //JSON_BLOCKING_SUBSCRIBE_EVENT
+            {
+                /**
+                 * Case-2: No supported method registered for requested action.
+                 * In this case, reply with NotSupported response.
+                 */
+                LOGINFO("METHOD %s not supported\n", action_name);
+
+                /* Sending missing/unsupported API reply to client. */
+                json_object *jreply = create_json_reply_msg(req_id, RESPONSE_NOT_SUPPORTED);
+                if (send_reply(fd, jreply) != RETURN_OK)
+                {
+                    LOGERROR("Failed to send the data to client \n");
+                }
+                json_object_put(jreply);
+            }
+            
+            json_object_put(jobj);
+            
+        }
+        else
+        {
+            /**
+             * Case-3: Found registered RPC handler for
+             * requested action.
+             */
+            if (is_request_expired(get_request_deadline(jobj), rpc, req_id) == TRUE)
+            {
+                /* Nobody waits for the reply any more. */
+                json_object_put(jobj);
+            }
+            else if (rpc->cb == NULL && rpc->async_cb != NULL)
+            {
+                /* The job owns the request message from now on. */
+                start_async_action(fd, jobj, rpc, action_name, req_id);
+            }
+            else if (rpc->cb != NULL)
+            {
+                int succeeded = FALSE;
+                action_flight_t *flight = NULL;
+                if (g_worker_count > 0)
+                {
+                    /* The job owns the request message from now on. */
+                    queue_action_job(fd, jobj, rpc, action_name, req_id);
+                    return;
+                }
+
+                if (rpc->single_flight == TRUE && join_flight(fd, jobj, rpc, action_name, req_id, &flight) == TRUE)
                 {
-                    /**
-                     * Case-2: No supported method registered for requested action.
-                     * In this case, reply with NotSupported response.
-                     */
-                    LOGINFO("METHOD %s not supported\n", action_name);
-
-                    /* Sending missing/unsupported API reply to client. */
-                    json_object *jreply = create_json_reply_msg(req_id, RESPONSE_NOT_SUPPORTED);
-                    if (socket_send(fd, jreply) != RETURN_OK)
+                    /* Answered along with the identical request run on another server thread. */
+                    return;
+                }
+                if (rpc->max_in_flight > 0 && take_action_slot(rpc) != RETURN_OK)
+                {
+                    json_object *jreply = create_busy_reply(rpc, req_id);
+                    if (send_reply(fd, jreply) != RETURN_OK)
                     {
                         LOGERROR("Failed to send the data to client \n");
                     }
+                    if (flight != NULL)
+                    {
+                        land_flight(flight, jreply);
+                    }
                     json_object_put(jreply);
+                    json_object_put(jobj);
+                    return;
+                }
+                jreply_msg = run_action_callback(jobj, rpc, action_name, req_id, &succeeded);
+                if (rpc->max_in_flight > 0)
+                {
+                    release_action_slot(rpc);
+                }
+                /* Send response message to client. */
+                if (socket_send(fd, jreply_msg, get_reply_lane(rpc)) != RETURN_OK)
+                {
+                    LOGERROR("Failed to send response back to client");
+                }
+                if (flight != NULL)
+                {
+                    land_flight(flight, jreply_msg);
+                }
+                /* Free the reply message object. */
+                json_object_put(jreply_msg);
+
+                /**
+                 * In case of event subscription request, we have to update the
+                 * global list to store the subscribed client's details.
+                 */
+                if (succeeded == TRUE && strncmp(action_name, JSON_RPC_SUBSCRIBE_EVENT_ACTION_NAME, strlen(JSON_RPC_SUBSCRIBE_EVENT_ACTION_NAME)) == 0)
+                {
+                    subscribe_client(fd, jobj);
                 }
-                
                 json_object_put(jobj);
-                
             }
             else
             {
                 /**
-                 * Case-3: Found registered RPC handler for
-                 * requested action.
-                 */
-                if (rpc->cb != NULL)
+                * Case-3: No handler for supported method for requested action.
+                * In this case, reply with NotSupported response.
+                */
+                LOGINFO("METHOD %s handler not found\n", action_name);
+
+                /* Sending missing/unsupported API reply to client. */
+                json_object *jreply = create_json_reply_msg(req_id, RESPONSE_NOT_SUPPORTED);
+                if (send_reply(fd, jreply) != RETURN_OK)
                 {
-                    int cb_rc = RETURN_OK;
-                    /**
-                     * In the JSON request message, parametes contains as array of objects.
-                     * So length of the array indicates number of params in the request. Check
-                     * JSON request has `params` array of request, if so calculate its length.
-                     * This can pass as an argument to regsitered callback, so user can know
-                     * number of arguments in the request has.
-                     */
-                    json_object *temp_jobject = NULL;
-                    int req_param_count = 0;
-                    if (json_object_object_get_ex(jobj, JSON_RPC_FIELD_PARAMS, &temp_jobject))
-                    {
-                        req_param_count = json_object_array_length(temp_jobject);
-        #ifdef DEBUG_ENABLED
-                        LOGINFO("Request parameter count = %d \n", req_param_count);
-        #endif
-                    }
+                    LOGERROR("Failed to send the data to client \n");
+                }
+                json_object_put(jreply);
+                json_object_put(jobj);
+            }
+        }
+    }
+}
 
-                    jreply_msg = prepare_json_response_header(action_name, req_id);
-                    /**
-                     * Callback routine invoked.
-                     */
-                    cb_rc = rpc->cb(jobj, req_param_count, jreply_msg);
-                    if (cb_rc == RETURN_OK)
-                    {
+static int get_request_param_count(const json_object *jobj)
+{
+    /**
+     * In the JSON request message, parametes contains as array of objects.
+     * So length of the array indicates number of params in the request. Check
+     * JSON request has `params` array of request, if so calculate its length.
+     * This can pass as an argument to regsitered callback, so user can know
+     * number of arguments in the request has.
+     */
+    json_object *temp_jobject = NULL;
+    int req_param_count = 0;
+    if (json_object_object_get_ex(jobj, JSON_RPC_FIELD_PARAMS, &temp_jobject))
+    {
+        req_param_count = json_object_array_length(temp_jobject);
+#ifdef DEBUG_ENABLED
+        LOGINFO("Request parameter count = %d \n", req_param_count);
+#endif
+    }
+    return req_param_count;
+}
+
+static json_object *run_action_callback(const json_object *jobj, const action_callback_list_t *rpc, const char *action_name, const char *req_id, int *succeeded)
+{
+    json_object *jreply_msg = NULL;
+    int cb_rc = RETURN_OK;
+
+    jreply_msg = prepare_json_response_header(action_name, req_id);
+    /**
+     * Callback routine invoked.
+     */
+    cb_rc = rpc->cb(jobj, get_request_param_count(jobj), jreply_msg);
+    return check_action_reply(jreply_msg, cb_rc, req_id, succeeded);
+}
+
+static json_object *check_action_reply(json_object *jreply_msg, int cb_rc, const char *req_id, int *succeeded)
+{
+    *succeeded = FALSE;
+    if (cb_rc != RETURN_OK) /* Callback failed to execute. */
+    {
+        LOGERROR("Callback failed to execute the request");
         /**
-                         * Validate the Json response message against the schema.
-                         * If the response is not valid as per schema, we are sending back a
-                         * Not Supported response to the client application.
-                         */
+         * Notify failed response back to requester.
+         */
+        json_object_put(jreply_msg);
+        return create_json_reply_msg(req_id, RESPONSE_FAILURE);
+    }
+
+    /**
+     * Validate the Json response message against the schema.
+     * If the response is not valid as per schema, we are sending back a
+     * Not Supported response to the client application.
+     */
 #ifdef JSON_SCHEMA_VALIDATION_ENABLED
-                        const char *reply_msg_str = json_object_to_json_string_ext(jreply_msg, JSON_C_TO_STRING_PRETTY);
-                        if (json_validator_validate_request(reply_msg_str) != RETURN_OK)
-                        {
-                            LOGERROR("Invalid JSON response, not validated against schema \n");
-                            /* Sending unsupported reply to client. */
-                            json_object *jreply_msg_not_supported = create_json_reply_msg(req_id, RESPONSE_NOT_SUPPORTED);
-                            if (socket_send(fd, jreply_msg_not_supported) != RETURN_OK)
-                            {
-                                LOGERROR("Failed to send the data to client \n");
-                            }
-                            json_object_put(jreply_msg); /* Frees json buffer will release string buffer too. */
-                            json_object_put(jreply_msg_not_supported);
-                            json_object_put(jobj);
-                            continue;
-                        }
+    const char *reply_msg_str = json_object_to_json_string_ext(jreply_msg, JSON_C_TO_STRING_PLAIN);
+    if (json_validator_validate_request(reply_msg_str) != RETURN_OK)
+    {
+        LOGERROR("Invalid JSON response, not validated against schema \n");
+        json_object_put(jreply_msg); /* Frees json buffer will release string buffer too. */
+        return create_json_reply_msg(req_id, RESPONSE_NOT_SUPPORTED);
+    }
 #endif
-                        /* Send response message to client. */
-                        if (socket_send(fd, jreply_msg) != RETURN_OK)
-                        {
-                            LOGERROR("Failed to send response back to client");
-                        }
-                        /* Free the reply message object. */
-                        json_object_put(jreply_msg);
-                    }
-                    else /* Callback failed to execute. */
-                    {
-                        LOGERROR("Callback failed to execute the request");
-                        /**
-                         * Notify failed response back to requester.
-                         */
-                        json_object *jfailure_msg = create_json_reply_msg(req_id, RESPONSE_FAILURE);
-                        if (socket_send(fd, jfailure_msg) != RETURN_OK)
-                        {
-                            LOGERROR("Failed to send the data to client \n");
-                        }
-                        json_object_put(jfailure_msg);
-                        json_object_put(jobj);
-                        json_object_put(jreply_msg);
-                        continue;
-                    }
+    *succeeded = TRUE;
+    return jreply_msg;
+}
 
-                    /**
-                     * In case of event subscription request, we have to update the
-                     * global list to store the subscribed client's details.
-                     * So update event subscription global list and invoke cb to notify
-                     * vendor software about subscription.
-                     */
-                    if (strncmp(action_name, JSON_RPC_SUBSCRIBE_EVENT_ACTION_NAME, strlen(JSON_RPC_SUBSCRIBE_EVENT_ACTION_NAME)) == 0)
-                    {
-                        event_subscriptions_list_t event_subs;
-                        memset(&event_subs, 0, sizeof(event_subs));
+static json_object *run_batch(int fd, const json_object *jbatch, action_job_t *job)
+{
+    json_object *jreplies = NULL;
+    json_object *jreply_msg = NULL;
+    int count = json_object_array_length(jbatch);
+
+    for (int i = 0; i < count; ++i)
+    {
+        jreply_msg = run_batch_request(fd, json_object_array_get_idx(jbatch, i), job);
+        if (jreply_msg == NULL)
+        {
+            continue;
+        }
+        if (jreplies == NULL)
+        {
+            jreplies = json_object_new_array();
+        }
+        json_object_array_add(jreplies, jreply_msg);
+    }
+    return jreplies;
+}
+
+static json_object *run_batch_request(int fd, const json_object *jobj, action_job_t *job)
+{
+    json_object *returnObj = NULL;
+    action_callback_list_t *rpc = NULL;
+    char req_id[BUF_64] = {'\0'};
+    char action_name[BUF_64] = {'\0'};
+    json_object *jreply_msg = NULL;
+    int succeeded = FALSE;
+
+    if (!json_object_object_get_ex(jobj, JSON_RPC_FIELD_ID, &returnObj))
+    {
+        LOGERROR("Json request doesn't have sequence number/id.");
+        return NULL;
+    }
+    strncpy(req_id, json_object_get_string(returnObj), sizeof(req_id) - 1);
+
+    if (!json_object_object_get_ex(jobj, JSON_RPC_FIELD_ACTION, &returnObj))
+    {
+        LOGERROR("Json request doesn't contain the action field");
+        return NULL;
+    }
+    strncpy(action_name, json_object_get_string(returnObj), sizeof(action_name) - 1);
+
+    rpc = get_registered_rpc_action_by_name(action_name);
+    if (rpc == NULL || rpc->cb == NULL)
+    {
+        if (rpc != NULL && rpc->async_cb != NULL)
+        {
+            LOGERROR("METHOD %s is asynchronous, not supported in a batch\n", action_name);
+            return create_json_reply_msg(req_id, RESPONSE_FAILURE);
+        }
+        LOGINFO("METHOD %s not supported\n", action_name);
+        return create_json_reply_msg(req_id, RESPONSE_NOT_SUPPORTED);
+    }
+
+    if (is_request_expired(get_request_deadline(jobj), rpc, req_id) == TRUE)
+    {
+        return NULL;
+    }
+    if (rpc->max_in_flight > 0 && take_action_slot(rpc) != RETURN_OK)
+    {
+        return create_busy_reply(rpc, req_id);
+    }
+    jreply_msg = run_action_callback(jobj, rpc, action_name, req_id, &succeeded);
+    if (rpc->max_in_flight > 0)
+    {
+        release_action_slot(rpc);
+    }
+    if (succeeded == TRUE && strncmp(action_name, JSON_RPC_SUBSCRIBE_EVENT_ACTION_NAME, strlen(JSON_RPC_SUBSCRIBE_EVENT_ACTION_NAME)) == 0)
+    {
+        if (job == NULL)
+        {
+            subscribe_client(fd, jobj);
+        }
+        else
+        {
+            /* Under the job lock, so a client that disconnected meanwhile is not subscribed. */
+            pthread_mutex_lock(&gm_job_lock);
+            if (job->fd >= 0)
+            {
+                subscribe_client(job->fd, jobj);
+            }
+            pthread_mutex_unlock(&gm_job_lock);
+        }
+    }
+    return jreply_msg;
+}
+
+static void subscribe_client(int fd, const json_object *jobj)
+{
+    event_subscriptions_list_t event_subs;
+
+    if (initialise_event_subscription_data(&event_subs) != RETURN_OK)
+    {
+        LOGERROR("Failed to initialise event data");
+        return;
+    }
+    if (get_event_subscription_data_from_msg(jobj, &event_subs) != RETURN_OK)
+    {
+        LOGERROR("Failed to get event data from request message ");
+        return;
+    }
+    event_subs.fd = fd;
+    event_subs.conn_id = json_rpc_server_get_connection_id(fd);
+    add_event_subscription_to_list(&event_subs);
+}
+
+static int send_reply(int fd, const json_object *jreply)
+{
+    action_job_t *job;
+
+    if (g_worker_count == 0)
+    {
+        return socket_send(fd, jreply, RPC_LANE_BULK);
+    }
+
+    job = (action_job_t *)calloc(1, sizeof(action_job_t));
+    POINTER_ASSERT(job != NULL);
+    job->fd = fd;
+    job->done = TRUE;
+    job->reply = encode_message(fd, jreply, &job->reply_len, &job->reply_codec);
+    if (job->reply == NULL)
+    {
+        free(job);
+        return RETURN_ERR;
+    }
+    pthread_mutex_lock(&gm_job_lock);
+    DL_APPEND(g_pending_jobs, job);
+    release_replies(job);
+    pthread_mutex_unlock(&gm_job_lock);
+    return RETURN_OK;
+}
+
+static void queue_action_job(int fd, json_object *jobj, action_callback_list_t *rpc, const char *action_name, const char *req_id)
+{
+    action_flight_t *flight = NULL;
+    if (rpc->single_flight == TRUE && join_flight(fd, jobj, rpc, action_name, req_id, &flight) == TRUE)
+    {
+        return;
+    }
+
+    action_job_t *job = (action_job_t *)calloc(1, sizeof(action_job_t));
+    if (job == NULL)
+    {
+        LOGERROR("Failed to allocate memory for the job of [%s] \n", action_name);
+        if (flight != NULL)
+        {
+            land_flight(flight, NULL);
+        }
+        json_object_put(jobj);
+        return;
+    }
+    job->fd = fd;
+    job->request = jobj;
+    job->rpc = rpc;
+    job->lane = rpc->lane;
+    job->deadline = get_request_deadline(jobj);
+    strncpy(job->req_id, req_id, sizeof(job->req_id) - 1);
+    strncpy(job->action_name, action_name, sizeof(job->action_name) - 1);
+
+    pthread_mutex_lock(&gm_job_lock);
+    if (rpc->max_queued > 0 && rpc->queued >= rpc->max_queued)
+    {
+        pthread_mutex_unlock(&gm_job_lock);
+        json_object *jreply = create_busy_reply(rpc, req_id);
+        if (send_reply(fd, jreply) != RETURN_OK)
+        {
+            LOGERROR("Failed to send the data to client \n");
+        }
+        if (flight != NULL)
+        {
+            land_flight(flight, jreply);
+        }
+        json_object_put(jreply);
+        free_action_job(job);
+        return;
+    }
+    job->flight = flight;
+    rpc->queued++;
+    DL_APPEND(g_pending_jobs, job);
+    push_job(job);
+    pthread_mutex_unlock(&gm_job_lock);
+}
+
+static int join_flight(int fd, json_object *jobj, action_callback_list_t *rpc, const char *action_name, const char *req_id, action_flight_t **flight)
+{
+    json_object *jparams = NULL;
+    action_flight_t *found = NULL;
+    action_job_t *job = NULL;
+    char *key = NULL;
+
+    *flight = NULL;
+    json_object_object_get_ex(jobj, JSON_RPC_FIELD_PARAMS, &jparams);
+    key = strdup((jparams != NULL) ? json_object_to_json_string_ext(jparams, JSON_C_TO_STRING_PLAIN) : "");
+    if (key == NULL)
+    {
+        LOGERROR("Failed to allocate memory for the flight of [%s] \n", action_name);
+        return FALSE;
+    }
+
+    pthread_mutex_lock(&gm_job_lock);
+    g_single_flight_requests[rpc->lane]++;
+    LL_FOREACH(g_flights, found)
+    {
+        if (found->rpc == rpc && strcmp(found->key, key) == 0)
+        {
+            break;
+        }
+    }
+    if (found != NULL)
+    {
+        job = (action_job_t *)calloc(1, sizeof(action_job_t));
+    }
+    if (job != NULL)
+    {
+        /* Not run, it waits on the pending list for the reply of the flight. */
+        job->fd = fd;
+        job->request = jobj;
+        job->rpc = rpc;
+        job->lane = rpc->lane;
+        job->deadline = get_request_deadline(jobj);
+        strncpy(job->req_id, req_id, sizeof(job->req_id) - 1);
+        strncpy(job->action_name, action_name, sizeof(job->action_name) - 1);
+        DL_APPEND(g_pending_jobs, job);
+        DL_APPEND2(found->followers, job, queue_prev, queue_next);
+        g_coalesced_requests[rpc->lane]++;
+        pthread_mutex_unlock(&gm_job_lock);
+        free(key);
+        return TRUE;
+    }
+    if (found == NULL)
+    {
+        found = (action_flight_t *)calloc(1, sizeof(action_flight_t));
+        if (found != NULL)
+        {
+            found->rpc = rpc;
+            found->key = key;
+            key = NULL;
+            LL_PREPEND(g_flights, found);
+            *flight = found;
+        }
+    }
+    /* Without memory for either the request is run on its own. */
+    pthread_mutex_unlock(&gm_job_lock);
+    free(key);
+    return FALSE;
+}
+
+static void land_flight(action_flight_t *flight, json_object *jreply_msg)
+{
+    action_job_t *followers, *tmp, *job;
+
+    /* No request joins the flight any more, its list of followers does not change. */
+    pthread_mutex_lock(&gm_job_lock);
+    LL_DELETE(g_flights, flight);
+    followers = flight->followers;
+    pthread_mutex_unlock(&gm_job_lock);
+
+    /* The waiting jobs are not done, nothing frees them meanwhile. */
+    DL_FOREACH2(followers, job, queue_next)
+    {
+        if (jreply_msg != NULL)
+        {
+            json_object_object_add(jreply_msg, JSON_RPC_FIELD_ID, json_object_new_string(job->req_id));
+            job->reply = encode_message(job->fd, jreply_msg, &job->reply_len, &job->reply_codec);
+        }
+        else
+        {
+            json_object *jfailure = create_json_reply_msg(job->req_id, RESPONSE_FAILURE);
+            job->reply = encode_message(job->fd, jfailure, &job->reply_len, &job->reply_codec);
+            json_object_put(jfailure);
+        }
+        if (job->reply == NULL)
+        {
+            LOGERROR("Failed to allocate memory for the reply of [%s] \n", job->action_name);
+        }
+    }
+
+    pthread_mutex_lock(&gm_job_lock);
+    DL_FOREACH_SAFE2(followers, job, tmp, queue_next)
+    {
+        DL_DELETE2(followers, job, queue_prev, queue_next);
+        if (job->cancelled == TRUE)
+        {
+            free(job->reply);
+            job->reply = NULL;
+        }
+        job->done = TRUE;
+        release_replies(job);
+    }
+    pthread_mutex_unlock(&gm_job_lock);
+    free(flight->key);
+    free(flight);
+}
+
+static void queue_batch_job(int fd, json_object *jbatch)
+{
+    action_job_t *job = (action_job_t *)calloc(1, sizeof(action_job_t));
+    if (job == NULL)
+    {
+        LOGERROR("Failed to allocate memory for the job of a batch \n");
+        json_object_put(jbatch);
+        return;
+    }
+    job->fd = fd;
+    job->request = jbatch;
+    job->batch = TRUE;
+    job->lane = RPC_LANE_BULK;
+
+    pthread_mutex_lock(&gm_job_lock);
+    DL_APPEND(g_pending_jobs, job);
+    push_job(job);
+    pthread_mutex_unlock(&gm_job_lock);
+}
+
+static void push_job(action_job_t *job)
+{
+    DL_APPEND2(g_job_queues[job->lane], job, queue_prev, queue_next);
+    job->queued = TRUE;
+    if (++g_queued_jobs[job->lane] > g_max_queued_jobs[job->lane])
+    {
+        g_max_queued_jobs[job->lane] = g_queued_jobs[job->lane];
+    }
+    pthread_cond_signal(&g_job_cond);
+}
+
+static action_job_t *pop_job(void)
+{
+    action_job_t *job;
+
+    for (int lane = 0; lane < RPC_LANE_COUNT; ++lane)
+    {
+        DL_FOREACH2(g_job_queues[lane], job, queue_next)
+        {
+            action_callback_list_t *rpc = job->rpc;
+            /* Jobs of an action running at its limit wait, the ones queued behind them go first. */
+            if (rpc != NULL && rpc->max_in_flight > 0 && rpc->in_flight >= rpc->max_in_flight)
+            {
+                continue;
+            }
+            DL_DELETE2(g_job_queues[lane], job, queue_prev, queue_next);
+            g_queued_jobs[lane]--;
+            job->queued = FALSE;
+            if (rpc != NULL)
+            {
+                rpc->queued--;
+                if (rpc->max_in_flight > 0)
+                {
+                    rpc->in_flight++;
+                    job->in_flight = TRUE;
+                }
+            }
+            return job;
+        }
+    }
+    return NULL;
+}
+
+static int take_action_slot(action_callback_list_t *rpc)
+{
+    int ret = RETURN_OK;
+
+    pthread_mutex_lock(&gm_job_lock);
+    if (rpc->in_flight >= rpc->max_in_flight)
+    {
+        ret = RETURN_ERR;
+    }
+    else
+    {
+        rpc->in_flight++;
+    }
+    pthread_mutex_unlock(&gm_job_lock);
+    return ret;
+}
+
+static void release_action_slot(action_callback_list_t *rpc)
+{
+    pthread_mutex_lock(&gm_job_lock);
+    rpc->in_flight--;
+    /* Queued jobs of the action may run now. */
+    pthread_cond_broadcast(&g_job_cond);
+    pthread_mutex_unlock(&gm_job_lock);
+}
+
+static json_object *create_busy_reply(const action_callback_list_t *rpc, const char *req_id)
+{
+    LOGERROR("METHOD %s busy, request [%s] rejected \n", rpc->function_name, req_id);
+    __atomic_fetch_add(&g_busy_replies[rpc->lane], 1, __ATOMIC_RELAXED);
+    return create_json_reply_msg(req_id, RESPONSE_BUSY);
+}
+
+static rpc_lane_t get_reply_lane(const action_callback_list_t *rpc)
+{
+    if (rpc == NULL || (g_worker_count > 0 && g_server_config.out_of_order_replies == FALSE))
+    {
+        return RPC_LANE_BULK;
+    }
+    return rpc->lane;
+}
+
+static void start_async_action(int fd, json_object *jobj, action_callback_list_t *rpc, const char *action_name, const char *req_id)
+{
+    action_job_t *job = (action_job_t *)calloc(1, sizeof(action_job_t));
+    if (job == NULL)
+    {
+        LOGERROR("Failed to allocate memory for the job of [%s] \n", action_name);
+        json_object_put(jobj);
+        return;
+    }
+    job->fd = fd;
+    job->request = jobj;
+    job->rpc = rpc;
+    job->lane = rpc->lane;
+    job->held = TRUE;
+    strncpy(job->req_id, req_id, sizeof(job->req_id) - 1);
+    strncpy(job->action_name, action_name, sizeof(job->action_name) - 1);
+    job->deadline = get_time_ms() + rpc->timeout_ms;
+    /* No use answering after the client gave up. */
+    uint64_t deadline = get_request_deadline(jobj);
+    if (deadline > 0 && deadline < job->deadline)
+    {
+        job->deadline = deadline;
+    }
+
+    pthread_mutex_lock(&gm_job_lock);
+    /* Nothing runs the request later, above the limit it is answered straight away. */
+    if (rpc->max_in_flight > 0 && rpc->in_flight >= rpc->max_in_flight)
+    {
+        pthread_mutex_unlock(&gm_job_lock);
+        json_object *jreply = create_busy_reply(rpc, req_id);
+        if (send_reply(fd, jreply) != RETURN_OK)
+        {
+            LOGERROR("Failed to send the data to client \n");
+        }
+        json_object_put(jreply);
+        job->held = FALSE;
+        free_action_job(job);
+        return;
+    }
+    if (rpc->max_in_flight > 0)
+    {
+        rpc->in_flight++;
+        job->in_flight = TRUE;
+    }
+    job->reply_msg = prepare_json_response_header(action_name, req_id);
+    DL_APPEND(g_pending_jobs, job);
+    /* Deadlines mostly grow, look for the insertion point from the tail. */
+    action_job_t *after = (g_async_jobs != NULL) ? g_async_jobs->timer_prev : NULL;
+    while (after != NULL && after->deadline > job->deadline)
+    {
+        after = (after == g_async_jobs) ? NULL : after->timer_prev;
+    }
+    DL_APPEND_ELEM2(g_async_jobs, after, job, timer_prev, timer_next);
+    if (g_async_jobs == job)
+    {
+        pthread_cond_signal(&g_async_cond);
+    }
+    pthread_mutex_unlock(&gm_job_lock);
+
+    /* The job may be completed and freed as soon as the callback is invoked. */
+    if (rpc->async_cb(jobj, get_request_param_count(jobj), job->reply_msg, (json_hal_completion_t)job) != RETURN_OK)
+    {
+        LOGERROR("Callback failed to execute the request");
+        json_hal_server_complete((json_hal_completion_t)job, NULL);
+    }
+}
+
+int json_hal_server_complete(json_hal_completion_t handle, json_object *reply_msg)
+{
+    action_job_t *job = (action_job_t *)handle;
+    json_object *jreply_msg = NULL;
+    int succeeded = FALSE;
+    char *reply = NULL;
+    size_t reply_len = 0;
+    rpc_codec_t reply_codec = RPC_CODEC_JSON;
+
+    POINTER_ASSERT(job != NULL);
+    if (reply_msg != NULL && reply_msg != job->reply_msg)
+    {
+        LOGERROR("Request [%s] of [%s] not completed with its reply message \n", job->req_id, job->action_name);
+        reply_msg = NULL;
+    }
+
+    /* The reply message belongs to the application until now, the job is kept while it is held. */
+    jreply_msg = check_action_reply(job->reply_msg, (reply_msg != NULL) ? RETURN_OK : RETURN_ERR, job->req_id, &succeeded);
+    job->reply_msg = NULL;
+    reply = encode_message(job->fd, jreply_msg, &reply_len, &reply_codec);
+    json_object_put(jreply_msg);
+
+    pthread_mutex_lock(&gm_job_lock);
+    job->held = FALSE;
+    if (job->done == TRUE)
+    {
+        /* Replied with a failure at the deadline already, or cancelled. */
+        DL_DELETE2(g_expired_jobs, job, timer_prev, timer_next);
+        LOGERROR("Request [%s] of [%s] completed after its %s \n", job->req_id, job->action_name,
+                 (job->cancelled == TRUE) ? "cancellation" : "timeout");
+        if (job->released == TRUE)
+        {
+            free_action_job(job);
+        }
+        pthread_mutex_unlock(&gm_job_lock);
+        free(reply);
+        return RETURN_ERR;
+    }
+
+    DL_DELETE2(g_async_jobs, job, timer_prev, timer_next);
+    if (reply == NULL)
+    {
+        LOGERROR("Failed to allocate memory for the reply of [%s] \n", job->action_name);
+    }
+    /* Under the job lock, so a client that disconnected meanwhile is not subscribed. */
+    if (succeeded == TRUE && job->fd >= 0 &&
+        strncmp(job->action_name, JSON_RPC_SUBSCRIBE_EVENT_ACTION_NAME, strlen(JSON_RPC_SUBSCRIBE_EVENT_ACTION_NAME)) == 0)
+    {
+        subscribe_client(job->fd, job->request);
+    }
+    job->reply = reply;
+    job->reply_len = reply_len;
+    job->reply_codec = reply_codec;
+    job->done = TRUE;
+    release_replies(job);
+    pthread_mutex_unlock(&gm_job_lock);
+    return RETURN_OK;
+}
+
+static void release_replies(action_job_t *job)
+{
+    action_job_t *tmp, *pending;
+    int fd = job->fd;
+
+    /* The slot of the action is free once the reply is ready. */
+    if (job->in_flight == TRUE)
+    {
+        job->rpc->in_flight--;
+        job->in_flight = FALSE;
+        pthread_cond_broadcast(&g_job_cond);
+    }
+
+    /* Without workers only the asynchronous requests are on the pending list, other replies do not wait for them. */
+    if (fd < 0 || g_server_config.out_of_order_replies == TRUE || g_worker_count == 0)
+    {
+        if (fd >= 0 && job->reply != NULL && json_rpc_server_post_message(fd, job->reply, job->reply_len, job->reply_codec, get_reply_lane(job->rpc)) != RETURN_OK)
+        {
+            LOGERROR("Failed to send response back to client");
+        }
+        DL_DELETE(g_pending_jobs, job);
+        free_action_job(job);
+        return;
+    }
+
+    /* The replies of a client leave in the order of its requests, up to the first one not ready. */
+    DL_FOREACH_SAFE(g_pending_jobs, pending, tmp)
+    {
+        if (pending->fd != fd)
+        {
+            continue;
+        }
+        if (pending->done == FALSE)
+        {
+            break;
+        }
+        if (pending->reply != NULL && json_rpc_server_post_message(fd, pending->reply, pending->reply_len, pending->reply_codec, RPC_LANE_BULK) != RETURN_OK)
+        {
+            LOGERROR("Failed to send response back to client");
+        }
+        DL_DELETE(g_pending_jobs, pending);
+        free_action_job(pending);
+    }
+}
+
+static void free_action_job(action_job_t *job)
+{
+    /* Freed by json_hal_server_complete(), the application may still use the request. */
+    if (job->held == TRUE)
+    {
+        job->released = TRUE;
+        return;
+    }
+    if (job->reply_msg != NULL)
+    {
+        json_object_put(job->reply_msg);
+    }
+    if (job->request != NULL)
+    {
+        json_object_put(job->request);
+    }
+    free(job->reply);
+    free(job);
+}
+
+static void drop_client_jobs(int fd)
+{
+    action_job_t *tmp, *job;
+
+    pthread_mutex_lock(&gm_job_lock);
+    DL_FOREACH_SAFE(g_pending_jobs, job, tmp)
+    {
+        if (job->fd != fd)
+        {
+            continue;
+        }
+        job->fd = -1;
+        if (job->done == TRUE)
+        {
+            DL_DELETE(g_pending_jobs, job);
+            free_action_job(job);
+        }
+    }
+    pthread_mutex_unlock(&gm_job_lock);
+}
+
+static void *worker_handler(void *arg)
+{
+    action_job_t *job;
+    json_object *jreply_msg;
+    int succeeded;
+    int expired;
+    (void)arg;
+
+    pthread_mutex_lock(&gm_job_lock);
+    while (g_workers_running == TRUE)
+    {
+        job = pop_job();
+        if (job == NULL)
+        {
+            pthread_cond_wait(&g_job_cond, &gm_job_lock);
+            continue;
+        }
+        /* A request others wait for is run whatever its own deadline. */
+        expired = (job->batch == FALSE && (job->flight == NULL || job->flight->followers == NULL) &&
+                   is_request_expired(job->deadline, job->rpc, job->req_id) == TRUE);
+        if (expired == TRUE && job->flight != NULL)
+        {
+            LL_DELETE(g_flights, job->flight);
+            free(job->flight->key);
+            free(job->flight);
+            job->flight = NULL;
+        }
+        pthread_mutex_unlock(&gm_job_lock);
+
+        if (job->batch == TRUE)
+        {
+            /* The batch subscribes its client itself, reading the fd of the job under the job lock. */
+            succeeded = FALSE;
+            jreply_msg = run_batch(-1, job->request, job);
+        }
+        else if (expired == TRUE)
+        {
+            /* The client gave up while the request waited for a worker, it gets no reply. */
+            succeeded = FALSE;
+            jreply_msg = NULL;
+        }
+        else
+        {
+            jreply_msg = run_action_callback(job->request, job->rpc, job->action_name, job->req_id, &succeeded);
+        }
+        if (jreply_msg != NULL)
+        {
+            job->reply = encode_message(job->fd, jreply_msg, &job->reply_len, &job->reply_codec);
+            if (job->reply == NULL)
+            {
+                LOGERROR("Failed to allocate memory for the reply of [%s] \n", job->action_name);
+            }
+        }
+        if (job->flight != NULL)
+        {
+            land_flight(job->flight, jreply_msg);
+            job->flight = NULL;
+        }
+        if (jreply_msg != NULL)
+        {
+            json_object_put(jreply_msg);
+        }
+
+        pthread_mutex_lock(&gm_job_lock);
+        if (job->cancelled == TRUE)
+        {
+            free(job->reply);
+            job->reply = NULL;
+        }
+        /* Under the job lock, so a client that disconnected meanwhile is not subscribed. */
+        if (succeeded == TRUE && job->fd >= 0 &&
+            strncmp(job->action_name, JSON_RPC_SUBSCRIBE_EVENT_ACTION_NAME, strlen(JSON_RPC_SUBSCRIBE_EVENT_ACTION_NAME)) == 0)
+        {
+            subscribe_client(job->fd, job->request);
+        }
+        job->done = TRUE;
+        release_replies(job);
+    }
+    pthread_mutex_unlock(&gm_job_lock);
+    return NULL;
+}
+
+static int start_workers(int count)
+{
+    g_workers = (pthread_t *)calloc(count, sizeof(pthread_t));
+    if (g_workers == NULL)
+    {
+        return RETURN_ERR;
+    }
+    g_workers_running = TRUE;
+    for (g_worker_count = 0; g_worker_count < count; ++g_worker_count)
+    {
+        if (pthread_create(&g_workers[g_worker_count], NULL, worker_handler, NULL) != 0)
+        {
+            LOGERROR("Failed to create worker thread %d \n", g_worker_count);
+            stop_workers();
+            return RETURN_ERR;
+        }
+    }
+    LOGINFO("%d worker thread(s) running the action callbacks, %s replies \n", count,
+            (g_server_config.out_of_order_replies == TRUE) ? "out of order" : "in order");
+    return RETURN_OK;
+}
+
+static void stop_workers(void)
+{
+    pthread_mutex_lock(&gm_job_lock);
+    g_workers_running = FALSE;
+    pthread_cond_broadcast(&g_job_cond);
+    pthread_mutex_unlock(&gm_job_lock);
+    for (int i = 0; i < g_worker_count; ++i)
+    {
+        pthread_join(g_workers[i], NULL);
+    }
+    free(g_workers);
+    g_workers = NULL;
+    g_worker_count = 0;
+}
+
+static void free_pending_jobs(void)
+{
+    action_job_t *tmp, *job;
+    action_flight_t *flight, *next;
+
+    /* Requests of the clients that were still connected are dropped, pending completions too. */
+    pthread_mutex_lock(&gm_job_lock);
+    DL_FOREACH_SAFE2(g_expired_jobs, job, tmp, timer_next)
+    {
+        DL_DELETE2(g_expired_jobs, job, timer_prev, timer_next);
+        job->held = FALSE;
+        /* The others are still on the pending list. */
+        if (job->released == TRUE)
+        {
+            free_action_job(job);
+        }
+    }
+    DL_FOREACH_SAFE(g_pending_jobs, job, tmp)
+    {
+        DL_DELETE(g_pending_jobs, job);
+        job->held = FALSE;
+        free_action_job(job);
+    }
+    for (int i = 0; i < RPC_LANE_COUNT; ++i)
+    {
+        g_job_queues[i] = NULL;
+        g_queued_jobs[i] = 0;
+    }
+    g_async_jobs = NULL;
+    LL_FOREACH_SAFE(g_flights, flight, next)
+    {
+        LL_DELETE(g_flights, flight);
+        free(flight->key);
+        free(flight);
+    }
+    pthread_mutex_unlock(&gm_job_lock);
+}
+
+static uint64_t get_time_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)(ts.tv_nsec / 1000000);
+}
+
+static uint64_t get_request_deadline(const json_object *jobj)
+{
+    json_object *jdeadline = NULL;
+
+    if (!json_object_object_get_ex(jobj, JSON_RPC_FIELD_DEADLINE, &jdeadline))
+    {
+        return 0;
+    }
+    return (uint64_t)json_object_get_int64(jdeadline);
+}
+
+static int is_request_expired(uint64_t deadline, const action_callback_list_t *rpc, const char *req_id)
+{
+    if (deadline == 0 || get_time_ms() < deadline)
+    {
+        return FALSE;
+    }
+    LOGERROR("Request [%s] of [%s] dropped, its deadline passed \n", req_id, rpc->function_name);
+    __atomic_fetch_add(&g_expired_requests[rpc->lane], 1, __ATOMIC_RELAXED);
+    return TRUE;
+}
+
+static void cancel_requests(int fd, const json_object *jobj)
+{
+    json_object *jparams = NULL;
+    json_object *jname = NULL;
+    action_job_t *job;
+    int count;
+
+    if (!json_object_object_get_ex(jobj, JSON_RPC_FIELD_PARAMS, &jparams) || !json_object_is_type(jparams, json_type_array))
+    {
+        LOGERROR("Cancel message without params \n");
+        return;
+    }
+    count = json_object_array_length(jparams);
+
+    pthread_mutex_lock(&gm_job_lock);
+    for (int i = 0; i < count; ++i)
+    {
+        if (!json_object_object_get_ex(json_object_array_get_idx(jparams, i), JSON_RPC_FIELD_PARAM_NAME, &jname))
+        {
+            continue;
+        }
+        const char *req_id = json_object_get_string(jname);
+        DL_FOREACH(g_pending_jobs, job)
+        {
+            if (job->fd == fd && job->done == FALSE && job->batch == FALSE && job->rpc != NULL && strcmp(job->req_id, req_id) == 0)
+            {
+                break;
+            }
+        }
+        if (job == NULL)
+        {
+            /* Answered already, or run on the server thread. */
+            continue;
+        }
+
+        LOGINFO("Request [%s] of [%s] cancelled \n", job->req_id, job->action_name);
+        job->cancelled = TRUE;
+        g_cancelled_requests[job->lane]++;
+        if (job->queued == TRUE && (job->flight == NULL || job->flight->followers == NULL))
+        {
+            /* Not started yet, it never runs. */
+            if (job->flight != NULL)
+            {
+                LL_DELETE(g_flights, job->flight);
+                free(job->flight->key);
+                free(job->flight);
+                job->flight = NULL;
+            }
+            DL_DELETE2(g_job_queues[job->lane], job, queue_prev, queue_next);
+            g_queued_jobs[job->lane]--;
+            job->rpc->queued--;
+            job->queued = FALSE;
+            job->done = TRUE;
+            release_replies(job);
+        }
+        else if (job->rpc->cb == NULL)
+        {
+            /* Asynchronous, released like at its deadline until the application completes it. */
+            DL_DELETE2(g_async_jobs, job, timer_prev, timer_next);
+            DL_APPEND2(g_expired_jobs, job, timer_prev, timer_next);
+            job->done = TRUE;
+            release_replies(job);
+        }
+        /* Running on a worker, or answering the requests of its flight, otherwise: its own reply is dropped. */
+    }
+    pthread_mutex_unlock(&gm_job_lock);
+}
+
+int json_hal_server_is_cancelled(json_hal_completion_t handle)
+{
+    action_job_t *job = (action_job_t *)handle;
+    int cancelled;
+
+    POINTER_ASSERT(job != NULL);
+    pthread_mutex_lock(&gm_job_lock);
+    cancelled = job->cancelled;
+    pthread_mutex_unlock(&gm_job_lock);
+    return cancelled;
+}
+
+int json_hal_server_get_time_left(json_hal_completion_t handle)
+{
+    action_job_t *job = (action_job_t *)handle;
+    uint64_t now = get_time_ms();
+
+    POINTER_ASSERT(job != NULL);
+    return (job->deadline > now) ? (int)(job->deadline - now) : 0;
+}
+
+static void *async_timer_handler(void *arg)
+{
+    action_job_t *job;
+    json_object *jreply_msg;
+    struct timespec ts;
+    (void)arg;
+
+    pthread_mutex_lock(&gm_job_lock);
+    while (g_async_timer_running == TRUE)
+    {
+        job = g_async_jobs;
+        if (job == NULL)
+        {
+            pthread_cond_wait(&g_async_cond, &gm_job_lock);
+            continue;
+        }
+        if (job->deadline > get_time_ms())
+        {
+            ts.tv_sec = job->deadline / 1000;
+            ts.tv_nsec = (job->deadline % 1000) * 1000000;
+            pthread_cond_timedwait(&g_async_cond, &gm_job_lock, &ts);
+            continue;
+        }
+
+        DL_DELETE2(g_async_jobs, job, timer_prev, timer_next);
+        DL_APPEND2(g_expired_jobs, job, timer_prev, timer_next);
+        LOGERROR("Request [%s] of [%s] not completed within %d ms \n", job->req_id, job->action_name, job->rpc->timeout_ms);
+        jreply_msg = create_json_reply_msg(job->req_id, RESPONSE_FAILURE);
+        job->reply = encode_message(job->fd, jreply_msg, &job->reply_len, &job->reply_codec);
+        json_object_put(jreply_msg);
+        job->done = TRUE;
+        release_replies(job);
+    }
+    pthread_mutex_unlock(&gm_job_lock);
+    return NULL;
+}
 
-                        ret_code = initialise_event_subscription_data(&event_subs);
-                        if (ret_code != RETURN_OK)
-                        {
-                            LOGERROR("Failed to initialise event data");
-                            json_object_put(jobj);
-                            return RETURN_ERR;
-                        }
-                        
-                        ret_code = get_event_subscription_data_from_msg(jobj, &event_subs);
-                        if (ret_code != RETURN_OK)
-                        {
-                            LOGERROR("Failed to get event data from request message ");
-                            json_object_put(jobj);
-                            break;
-                        }
-                        
-                        event_subs.fd = fd;
-                        add_event_subscription_to_list(&event_subs);
-                    }
-                    json_object_put(jobj);
-                }
-                else
-                {
-                    /**
-                    * Case-3: No handler for supported method for requested action.
-                    * In this case, reply with NotSupported response.
-                    */
-                    LOGINFO("METHOD %s handler not found\n", action_name);
-
-                    /* Sending missing/unsupported API reply to client. */
-                    json_object *jreply = create_json_reply_msg(req_id, RESPONSE_NOT_SUPPORTED);
-                    if (socket_send(fd, jreply) != RETURN_OK)
-                    {
-                        LOGERROR("Failed to send the data to client \n");
-                    }
-                    json_object_put(jreply);
-                    json_object_put(jobj);
-                }
-            }
-        } /* End of jobj != NULL */
-    } /* End of for */
+static int start_async_timer(void)
+{
+    pthread_condattr_t attr;
 
-    json_tokener_free(tok);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&g_async_cond, &attr);
+    pthread_condattr_destroy(&attr);
 
+    g_async_timer_running = TRUE;
+    if (pthread_create(&g_async_timer, NULL, async_timer_handler, NULL) != 0)
+    {
+        LOGERROR("Failed to create the deadline thread \n");
+        g_async_timer_running = FALSE;
+        pthread_cond_destroy(&g_async_cond);
+        return RETURN_ERR;
+    }
     return RETURN_OK;
 }
 
+static void stop_async_timer(void)
+{
+    pthread_mutex_lock(&gm_job_lock);
+    g_async_timer_running = FALSE;
+    pthread_cond_broadcast(&g_async_cond);
+    pthread_mutex_unlock(&gm_job_lock);
+    pthread_join(g_async_timer, NULL);
+    pthread_cond_destroy(&g_async_cond);
+}
+
 /**
  * @brief Update event details into global event subscription list.
  * @param Pointer to event_subscriptions_list_t struct which contains event data
@@ -604,6 +2200,7 @@ static void add_event_subscription_to_list(event_subscriptions_list_t *event_sub
     subs = (event_subscriptions_list_t *)calloc(1, sizeof(event_subscriptions_list_t));
     POINTER_ASSERT_V(subs != NULL);
     subs->fd = event_subs_data->fd;
+    subs->conn_id = event_subs_data->conn_id;
     strcpy(subs->event, event_subs_data->event);
     subs->event_type = event_subs_data->event_type;
     strcpy(subs->last_msg.req_id, event_subs_data->last_msg.req_id);
@@ -632,38 +2229,180 @@ static void remove_event_subscription_from_list(int fd)
     pthread_mutex_unlock(&gm_subscription_mutex);
 }
 
+int json_hal_server_register_write_queue_callbacks(const write_queue_callback high_watermark_cb, const write_queue_callback low_watermark_cb)
+{
+    g_rpc_server.func_high_watermark = (void *)high_watermark_cb;
+    g_rpc_server.func_low_watermark = (void *)low_watermark_cb;
+    return RETURN_OK;
+}
+
+int json_hal_server_get_queue_stats(json_hal_queue_stats_t *stats)
+{
+    rpc_server_stats_t server_stats;
+    POINTER_ASSERT(stats != NULL);
+
+    if (json_rpc_server_get_stats(&server_stats) != RETURN_OK)
+    {
+        return RETURN_ERR;
+    }
+    memset(stats, 0, sizeof(json_hal_queue_stats_t));
+    pthread_mutex_lock(&gm_job_lock);
+    for (int i = 0; i < JSON_HAL_PRIORITY_COUNT; ++i)
+    {
+        stats->jobs[i] = g_queued_jobs[i];
+        stats->max_jobs[i] = g_max_queued_jobs[i];
+        stats->cancelled[i] = g_cancelled_requests[i];
+        stats->single_flight[i] = g_single_flight_requests[i];
+        stats->coalesced[i] = g_coalesced_requests[i];
+    }
+    pthread_mutex_unlock(&gm_job_lock);
+    for (int i = 0; i < JSON_HAL_PRIORITY_COUNT; ++i)
+    {
+        stats->queued_bytes[i] = server_stats.lane_queued[i];
+        stats->max_queued_bytes[i] = server_stats.lane_max_queued[i];
+        stats->messages[i] = server_stats.lane_messages[i];
+        stats->busy[i] = __atomic_load_n(&g_busy_replies[i], __ATOMIC_RELAXED);
+        stats->expired[i] = __atomic_load_n(&g_expired_requests[i], __ATOMIC_RELAXED);
+    }
+    return RETURN_OK;
+}
+
+int json_hal_server_set_action_limits(const char *action_name, const int max_in_flight, const int max_queued)
+{
+    POINTER_ASSERT(action_name != NULL);
+    action_callback_list_t *rpc = get_registered_rpc_action_by_name((char *)action_name);
+    if (rpc == NULL || max_in_flight < 0 || max_queued < 0)
+    {
+        LOGERROR("Invalid limits for action [%s] \n", action_name);
+        return RETURN_ERR;
+    }
+
+    pthread_mutex_lock(&gm_job_lock);
+    rpc->max_in_flight = max_in_flight;
+    rpc->max_queued = max_queued;
+    /* A higher limit may let queued jobs run. */
+    pthread_cond_broadcast(&g_job_cond);
+    pthread_mutex_unlock(&gm_job_lock);
+    return RETURN_OK;
+}
+
+int json_hal_server_set_action_single_flight(const char *action_name, const int enable)
+{
+    POINTER_ASSERT(action_name != NULL);
+    action_callback_list_t *rpc = get_registered_rpc_action_by_name((char *)action_name);
+    if (rpc == NULL)
+    {
+        LOGERROR("Action [%s] not registered \n", action_name);
+        return RETURN_ERR;
+    }
+
+    pthread_mutex_lock(&gm_job_lock);
+    rpc->single_flight = (enable != 0) ? TRUE : FALSE;
+    pthread_mutex_unlock(&gm_job_lock);
+    return RETURN_OK;
+}
+
 int json_hal_server_register_action_callback(const char *action_name, const action_callback callback)
 {
+    return register_action(action_name, callback, NULL, 0);
+}
+
+int json_hal_server_register_async_action_callback(const char *action_name, const async_action_callback callback, const int timeout_ms)
+{
+    if (callback == NULL || timeout_ms < 0)
+    {
+        LOGERROR("Invalid asynchronous action [%s] \n", action_name);
+        return RETURN_ERR;
+    }
+    return register_action(action_name, NULL, callback, (timeout_ms > 0) ? timeout_ms : JSON_HAL_ASYNC_DEFAULT_TIMEOUT_MS);
+}
+
+static int register_action(const char *action_name, const action_callback callback, const async_action_callback async_callback, int timeout_ms)
+{
+    POINTER_ASSERT(action_name != NULL);
+    if (strlen(action_name) >= MAX_FUNCTION_LEN)
+    {
+        LOGERROR("Action name [%s] is too long \n", action_name);
+        return RETURN_ERR;
+    }
+
     /* Check function already regsistered. */
-    action_callback_list_t *temp = NULL;
-    LL_FOREACH(g_hal_functions_list, temp)
+    pthread_mutex_lock(&gm_action_lock);
+    if (json_rpc_table_lookup(&g_action_table, action_name) != NULL)
     {
-        if (!strcmp(temp->function_name, action_name))
-        {
-            LOGINFO("[%s] already registered, no need to reregister\n", action_name);
-            return RETURN_ERR;
-        }
+        pthread_mutex_unlock(&gm_action_lock);
+        LOGINFO("[%s] already registered, no need to reregister\n", action_name);
+        return RETURN_ERR;
     }
 
     action_callback_list_t *rpc = NULL;
     rpc = (action_callback_list_t *)malloc(sizeof(action_callback_list_t));
-    POINTER_ASSERT(rpc != NULL);
+    if (rpc == NULL)
+    {
+        pthread_mutex_unlock(&gm_action_lock);
+        LOGERROR("Failed to allocate memory for [%s] \n", action_name);
+        return RETURN_ERR;
+    }
+
+    /* The deadline thread runs once there is an asynchronous action. */
+    if (async_callback != NULL && g_async_timer_running == FALSE && start_async_timer() != RETURN_OK)
+    {
+        pthread_mutex_unlock(&gm_action_lock);
+        free(rpc);
+        return RETURN_ERR;
+    }
 
     strcpy(rpc->function_name, action_name);
     rpc->cb = callback;
-    LL_APPEND(g_hal_functions_list, rpc);
+    rpc->async_cb = async_callback;
+    rpc->timeout_ms = timeout_ms;
+    rpc->lane = RPC_LANE_BULK;
+    for (int i = 0; i < g_server_config.control_action_count; ++i)
+    {
+        if (strcmp(g_server_config.control_actions[i], action_name) == 0)
+        {
+            rpc->lane = RPC_LANE_CONTROL;
+            break;
+        }
+    }
+    rpc->max_in_flight = 0;
+    rpc->max_queued = 0;
+    rpc->in_flight = 0;
+    rpc->queued = 0;
+    for (int i = 0; i < g_server_config.action_limit_count; ++i)
+    {
+        if (strcmp(g_server_config.action_limits[i].action_name, action_name) == 0)
+        {
+            rpc->max_in_flight = g_server_config.action_limits[i].max_in_flight;
+            rpc->max_queued = g_server_config.action_limits[i].max_queued;
+            break;
+        }
+    }
+    rpc->single_flight = FALSE;
+    for (int i = 0; i < g_server_config.single_flight_action_count; ++i)
+    {
+        if (strcmp(g_server_config.single_flight_actions[i], action_name) == 0)
+        {
+            rpc->single_flight = TRUE;
+            break;
+        }
+    }
+    if (json_rpc_table_insert(&g_action_table, rpc->function_name, rpc) != RETURN_OK)
+    {
+        pthread_mutex_unlock(&gm_action_lock);
+        free(rpc);
+        LOGERROR("Failed to allocate memory for [%s] \n", action_name);
+        return RETURN_ERR;
+    }
+    LL_PREPEND(g_hal_functions_list, rpc);
+    pthread_mutex_unlock(&gm_action_lock);
     return RETURN_OK;
 }
 
 static action_callback_list_t *get_registered_rpc_action_by_name(char *func_name)
 {
-    action_callback_list_t *rpc = NULL;
-    LL_FOREACH(g_hal_functions_list, rpc)
-    {
-        if (!strcmp(rpc->function_name, func_name))
-            return rpc;
-    }
-    return NULL;
+    /* Entries are only released by json_hal_server_terminate(). */
+    return (action_callback_list_t *)json_rpc_table_lookup(&g_action_table, func_name);
 }
 
 
@@ -743,12 +2482,27 @@ int json_hal_server_publish_event(const char *event_name, const char *event_valu
 {
     int ret = RETURN_OK;
     event_subscriptions_list_t *subs = NULL;
+    publish_event_msg_t *pending = NULL;
+    int pending_count = 0;
+    int subs_count = 0;
 #ifdef JSON_BLOCKING_SUBSCRIBE_EVENT
     bool publish_event_blocking = FALSE;
 #endif //JSON_BLOCKING_SUBSCRIBE_EVENT
     
     pthread_mutex_lock(&gm_subscription_mutex);
 
+    LL_COUNT(g_event_subscriptions_list, subs, subs_count);
+    if (subs_count > 0)
+    {
+        pending = (publish_event_msg_t *)calloc(subs_count, sizeof(publish_event_msg_t));
+        if (pending == NULL)
+        {
+            pthread_mutex_unlock(&gm_subscription_mutex);
+            LOGERROR("Failed to allocate memory for the event messages \n");
+            return RETURN_ERR;
+        }
+    }
+
     LL_FOREACH(g_event_subscriptions_list, subs)
     {
         if (!strncmp(subs->event, event_name, strlen(event_name)))
@@ -774,22 +2528,34 @@ int json_hal_server_publish_event(const char *event_name, const char *event_valu
             }
 #endif //JSON_BLOCKING_SUBSCRIBE_EVENT
 
-            /* Send message to client. */
-            if (socket_send(subs->fd, jevent_msg) != RETURN_OK)
-            {
-                LOGERROR("Failed to send the data to client \n");
-                ret = RETURN_ERR;
-#ifdef JSON_BLOCKING_SUBSCRIBE_EVENT
-                publish_event_blocking = FALSE;
-#endif //JSON_BLOCKING_SUBSCRIBE_EVENT
-            }
-
-            json_object_put(jevent_msg); // Free json object. Its freed buffer memory too.
+            pending[pending_count].fd = subs->fd;
+            pending[pending_count].conn_id = subs->conn_id;
+            pending[pending_count].msg = jevent_msg;
+            pending_count++;
         }
     }
 
     pthread_mutex_unlock(&gm_subscription_mutex);
 
+    /* Send outside of the subscription lock, a client that is not reading
+     * must not hold up subscribe requests or other publishers. The subscriber
+     * may disconnect meanwhile, the connection id keeps a new client on its fd
+     * from getting the event. */
+    for (int i = 0; i < pending_count; ++i)
+    {
+        if (socket_send_to(pending[i].fd, pending[i].conn_id, pending[i].msg, RPC_LANE_CONTROL) != RETURN_OK)
+        {
+            LOGERROR("Failed to send the data to client \n");
+            ret = RETURN_ERR;
+#ifdef JSON_BLOCKING_SUBSCRIBE_EVENT
+            publish_event_blocking = FALSE;
+#endif //JSON_BLOCKING_SUBSCRIBE_EVENT
+        }
+
+        json_object_put(pending[i].msg); // Free json object. Its freed buffer memory too.
+    }
+    free(pending);
+
 
 #ifdef JSON_BLOCKING_SUBSCRIBE_EVENT
     //Check the answer
@@ -830,6 +2596,9 @@ static json_object *create_json_reply_msg(const char *req_id, const response_msg
     case RESPONSE_FAILURE:
         json_object_object_add(jparamval, JSON_RPC_PARAM_STATUS_FIELD, json_object_new_string(JSON_RPC_STATUS_FAILED));
         break;
+    case RESPONSE_BUSY:
+        json_object_object_add(jparamval, JSON_RPC_PARAM_STATUS_FIELD, json_object_new_string(JSON_RPC_STATUS_BUSY));
+        break;
     }
 
     json_object *jreply = json_object_new_object();
@@ -846,7 +2615,7 @@ int json_hal_server_terminate()
 {
 
     /* Stop server socket thread and close all the current connections. */
-    g_rpc_server.running = FALSE;
+    json_rpc_server_stop(&g_rpc_server);
 
     /**
      * Make sure server thread stopped and closed all client sockets.
@@ -865,8 +2634,22 @@ int json_hal_server_terminate()
         counter--;
     } while (counter > 0);
 
+    /* No more requests come in, let the workers finish the callbacks they run. */
+    if (g_worker_count > 0)
+    {
+        stop_workers();
+    }
+    if (g_async_timer_running == TRUE)
+    {
+        stop_async_timer();
+    }
+    free_pending_jobs();
+    json_rpc_template_free(&g_message_template);
+
     /* Free the global lists for the rpc registered functions and event subscriptions. */
     action_callback_list_t *tmp, *rpc;
+    pthread_mutex_lock(&gm_action_lock);
+    json_rpc_table_free(&g_action_table);
     LL_FOREACH_SAFE(g_hal_functions_list, rpc, tmp)
     {
         LL_DELETE(g_hal_functions_list, rpc);
@@ -878,6 +2661,7 @@ int json_hal_server_terminate()
         free(g_hal_functions_list);
         g_hal_functions_list = NULL;
     }
+    pthread_mutex_unlock(&gm_action_lock);
 
     /* Delete event subscription list. */
     event_subscriptions_list_t *tmp_event, *rpc_event;
@@ -933,8 +2717,8 @@ static int get_event_subscription_data_from_msg(const json_object *jmsg, event_s
     }
     else
     {
+        /* The caller owns the request message. */
         LOGERROR("Json request doesn't contain the params field");
-        json_object_put(jmsg);
         return RETURN_ERR;
     }
 
@@ -1047,29 +2831,65 @@ static json_object *create_publish_event_msg(const char *event_name, const char
     return jmsg;
 }
 
-static int socket_send(const int sockfd, const json_object *jmsg)
+static int socket_send(const int sockfd, const json_object *jmsg, rpc_lane_t lane)
+{
+    return socket_send_to(sockfd, 0, jmsg, lane);
+}
+
+static int socket_send_to(const int sockfd, uint64_t conn_id, const json_object *jmsg, rpc_lane_t lane)
 {
     char *response_msg_buffer = NULL;
+    size_t len = 0;
+    rpc_codec_t codec = RPC_CODEC_JSON;
     int rc = RETURN_OK;
     POINTER_ASSERT(jmsg != NULL);
-    response_msg_buffer = json_object_to_json_string_ext(jmsg, JSON_C_TO_STRING_PRETTY);
+#ifdef DEBUG_ENABLED
+    /* Before the wire string, both share the buffer of the message. */
+    LOGINFO("Message sent = %s \n", json_object_to_json_string_ext((json_object *)jmsg, JSON_C_TO_STRING_PRETTY));
+#endif
+    response_msg_buffer = encode_message(sockfd, jmsg, &len, &codec);
     POINTER_ASSERT(response_msg_buffer != NULL);
 
-    rc = json_rpc_server_send_data(sockfd, response_msg_buffer);
+    rc = json_rpc_server_send_message_to(sockfd, conn_id, response_msg_buffer, len, codec, lane);
     if (rc != RETURN_OK)
     {
         LOGERROR("Failed to send the response back to client");
     }
+    free(response_msg_buffer);
     return rc;
 }
 
+static char *encode_message(int fd, const json_object *jmsg, size_t *len, rpc_codec_t *codec)
+{
+    rpc_frame_buffer_t buf;
+
+    /* No client on the fd any more, the message is dropped when sent. */
+    *codec = (json_rpc_server_get_codec(fd) == RPC_CODEC_MSGPACK) ? RPC_CODEC_MSGPACK : RPC_CODEC_JSON;
+    memset(&buf, 0, sizeof(buf));
+    if (json_rpc_template_encode(&g_message_template, (json_object *)jmsg, *codec,
+                                 json_hal_get_wire_flags(g_server_config.wire_format), &buf) != RETURN_OK)
+    {
+        LOGERROR("Failed to encode the message for fd %d \n", fd);
+        json_rpc_frame_buffer_free(&buf);
+        return NULL;
+    }
+    /* The buffer is handed over as it is. */
+    *len = buf.len;
+    return buf.data;
+}
+
 unsigned int get_sequence_number(void)
 {
+    unsigned int seqnumber;
+
+    pthread_mutex_lock(&gm_seqnumber_lock);
     g_seqnumber++;
     if (g_seqnumber > INT_MAX)
         g_seqnumber = DEFAULT_SEQ_START_NUMBER;
+    seqnumber = g_seqnumber;
+    pthread_mutex_unlock(&gm_seqnumber_lock);
 
-    return g_seqnumber;
+    return seqnumber;
 }
 
 static json_object *prepare_json_response_header(const char *action_name, const char *req_id)
@@ -1131,6 +2951,12 @@ int json_hal_add_result_status(json_object *jreply, eResult_t result)
         case RESULT_FAILURE:
             json_object_object_add(jresult, JSON_RPC_PARAM_STATUS_FIELD, json_object_new_string(JSON_RPC_STATUS_FAILED));
             break;
+        case RESULT_NOT_SUPPORTED:
+            json_object_object_add(jresult, JSON_RPC_PARAM_STATUS_FIELD, json_object_new_string(JSON_RPC_STATUS_NOT_SUPPORTED));
+            break;
+        case RESULT_BUSY:
+            json_object_object_add(jresult, JSON_RPC_PARAM_STATUS_FIELD, json_object_new_string(JSON_RPC_STATUS_BUSY));
+            break;
     }
     json_object_object_add(jreply, JSON_RPC_FILED_RESULT, jresult);
 
@@ -1157,6 +2983,300 @@ int json_hal_add_schema_response(json_object *jreply, hal_schema_response_t *par
     return RETURN_OK;
 }
 
+int json_hal_reply_writer_start(json_hal_reply_writer_t *writer, json_object *jreply)
+{
+    json_object *jparams = NULL;
+    rpc_codec_array_t *array = NULL;
+    reply_writer_records_t *records = NULL;
+
+    if (writer == NULL || jreply == NULL || !json_object_object_get_ex(jreply, JSON_RPC_FIELD_PARAMS, &jparams) ||
+        !json_object_is_type(jparams, json_type_array))
+    {
+        return RETURN_ERR;
+    }
+
+    memset(writer, 0, sizeof(*writer));
+
+    /* A writer started on the reply already goes on with its records. */
+    array = json_rpc_codec_find_array(jparams);
+    if (array != NULL && array->encode == reply_writer_encode)
+    {
+        writer->params = jparams;
+        writer->records = (reply_writer_records_t *)array;
+        return RETURN_OK;
+    }
+
+    records = (reply_writer_records_t *)calloc(1, sizeof(*records));
+    writer->params = json_object_new_array();
+    if (records == NULL || writer->params == NULL)
+    {
+        free(records);
+        json_object_put(writer->params);
+        return RETURN_ERR;
+    }
+    /* Params added already are written ahead of the records. */
+    if (json_object_array_length(jparams) > 0)
+    {
+        records->added = json_object_get(jparams);
+    }
+    records->array.jarray = writer->params;
+    records->array.encode = reply_writer_encode;
+    json_rpc_codec_register_array(&records->array);
+    json_object_set_serializer(writer->params, reply_writer_to_json_string, records, reply_writer_free);
+    writer->records = records;
+
+    /* Replaces the former params array, the tree holds no param any more. */
+    json_object_object_add(jreply, JSON_RPC_FIELD_PARAMS, writer->params);
+    return RETURN_OK;
+}
+
+int json_hal_reply_writer_add_param(json_hal_reply_writer_t *writer, const hal_param_t *param)
+{
+    reply_writer_records_t *records = NULL;
+    reply_writer_record_t *record = NULL;
+    const char *type = NULL;
+    int kind = REPLY_WRITER_VALUE_NONE;
+    int64_t number = 0;
+
+    if (writer == NULL || writer->records == NULL || param == NULL)
+    {
+        return RETURN_ERR;
+    }
+    records = writer->records;
+
+    /* Same types and value conversions as json_hal_add_param(). */
+    switch (param->type)
+    {
+        case PARAM_STRING:
+            type = JSON_RPC_FIELD_TYPE_STRING;
+            kind = REPLY_WRITER_VALUE_STRING;
+            break;
+        case PARAM_HEXBINARY:
+            type = JSON_RPC_FIELD_TYPE_HEX_BINARY;
+            kind = REPLY_WRITER_VALUE_STRING;
+            break;
+        case PARAM_BASE64:
+            type = JSON_RPC_FIELD_TYPE_BASE64;
+            kind = REPLY_WRITER_VALUE_STRING;
+            break;
+        case PARAM_BOOLEAN:
+            type = JSON_RPC_FIELD_TYPE_BOOLEAN;
+            kind = REPLY_WRITER_VALUE_BOOLEAN;
+            if (strcmp(param->value, "true") == 0 || strcmp(param->value, "TRUE") == 0)
+            {
+                number = TRUE;
+            }
+            else if (strcmp(param->value, "false") == 0 || strcmp(param->value, "FALSE") == 0)
+            {
+                number = FALSE;
+            }
+            else
+            {
+                return RETURN_ERR;
+            }
+            break;
+        case PARAM_INTEGER:
+            type = JSON_RPC_FIELD_TYPE_INTEGER;
+            kind = REPLY_WRITER_VALUE_NUMBER;
+            number = atoi(param->value);
+            break;
+        case PARAM_UNSIGNED_INTEGER:
+            type = JSON_RPC_FIELD_TYPE_UNSIGNED_INTEGER;
+            kind = REPLY_WRITER_VALUE_NUMBER;
+            number = (int)(unsigned int)atoi(param->value);
+            break;
+        case PARAM_LONG:
+            type = JSON_RPC_FIELD_TYPE_LONG;
+            kind = REPLY_WRITER_VALUE_NUMBER;
+            number = atol(param->value);
+            break;
+        case PARAM_UNSIGNED_LONG:
+            type = JSON_RPC_FIELD_TYPE_UNSIGNED_LONG;
+            kind = REPLY_WRITER_VALUE_NUMBER;
+            number = (unsigned)atol(param->value);
+            break;
+    }
+
+    size_t name_len = strlen(param->name);
+    size_t value_len = (kind == REPLY_WRITER_VALUE_STRING) ? strlen(param->value) : 0;
+    size_t size = (sizeof(*record) + name_len + value_len + 2 + 7) & ~(size_t)7;
+    if (reply_writer_reserve(records, size) != RETURN_OK)
+    {
+        return RETURN_ERR;
+    }
+
+    record = (reply_writer_record_t *)(records->data + records->len);
+    record->type = type;
+    record->number = number;
+    record->size = (uint32_t)size;
+    record->name_len = (uint32_t)name_len;
+    record->value_len = (uint32_t)value_len;
+    record->kind = kind;
+    memcpy(REPLY_WRITER_RECORD_NAME(record), param->name, name_len + 1);
+    if (kind == REPLY_WRITER_VALUE_STRING)
+    {
+        memcpy(REPLY_WRITER_RECORD_VALUE(record), param->value, value_len + 1);
+    }
+    records->len += size;
+    records->count++;
+    /* Members, quotes and a number, and 6 bytes per escaped character. */
+    records->text_size += BUF_128 + (name_len + value_len) * 6;
+    return RETURN_OK;
+}
+
+static int reply_writer_reserve(reply_writer_records_t *records, size_t extra)
+{
+    size_t size = (records->size > 0) ? records->size : BUF_512;
+    char *data = NULL;
+
+    if (records->len + extra <= records->size)
+    {
+        return RETURN_OK;
+    }
+    while (size < records->len + extra)
+    {
+        size *= 2;
+    }
+    data = (char *)realloc(records->data, size);
+    if (data == NULL)
+    {
+        LOGERROR("Failed to allocate %zu bytes for the reply params \n", size);
+        return RETURN_ERR;
+    }
+    records->data = data;
+    records->size = size;
+    return RETURN_OK;
+}
+
+static int reply_writer_to_json_string(json_object *jparams, struct printbuf *pb, int level, int flags)
+{
+    reply_writer_records_t *records = (reply_writer_records_t *)json_rpc_codec_find_array(jparams);
+    const char *added = NULL;
+    size_t added_len = 0;
+    size_t len = 0;
+    char *text = NULL;
+    int rc;
+
+    (void)level;
+    (void)flags;
+    if (records == NULL)
+    {
+        return printbuf_memappend(pb, "[]", 2);
+    }
+    if (records->added != NULL)
+    {
+        added = json_object_to_json_string_ext(records->added, JSON_C_TO_STRING_PLAIN);
+        added_len = strlen(added);
+    }
+    text = (char *)malloc(records->text_size + added_len + 2);
+    if (text == NULL)
+    {
+        LOGERROR("Failed to allocate %zu bytes for the reply params \n", records->text_size + added_len + 2);
+        return -1;
+    }
+
+    /* The params added already, without their closing bracket. */
+    if (added_len > 2)
+    {
+        memcpy(text, added, added_len - 1);
+        len = added_len - 1;
+    }
+    else
+    {
+        text[len++] = '[';
+    }
+    for (size_t offset = 0; offset < records->len; offset += ((reply_writer_record_t *)(records->data + offset))->size)
+    {
+        reply_writer_record_t *record = (reply_writer_record_t *)(records->data + offset);
+        if (len > 1)
+        {
+            text[len++] = ',';
+        }
+        memcpy(text + len, "{\"" JSON_RPC_FIELD_PARAM_NAME "\":", sizeof("{\"" JSON_RPC_FIELD_PARAM_NAME "\":") - 1);
+        len += sizeof("{\"" JSON_RPC_FIELD_PARAM_NAME "\":") - 1;
+        len += json_rpc_template_escape(text + len, REPLY_WRITER_RECORD_NAME(record), record->name_len);
+        if (record->type != NULL)
+        {
+            len += sprintf(text + len, ",\"" JSON_RPC_FIELD_PARAM_TYPE "\":\"%s\",\"" JSON_RPC_FIELD_PARAM_VALUE "\":", record->type);
+            switch (record->kind)
+            {
+                case REPLY_WRITER_VALUE_STRING:
+                    len += json_rpc_template_escape(text + len, REPLY_WRITER_RECORD_VALUE(record), record->value_len);
+                    break;
+                case REPLY_WRITER_VALUE_BOOLEAN:
+                    len += sprintf(text + len, "%s", record->number ? "true" : "false");
+                    break;
+                default:
+                    len += sprintf(text + len, "%" PRId64, record->number);
+                    break;
+            }
+        }
+        text[len++] = '}';
+    }
+    text[len++] = ']';
+
+    rc = printbuf_memappend(pb, text, (int)len);
+    free(text);
+    return rc;
+}
+
+static int reply_writer_encode(rpc_codec_array_t *array, rpc_frame_buffer_t *buf)
+{
+    reply_writer_records_t *records = (reply_writer_records_t *)array;
+    size_t added_count = (records->added != NULL) ? json_object_array_length(records->added) : 0;
+    int rc;
+
+    rc = json_rpc_codec_encode_array(buf, added_count + records->count);
+    for (size_t i = 0; rc == RETURN_OK && i < added_count; ++i)
+    {
+        rc = json_rpc_codec_encode(json_object_array_get_idx(records->added, i), buf);
+    }
+    for (size_t offset = 0; rc == RETURN_OK && offset < records->len; offset += ((reply_writer_record_t *)(records->data + offset))->size)
+    {
+        reply_writer_record_t *record = (reply_writer_record_t *)(records->data + offset);
+
+        /* Members in the order json_hal_add_param() adds them. */
+        rc = json_rpc_codec_encode_map(buf, (record->type != NULL) ? 3 : 1);
+        rc = (rc == RETURN_OK) ? json_rpc_codec_encode_string(buf, JSON_RPC_FIELD_PARAM_NAME, sizeof(JSON_RPC_FIELD_PARAM_NAME) - 1) : rc;
+        rc = (rc == RETURN_OK) ? json_rpc_codec_encode_string(buf, REPLY_WRITER_RECORD_NAME(record), record->name_len) : rc;
+        if (rc != RETURN_OK || record->type == NULL)
+        {
+            continue;
+        }
+        rc = json_rpc_codec_encode_string(buf, JSON_RPC_FIELD_PARAM_TYPE, sizeof(JSON_RPC_FIELD_PARAM_TYPE) - 1);
+        rc = (rc == RETURN_OK) ? json_rpc_codec_encode_string(buf, record->type, strlen(record->type)) : rc;
+        rc = (rc == RETURN_OK) ? json_rpc_codec_encode_string(buf, JSON_RPC_FIELD_PARAM_VALUE, sizeof(JSON_RPC_FIELD_PARAM_VALUE) - 1) : rc;
+        if (rc != RETURN_OK)
+        {
+            continue;
+        }
+        switch (record->kind)
+        {
+            case REPLY_WRITER_VALUE_STRING:
+                rc = json_rpc_codec_encode_string(buf, REPLY_WRITER_RECORD_VALUE(record), record->value_len);
+                break;
+            case REPLY_WRITER_VALUE_BOOLEAN:
+                rc = json_rpc_codec_encode_boolean(buf, (int)record->number);
+                break;
+            default:
+                rc = json_rpc_codec_encode_int(buf, record->number);
+                break;
+        }
+    }
+    return rc;
+}
+
+static void reply_writer_free(json_object *jparams, void *userdata)
+{
+    reply_writer_records_t *records = (reply_writer_records_t *)userdata;
+
+    (void)jparams;
+    json_rpc_codec_unregister_array(&records->array);
+    json_object_put(records->added);
+    free(records->data);
+    free(records);
+}
+
 int json_hal_get_subscribe_event_request(json_object *jmsg, int index, hal_subscribe_event_request_t *param)
 {
     json_object *jparams = NULL;
@@ -41,6 +41,8 @@
 
 #define BUF_512 512
 
+#define JSON_HAL_ASYNC_DEFAULT_TIMEOUT_MS 5000
+
 
 typedef enum _eNotificationType
 {
@@ -53,6 +55,34 @@ typedef enum _eNotificationType
 }eNotificationType_t;
 
 
+/**
+ * @brief Traffic classes. Events and the actions listed in `control_actions` are
+ * control traffic, it is run and written ahead of the other (bulk) traffic.
+ */
+typedef enum _json_hal_priority_t
+{
+    JSON_HAL_PRIORITY_CONTROL = 0,
+    JSON_HAL_PRIORITY_BULK,
+    JSON_HAL_PRIORITY_COUNT
+}json_hal_priority_t;
+
+/**
+ * @brief Queue depths per traffic class, indexed by json_hal_priority_t.
+ */
+typedef struct _json_hal_queue_stats_t
+{
+    unsigned int jobs[JSON_HAL_PRIORITY_COUNT];                 /* Requests waiting for a worker thread. */
+    unsigned int max_jobs[JSON_HAL_PRIORITY_COUNT];             /* Highest value of jobs. */
+    unsigned long long queued_bytes[JSON_HAL_PRIORITY_COUNT];     /* Bytes waiting in the outbound queues of all the clients. */
+    unsigned long long max_queued_bytes[JSON_HAL_PRIORITY_COUNT]; /* Highest value of queued_bytes. */
+    unsigned long long messages[JSON_HAL_PRIORITY_COUNT];         /* Messages queued to the clients. */
+    unsigned long long busy[JSON_HAL_PRIORITY_COUNT];             /* Requests answered Busy, over the limits of their action. */
+    unsigned long long expired[JSON_HAL_PRIORITY_COUNT];          /* Requests dropped unanswered, their deadline passed before they ran. */
+    unsigned long long cancelled[JSON_HAL_PRIORITY_COUNT];        /* Requests cancelled by their client before they were answered. */
+    unsigned long long single_flight[JSON_HAL_PRIORITY_COUNT];    /* Requests of single flight actions. */
+    unsigned long long coalesced[JSON_HAL_PRIORITY_COUNT];        /* Single flight requests answered with the reply of an identical request in flight. */
+}json_hal_queue_stats_t;
+
 /* getSchemaResponse message */
 typedef struct _hal_schema_response_t
 {
@@ -66,6 +96,17 @@ typedef struct _hal_subscribe_event_request_t
     eNotificationType_t type;
 }hal_subscribe_event_request_t;
 
+/**
+ * @brief Writer appending the params of a getParameters reply without json objects,
+ * see json_hal_reply_writer_start(). Declared by the action callback, it holds no
+ * memory of its own and needs no clean up.
+ */
+typedef struct _json_hal_reply_writer_t
+{
+    json_object *params;                      /* params array of the reply, written from the records. */
+    struct _json_hal_reply_records_t *records; /* Params added, owned by the params array. */
+} json_hal_reply_writer_t;
+
 /**
  * @brief Typedefed action callback handler routine.
  * @param (IN) json_object instance pointing to request json message
@@ -75,6 +116,33 @@ typedef struct _hal_subscribe_event_request_t
  */
 typedef int (*action_callback) (const json_object* request_msg, const int params_count, json_object* reply_msg);
 
+/**
+ * @brief Opaque handle of a request handled by an asynchronous action callback.
+ */
+typedef void *json_hal_completion_t;
+
+/**
+ * @brief Typedefed asynchronous action callback handler routine.
+ * Returns without waiting for the result, the request is answered later by passing
+ * the filled reply_msg to json_hal_server_complete(). Both messages stay valid until then.
+ * @param (IN) json_object instance pointing to request json message
+ * @param (IN) params_count: Contains the number of parameters in the  request.
+ * @param (OUT) json_object instance to fill with the reply json message.
+ * @param (IN) Completion handle of the request.
+ * @return RETURN_OK if the request will be completed, RETURN_ERR to reply with a failure
+ * right away, the handle must not be completed then.
+ */
+typedef int (*async_action_callback) (const json_object* request_msg, const int params_count, json_object* reply_msg, json_hal_completion_t handle);
+
+/**
+ * @brief Typedefed outbound queue watermark callback routine.
+ * Invoked from the thread that crossed the watermark, must not block.
+ * @param (IN) client socket fd
+ * @param (IN) number of bytes queued for the client
+ * @return RETURN_OK in success case else returned RETURN_ERR.
+ */
+typedef int (*write_queue_callback) (const int fd, const size_t queued_bytes);
+
 /**
  * @brief  Initialise the rpc server.
  * @param  hal_conf_path  String contains the configuration file path
@@ -93,6 +161,99 @@ int json_hal_server_init(const char *hal_conf_path);
  */
 int  json_hal_server_register_action_callback(const char *action_name, const action_callback callback);
 
+/**
+ * @brief Register an asynchronous handler callback routine to the HAL server module.
+ *
+ * The callback starts the action and returns, the server thread goes on with the other
+ * requests meanwhile. The request is answered once json_hal_server_complete() is called,
+ * or with a failure reply by the library if it is not completed within timeout_ms.
+ *
+ * @param (IN) Action name indicates function. This action name could be embed in the request message
+ * @param (IN) Funcion pointer is the actual callback function. This callback should invoked when HAL server received a request for action_name
+ * @param (IN) Time in milliseconds given to complete a request, 0 for JSON_HAL_ASYNC_DEFAULT_TIMEOUT_MS.
+ * @return RETURN_OK if registration is successful else RETURN_ERR.
+ */
+int json_hal_server_register_async_action_callback(const char *action_name, const async_action_callback callback, const int timeout_ms);
+
+/**
+ * @brief Limit the requests of a registered action handled at once.
+ *
+ * Overrides the limits given in `action_limits` of the configuration file. A request
+ * above the limits is answered at once with the status "Busy", so the client can back
+ * off instead of waiting for its timeout. With worker threads a request waits for a
+ * free slot while fewer than max_queued requests wait, without workers and for
+ * asynchronous actions it is answered Busy straight away.
+ *
+ * @param (IN) Action name.
+ * @param (IN) Requests run at once, callbacks running or asynchronous requests not completed, 0 for no limit.
+ * @param (IN) Requests waiting for a worker thread, 0 for no limit.
+ * @return RETURN_OK if the limits are set else RETURN_ERR.
+ */
+int json_hal_server_set_action_limits(const char *action_name, const int max_in_flight, const int max_queued);
+
+/**
+ * @brief Share the reply of a registered action between identical requests.
+ *
+ * Overrides `single_flight_actions` of the configuration file. A request whose params
+ * are the same as the ones of a request of the action still waiting or running does
+ * not run the callback again, it gets a copy of that reply with its own reqId. Meant
+ * for read only actions such as getParameters. Asynchronous actions and requests of a
+ * batch are always run on their own. The share of the requests answered that way is
+ * coalesced / single_flight of json_hal_server_get_queue_stats().
+ *
+ * @param (IN) Action name.
+ * @param (IN) TRUE to share the replies, FALSE to run every request.
+ * @return RETURN_OK if the mode is set else RETURN_ERR.
+ */
+int json_hal_server_set_action_single_flight(const char *action_name, const int enable);
+
+/**
+ * @brief Complete a request handled by an asynchronous action callback.
+ *
+ * Can be called from any thread, also from the callback itself. The reply is dropped
+ * if the request timed out already. The handle is invalid afterwards.
+ *
+ * @param (IN) Completion handle given to the callback.
+ * @param (IN) The reply_msg given to the callback, filled in. NULL to reply with a failure.
+ * @return RETURN_OK if the reply is sent, RETURN_ERR if it was dropped.
+ */
+int json_hal_server_complete(json_hal_completion_t handle, json_object *reply_msg);
+
+/**
+ * @brief Time left to complete a request handled by an asynchronous action callback.
+ *
+ * The earlier of the timeout given at registration and the deadline the client
+ * stamped the request with. Can be called from any thread while the handle is valid.
+ *
+ * @param (IN) Completion handle given to the callback.
+ * @return time left in milliseconds, 0 once it passed.
+ */
+int json_hal_server_get_time_left(json_hal_completion_t handle);
+
+/**
+ * @brief Check whether the client cancelled a request handled by an asynchronous action callback.
+ *
+ * A cancelled request is not answered, the callback can stop its work and complete
+ * the request, json_hal_server_complete() then returns RETURN_ERR.
+ *
+ * @param (IN) Completion handle given to the callback.
+ * @return TRUE if the request was cancelled, FALSE else.
+ */
+int json_hal_server_is_cancelled(json_hal_completion_t handle);
+
+/**
+ * @brief Register the outbound queue watermark callbacks.
+ *
+ * Every client connection has a bounded outbound queue of `write_queue_size` bytes.
+ * high_watermark_cb is invoked once a queue grows above 3/4 of it, low_watermark_cb
+ * once the same queue drained below 1/4 again. Must be called after json_hal_server_init().
+ *
+ * @param (IN) Callback invoked when the client is not keeping up, NULL if not needed.
+ * @param (IN) Callback invoked when the client caught up again, NULL if not needed.
+ * @return RETURN_OK if registration is successful else RETURN_ERR.
+ */
+int json_hal_server_register_write_queue_callbacks(const write_queue_callback high_watermark_cb, const write_queue_callback low_watermark_cb);
+
 /**
  * @brief Start the server socket thread.
  * This will start the server socket and listen for client connections and requests.
@@ -109,6 +270,13 @@ int json_hal_server_run();
  */
 int json_hal_server_publish_event(const char *event_name, const char *event_value);
 
+/**
+ * @brief Get the queue depths of the control and bulk traffic classes.
+ * @param (OUT) Statistics filled in.
+ * @return RETURN_OK in success case else RETURN_ERR.
+ */
+int json_hal_server_get_queue_stats(json_hal_queue_stats_t *stats);
+
 /**
  * @brief Clean up function
  * Application needs to call this API once they complete their process.
@@ -142,4 +310,27 @@ int json_hal_add_schema_response(json_object *jreply, hal_schema_response_t *par
  * @return RETURN_OK in success case else RETURN_ERR.
  */
 int json_hal_add_result_status(json_object *jreply, eResult_t result);
+
+/**
+ * @brief Start writing the params of a getParameters reply without json objects.
+ *
+ * json_hal_reply_writer_add_param() then appends each param to one growing buffer of
+ * records, and the params array of the reply is written from it when the reply is
+ * serialised, as json text or MessagePack. Meant for replies carrying many params.
+ * The params already added with json_hal_add_param() are kept, but it must not be
+ * used on the reply afterwards. The params are always written without whitespace.
+ *
+ * @param (OUT) writer - Writer to start, declared by the caller
+ * @param (IN) jreply - Pointer to JSON reply object
+ * @return RETURN_OK in success case else RETURN_ERR.
+ */
+int json_hal_reply_writer_start(json_hal_reply_writer_t *writer, json_object *jreply);
+
+/**
+ * @brief Append a param to a getParameters reply, as json_hal_add_param() does.
+ * @param (IN) writer - Writer started on the reply
+ * @param (IN) param - Pointer to hal_param_t structure
+ * @return RETURN_OK in success case else RETURN_ERR.
+ */
+int json_hal_reply_writer_add_param(json_hal_reply_writer_t *writer, const hal_param_t *param);
 #endif
@@ -0,0 +1,1294 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+/**
+ * @file json_hal_server_bench.c
+ * @description Benchmark application for the HAL server socket loop.
+ *
+ * The application starts the HAL server in-process, opens 1, 32 and 512 raw
+ * client connections to it and reports:
+ *    - CPU consumed by the process while all the connections are idle.
+ *    - Round trip latency (avg/p50/p99) of a getParameters request, sent
+ *      round robin over the connected clients.
+ *    - CPU time spent per request.
+ *    - Throughput (requests/s) with 1, 4 and 16 clients sending in parallel,
+ *      each client waiting for its reply before sending the next request.
+ *    - Server side send system calls per reply, with every client waiting for
+ *      its reply and with 16 requests pipelined per client.
+ *    - Time to get the replies to a burst of 1, 10 and 100 requests, sent one
+ *      by one and as a single batch (json array of requests).
+ *    - Cost of looking up the action of a request among 1, 8, 32 and 128
+ *      registered actions, with the action table and with a list walk.
+ *    - Size and serialisation time of getParameters replies carrying 1, 10
+ *      and 100 parameters, in the plain and the pretty wire format.
+ *    - Size, encoding and decoding time of the same replies as text json and
+ *      as MessagePack.
+ *    - Time to build and serialise the same replies from json objects and
+ *      with a reply writer.
+ *    - Time to encode the same replies, and a `Not Supported` result, as a
+ *      whole and with the module, version and status serialised beforehand.
+ *    - Time to split and parse 1, 10 and 100 replies received glued together,
+ *      restarting the tokener at each message and with the structural scanner.
+ *    - Time to read every parameter of a message carrying 10, 100 and 500
+ *      parameters, copied with json_hal_get_param and in place with
+ *      json_hal_get_param_view.
+ *
+ * Usage: test_json_hal_bench <configuration file> [requests per run]
+ *
+ * If the configuration enables `message_framing`, requests and replies are
+ * sent as length prefixed frames. If it sets `server_socket_path`, the clients
+ * connect over the AF_UNIX SOCK_SEQPACKET socket instead of TCP loopback; run
+ * the benchmark once with each configuration to compare both transports.
+ * Set `server_threads` to compare the throughput with several reactor threads.
+ * With `shared_memory_ring_size` set as well, every client offers shared memory
+ * rings to the server and sends its requests through them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <assert.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <poll.h>
+#include <json-c/json.h>
+#include "json_hal_server.h"
+#include "tcp_server.h"
+#include "json_rpc_common.h"
+#include "json_rpc_frame.h"
+#include "json_rpc_shm.h"
+#include "json_rpc_table.h"
+#include "json_rpc_codec.h"
+#include "json_rpc_template.h"
+#include "json_rpc_scan.h"
+
+#define BENCH_DEFAULT_REQUESTS 5000
+#define BENCH_IDLE_PERIOD_US 1000000
+#define BENCH_CONNECT_RETRY 100
+#define BENCH_THROUGHPUT_PERIOD_US 1000000
+#define BENCH_PIPELINE_ROUNDS 200
+#define BENCH_DISPATCH_LOOKUPS 2000000
+#define BENCH_BATCH_ROUNDS 200
+#define BENCH_WIRE_ROUNDS 20000
+#define BENCH_GLUED_PARAMS 10
+
+#ifndef HAVE_JSON_TOKENER_GET_PARSE_END
+#define json_tokener_get_parse_end(tok) ((tok)->char_offset)
+#endif
+
+static const int bench_client_counts[] = {1, 32, 512};
+static const int bench_throughput_client_counts[] = {1, 4, 16};
+static const int bench_pipeline_depths[] = {1, 16};
+static const int bench_batch_sizes[] = {1, 10, 100};
+static const int bench_dispatch_action_counts[] = {1, 8, 32, 128};
+static const int bench_wire_param_counts[] = {1, 10, 100};
+static const int bench_glued_message_counts[] = {1, 10, 100};
+static const int bench_param_view_counts[] = {10, 100, 500};
+
+static hal_config_t g_bench_config;
+static volatile int g_bench_stop = FALSE;
+
+/**
+ * Shared memory rings of the client connections, indexed by socket fd.
+ */
+static rpc_shm_channel_t **g_bench_shm = NULL;
+static int g_bench_shm_size = 0;
+
+/**
+ * Client thread of the throughput phase.
+ */
+typedef struct bench_worker_t
+{
+    pthread_t thread;
+    int sd;
+    rpc_frame_buffer_t rx;
+    long requests;
+    int failed;
+} bench_worker_t;
+
+static int bench_getparam_cb(const json_object *jmsg, int param_count, json_object *jreply)
+{
+    hal_param_t param;
+
+    memset(&param, 0, sizeof(param));
+    strncpy(param.name, "Device.DSL.Line.1.Status", sizeof(param.name) - 1);
+    strncpy(param.value, "Up", sizeof(param.value) - 1);
+    param.type = PARAM_STRING;
+    return json_hal_add_param(jreply, GET_RESPONSE_MESSAGE, &param);
+}
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long long cpu_ns(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ((long long)ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000LL +
+           ((long long)ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000LL;
+}
+
+static int cmp_ll(const void *a, const void *b)
+{
+    long long x = *(const long long *)a;
+    long long y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Offer shared memory rings over the connected unix socket and wait until the server accepted them.
+ */
+static int bench_offer_shm(int sd)
+{
+    rpc_frame_buffer_t rx;
+    rpc_frame_header_t header;
+    rpc_shm_channel_t *shm;
+    uint32_t ring_size;
+    int fds[3];
+    int rc;
+
+    if (sd >= g_bench_shm_size || (shm = calloc(1, sizeof(rpc_shm_channel_t))) == NULL)
+    {
+        return RETURN_ERR;
+    }
+    if (json_rpc_shm_create(shm, g_bench_config.shared_memory_ring_size) != RETURN_OK)
+    {
+        free(shm);
+        return RETURN_ERR;
+    }
+    ring_size = htonl(shm->ring_size);
+    fds[0] = shm->memfd;
+    fds[1] = shm->tx_doorbell;
+    fds[2] = shm->rx_doorbell;
+    memset(&rx, 0, sizeof(rx));
+    rx.record_size = RPC_FRAME_MAX_RECORD;
+    rc = json_rpc_frame_send_fds(sd, RPC_FRAME_TYPE_SHM_OFFER, (const char *)&ring_size, sizeof(ring_size), fds, 3);
+    while (rc == RETURN_OK && (rc = json_rpc_frame_next(&rx, &header)) == FALSE)
+    {
+        rc = (json_rpc_frame_recv(sd, &rx) > 0) ? RETURN_OK : RETURN_ERR;
+    }
+    json_rpc_frame_buffer_free(&rx);
+    if (rc != TRUE || header.type != RPC_FRAME_TYPE_SHM_ACCEPT)
+    {
+        json_rpc_shm_close(shm);
+        free(shm);
+        return RETURN_ERR;
+    }
+    g_bench_shm[sd] = shm;
+    return RETURN_OK;
+}
+
+/**
+ * Close a client connection and its shared memory rings.
+ */
+static void bench_disconnect(int sd)
+{
+    if (sd >= 0 && sd < g_bench_shm_size && g_bench_shm[sd] != NULL)
+    {
+        json_rpc_shm_close(g_bench_shm[sd]);
+        free(g_bench_shm[sd]);
+        g_bench_shm[sd] = NULL;
+    }
+    close(sd);
+}
+
+static int bench_connect(void)
+{
+    struct sockaddr_in addr;
+    struct sockaddr_un addr_un;
+    struct sockaddr *server_addr = (struct sockaddr *)&addr;
+    socklen_t server_addr_len = sizeof(addr);
+    int one = 1;
+    int sd = -1;
+
+    if (g_bench_config.server_socket_path[0] != '\0')
+    {
+        sd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+        memset(&addr_un, 0, sizeof(addr_un));
+        addr_un.sun_family = AF_UNIX;
+        strncpy(addr_un.sun_path, g_bench_config.server_socket_path, sizeof(addr_un.sun_path) - 1);
+        server_addr = (struct sockaddr *)&addr_un;
+        server_addr_len = sizeof(addr_un);
+    }
+    else
+    {
+        sd = socket(AF_INET, SOCK_STREAM, 0);
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        addr.sin_port = htons(g_bench_config.server_port_number);
+    }
+    if (sd < 0)
+    {
+        return RETURN_ERR;
+    }
+    for (int retry = 0; retry < BENCH_CONNECT_RETRY; ++retry)
+    {
+        if (connect(sd, server_addr, server_addr_len) == 0)
+        {
+            if (g_bench_config.server_socket_path[0] == '\0')
+            {
+                setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            }
+            else if (g_bench_config.shared_memory_ring_size > 0 && bench_offer_shm(sd) != RETURN_OK)
+            {
+                break;
+            }
+            return sd;
+        }
+        usleep(20000);
+    }
+    close(sd);
+    return RETURN_ERR;
+}
+
+/**
+ * Send one framed request and block until the reply frame has been received.
+ */
+static int bench_framed_round_trip(int sd, rpc_frame_buffer_t *rx, const char *request, int request_len)
+{
+    rpc_frame_header_t header;
+    int rc;
+
+    if (g_bench_config.server_socket_path[0] != '\0')
+    {
+        rx->record_size = RPC_FRAME_MAX_RECORD;
+    }
+
+    if (json_rpc_frame_send(sd, RPC_FRAME_TYPE_JSON, RPC_FRAME_FLAG_NONE, request, request_len) != RETURN_OK)
+    {
+        return RETURN_ERR;
+    }
+    while ((rc = json_rpc_frame_next(rx, &header)) == FALSE)
+    {
+        if (json_rpc_frame_recv(sd, rx) <= 0)
+        {
+            return RETURN_ERR;
+        }
+    }
+    if (rc == TRUE)
+    {
+        json_rpc_frame_consume(rx, &header);
+        return RETURN_OK;
+    }
+    return RETURN_ERR;
+}
+
+/**
+ * Send one request through the shared memory rings and block on the doorbell until the reply is in.
+ */
+static int bench_shm_round_trip(rpc_shm_channel_t *shm, const char *request, int request_len)
+{
+    struct pollfd pfd = {.fd = shm->rx_doorbell, .events = POLLIN};
+    char *payload;
+    uint32_t len;
+    uint8_t type;
+    int rc;
+
+    if (json_rpc_shm_send(shm, RPC_FRAME_TYPE_JSON, request, request_len) != RETURN_OK)
+    {
+        return RETURN_ERR;
+    }
+    while ((rc = json_rpc_shm_next(shm, &type, &payload, &len)) == FALSE)
+    {
+        if (json_rpc_shm_prepare_wait(shm) == TRUE && poll(&pfd, 1, -1) < 0 && errno != EINTR)
+        {
+            return RETURN_ERR;
+        }
+    }
+    if (rc != TRUE)
+    {
+        return RETURN_ERR;
+    }
+    json_rpc_shm_consume(shm);
+    return RETURN_OK;
+}
+
+/**
+ * Send one request and block until a complete json reply has been received.
+ */
+static int bench_round_trip(int sd, rpc_frame_buffer_t *rx, const char *request, int request_len)
+{
+    char buffer[MAX_BUFFER_SIZE];
+    json_tokener *tok = NULL;
+    json_object *jreply = NULL;
+    int rc = RETURN_ERR;
+
+    if (sd < g_bench_shm_size && g_bench_shm[sd] != NULL)
+    {
+        return bench_shm_round_trip(g_bench_shm[sd], request, request_len);
+    }
+    if (g_bench_config.message_framing == TRUE)
+    {
+        return bench_framed_round_trip(sd, rx, request, request_len);
+    }
+
+    tok = json_tokener_new();
+    if (send(sd, request, request_len, 0) != request_len)
+    {
+        json_tokener_free(tok);
+        return RETURN_ERR;
+    }
+    while (jreply == NULL)
+    {
+        int len = recv(sd, buffer, sizeof(buffer), 0);
+        if (len <= 0)
+        {
+            break;
+        }
+        jreply = json_tokener_parse_ex(tok, buffer, len);
+        if (jreply == NULL && json_tokener_get_error(tok) != json_tokener_continue)
+        {
+            break;
+        }
+    }
+    if (jreply != NULL)
+    {
+        rc = RETURN_OK;
+        json_object_put(jreply);
+    }
+    json_tokener_free(tok);
+    return rc;
+}
+
+static int bench_request(char *request, size_t size, int id)
+{
+    return snprintf(request, size,
+                    "{\"module\":\"%s\",\"version\":\"%s\",\"action\":\"getParameters\",\"reqId\":\"%8.8d\","
+                    "\"params\":[{\"name\":\"Device.DSL.Line.1.Status\"}]}",
+                    g_bench_config.hal_module_name, g_bench_config.hal_module_version, id);
+}
+
+static void bench_run(int client_count, int requests)
+{
+    static rpc_frame_buffer_t rx;
+    int *socks = calloc(client_count, sizeof(int));
+    long long *samples = calloc(requests, sizeof(long long));
+    char request[BUF_256];
+    long long start, cpu_start, idle_cpu, total = 0;
+    int connected = 0;
+
+    assert(socks != NULL && samples != NULL);
+    for (connected = 0; connected < client_count; ++connected)
+    {
+        socks[connected] = bench_connect();
+        if (socks[connected] < 0)
+        {
+            LOGERROR("Failed to connect client %d", connected);
+            break;
+        }
+    }
+    if (connected != client_count)
+    {
+        goto CLEANUP;
+    }
+
+    /* Idle phase: every client is connected but silent. */
+    usleep(100000);
+    cpu_start = cpu_ns();
+    usleep(BENCH_IDLE_PERIOD_US);
+    idle_cpu = cpu_ns() - cpu_start;
+
+    /* Active phase: requests are sent round robin over the clients. */
+    cpu_start = cpu_ns();
+    for (int i = 0; i < requests; ++i)
+    {
+        int len = bench_request(request, sizeof(request), i);
+        start = now_ns();
+        if (bench_round_trip(socks[i % client_count], &rx, request, len) != RETURN_OK)
+        {
+            LOGERROR("Request %d failed", i);
+            goto CLEANUP;
+        }
+        samples[i] = now_ns() - start;
+        total += samples[i];
+    }
+    cpu_start = cpu_ns() - cpu_start;
+    qsort(samples, requests, sizeof(long long), cmp_ll);
+
+    printf("%7d %12.3f %10.1f %10.1f %10.1f %14.2f\n",
+           client_count,
+           idle_cpu / 1000000.0 / (BENCH_IDLE_PERIOD_US / 1000000.0),
+           total / 1000.0 / requests,
+           samples[requests / 2] / 1000.0,
+           samples[(requests * 99) / 100] / 1000.0,
+           cpu_start / 1000.0 / requests);
+    fflush(stdout);
+
+CLEANUP:
+    for (int i = 0; i < connected; ++i)
+    {
+        bench_disconnect(socks[i]);
+    }
+    /* Let the server reap the closed connections before the next run. */
+    usleep(200000);
+    free(socks);
+    free(samples);
+}
+
+static void *bench_worker(void *arg)
+{
+    bench_worker_t *worker = (bench_worker_t *)arg;
+    char request[BUF_256];
+
+    while (g_bench_stop == FALSE)
+    {
+        int len = bench_request(request, sizeof(request), (int)worker->requests);
+        if (bench_round_trip(worker->sd, &worker->rx, request, len) != RETURN_OK)
+        {
+            worker->failed = TRUE;
+            break;
+        }
+        worker->requests++;
+    }
+    return NULL;
+}
+
+static void bench_throughput(int client_count)
+{
+    bench_worker_t *workers = calloc(client_count, sizeof(bench_worker_t));
+    long long start, elapsed, cpu_start;
+    long total = 0;
+    int started = 0, failed = FALSE;
+
+    assert(workers != NULL);
+    for (int i = 0; i < client_count; ++i)
+    {
+        workers[i].sd = bench_connect();
+        if (workers[i].sd < 0)
+        {
+            LOGERROR("Failed to connect client %d", i);
+            client_count = i;
+            goto CLEANUP;
+        }
+    }
+
+    g_bench_stop = FALSE;
+    start = now_ns();
+    cpu_start = cpu_ns();
+    for (started = 0; started < client_count; ++started)
+    {
+        if (pthread_create(&workers[started].thread, NULL, bench_worker, &workers[started]) != 0)
+        {
+            break;
+        }
+    }
+    usleep(BENCH_THROUGHPUT_PERIOD_US);
+    g_bench_stop = TRUE;
+    for (int i = 0; i < started; ++i)
+    {
+        pthread_join(workers[i].thread, NULL);
+        total += workers[i].requests;
+        failed |= workers[i].failed;
+    }
+    elapsed = now_ns() - start;
+    cpu_start = cpu_ns() - cpu_start;
+
+    printf("%7d %14.0f %14.2f%s\n", client_count, total * 1000000000.0 / elapsed,
+           total ? cpu_start / 1000.0 / total : 0.0, failed ? "  (failed)" : "");
+    fflush(stdout);
+
+CLEANUP:
+    for (int i = 0; i < client_count; ++i)
+    {
+        bench_disconnect(workers[i].sd);
+        json_rpc_frame_buffer_free(&workers[i].rx);
+    }
+    usleep(200000);
+    free(workers);
+}
+
+/**
+ * Send the requests of every round in one write and report the server side
+ * send system calls per reply. Needs message framing.
+ */
+static void bench_pipeline(int depth)
+{
+    rpc_frame_buffer_t tx, rx;
+    rpc_frame_header_t header;
+    rpc_server_stats_t before, after;
+    char request[BUF_256];
+    int sd = bench_connect();
+    int failed = FALSE;
+
+    if (sd < 0)
+    {
+        LOGERROR("Failed to connect client");
+        return;
+    }
+    memset(&tx, 0, sizeof(tx));
+    memset(&rx, 0, sizeof(rx));
+    if (g_bench_config.server_socket_path[0] != '\0')
+    {
+        rx.record_size = RPC_FRAME_MAX_RECORD;
+    }
+
+    json_rpc_server_get_stats(&before);
+    for (int round = 0; round < BENCH_PIPELINE_ROUNDS && failed == FALSE; ++round)
+    {
+        tx.len = 0;
+        for (int i = 0; i < depth; ++i)
+        {
+            int len = bench_request(request, sizeof(request), round * depth + i);
+            json_rpc_frame_encode(&tx, RPC_FRAME_TYPE_JSON, RPC_FRAME_FLAG_NONE, request, len);
+        }
+        if (send(sd, tx.data, tx.len, 0) != (ssize_t)tx.len)
+        {
+            failed = TRUE;
+            break;
+        }
+        for (int replies = 0; replies < depth; ++replies)
+        {
+            int rc;
+            while ((rc = json_rpc_frame_next(&rx, &header)) == FALSE)
+            {
+                if (json_rpc_frame_recv(sd, &rx) <= 0)
+                {
+                    break;
+                }
+            }
+            if (rc != TRUE)
+            {
+                failed = TRUE;
+                break;
+            }
+            json_rpc_frame_consume(&rx, &header);
+        }
+    }
+    json_rpc_server_get_stats(&after);
+
+    printf("%7d %16.3f%s\n", depth,
+           (after.messages > before.messages) ?
+               (double)(after.send_calls - before.send_calls) / (after.messages - before.messages) : 0.0,
+           failed ? "  (failed)" : "");
+    fflush(stdout);
+
+    bench_disconnect(sd);
+    json_rpc_frame_buffer_free(&tx);
+    json_rpc_frame_buffer_free(&rx);
+    usleep(200000);
+}
+
+/**
+ * Time bursts of `burst` requests, sent one by one waiting for every reply and
+ * sent as one batch answered with one array of replies.
+ */
+static void bench_batch(int burst)
+{
+    rpc_frame_buffer_t rx;
+    char request[BUF_256];
+    size_t size = (size_t)burst * BUF_256 + 2;
+    char *batch = malloc(size);
+    long long single = 0, batched = 0, start;
+    int failed = FALSE;
+    int sd = bench_connect();
+
+    if (sd < 0 || batch == NULL)
+    {
+        LOGERROR("Failed to connect client");
+        free(batch);
+        return;
+    }
+    memset(&rx, 0, sizeof(rx));
+
+    for (int round = 0; round < BENCH_BATCH_ROUNDS && failed == FALSE; ++round)
+    {
+        start = now_ns();
+        for (int i = 0; i < burst; ++i)
+        {
+            int len = bench_request(request, sizeof(request), round * burst + i);
+            if (bench_round_trip(sd, &rx, request, len) != RETURN_OK)
+            {
+                failed = TRUE;
+                break;
+            }
+        }
+        single += now_ns() - start;
+
+        int len = 0;
+        batch[len++] = '[';
+        for (int i = 0; i < burst; ++i)
+        {
+            if (i > 0)
+            {
+                batch[len++] = ',';
+            }
+            len += bench_request(&batch[len], size - len, round * burst + i);
+        }
+        batch[len++] = ']';
+        start = now_ns();
+        if (bench_round_trip(sd, &rx, batch, len) != RETURN_OK)
+        {
+            failed = TRUE;
+        }
+        batched += now_ns() - start;
+    }
+
+    printf("%5d %14.1f %13.1f %9.2f%s\n", burst,
+           single / 1000.0 / BENCH_BATCH_ROUNDS, batched / 1000.0 / BENCH_BATCH_ROUNDS,
+           batched > 0 ? (double)single / batched : 0.0, failed ? "  (failed)" : "");
+    fflush(stdout);
+
+    bench_disconnect(sd);
+    json_rpc_frame_buffer_free(&rx);
+    free(batch);
+    usleep(200000);
+}
+
+/**
+ * @brief Measure the cost of finding the action of a request among `action_count`
+ * registered ones, looked up in an action table and by walking them in order.
+ */
+static void bench_dispatch(int action_count)
+{
+    char (*names)[MAX_FUNCTION_LEN] = calloc(action_count, MAX_FUNCTION_LEN);
+    rpc_table_t table = {0};
+    assert(names != NULL);
+    for (int i = 0; i < action_count; ++i)
+    {
+        snprintf(names[i], MAX_FUNCTION_LEN, "getParameters%03d", i);
+        json_rpc_table_insert(&table, names[i], names[i]);
+    }
+
+    volatile uintptr_t sink = 0;
+    long long start = now_ns();
+    for (int i = 0; i < BENCH_DISPATCH_LOOKUPS; ++i)
+    {
+        sink += (uintptr_t)json_rpc_table_lookup(&table, names[i % action_count]);
+    }
+    long long table_ns = now_ns() - start;
+
+    start = now_ns();
+    for (int i = 0; i < BENCH_DISPATCH_LOOKUPS; ++i)
+    {
+        const char *name = names[i % action_count];
+        for (int j = 0; j < action_count; ++j)
+        {
+            if (!strcmp(names[j], name))
+            {
+                sink += (uintptr_t)names[j];
+                break;
+            }
+        }
+    }
+    long long list_ns = now_ns() - start;
+
+    printf("%-8d %-14.1f %.1f\n", action_count, (double)table_ns / BENCH_DISPATCH_LOOKUPS,
+           (double)list_ns / BENCH_DISPATCH_LOOKUPS);
+    json_rpc_table_free(&table);
+    free(names);
+}
+
+/**
+ * @brief Create a getParameters reply header with an empty params array.
+ */
+static json_object *bench_create_reply_header(void)
+{
+    json_object *jreply = json_object_new_object();
+    assert(jreply != NULL);
+
+    json_object_object_add(jreply, JSON_RPC_FIELD_MODULE, json_object_new_string(g_bench_config.hal_module_name));
+    json_object_object_add(jreply, JSON_RPC_FIELD_VERSION, json_object_new_string(g_bench_config.hal_module_version));
+    json_object_object_add(jreply, JSON_RPC_FIELD_ACTION, json_object_new_string(JSON_RPC_ACTION_RESULT));
+    json_object_object_add(jreply, JSON_RPC_FIELD_ID, json_object_new_string("12345"));
+    json_object_object_add(jreply, JSON_RPC_FIELD_PARAMS, json_object_new_array());
+    return jreply;
+}
+
+/**
+ * @brief Fill the parameter `index` of the benchmark replies.
+ */
+static void bench_fill_param(hal_param_t *param, int index)
+{
+    memset(param, 0, sizeof(*param));
+    snprintf(param->name, sizeof(param->name), "Device.DSL.Line.1.Stats.Showtime.Counter%d", index);
+    snprintf(param->value, sizeof(param->value), "%d", index * 1000);
+    param->type = PARAM_UNSIGNED_INTEGER;
+}
+
+/**
+ * @brief Create a getParameters reply carrying `param_count` parameters.
+ */
+static json_object *bench_create_reply(int param_count)
+{
+    json_object *jreply = bench_create_reply_header();
+    hal_param_t param;
+
+    for (int i = 0; i < param_count; ++i)
+    {
+        bench_fill_param(&param, i);
+        json_hal_add_param(jreply, GET_RESPONSE_MESSAGE, &param);
+    }
+    return jreply;
+}
+
+/**
+ * @brief Measure the size of a getParameters reply carrying `param_count` parameters
+ * and the time to serialise it, in the plain and the pretty wire format.
+ */
+static void bench_wire_format(int param_count)
+{
+    json_object *jreply = bench_create_reply(param_count);
+    size_t plain_bytes = 0;
+    size_t pretty_bytes = 0;
+
+    long long start = now_ns();
+    for (int i = 0; i < BENCH_WIRE_ROUNDS; ++i)
+    {
+        plain_bytes = strlen(json_object_to_json_string_ext(jreply, json_hal_get_wire_flags(WIRE_FORMAT_PLAIN)));
+    }
+    long long plain_ns = now_ns() - start;
+
+    start = now_ns();
+    for (int i = 0; i < BENCH_WIRE_ROUNDS; ++i)
+    {
+        pretty_bytes = strlen(json_object_to_json_string_ext(jreply, json_hal_get_wire_flags(WIRE_FORMAT_PRETTY)));
+    }
+    long long pretty_ns = now_ns() - start;
+
+    printf("%-7d %-12zu %-13zu %-12.2f %.2f\n", param_count, plain_bytes, pretty_bytes,
+           (double)plain_ns / BENCH_WIRE_ROUNDS / 1000, (double)pretty_ns / BENCH_WIRE_ROUNDS / 1000);
+    json_object_put(jreply);
+}
+
+/**
+ * @brief Measure the size of a getParameters reply carrying `param_count` parameters
+ * and the time to encode and decode it, as plain text json and as MessagePack.
+ */
+static void bench_wire_encoding(int param_count)
+{
+    json_object *jreply = bench_create_reply(param_count);
+    rpc_frame_buffer_t buf = {0};
+    char *text = strdup(json_object_to_json_string_ext(jreply, json_hal_get_wire_flags(WIRE_FORMAT_PLAIN)));
+    json_object *jdecoded = NULL;
+    assert(text != NULL);
+
+    long long start = now_ns();
+    for (int i = 0; i < BENCH_WIRE_ROUNDS; ++i)
+    {
+        json_object_to_json_string_ext(jreply, json_hal_get_wire_flags(WIRE_FORMAT_PLAIN));
+    }
+    long long json_encode_ns = now_ns() - start;
+
+    start = now_ns();
+    for (int i = 0; i < BENCH_WIRE_ROUNDS; ++i)
+    {
+        buf.len = 0;
+        json_rpc_codec_encode(jreply, &buf);
+    }
+    long long msgpack_encode_ns = now_ns() - start;
+
+    start = now_ns();
+    for (int i = 0; i < BENCH_WIRE_ROUNDS; ++i)
+    {
+        jdecoded = json_tokener_parse(text);
+        assert(jdecoded != NULL);
+        json_object_put(jdecoded);
+    }
+    long long json_decode_ns = now_ns() - start;
+
+    start = now_ns();
+    for (int i = 0; i < BENCH_WIRE_ROUNDS; ++i)
+    {
+        jdecoded = json_rpc_codec_decode(buf.data, buf.len);
+        assert(jdecoded != NULL);
+        json_object_put(jdecoded);
+    }
+    long long msgpack_decode_ns = now_ns() - start;
+
+    printf("%-7d %-11zu %-14zu %-12.2f %-15.2f %-12.2f %.2f\n", param_count, strlen(text), buf.len,
+           (double)json_encode_ns / BENCH_WIRE_ROUNDS / 1000, (double)msgpack_encode_ns / BENCH_WIRE_ROUNDS / 1000,
+           (double)json_decode_ns / BENCH_WIRE_ROUNDS / 1000, (double)msgpack_decode_ns / BENCH_WIRE_ROUNDS / 1000);
+    json_rpc_frame_buffer_free(&buf);
+    free(text);
+    json_object_put(jreply);
+}
+
+/**
+ * @brief Measure the time to build and serialise a getParameters reply carrying
+ * `param_count` parameters, added as json objects and with a reply writer.
+ */
+static void bench_reply_writer(int param_count)
+{
+    json_hal_reply_writer_t writer;
+    json_object *jreply = NULL;
+    hal_param_t param;
+    size_t tree_bytes = 0;
+    size_t writer_bytes = 0;
+
+    long long start = now_ns();
+    for (int i = 0; i < BENCH_WIRE_ROUNDS; ++i)
+    {
+        jreply = bench_create_reply(param_count);
+        tree_bytes = strlen(json_object_to_json_string_ext(jreply, json_hal_get_wire_flags(WIRE_FORMAT_PLAIN)));
+        json_object_put(jreply);
+    }
+    long long tree_ns = now_ns() - start;
+
+    start = now_ns();
+    for (int i = 0; i < BENCH_WIRE_ROUNDS; ++i)
+    {
+        jreply = bench_create_reply_header();
+        json_hal_reply_writer_start(&writer, jreply);
+        for (int j = 0; j < param_count; ++j)
+        {
+            bench_fill_param(&param, j);
+            json_hal_reply_writer_add_param(&writer, &param);
+        }
+        writer_bytes = strlen(json_object_to_json_string_ext(jreply, json_hal_get_wire_flags(WIRE_FORMAT_PLAIN)));
+        json_object_put(jreply);
+    }
+    long long writer_ns = now_ns() - start;
+
+    assert(tree_bytes == writer_bytes);
+    printf("%-7d %-11zu %-12.2f %.2f\n", param_count, tree_bytes,
+           (double)tree_ns / BENCH_WIRE_ROUNDS / 1000, (double)writer_ns / BENCH_WIRE_ROUNDS / 1000);
+}
+
+/**
+ * @brief Create a result reply with a `Not Supported` status.
+ */
+static json_object *bench_create_status_reply(void)
+{
+    json_object *jreply = json_object_new_object();
+    json_object *jresult = json_object_new_object();
+    assert(jreply != NULL && jresult != NULL);
+
+    json_object_object_add(jresult, JSON_RPC_PARAM_STATUS_FIELD, json_object_new_string(JSON_RPC_STATUS_NOT_SUPPORTED));
+    json_object_object_add(jreply, JSON_RPC_FIELD_MODULE, json_object_new_string(g_bench_config.hal_module_name));
+    json_object_object_add(jreply, JSON_RPC_FIELD_VERSION, json_object_new_string(g_bench_config.hal_module_version));
+    json_object_object_add(jreply, JSON_RPC_FIELD_ACTION, json_object_new_string(JSON_RPC_ACTION_RESULT));
+    json_object_object_add(jreply, JSON_RPC_FIELD_ID, json_object_new_string("12345"));
+    json_object_object_add(jreply, JSON_RPC_FILED_RESULT, jresult);
+    return jreply;
+}
+
+/**
+ * @brief Measure the time to encode a reply carrying `param_count` parameters, or a
+ * `Not Supported` result if 0, as a whole and with the serialised module and version
+ * members and result bodies spliced in, in text json and in MessagePack.
+ */
+static void bench_message_template(const rpc_template_t *tpl, int param_count)
+{
+    json_object *jreply = (param_count > 0) ? bench_create_reply(param_count) : bench_create_status_reply();
+    rpc_frame_buffer_t buf = {0};
+    char *text = NULL;
+    size_t bytes = 0;
+
+    long long start = now_ns();
+    for (int i = 0; i < BENCH_WIRE_ROUNDS; ++i)
+    {
+        /* Copied out of the json object, as the messages queued. */
+        text = strdup(json_object_to_json_string_ext(jreply, json_hal_get_wire_flags(WIRE_FORMAT_PLAIN)));
+        bytes = strlen(text);
+        free(text);
+    }
+    long long json_ns = now_ns() - start;
+
+    start = now_ns();
+    for (int i = 0; i < BENCH_WIRE_ROUNDS; ++i)
+    {
+        json_rpc_template_encode(tpl, jreply, RPC_CODEC_JSON, json_hal_get_wire_flags(WIRE_FORMAT_PLAIN), &buf);
+        assert(buf.len == bytes);
+        json_rpc_frame_buffer_free(&buf);
+    }
+    long long template_json_ns = now_ns() - start;
+
+    start = now_ns();
+    for (int i = 0; i < BENCH_WIRE_ROUNDS; ++i)
+    {
+        json_rpc_codec_encode(jreply, &buf);
+        bytes = buf.len;
+        json_rpc_frame_buffer_free(&buf);
+    }
+    long long msgpack_ns = now_ns() - start;
+
+    start = now_ns();
+    for (int i = 0; i < BENCH_WIRE_ROUNDS; ++i)
+    {
+        json_rpc_template_encode(tpl, jreply, RPC_CODEC_MSGPACK, 0, &buf);
+        assert(buf.len == bytes);
+        json_rpc_frame_buffer_free(&buf);
+    }
+    long long template_msgpack_ns = now_ns() - start;
+
+    printf("%-7d %-12.2f %-12.2f %-15.2f %.2f\n", param_count,
+           (double)json_ns / BENCH_WIRE_ROUNDS / 1000, (double)template_json_ns / BENCH_WIRE_ROUNDS / 1000,
+           (double)msgpack_ns / BENCH_WIRE_ROUNDS / 1000, (double)template_msgpack_ns / BENCH_WIRE_ROUNDS / 1000);
+    json_object_put(jreply);
+}
+
+/**
+ * @brief Create a tokener with the flags of the client and the server.
+ * @param also accept characters after the message
+ */
+static json_tokener *bench_new_tokener(int trailing)
+{
+    json_tokener *tok = json_tokener_new();
+    assert(tok != NULL);
+#ifdef JSON_TOKENER_ALLOW_TRAILING_CHARS
+    json_tokener_set_flags(tok, JSON_TOKENER_STRICT | (trailing ? JSON_TOKENER_ALLOW_TRAILING_CHARS : 0));
+#else
+    json_tokener_set_flags(tok, JSON_TOKENER_STRICT);
+#endif
+    return tok;
+}
+
+/**
+ * @brief Parse glued messages the way the client did without the scanner: a strict
+ * tokener fails at the start of the next message, the message is parsed again up
+ * to there with a new tokener.
+ * @return number of messages parsed.
+ */
+static int bench_split_restart(const char *data, int len)
+{
+    json_tokener *tok = bench_new_tokener(FALSE);
+    json_object *jobj = NULL;
+    int start = 0;
+    int end = len;
+    int count = 0;
+
+    while (start < len)
+    {
+        jobj = json_tokener_parse_ex(tok, data + start, end - start);
+        int parse_end = (int)json_tokener_get_parse_end(tok);
+        if (jobj == NULL && json_tokener_get_error(tok) == json_tokener_error_parse_unexpected &&
+            start + parse_end < end && data[start + parse_end] == '{')
+        {
+            end = start + parse_end;
+            json_tokener_free(tok);
+            tok = bench_new_tokener(FALSE);
+            continue;
+        }
+        if (jobj == NULL)
+        {
+            break;
+        }
+        json_object_put(jobj);
+        count++;
+        start += parse_end;
+        end = len;
+    }
+    json_tokener_free(tok);
+    return count;
+}
+
+/**
+ * @brief Parse glued messages with a tokener stopping at the end of each one,
+ * json-c 0.15 and later.
+ * @return number of messages parsed.
+ */
+static int bench_split_trailing(const char *data, int len)
+{
+    json_tokener *tok = bench_new_tokener(TRUE);
+    json_object *jobj = NULL;
+    int start = 0;
+    int count = 0;
+
+    while (start < len && (jobj = json_tokener_parse_ex(tok, data + start, len - start)) != NULL)
+    {
+        json_object_put(jobj);
+        count++;
+        start += (int)json_tokener_get_parse_end(tok);
+    }
+    json_tokener_free(tok);
+    return count;
+}
+
+/**
+ * @brief Parse glued messages split by the scanner beforehand.
+ * @param parse the messages, only split them if FALSE
+ * @return number of messages found.
+ */
+static int bench_split_scan(const char *data, int len, int parse)
+{
+    json_tokener *tok = bench_new_tokener(FALSE);
+    json_object *jobj = NULL;
+    size_t start = 0;
+    size_t message_len = 0;
+    int count = 0;
+
+    while ((message_len = json_rpc_scan_message(data + start, len - start)) > 0)
+    {
+        if (parse)
+        {
+            jobj = json_tokener_parse_ex(tok, data + start, message_len);
+            if (jobj == NULL)
+            {
+                break;
+            }
+            json_tokener_reset(tok);
+            json_object_put(jobj);
+        }
+        count++;
+        start += message_len;
+    }
+    json_tokener_free(tok);
+    return count;
+}
+
+/**
+ * @brief Measure the time to split and parse `message_count` getParameters replies
+ * received glued together, restarting a strict tokener, with a tokener accepting
+ * trailing characters, and with the scanner, and the time of the scanner alone.
+ */
+static void bench_glued(int message_count)
+{
+    json_object *jreply = bench_create_reply(BENCH_GLUED_PARAMS);
+    const char *text = json_object_to_json_string_ext(jreply, json_hal_get_wire_flags(WIRE_FORMAT_PLAIN));
+    size_t text_len = strlen(text);
+    int rounds = BENCH_WIRE_ROUNDS / message_count;
+    int len = (int)(text_len * message_count);
+    char *data = malloc(len);
+    int found = 0;
+    assert(data != NULL);
+
+    for (int i = 0; i < message_count; ++i)
+    {
+        memcpy(data + i * text_len, text, text_len);
+    }
+
+    long long start = now_ns();
+    for (int i = 0; i < rounds; ++i)
+    {
+        found += bench_split_restart(data, len);
+    }
+    long long restart_ns = now_ns() - start;
+    assert(found == rounds * message_count);
+    found = 0;
+
+    long long trailing_ns = -1;
+#ifdef JSON_TOKENER_ALLOW_TRAILING_CHARS
+    start = now_ns();
+    for (int i = 0; i < rounds; ++i)
+    {
+        found += bench_split_trailing(data, len);
+    }
+    trailing_ns = now_ns() - start;
+    assert(found == rounds * message_count);
+    found = 0;
+#endif
+
+    start = now_ns();
+    for (int i = 0; i < rounds; ++i)
+    {
+        found += bench_split_scan(data, len, TRUE);
+    }
+    long long scanner_ns = now_ns() - start;
+    assert(found == rounds * message_count);
+    found = 0;
+
+    start = now_ns();
+    for (int i = 0; i < rounds; ++i)
+    {
+        found += bench_split_scan(data, len, FALSE);
+    }
+    long long scan_ns = now_ns() - start;
+    assert(found == rounds * message_count);
+    found = 0;
+
+    printf("%-9d %-8d %-11.2f %-12.2f %-11.2f %.2f\n", message_count, len,
+           (double)restart_ns / rounds / 1000, (double)trailing_ns / rounds / 1000,
+           (double)scanner_ns / rounds / 1000, (double)scan_ns / rounds / 1000);
+    free(data);
+    json_object_put(jreply);
+}
+
+/**
+ * @brief Measure the time to read every parameter of a message carrying `param_count`
+ * parameters, copied into a hal_param_t and pointed at with a view.
+ */
+static void bench_param_view(int param_count)
+{
+    json_object *jmsg = bench_create_reply(param_count);
+    int rounds = BENCH_WIRE_ROUNDS * 10 / param_count;
+    hal_param_t param;
+    hal_param_view_t view;
+    unsigned long long copied = 0;
+    unsigned long long viewed = 0;
+
+    long long start = now_ns();
+    for (int i = 0; i < rounds; ++i)
+    {
+        for (int j = 0; j < param_count; ++j)
+        {
+            json_hal_get_param(jmsg, j, GET_RESPONSE_MESSAGE, &param);
+            copied += (unsigned long long)strtoul(param.value, NULL, 10);
+        }
+    }
+    long long copy_ns = now_ns() - start;
+
+    start = now_ns();
+    for (int i = 0; i < rounds; ++i)
+    {
+        for (int j = 0; j < param_count; ++j)
+        {
+            json_hal_get_param_view(jmsg, j, GET_RESPONSE_MESSAGE, &view);
+            viewed += view.typed.unsigned_integer;
+        }
+    }
+    long long view_ns = now_ns() - start;
+
+    assert(copied == viewed);
+    printf("%-7d %-14.2f %.2f\n", param_count,
+           (double)copy_ns / rounds / 1000, (double)view_ns / rounds / 1000);
+    json_object_put(jmsg);
+}
+
+int main(int argc, char **argv)
+{
+    int requests = BENCH_DEFAULT_REQUESTS;
+    int rc = RETURN_ERR;
+    rpc_template_t tpl = {0};
+
+    if (argc < 2)
+    {
+        printf("usage: %s <configuration file> [requests per run]\n", argv[0]);
+        exit(0);
+    }
+    if (argc > 2)
+    {
+        requests = atoi(argv[2]);
+        if (requests <= 0)
+        {
+            requests = BENCH_DEFAULT_REQUESTS;
+        }
+    }
+
+    rc = json_hal_load_config(argv[1], &g_bench_config);
+    assert(rc == RETURN_OK);
+    if (g_bench_config.shared_memory_ring_size > 0)
+    {
+        struct rlimit limit;
+        getrlimit(RLIMIT_NOFILE, &limit);
+        g_bench_shm_size = (int)limit.rlim_cur;
+        g_bench_shm = calloc(g_bench_shm_size, sizeof(rpc_shm_channel_t *));
+        assert(g_bench_shm != NULL);
+    }
+    rc = json_hal_server_init(argv[1]);
+    assert(rc == RETURN_OK);
+    json_hal_server_register_action_callback(JSON_RPC_ACTION_GET_PARAM, bench_getparam_cb);
+    rc = json_hal_server_run();
+    assert(rc == RETURN_OK);
+
+    if (g_bench_config.server_socket_path[0] != '\0')
+    {
+        printf("transport: unix seqpacket %s%s\n", g_bench_config.server_socket_path,
+               g_bench_config.shared_memory_ring_size > 0 ? " (shared memory)" : "");
+    }
+    else
+    {
+        printf("transport: tcp 127.0.0.1:%d%s\n", g_bench_config.server_port_number,
+               g_bench_config.message_framing == TRUE ? " (framed)" : "");
+    }
+    printf("wire format: %s\n", g_bench_config.wire_format == WIRE_FORMAT_PRETTY ? "pretty" : "plain");
+    printf("clients  idle_cpu_ms/s  avg_us     p50_us     p99_us     cpu_us/request\n");
+    for (size_t i = 0; i < sizeof(bench_client_counts) / sizeof(bench_client_counts[0]); ++i)
+    {
+        bench_run(bench_client_counts[i], requests);
+    }
+
+    printf("\nserver threads: %d\n", g_bench_config.server_threads);
+    printf("clients  requests/s     cpu_us/request\n");
+    for (size_t i = 0; i < sizeof(bench_throughput_client_counts) / sizeof(bench_throughput_client_counts[0]); ++i)
+    {
+        bench_throughput(bench_throughput_client_counts[i]);
+    }
+
+    /* Replies through the shared memory rings do not use the socket. */
+    if (g_bench_config.message_framing == TRUE && g_bench_config.shared_memory_ring_size == 0)
+    {
+        printf("\npipelined  send_calls/reply\n");
+        for (size_t i = 0; i < sizeof(bench_pipeline_depths) / sizeof(bench_pipeline_depths[0]); ++i)
+        {
+            bench_pipeline(bench_pipeline_depths[i]);
+        }
+    }
+
+    printf("\nburst  one_by_one_us  batch_us      speedup\n");
+    for (size_t i = 0; i < sizeof(bench_batch_sizes) / sizeof(bench_batch_sizes[0]); ++i)
+    {
+        bench_batch(bench_batch_sizes[i]);
+    }
+
+    printf("\nactions  table_ns/lookup list_ns/lookup\n");
+    for (size_t i = 0; i < sizeof(bench_dispatch_action_counts) / sizeof(bench_dispatch_action_counts[0]); ++i)
+    {
+        bench_dispatch(bench_dispatch_action_counts[i]);
+    }
+
+    printf("\nparams  plain_bytes  pretty_bytes  plain_us     pretty_us\n");
+    for (size_t i = 0; i < sizeof(bench_wire_param_counts) / sizeof(bench_wire_param_counts[0]); ++i)
+    {
+        bench_wire_format(bench_wire_param_counts[i]);
+    }
+
+    printf("\nparams  json_bytes  msgpack_bytes  json_enc_us  msgpack_enc_us  json_dec_us  msgpack_dec_us\n");
+    for (size_t i = 0; i < sizeof(bench_wire_param_counts) / sizeof(bench_wire_param_counts[0]); ++i)
+    {
+        bench_wire_encoding(bench_wire_param_counts[i]);
+    }
+
+    printf("\nparams  reply_bytes tree_us      writer_us\n");
+    for (size_t i = 0; i < sizeof(bench_wire_param_counts) / sizeof(bench_wire_param_counts[0]); ++i)
+    {
+        bench_reply_writer(bench_wire_param_counts[i]);
+    }
+
+    /* 0 parameters stands for a `Not Supported` result. */
+    rc = json_rpc_template_init(&tpl, g_bench_config.hal_module_name, g_bench_config.hal_module_version);
+    assert(rc == RETURN_OK);
+    printf("\nparams  json_us      template_us  msgpack_us      template_us\n");
+    bench_message_template(&tpl, 0);
+    for (size_t i = 0; i < sizeof(bench_wire_param_counts) / sizeof(bench_wire_param_counts[0]); ++i)
+    {
+        bench_message_template(&tpl, bench_wire_param_counts[i]);
+    }
+    json_rpc_template_free(&tpl);
+
+    /* trailing_us is negative if json-c cannot stop at the end of a message. */
+    printf("\nmessages  bytes    restart_us  trailing_us  scanner_us  scan_us\n");
+    for (size_t i = 0; i < sizeof(bench_glued_message_counts) / sizeof(bench_glued_message_counts[0]); ++i)
+    {
+        bench_glued(bench_glued_message_counts[i]);
+    }
+
+    printf("\nparams  get_param_us   view_us\n");
+    for (size_t i = 0; i < sizeof(bench_param_view_counts) / sizeof(bench_param_view_counts[0]); ++i)
+    {
+        bench_param_view(bench_param_view_counts[i]);
+    }
+
+    json_hal_server_terminate();
+    free(g_bench_shm);
+    return 0;
+}
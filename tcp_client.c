@@ -26,11 +26,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include "tcp_client.h"
+#include "json_rpc_shm.h"
 #include <sys/time.h>
 
 
@@ -45,9 +51,120 @@ typedef enum _SOCKET_TRANISTION_STAGE_
 } SOCKET_TRANISTION_STAGE;
 
 /**
- * Global variable to store the server thread running status.
+ * Enum to handle the states of the shared memory rings.
  */
-static int g_rpc_client_running_status = FALSE;
+typedef enum _SHM_STAGE_
+{
+    SHM_NONE = 0, /* No rings, everything goes over the socket. */
+    SHM_OFFERED,  /* Rings offered, responses may come through them but requests still use the socket. */
+    SHM_ACTIVE    /* Server accepted the rings. */
+} SHM_STAGE;
+
+/**
+ * Enum to tag the fds watched by the epoll instance of a client thread.
+ */
+typedef enum _CLIENT_EVENT_TAG_
+{
+    CLIENT_EVENT_SOCKET = 0, /* Server socket, readable or done connecting. */
+    CLIENT_EVENT_DOORBELL,   /* Doorbell of the shared memory response ring. */
+    CLIENT_EVENT_TIMER,      /* timerfd armed for the earliest request deadline. */
+    CLIENT_EVENT_WAKEUP      /* eventfd written by json_rpc_client_stop(). */
+} CLIENT_EVENT_TAG;
+
+/**
+ * Wait between two connection attempts, in milliseconds.
+ */
+#define CONNECT_RETRY_PERIOD 1000
+
+/**
+ * Maximum events handled per epoll_wait() call, one per watched fd.
+ */
+#define MAX_CLIENT_EVENTS 4
+
+/**
+ * Global variable to store the number of client threads running.
+ */
+static int g_rpc_client_running_count = 0;
+
+/**
+ * @brief Create the epoll instance, the timerfd and the wakeup eventfd of a client
+ * thread. The timerfd and the eventfd stay registered as long as the thread runs.
+ * @param Client data to hold the fds.
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+static int create_event_fds(rpc_client_data_t *params);
+
+/**
+ * @brief Close the fds created by create_event_fds(), json_rpc_client_stop() and
+ * json_rpc_client_set_timer() do nothing afterwards.
+ * @param Client data holds the fds.
+ */
+static void close_event_fds(rpc_client_data_t *params);
+
+/**
+ * @brief Add a fd to the epoll instance of the client thread, or change the
+ * events it is watched for if it is registered already.
+ * @param Client data holds the epoll instance.
+ * @param fd to watch
+ * @param epoll events
+ * @param CLIENT_EVENT_TAG reported with the events
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+static int watch_fd(rpc_client_data_t *params, int fd, uint32_t events, uint32_t tag);
+
+/**
+ * @brief Remove a fd from the epoll instance of the client thread.
+ * @param Client data holds the epoll instance.
+ * @param fd to remove, ignored if not registered
+ */
+static void unwatch_fd(rpc_client_data_t *params, int fd);
+
+/**
+ * @brief Wait for the watched fds. Timer expiries and wakeups are handled here,
+ * the readiness of the socket and of the doorbell is returned to the caller.
+ * @param Client data holds the epoll instance.
+ * @param timeout in milliseconds, -1 to wait until an event arrives.
+ * @param (OUT) TRUE if the socket is ready.
+ * @param (OUT) TRUE if the shared memory doorbell rang.
+ * @return RETURN_OK on success or timeout, RETURN_ERR if epoll_wait() failed.
+ */
+static int wait_events(rpc_client_data_t *params, int timeout, int *socket_ready, int *doorbell_ready);
+
+/**
+ * @brief Invoke the timer callback once the timerfd expired and arm the
+ * timerfd again for the deadline it returned.
+ * @param Client data holds the timer callback.
+ */
+static void expire_timer(rpc_client_data_t *params);
+
+/**
+ * @brief Create the shared memory rings and offer them to the server.
+ * The connection keeps working over the socket if this fails.
+ * @param Client data holds the socket and the ring size.
+ */
+static void offer_shared_memory(rpc_client_data_t *params);
+
+/**
+ * @brief Offer the configured encoding to the server, messages stay text json
+ * until the server agreed to it.
+ * @param Client data holds the socket and the encoding.
+ */
+static void offer_codec(rpc_client_data_t *params);
+
+/**
+ * @brief Pass every response of the shared memory ring to the parse callback,
+ * until the ring is empty and the server was told to ring the doorbell again.
+ * @param Client data holds the parse callback.
+ * @return RETURN_OK on success , RETURN_ERR if the ring content is invalid.
+ */
+static int read_shared_memory(rpc_client_data_t *params);
+
+/**
+ * @brief Report the disconnect, close the socket and the shared memory rings
+ * and go back to the init state to reconnect.
+ * @param Client data holds the socket and the disconnect callback.
+ */
+static void reset_connection(rpc_client_data_t *params);
 
 /**
  * @brief Socket client main thread
@@ -56,25 +173,49 @@ static int g_rpc_client_running_status = FALSE;
  */
 static void *rpc_client_handler(void *paramPtr);
 
-int json_rpc_client_send_data(const int sockfd, const char *buffer)
+int json_rpc_client_send_data(rpc_client_data_t *client, const char *buffer)
+{
+    POINTER_ASSERT(buffer != NULL);
+    return json_rpc_client_send_message(client, buffer, strlen(buffer), RPC_CODEC_JSON);
+}
+
+int json_rpc_client_send_message(rpc_client_data_t *client, const char *buffer, size_t len, rpc_codec_t codec)
 {
+    POINTER_ASSERT(client != NULL);
     POINTER_ASSERT(buffer != NULL);
+    int sockfd = client->sock;
     int total_bytes_sent = 0; // how many bytes we've sent
     int total_bytes_left = 0; // how many we have left to send
     int ret = RETURN_OK;
 
-    total_bytes_left = strlen(buffer);
-    while (total_bytes_sent < total_bytes_left)
+    total_bytes_left = len;
+    pthread_mutex_lock(&client->send_lock);
+    /* Shared memory first, the socket takes what does not fit the request ring. */
+    if (client->shm_state == SHM_ACTIVE &&
+        json_rpc_shm_send(&client->shm, RPC_CODEC_FRAME_TYPE(codec), buffer, total_bytes_left) == RETURN_OK)
+    {
+        pthread_mutex_unlock(&client->send_lock);
+        return RETURN_OK;
+    }
+    if (client->framing == TRUE)
+    {
+        ret = json_rpc_frame_send(sockfd, RPC_CODEC_FRAME_TYPE(codec), RPC_FRAME_FLAG_NONE, buffer, total_bytes_left);
+        pthread_mutex_unlock(&client->send_lock);
+        return ret;
+    }
+    while (total_bytes_left > 0)
     {
         ret = send(sockfd, buffer + total_bytes_sent, total_bytes_left, 0);
         if (ret == RETURN_ERR)
         {
             LOGERROR("Failed to send the response message over socket, [%d] bytes left to send", total_bytes_left);
+            pthread_mutex_unlock(&client->send_lock);
             return RETURN_ERR;
         }
         total_bytes_sent += ret;
         total_bytes_left -= ret;
     }
+    pthread_mutex_unlock(&client->send_lock);
     return RETURN_OK;
 }
 
@@ -86,27 +227,323 @@ int json_rpc_client_run(rpc_client_data_t *s)
     pthread_attr_init(&attributes);
     pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
     s->sock = INVALID_SOCKFD;
+    if (s->socket_path[0] != '\0')
+    {
+        /* Records of a SOCK_SEQPACKET socket carry chunks of the frame stream. */
+        s->framing = TRUE;
+        s->rx.record_size = RPC_FRAME_MAX_RECORD;
+    }
+    s->shm_state = SHM_NONE;
+    s->codec = RPC_CODEC_JSON;
+    pthread_mutex_init(&s->send_lock, NULL);
+    pthread_mutex_init(&s->event_lock, NULL);
+    if (create_event_fds(s) != RETURN_OK)
+    {
+        pthread_attr_destroy(&attributes);
+        return RETURN_ERR;
+    }
+    /* Set before the thread starts, so a json_rpc_client_stop() right after this call is not lost. */
+    s->RUNNING = TRUE;
     rc = pthread_create(&socket_thread, &attributes, rpc_client_handler, s);
     if (rc != RETURN_OK)
     {
         LOGERROR("Failed to start sever socket");
+        s->RUNNING = FALSE;
+        close_event_fds(s);
     }
 
     pthread_attr_destroy(&attributes);
     return rc;
 }
 
+int json_rpc_client_stop(rpc_client_data_t *client)
+{
+    POINTER_ASSERT(client != NULL);
+    uint64_t value = 1;
+    int rc = RETURN_OK;
+    int running;
+
+    pthread_mutex_lock(&client->event_lock);
+    running = client->RUNNING;
+    client->RUNNING = FALSE;
+    /* The fds of a client that was never run are not valid. */
+    if (running == TRUE && client->wakeup_fd >= 0)
+    {
+        if (write(client->wakeup_fd, &value, sizeof(value)) != sizeof(value))
+        {
+            LOGERROR("Failed to wake up client socket thread");
+            rc = RETURN_ERR;
+        }
+    }
+    pthread_mutex_unlock(&client->event_lock);
+    return rc;
+}
+
+int json_rpc_client_set_timer(rpc_client_data_t *client, uint64_t deadline)
+{
+    POINTER_ASSERT(client != NULL);
+    struct itimerspec its;
+    int rc = RETURN_OK;
+
+    pthread_mutex_lock(&client->event_lock);
+    /* The timerfd always holds the earliest deadline, a later one is picked up by the timer callback. */
+    if (client->timer_fd >= 0 && deadline > 0 &&
+        (client->timer_deadline == 0 || deadline < client->timer_deadline))
+    {
+        memset(&its, 0, sizeof(its));
+        its.it_value.tv_sec = deadline / 1000;
+        its.it_value.tv_nsec = (deadline % 1000) * 1000000;
+        if (timerfd_settime(client->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == 0)
+        {
+            client->timer_deadline = deadline;
+        }
+        else
+        {
+            LOGERROR("timerfd_settime() failed, Error : %s", strerror(errno));
+            rc = RETURN_ERR;
+        }
+    }
+    pthread_mutex_unlock(&client->event_lock);
+    return rc;
+}
+
+uint64_t json_rpc_client_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static int create_event_fds(rpc_client_data_t *params)
+{
+    params->timer_deadline = 0;
+    params->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    params->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    params->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (params->epoll_fd < 0 || params->timer_fd < 0 || params->wakeup_fd < 0)
+    {
+        LOGERROR("Failed to create the client event fds, Error : %s", strerror(errno));
+        close_event_fds(params);
+        return RETURN_ERR;
+    }
+    if (watch_fd(params, params->timer_fd, EPOLLIN, CLIENT_EVENT_TIMER) != RETURN_OK ||
+        watch_fd(params, params->wakeup_fd, EPOLLIN, CLIENT_EVENT_WAKEUP) != RETURN_OK)
+    {
+        close_event_fds(params);
+        return RETURN_ERR;
+    }
+    return RETURN_OK;
+}
+
+static void close_event_fds(rpc_client_data_t *params)
+{
+    pthread_mutex_lock(&params->event_lock);
+    if (params->epoll_fd >= 0)
+    {
+        close(params->epoll_fd);
+    }
+    if (params->timer_fd >= 0)
+    {
+        close(params->timer_fd);
+    }
+    if (params->wakeup_fd >= 0)
+    {
+        close(params->wakeup_fd);
+    }
+    params->epoll_fd = -1;
+    params->timer_fd = -1;
+    params->wakeup_fd = -1;
+    params->timer_deadline = 0;
+    pthread_mutex_unlock(&params->event_lock);
+}
+
+static int watch_fd(rpc_client_data_t *params, int fd, uint32_t events, uint32_t tag)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.u32 = tag;
+    if (epoll_ctl(params->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0 &&
+        (errno != EEXIST || epoll_ctl(params->epoll_fd, EPOLL_CTL_MOD, fd, &ev) < 0))
+    {
+        LOGERROR("epoll_ctl() failed, Error Number : %d, Error : %s", errno, strerror(errno));
+        return RETURN_ERR;
+    }
+    return RETURN_OK;
+}
+
+static void unwatch_fd(rpc_client_data_t *params, int fd)
+{
+    if (fd >= 0)
+    {
+        epoll_ctl(params->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    }
+}
+
+static int wait_events(rpc_client_data_t *params, int timeout, int *socket_ready, int *doorbell_ready)
+{
+    struct epoll_event events[MAX_CLIENT_EVENTS];
+    uint64_t value;
+    int count;
+
+    *socket_ready = FALSE;
+    *doorbell_ready = FALSE;
+    count = epoll_wait(params->epoll_fd, events, MAX_CLIENT_EVENTS, timeout);
+    if (count < 0)
+    {
+        if (errno == EINTR)
+        {
+            return RETURN_OK;
+        }
+        LOGERROR("epoll_wait() failed, Error Number : %d, Error : %s", errno, strerror(errno));
+        return RETURN_ERR;
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        switch (events[i].data.u32)
+        {
+            case CLIENT_EVENT_SOCKET:
+                *socket_ready = TRUE;
+                break;
+            case CLIENT_EVENT_DOORBELL:
+                *doorbell_ready = TRUE;
+                break;
+            case CLIENT_EVENT_TIMER:
+                /* Nothing to read if the timer was armed again meanwhile. */
+                if (read(params->timer_fd, &value, sizeof(value)) == sizeof(value))
+                {
+                    expire_timer(params);
+                }
+                break;
+            default:
+                if (read(params->wakeup_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+                {
+                    LOGERROR("Failed to read the client wakeup eventfd, Error : %s", strerror(errno));
+                }
+                break;
+        }
+    }
+    return RETURN_OK;
+}
+
+static void expire_timer(rpc_client_data_t *params)
+{
+    uint64_t deadline = 0;
+
+    pthread_mutex_lock(&params->event_lock);
+    params->timer_deadline = 0;
+    pthread_mutex_unlock(&params->event_lock);
+    if (params->func_timer != NULL)
+    {
+        deadline = params->func_timer();
+    }
+    if (deadline > 0)
+    {
+        json_rpc_client_set_timer(params, deadline);
+    }
+}
+
+static void offer_shared_memory(rpc_client_data_t *params)
+{
+    uint32_t ring_size;
+    int fds[3];
+
+    pthread_mutex_lock(&params->send_lock);
+    if (json_rpc_shm_create(&params->shm, params->shm_ring_size) != RETURN_OK)
+    {
+        pthread_mutex_unlock(&params->send_lock);
+        return;
+    }
+    ring_size = htonl(params->shm.ring_size);
+    fds[0] = params->shm.memfd;
+    fds[1] = params->shm.tx_doorbell;
+    fds[2] = params->shm.rx_doorbell;
+    if (json_rpc_frame_send_fds(params->sock, RPC_FRAME_TYPE_SHM_OFFER, (const char *)&ring_size, sizeof(ring_size), fds, 3) != RETURN_OK)
+    {
+        json_rpc_shm_close(&params->shm);
+        pthread_mutex_unlock(&params->send_lock);
+        return;
+    }
+    params->shm_state = SHM_OFFERED;
+    pthread_mutex_unlock(&params->send_lock);
+    watch_fd(params, params->shm.rx_doorbell, EPOLLIN, CLIENT_EVENT_DOORBELL);
+}
+
+static void offer_codec(rpc_client_data_t *params)
+{
+    unsigned char codec = (unsigned char)params->codec_offer;
+
+    pthread_mutex_lock(&params->send_lock);
+    if (json_rpc_frame_send(params->sock, RPC_FRAME_TYPE_CODEC_OFFER, RPC_FRAME_FLAG_NONE, (const char *)&codec, sizeof(codec)) != RETURN_OK)
+    {
+        LOGERROR("Failed to offer the message encoding, text json is used");
+    }
+    pthread_mutex_unlock(&params->send_lock);
+}
+
+static int read_shared_memory(rpc_client_data_t *params)
+{
+    char *payload;
+    uint32_t len;
+    uint8_t type;
+    int rc;
+
+    do
+    {
+        while ((rc = json_rpc_shm_next(&params->shm, &type, &payload, &len)) == TRUE)
+        {
+            if (params->func_parse != NULL)
+            {
+                params->func_parse(params->sock, payload, len, RPC_FRAME_TYPE_CODEC(type));
+            }
+            json_rpc_shm_consume(&params->shm);
+        }
+        if (rc == RETURN_ERR)
+        {
+            return RETURN_ERR;
+        }
+    } while (json_rpc_shm_prepare_wait(&params->shm) == FALSE);
+    return RETURN_OK;
+}
+
+static void reset_connection(rpc_client_data_t *params)
+{
+    if (params->func_disconnected != NULL)
+    {
+        params->func_disconnected(params->sock);
+    }
+    pthread_mutex_lock(&params->send_lock);
+    if (params->shm_state != SHM_NONE)
+    {
+        /* The server holds a copy of the doorbell, closing ours does not remove it from epoll. */
+        unwatch_fd(params, params->shm.rx_doorbell);
+        json_rpc_shm_close(&params->shm);
+        params->shm_state = SHM_NONE;
+    }
+    params->codec = RPC_CODEC_JSON;
+    pthread_mutex_unlock(&params->send_lock);
+    unwatch_fd(params, params->sock);
+    close(params->sock);
+    params->sock = INVALID_SOCKFD;
+    params->rx.len = 0;
+    params->rx.offset = 0;
+    params->state = SOCKET_INIT;
+}
+
 /* State machine to manage client connection and response. */
 static void *rpc_client_handler(void *paramPtr)
 {
     int rc;
-    int sret;
-    int max_sd;
-    struct timeval tv;
-    fd_set read_set;
+    int socket_ready;
+    int doorbell_ready;
 
     struct rpc_client_data_t *params = (rpc_client_data_t *)paramPtr;
     struct sockaddr_in server;
+    struct sockaddr_un server_un;
+    struct sockaddr *server_addr = (struct sockaddr *)&server;
+    socklen_t server_addr_len = sizeof(server);
 
     if (NULL == params)
     {
@@ -115,32 +552,49 @@ static void *rpc_client_handler(void *paramPtr)
     }
     pthread_detach(pthread_self());
 
-    params->RUNNING = TRUE;
     params->state = SOCKET_INIT;
-    g_rpc_client_running_status = TRUE;
+    __atomic_add_fetch(&g_rpc_client_running_count, 1, __ATOMIC_SEQ_CST);
 
     while(params->RUNNING == TRUE)
     {
         switch (params->state)
         {
             case SOCKET_INIT:
-                params->sock = socket(AF_INET, SOCK_STREAM, 0);
+                if (params->socket_path[0] != '\0') {
+                    params->sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+                } else {
+                    params->sock = socket(AF_INET, SOCK_STREAM, 0);
+                }
                 if(params->sock == -1) {
                     LOGERROR("Could not create socket, Error Number : %d, Error : %s", errno, strerror(errno));
                     pthread_exit(NULL);
                 }
                 fcntl(params->sock, F_SETFL, O_NONBLOCK);
-                server.sin_addr.s_addr = inet_addr(params->host);
-                server.sin_family = AF_INET;
-                server.sin_port = htons(params->port);
+                if (params->socket_path[0] != '\0') {
+                    memset(&server_un, 0, sizeof(server_un));
+                    server_un.sun_family = AF_UNIX;
+                    strncpy(server_un.sun_path, params->socket_path, sizeof(server_un.sun_path) - 1);
+                    server_addr = (struct sockaddr *)&server_un;
+                    server_addr_len = sizeof(server_un);
+                } else {
+                    server.sin_addr.s_addr = inet_addr(params->host);
+                    server.sin_family = AF_INET;
+                    server.sin_port = htons(params->port);
+                }
                 params->state = SOCKET_CONNECT;
                 break;   // State == 0
 
             case SOCKET_CONNECT:
                 rc = 0;
-                rc = connect(params->sock, (struct sockaddr*)&server, sizeof(server));
+                rc = connect(params->sock, server_addr, server_addr_len);
                 if(rc < 0) {
                     switch (errno) {
+                        case EINPROGRESS:
+                        case EALREADY:
+                            /* Retry as soon as the socket is done connecting. */
+                            watch_fd(params, params->sock, EPOLLOUT, CLIENT_EVENT_SOCKET);
+                            wait_events(params, CONNECT_RETRY_PERIOD, &socket_ready, &doorbell_ready);
+                            break;
                         case EBADF:
                         case EISCONN:
                         case EADDRNOTAVAIL:
@@ -148,13 +602,23 @@ static void *rpc_client_handler(void *paramPtr)
                             close(params->sock);
                             params->sock = INVALID_SOCKFD;
                             params->state = SOCKET_INIT;
-                        case EINPROGRESS:
-                        case EALREADY:
                         case ECONNREFUSED:
-                        default    :    sleep(1);
+                        default    :    /* A failed socket stays writable, do not let it end the wait. */
+                                        unwatch_fd(params, params->sock);
+                                        wait_events(params, CONNECT_RETRY_PERIOD, &socket_ready, &doorbell_ready);
                                         break;
                     }
                 }else {
+                    if (watch_fd(params, params->sock, EPOLLIN, CLIENT_EVENT_SOCKET) != RETURN_OK) {
+                        reset_connection(params);
+                        break;
+                    }
+                    if (params->socket_path[0] != '\0' && params->shm_ring_size > 0) {
+                        offer_shared_memory(params);
+                    }
+                    if (params->framing == TRUE && params->codec_offer != RPC_CODEC_JSON) {
+                        offer_codec(params);
+                    }
                     if(params->func_connected != NULL) {
                         params->func_connected(params->sock);
                     }
@@ -163,57 +627,68 @@ static void *rpc_client_handler(void *paramPtr)
                 break;   // State == 1
             case SOCKET_RECEIVE:
                 rc = 0;
-                sret = 0;
-                memset(params->buffer, 0, MAX_BUFFER_SIZE);
-                FD_ZERO(&read_set);
-                FD_SET(params->sock,&read_set);
-                max_sd = params->sock;
-
-                /* Wait up to 250 milliseconds */
-                tv.tv_sec = 0;
-                tv.tv_usec = LOOP_TIMEOUT;
-                sret = select(max_sd + 1, &read_set, NULL, NULL, &tv);
-                if (sret < 0) {
-                    LOGERROR("select() failed, Error Number : %d, Error : %s", errno, strerror(errno));
-                    break;
-                } else if(sret == 0) {
-                    /* Time out */
+                /* No timeout, request deadlines come from the timerfd and json_rpc_client_stop() wakes us up. */
+                if (wait_events(params, -1, &socket_ready, &doorbell_ready) != RETURN_OK) {
                     break;
                 }
 
-            if (FD_ISSET(params->sock, &read_set)) {
-                rc = recv(params->sock, params->buffer, MAX_BUFFER_SIZE, 0);
+            if (doorbell_ready == TRUE && params->shm_state != SHM_NONE) {
+                if (read_shared_memory(params) != RETURN_OK) {
+                    LOGERROR("Invalid shared memory ring content, reconnecting");
+                    reset_connection(params);
+                    break;
+                }
+            }
+            if (socket_ready == TRUE) {
+                memset(params->buffer, 0, MAX_BUFFER_SIZE);
+                if (params->framing == TRUE) {
+                    int more;
+                    rc = json_rpc_frame_recv(params->sock, &params->rx);
+                    /* Drain the socket, a SOCK_SEQPACKET read returns a single record. */
+                    while (rc > 0 && (more = json_rpc_frame_recv(params->sock, &params->rx)) > 0) {
+                        rc += more;
+                    }
+                } else {
+                    rc = recv(params->sock, params->buffer, MAX_BUFFER_SIZE, 0);
+                }
                 if(rc < 0) {
                     LOGERROR("recv failed, Error Number : %d, Error : %s", errno, strerror(errno));
                     break;
                 }
                 else if(rc == 0) {
-                    if (params->func_disconnected != NULL) {
-                        params->func_disconnected(params->sock);
-                    }
-                    close(params->sock);
-                    params->sock = INVALID_SOCKFD;
-                    params->state = SOCKET_INIT;
+                    reset_connection(params);
                     break;
                 }
+                else if (params->framing == TRUE) {
+                    rpc_frame_header_t header;
+                    /* Deliver every complete frame, a partial frame stays buffered. */
+                    while ((rc = json_rpc_frame_next(&params->rx, &header)) == TRUE) {
+                        if ((header.type == RPC_FRAME_TYPE_JSON || header.type == RPC_FRAME_TYPE_MSGPACK) && params->func_parse != NULL) {
+                            params->func_parse(params->sock, RPC_FRAME_PAYLOAD(&params->rx), header.length, RPC_FRAME_TYPE_CODEC(header.type));
+                        } else if (header.type == RPC_FRAME_TYPE_SHM_ACCEPT && params->shm_state == SHM_OFFERED) {
+                            pthread_mutex_lock(&params->send_lock);
+                            params->shm_state = SHM_ACTIVE;
+                            pthread_mutex_unlock(&params->send_lock);
+                        } else if (header.type == RPC_FRAME_TYPE_CODEC_ACCEPT && header.length == 1) {
+                            pthread_mutex_lock(&params->send_lock);
+                            params->codec = (unsigned char)*RPC_FRAME_PAYLOAD(&params->rx);
+                            pthread_mutex_unlock(&params->send_lock);
+                        }
+                        json_rpc_frame_consume(&params->rx, &header);
+                    }
+                    if (rc == RETURN_ERR) {
+                        LOGERROR("Invalid frame received, reconnecting");
+                        reset_connection(params);
+                    }
+                }
                 else { //rc > 0
                     if(params->func_parse != NULL) {
-                        params->func_parse(params->sock, params->buffer, rc);
+                        params->func_parse(params->sock, params->buffer, rc, RPC_CODEC_JSON);
                     }
                 } // Got a reponse for something!
-            } else {
-                LOGERROR("sock desc is not set");
             }
             break;  // End of state == SOCKET_RECEIVE
         } // End of switch
-        
-        
-        //IDLE
-        if (params->func_idle != NULL)
-        {
-            params->func_idle();
-        }
-        
     } // End of RUNNING;
     /**
      * Close the socket.
@@ -223,8 +698,17 @@ static void *rpc_client_handler(void *paramPtr)
     {
         close(params->sock);
         params->sock = INVALID_SOCKFD;
+        json_rpc_frame_buffer_free(&params->rx);
+        pthread_mutex_lock(&params->send_lock);
+        if (params->shm_state != SHM_NONE)
+        {
+            json_rpc_shm_close(&params->shm);
+            params->shm_state = SHM_NONE;
+        }
+        pthread_mutex_unlock(&params->send_lock);
+        close_event_fds(params);
     }
-    g_rpc_client_running_status = FALSE;
+    __atomic_sub_fetch(&g_rpc_client_running_count, 1, __ATOMIC_SEQ_CST);
     pthread_exit(0);
 }
 
@@ -234,5 +718,5 @@ static void *rpc_client_handler(void *paramPtr)
  */
 inline int json_rpc_client_is_running()
 {
-    return g_rpc_client_running_status;
+    return (__atomic_load_n(&g_rpc_client_running_count, __ATOMIC_SEQ_CST) > 0) ? TRUE : FALSE;
 }
@@ -29,10 +29,12 @@
 #include <syslog.h>
 #include <pthread.h>
 #include "json_rpc_common.h"
+#include "json_rpc_frame.h"
+#include "json_rpc_shm.h"
+#include "json_rpc_codec.h"
 
 #define SERVER_HOST "127.0.0.1"
 #define INVALID_SOCKFD -1
-#define LOOP_TIMEOUT 250000 // timeout in microseconds.
 
 /**
  * @brief Structure to hold the client socket connection.
@@ -42,17 +44,42 @@ typedef struct rpc_client_data_t {
     int state; /* Current state of client socket state machine. */
     int port; /* Server Port number to connect. */
     char host[BUF_32]; /* Host name. */
+    char socket_path[BUF_128]; /* Unix domain socket path of the server, host and port are used if empty. */
     int RUNNING; /* Flag indicates state machine is running or not. */
     char buffer[MAX_BUFFER_SIZE]; /* Buffer contains the message. */
+    int framing; /* Flag indicates messages are length prefixed frames. */
+    rpc_frame_buffer_t rx; /* Receive buffer used to reassemble frames in framed mode. */
+    uint32_t shm_ring_size; /* Size of the shared memory rings offered to a unix domain socket server, 0 for none. */
+    rpc_shm_channel_t shm; /* Shared memory rings, only valid while shm_state is not SHM_NONE. */
+    int shm_state; /* State of the shared memory rings, changed by the client thread with send_lock held. */
+    rpc_codec_t codec_offer; /* Encoding offered to the server once connected in framed mode, RPC_CODEC_JSON for none. */
+    rpc_codec_t codec; /* Encoding the server agreed to, changed by the client thread with send_lock held. */
+    pthread_mutex_t send_lock; /* Keeps messages sent from different caller threads from interleaving on the socket. */
+    int epoll_fd; /* epoll instance the client thread waits on. */
+    int timer_fd; /* timerfd armed for the deadline given to json_rpc_client_set_timer(). */
+    int wakeup_fd; /* eventfd used to wake up the client thread. */
+    uint64_t timer_deadline; /* CLOCK_MONOTONIC deadline the timerfd is armed for in milliseconds, 0 if none. */
+    pthread_mutex_t event_lock; /* Protects timer_deadline and the fds above against their close on thread exit. */
     int (*func_connected)(int); /* Callback invoked when connection established. */
     int (*func_disconnected)(int); /* Callback invoked when connection disconnected. */
-    int (*func_parse)(const int, const char*, const int); /* Callback invoked when client got response from server. */
-    int (*func_idle)(void); /* Callback invoked whenever client is not receiving reponse after send the request. */
+    int (*func_parse)(const int, const char*, const int, rpc_codec_t); /* Callback invoked when client got response from server, in the encoding given. */
+    uint64_t (*func_timer)(void); /* Callback invoked when the timer expired, returns the next deadline or 0 for none. */
 }rpc_client_data_t;
 
 /**
  * @brief Start the socket client thread and connected to server socket.
- * @param (IN) Received filled structure which defines the callback [To be invoked when connect/disconnect/Idle/Get Response] and
+ * Every rpc_client_data_t is one connection served by its own thread, several
+ * of them can run at the same time.
+ * If socket_path is set the client connects over an AF_UNIX SOCK_SEQPACKET
+ * socket instead of TCP, framing is then always enabled.
+ * With shm_ring_size set, the client also offers shared memory rings to the server
+ * once connected over the unix domain socket. Messages go through the rings after
+ * the server accepted them, the ones that do not fit keep using the socket.
+ * With codec_offer set on a framed connection, the client offers that encoding
+ * to the server once connected and codec tells which one the server agreed to.
+ * The thread only wakes up for the socket, the timer and json_rpc_client_stop(),
+ * it never polls.
+ * @param (IN) Received filled structure which defines the callback [To be invoked when connect/disconnect/Timer/Get Response] and
  * server port to which socket needs to be connected.
  * @return RETURN_OK if thread created successfully else returned RETURN_ERR.
  */
@@ -61,14 +88,49 @@ int json_rpc_client_run(struct rpc_client_data_t*);
 /**
  * @brief Send the data packet to the server
  * Make sure all the data packet has been successfully send over the socket.
- * @param socket file descriptor to use
+ * @param connection to use
  * @param buffer pointing to the json message
  * @return RETURN_OK on success , RETURN_ERR else.
  */
-int json_rpc_client_send_data(const int sockfd, const char *buffer);
+int json_rpc_client_send_data(rpc_client_data_t *client, const char *buffer);
 
 /**
- * @brief Utility API used to verify client socket thread is running or not.
+ * @brief json_rpc_client_send_data() of an encoded message, text json or MessagePack.
+ * @param connection to use
+ * @param buffer pointing to the message
+ * @param message length
+ * @param encoding of the message, sent along with it
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_client_send_message(rpc_client_data_t *client, const char *buffer, size_t len, rpc_codec_t codec);
+
+/**
+ * @brief Stop the socket client thread.
+ * Wakes the thread up, it closes the connection and exits.
+ * @param connection to stop
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_client_stop(rpc_client_data_t *client);
+
+/**
+ * @brief Arm the timer of the client thread, func_timer is invoked once the deadline passed.
+ * A deadline later than the one the timer is armed for is ignored, func_timer has to
+ * return it when it is invoked for the earlier one. Can be called from any thread.
+ * @param connection whose thread invokes func_timer
+ * @param deadline in milliseconds of json_rpc_client_now_ms()
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_client_set_timer(rpc_client_data_t *client, uint64_t deadline);
+
+/**
+ * @brief Current time of the clock the timer deadlines refer to.
+ * @return CLOCK_MONOTONIC time in milliseconds.
+ */
+uint64_t json_rpc_client_now_ms(void);
+
+/**
+ * @brief Utility API used to verify client socket threads are running or not.
+ * TRUE as long as one of them did not exit yet.
  * @return RETURN TRUE if server is running else FALSE returned.
  */
 int json_rpc_client_is_running();
@@ -17,11 +17,17 @@
  * limitations under the License.
 */
 
+#define _GNU_SOURCE /* accept4() */
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include <syslog.h>
 #include <errno.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <pthread.h>
@@ -29,84 +35,2006 @@
 #include <string.h>
 #include "tcp_server.h"
 #include "json_rpc_common.h"
-#include "utlist.h"
+#include "json_rpc_shm.h"
+#ifdef JSON_HAL_IO_URING
+#include "json_rpc_uring.h"
+#endif
+
+/**
+ * Maximum number of events handled per epoll_wait() call.
+ */
+#define MAX_EPOLL_EVENTS 64
+
+/**
+ * Initial number of entries in the connection table.
+ */
+#define CONNECTION_TABLE_INITIAL_SIZE 64
+
+/**
+ * Upper limit of the number of reactor threads.
+ */
+#define MAX_REACTOR_THREADS 64
+
+/**
+ * Set in the low bit of the epoll data of a connection's shared memory doorbell,
+ * the other bits hold the connection pointer. Also set for the reactor's own
+ * notify eventfd, the other bits then hold the reactor pointer.
+ */
+#define EPOLL_TAG_DOORBELL 1
+
+/**
+ * Maximum number of SOCK_SEQPACKET records written with one sendmmsg() call.
+ */
+#define FLUSH_MAX_RECORDS 16
+
+#ifdef JSON_HAL_IO_URING
+/**
+ * Number of submission queue entries of a reactor's io_uring.
+ */
+#define URING_QUEUE_DEPTH 256
+
+/**
+ * Number of provided receive buffers per reactor, a power of 2.
+ */
+#define URING_BUFFER_COUNT 32
+
+/**
+ * Size of a provided receive buffer, the size of a recv() in the epoll loop.
+ */
+#define URING_BUFFER_SIZE (MAX_BUFFER_SIZE - 1)
+
+/**
+ * Buffer group id of the provided receive buffers.
+ */
+#define URING_BUFFER_GROUP 0
+
+/**
+ * Request type stored in the low bits of the io_uring user data,
+ * the other bits hold the connection pointer if any.
+ */
+#define URING_TAG_RECV 0
+#define URING_TAG_POLLOUT 1
+#define URING_TAG_ACCEPT 2
+#define URING_TAG_WAKEUP 3
+#define URING_TAG_MASK 3
+#endif
 
 /**
- *  Pointer to hold client connection list.
+ * With the block policy, messages that can not wait for the queue to drain, posted
+ * ones and the ones sent by a reactor, may fill the queue up to this many times its
+ * limit. Past it the client is disconnected.
+ */
+#define WRITE_QUEUE_NO_WAIT_FACTOR 2
+
+/**
+ * @brief Reactor thread, owns an epoll instance and the client connections registered to it.
+ * Reactor 0 also accepts the new connections and hands them out round robin.
+ */
+typedef struct rpc_reactor_t
+{
+    int index;                     /* Reactor index. */
+    int epoll_fd;                  /* epoll instance of the reactor. */
+    pthread_t thread;              /* Reactor thread. */
+    rpc_server_data_t *serverdata; /* Server data holds the callbacks. */
+    struct epoll_event *events;    /* Events of the batch being handled, a closed connection drops its own. */
+    int event_count;               /* Number of entries in events. */
+    rpc_connection_t *flush_list;  /* Connections with replies queued during the batch, written at its end. */
+    int notify_fd;                 /* eventfd rung by other threads that put a connection on the flush list. */
+#ifdef JSON_HAL_IO_URING
+    rpc_uring_t *ring;             /* io_uring of the reactor, NULL when it runs on epoll. */
+#endif
+} rpc_reactor_t;
+
+/**
+ *  Connection table indexed by client socket fd.
  **/
-static client_list_t *g_client_list;
+static rpc_connection_t **g_connection_table = NULL;
+
+/**
+ * Number of entries allocated in g_connection_table.
+ */
+static int g_connection_table_size = 0;
+
+/**
+ * Global variable to store the server thread running status.
+ */
+static int g_rpc_server_running_status = FALSE;
+
+/**
+ * Global variable to store whether messages are sent as length prefixed frames.
+ */
+static int g_rpc_server_framing = FALSE;
+
+/**
+ * Mutex to serialise the wakeup eventfd signalling against its close on thread exit.
+ */
+static pthread_mutex_t gm_wakeup_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Server configuration of the running server thread, used by json_rpc_server_send_data().
+ */
+static rpc_server_data_t *g_rpc_server_data = NULL;
+
+/**
+ * Reactor threads of the running server. They must never wait for an outbound queue to drain.
+ */
+static rpc_reactor_t *g_reactors = NULL;
+
+/**
+ * Number of entries in g_reactors.
+ */
+static int g_reactor_count = 0;
+
+/**
+ * Reactor the next accepted connection is handed to.
+ */
+static int g_next_reactor = 0;
+
+/**
+ * Last connection id handed out.
+ */
+static uint64_t g_connection_id = 0;
+
+/**
+ * Number of senders waiting for an outbound queue to drain.
+ */
+static int g_write_queue_waiters = 0;
+
+/**
+ * Mutex to protect the connection table and the outbound queues. Connections are added
+ * by reactor 0 and removed by the reactor owning them, other threads lock it to queue messages.
+ */
+static pthread_mutex_t gm_connection_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Counters of the messages written to the client sockets, protected by gm_connection_lock.
+ */
+static rpc_server_stats_t g_server_stats = {0};
+
+/**
+ * Signalled when an outbound queue drained or a connection went away.
+ */
+static pthread_cond_t g_write_queue_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Watermark crossed by an outbound queue.
+ */
+typedef enum write_queue_watermark_t
+{
+    WRITE_QUEUE_WATERMARK_NONE = 0,
+    WRITE_QUEUE_WATERMARK_HIGH,
+    WRITE_QUEUE_WATERMARK_LOW,
+} write_queue_watermark_t;
+
+/**
+ * @brief Server socket handler thread routine.
+ * @param Received filled rpc_server_data_t structure object (typecasted to void*) contains socket port and the callback functions needs to be execute
+ * once receive connection request, data from client side etc.
+ * Runs reactor 0, starts the other reactor threads and waits for them on exit.
+ * This thread will exit when the terminate api invoked.
+ */
+static void *rpc_server_handler(void *arg);
+
+/**
+ * @brief Thread routine of the reactors 1 to N-1.
+ * @param Reactor (typecasted to void*).
+ */
+static void *rpc_reactor_handler(void *arg);
+
+/**
+ * @brief Event loop of a reactor, runs until the server is stopped.
+ * @param reactor
+ * @param listening socket fd, -1 if the reactor does not accept connections.
+ */
+static void reactor_loop(rpc_reactor_t *reactor, int listen_sd);
+
+/**
+ * @brief Check whether the calling thread is one of the reactor threads.
+ * Must be called with gm_connection_lock held.
+ * @return TRUE for a reactor thread, FALSE else.
+ */
+static int is_reactor_thread(void);
+
+/**
+ * @brief Create the listening socket, bound to the unix domain socket path
+ * if one is configured or to the loopback TCP port otherwise.
+ * @param Server data holds the port number and socket path.
+ * @return listening socket fd on success , RETURN_ERR else.
+ */
+static int create_listen_socket(rpc_server_data_t *serverdata);
+
+/**
+ * @brief Remove the socket file left behind at a unix domain socket path.
+ * The file is only removed when nothing accepts connections on it any more,
+ * a server still running there keeps its path.
+ * @param address of the unix domain socket
+ * @return RETURN_OK if the path is free to bind, RETURN_ERR else.
+ */
+static int remove_stale_socket(const struct sockaddr_un *addr);
+
+/**
+ * @brief Store a new client connection into the connection table.
+ * Table grows to fit the fd if required.
+ * @param client socket fd
+ * @param reactor owning the connection
+ * @return the new connection on success , NULL else.
+ */
+static rpc_connection_t *add_connection(int fd, rpc_reactor_t *reactor);
+
+/**
+ * @brief Store the connection into the connection table, gm_connection_lock must be held.
+ * @param client socket fd
+ * @param reactor owning the connection
+ * @return the new connection on success , NULL else.
+ */
+static rpc_connection_t *insert_connection(int fd, rpc_reactor_t *reactor);
+
+/**
+ * @brief Report the disconnect, unregister the client connection from its reactor
+ * and release it. Only the reactor owning the connection closes it.
+ * On io_uring the socket is shut down and the connection is released once
+ * its last request in flight completed.
+ * @param Server data holds the disconnect callback.
+ * @param client connection
+ */
+static void close_connection(rpc_server_data_t *serverdata, rpc_connection_t *conn);
+
+/**
+ * @brief Remove the connection from the connection table, close the socket and
+ * free the connection. gm_connection_lock must be held.
+ * @param client connection
+ */
+static void release_connection(rpc_connection_t *conn);
+
+/**
+ * @brief Close the passed fds and the shared memory of the connection and free it.
+ * The socket is closed by the caller.
+ * @param client connection
+ */
+static void free_connection(rpc_connection_t *conn);
+
+/**
+ * @brief Accept all the pending connections on the listening socket and
+ * register them round robin to the reactors.
+ * @param Server data holds the connect callback.
+ * @param listening socket fd
+ */
+static void accept_connections(rpc_server_data_t *serverdata, int listen_sd);
+
+/**
+ * @brief Hand an accepted socket to the next reactor, round robin.
+ * @param Server data holds the connect callback.
+ * @param accepted socket fd
+ */
+static void hand_out_connection(rpc_server_data_t *serverdata, int new_sd);
+
+/**
+ * @brief Pass every complete frame buffered for the connection to the process callback.
+ * @param Server data holds the process callback.
+ * @param client connection
+ * @return RETURN_OK if the buffer holds at most a partial frame, RETURN_ERR on an invalid frame.
+ */
+static int deliver_frames(rpc_server_data_t *serverdata, rpc_connection_t *conn);
+
+/**
+ * @brief Read all the pending data from the client socket and pass it
+ * to the process callback.
+ * @param Server data holds the process callback.
+ * @param client connection
+ * @param buffer used to receive the data.
+ */
+static void read_connection(rpc_server_data_t *serverdata, rpc_connection_t *conn, char *buffer);
+
+/**
+ * @brief Read all the pending data from the client socket into the connection's
+ * frame buffer and pass every complete frame to the process callback.
+ * @param Server data holds the process callback.
+ * @param client connection
+ */
+static void read_framed_connection(rpc_server_data_t *serverdata, rpc_connection_t *conn);
+
+/**
+ * @brief Map the shared memory rings offered by the client with the passed fds,
+ * register the request doorbell and queue the acceptance of the offer.
+ * An invalid offer is ignored, the client then keeps using the socket.
+ * @param client connection
+ * @param offer payload, the ring size
+ * @param payload length
+ */
+static void accept_shm_offer(rpc_connection_t *conn, const char *payload, uint32_t len);
+
+/**
+ * @brief Answer the encoding offered by the client, the messages sent to it use
+ * that encoding from now on if the server agrees to it.
+ * @param Server data
+ * @param client connection
+ * @param offer payload, the encoding
+ * @param payload length
+ */
+static void accept_codec_offer(rpc_server_data_t *serverdata, rpc_connection_t *conn, const char *payload, uint32_t len);
+
+/**
+ * @brief Pass every message of the shared memory request ring to the process callback
+ * until the ring is empty and the client was told to ring the doorbell again.
+ * @param Server data holds the process callback.
+ * @param client connection
+ */
+static void read_shm_connection(rpc_server_data_t *serverdata, rpc_connection_t *conn);
+
+/**
+ * @brief Write as much of the outbound queues as the socket accepts without blocking.
+ * The rest of a bulk message already started goes first, then the control lane and
+ * the bulk lane, with one system call where possible.
+ * EPOLLOUT is registered while bytes are left and removed once the queues are empty.
+ * Must be called with gm_connection_lock held.
+ * @param client connection
+ * @return RETURN_OK if the queue drained or the socket is full, RETURN_ERR on socket error.
+ */
+static int flush_connection(rpc_connection_t *conn);
+
+/**
+ * @brief Append a message to the outbound queue of a connection.
+ * @param client socket fd
+ * @param id of the connection the message is meant for, 0 for the one on the fd
+ * @param message, text json or MessagePack
+ * @param message length
+ * @param frame type of the message, RPC_FRAME_TYPE_JSON or RPC_FRAME_TYPE_MSGPACK
+ * @param TRUE to leave the write to the reactor thread owning the connection,
+ * FALSE to write straight away unless called from that reactor thread.
+ * @param lane of the message
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+static int queue_message(const int sockfd, uint64_t conn_id, const char *buffer, size_t len, uint8_t type, int post, rpc_lane_t lane);
+
+/**
+ * @brief Append a message to the queue of a lane and count it.
+ * Must be called with gm_connection_lock held.
+ * @param client connection
+ * @param lane of the message
+ * @param frame type, unused without framing
+ * @param payload
+ * @param payload length
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+static int enqueue_message(rpc_connection_t *conn, rpc_lane_t lane, uint8_t type, const char *buffer, size_t len);
+
+/**
+ * @brief Number of bytes waiting in the outbound queues of a connection.
+ * @param client connection
+ * @return queued bytes of both lanes.
+ */
+static size_t queued_bytes(const rpc_connection_t *conn);
+
+/**
+ * @brief Account bytes of a lane written to the socket.
+ * @param client connection
+ * @param lane written
+ * @param number of bytes written
+ */
+static void consume_queue(rpc_connection_t *conn, rpc_lane_t lane, size_t bytes);
+
+/**
+ * @brief Release the consumed bytes at the start of a queue buffer.
+ * @param queue buffer
+ * @param (IN/OUT) number of bytes of the buffer already consumed
+ */
+static void compact_queue(rpc_frame_buffer_t *buf, size_t *offset);
+
+/**
+ * @brief Put the connection on its reactor's flush list, its outbound queue is
+ * written once the reactor handled the current batch of events. The reactor is
+ * woken up through its notify eventfd when called from another thread.
+ * Must be called with gm_connection_lock held.
+ * @param client connection
+ */
+static void defer_flush(rpc_connection_t *conn);
+
+/**
+ * @brief Clear the notify eventfd of the reactor, the connections put on its
+ * flush list are written at the end of the current batch.
+ * @param reactor
+ */
+static void read_notify(rpc_reactor_t *reactor);
+
+/**
+ * @brief Write the outbound queues of the connections on the reactor's flush list.
+ * @param reactor
+ */
+static void flush_pending_connections(rpc_reactor_t *reactor);
+
+/**
+ * @brief Check whether the outbound queue crossed one of the watermarks.
+ * Must be called with gm_connection_lock held.
+ * @param Server data holds the watermarks.
+ * @param client connection
+ * @return watermark crossed, WRITE_QUEUE_WATERMARK_NONE if none.
+ */
+static write_queue_watermark_t update_watermark(rpc_server_data_t *serverdata, rpc_connection_t *conn);
+
+/**
+ * @brief Invoke the watermark callback, gm_connection_lock must not be held.
+ * @param Server data holds the watermark callbacks.
+ * @param client socket fd
+ * @param watermark crossed
+ * @param number of bytes queued
+ */
+static void notify_watermark(rpc_server_data_t *serverdata, int fd, write_queue_watermark_t watermark, size_t queued);
+
+/**
+ * @brief Flush the outbound queue of the connection once its socket became writable.
+ * @param Server data holds the watermark callbacks.
+ * @param client connection
+ */
+static void write_connection(rpc_server_data_t *serverdata, rpc_connection_t *conn);
+
+#ifdef JSON_HAL_IO_URING
+/**
+ * @brief Create an io_uring with its provided receive buffers for every reactor.
+ * @param reactors
+ * @param number of reactors
+ * @return RETURN_OK on success, RETURN_ERR if io_uring is not usable, the reactors
+ * are then left without ring.
+ */
+static int uring_setup_reactors(rpc_reactor_t *reactors, int count);
+
+/**
+ * @brief Event loop of a reactor running on io_uring, runs until the server is stopped.
+ * Accepts and receives with multishot requests, so one system call per loop
+ * submits the new requests and reaps the completions of all the connections.
+ * @param reactor
+ * @param listening socket fd, -1 if the reactor does not accept connections.
+ */
+static void uring_reactor_loop(rpc_reactor_t *reactor, int listen_sd);
+
+/**
+ * @brief Queue a multishot recv for the connection on its reactor's ring.
+ * Must be called with gm_connection_lock held.
+ * @param client connection
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+static int uring_arm_recv(rpc_connection_t *conn);
+
+/**
+ * @brief Queue a one shot POLLOUT poll for the connection on its reactor's ring,
+ * the replacement of EPOLLOUT. Must be called with gm_connection_lock held.
+ * @param client connection
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+static int uring_arm_pollout(rpc_connection_t *conn);
+
+/**
+ * @brief Handle a completion of the multishot recv of a connection.
+ * @param reactor owning the connection
+ * @param client connection
+ * @param completion
+ * @param buffer used to pass unframed data to the process callback.
+ */
+static void uring_handle_recv(rpc_reactor_t *reactor, rpc_connection_t *conn, const struct io_uring_cqe *cqe, char *buffer);
+#endif
+
+int json_rpc_server_send_data(const int sockfd, const char *buffer)
+{
+    POINTER_ASSERT(buffer != NULL);
+    return queue_message(sockfd, 0, buffer, strlen(buffer), RPC_FRAME_TYPE_JSON, FALSE, RPC_LANE_BULK);
+}
+
+int json_rpc_server_post_data(const int sockfd, const char *buffer)
+{
+    POINTER_ASSERT(buffer != NULL);
+    return queue_message(sockfd, 0, buffer, strlen(buffer), RPC_FRAME_TYPE_JSON, TRUE, RPC_LANE_BULK);
+}
+
+int json_rpc_server_send_data_lane(const int sockfd, const char *buffer, rpc_lane_t lane)
+{
+    POINTER_ASSERT(buffer != NULL);
+    return queue_message(sockfd, 0, buffer, strlen(buffer), RPC_FRAME_TYPE_JSON, FALSE, (lane == RPC_LANE_CONTROL) ? RPC_LANE_CONTROL : RPC_LANE_BULK);
+}
+
+int json_rpc_server_post_data_lane(const int sockfd, const char *buffer, rpc_lane_t lane)
+{
+    POINTER_ASSERT(buffer != NULL);
+    return queue_message(sockfd, 0, buffer, strlen(buffer), RPC_FRAME_TYPE_JSON, TRUE, (lane == RPC_LANE_CONTROL) ? RPC_LANE_CONTROL : RPC_LANE_BULK);
+}
+
+int json_rpc_server_send_message(const int sockfd, const char *buffer, size_t len, rpc_codec_t codec, rpc_lane_t lane)
+{
+    return queue_message(sockfd, 0, buffer, len, RPC_CODEC_FRAME_TYPE(codec), FALSE, (lane == RPC_LANE_CONTROL) ? RPC_LANE_CONTROL : RPC_LANE_BULK);
+}
+
+int json_rpc_server_post_message(const int sockfd, const char *buffer, size_t len, rpc_codec_t codec, rpc_lane_t lane)
+{
+    return queue_message(sockfd, 0, buffer, len, RPC_CODEC_FRAME_TYPE(codec), TRUE, (lane == RPC_LANE_CONTROL) ? RPC_LANE_CONTROL : RPC_LANE_BULK);
+}
+
+int json_rpc_server_send_message_to(const int sockfd, uint64_t conn_id, const char *buffer, size_t len, rpc_codec_t codec, rpc_lane_t lane)
+{
+    return queue_message(sockfd, conn_id, buffer, len, RPC_CODEC_FRAME_TYPE(codec), FALSE, (lane == RPC_LANE_CONTROL) ? RPC_LANE_CONTROL : RPC_LANE_BULK);
+}
+
+uint64_t json_rpc_server_get_connection_id(const int sockfd)
+{
+    uint64_t id = 0;
+
+    pthread_mutex_lock(&gm_connection_lock);
+    if (sockfd >= 0 && sockfd < g_connection_table_size && g_connection_table[sockfd] != NULL)
+    {
+        id = g_connection_table[sockfd]->id;
+    }
+    pthread_mutex_unlock(&gm_connection_lock);
+    return id;
+}
+
+int json_rpc_server_get_codec(const int sockfd)
+{
+    int codec = RETURN_ERR;
+
+    pthread_mutex_lock(&gm_connection_lock);
+    if (sockfd >= 0 && sockfd < g_connection_table_size && g_connection_table[sockfd] != NULL)
+    {
+        codec = g_connection_table[sockfd]->codec;
+    }
+    pthread_mutex_unlock(&gm_connection_lock);
+    return codec;
+}
+
+static int queue_message(const int sockfd, uint64_t conn_id, const char *buffer, size_t len, uint8_t type, int post, rpc_lane_t lane)
+{
+    POINTER_ASSERT(buffer != NULL);
+    rpc_server_data_t *serverdata = g_rpc_server_data;
+    rpc_connection_t *conn = NULL;
+    write_queue_watermark_t watermark = WRITE_QUEUE_WATERMARK_NONE;
+    size_t message_len = len + ((g_rpc_server_framing == TRUE) ? RPC_FRAME_HEADER_SIZE : 0);
+    size_t queued = 0;
+    uint64_t id;
+    int ret = RETURN_OK;
+
+    if (serverdata == NULL)
+    {
+        LOGERROR("Server is not running \n");
+        return RETURN_ERR;
+    }
+
+    pthread_mutex_lock(&gm_connection_lock);
+    if (sockfd < 0 || sockfd >= g_connection_table_size || g_connection_table[sockfd] == NULL ||
+        g_connection_table[sockfd]->closing == TRUE)
+    {
+        pthread_mutex_unlock(&gm_connection_lock);
+        LOGERROR("No client connection on fd %d \n", sockfd);
+        return RETURN_ERR;
+    }
+    if (conn_id != 0 && g_connection_table[sockfd]->id != conn_id)
+    {
+        /* The client went away and the fd got reused by another one. */
+        pthread_mutex_unlock(&gm_connection_lock);
+        LOGERROR("Client connection on fd %d closed, message dropped \n", sockfd);
+        return RETURN_ERR;
+    }
+    conn = g_connection_table[sockfd];
+    id = conn->id;
+    queued = queued_bytes(conn);
+
+    /* A message larger than the limit is still accepted by an empty queue. */
+    while (serverdata->write_queue_size > 0 && queued > 0 && queued + message_len > serverdata->write_queue_size)
+    {
+        if (serverdata->write_queue_policy == RPC_WRITE_QUEUE_POLICY_BLOCK &&
+            (post == TRUE || is_reactor_thread() == TRUE))
+        {
+            /* Reactors drain the queues, they can not wait for them. Posted
+             * messages are handed to the reactor, they do not wait either. */
+            if (queued + message_len <= serverdata->write_queue_size * WRITE_QUEUE_NO_WAIT_FACTOR)
+            {
+                break;
+            }
+        }
+        else if (serverdata->write_queue_policy == RPC_WRITE_QUEUE_POLICY_BLOCK)
+        {
+            g_write_queue_waiters++;
+            pthread_cond_wait(&g_write_queue_cond, &gm_connection_lock);
+            g_write_queue_waiters--;
+            if (sockfd >= g_connection_table_size || g_connection_table[sockfd] == NULL ||
+                g_connection_table[sockfd]->id != id || g_connection_table[sockfd]->closing == TRUE)
+            {
+                LOGERROR("Client connection on fd %d closed while waiting to send \n", sockfd);
+                ret = RETURN_ERR;
+                goto EXIT;
+            }
+            conn = g_connection_table[sockfd];
+            queued = queued_bytes(conn);
+            continue;
+        }
+
+        if (serverdata->write_queue_policy != RPC_WRITE_QUEUE_POLICY_DROP)
+        {
+            LOGERROR("Outbound queue of fd %d is full [%zu bytes], disconnecting client \n", sockfd, queued);
+            conn->closing = TRUE;
+            /* The owning reactor sees the hang up and closes the connection. */
+            shutdown(sockfd, SHUT_RDWR);
+        }
+        else
+        {
+            LOGERROR("Outbound queue of fd %d is full [%zu bytes], message dropped \n", sockfd, queued);
+        }
+        ret = RETURN_ERR;
+        goto EXIT;
+    }
+
+    /* Shared memory first, the socket takes what does not fit the response ring. */
+    if (conn->shm != NULL && queued == 0 && json_rpc_shm_send(conn->shm, type, buffer, len) == RETURN_OK)
+    {
+        goto EXIT;
+    }
+
+    ret = enqueue_message(conn, lane, type, buffer, len);
+    if (ret != RETURN_OK)
+    {
+        LOGERROR("Failed to queue the message for fd %d \n", sockfd);
+        goto EXIT;
+    }
+
+    g_server_stats.messages++;
+
+    /* Write straight away unless the socket is already known to be full. A reply from
+     * the owning reactor waits for the other replies of its batch, a posted one for the
+     * reactor to wake up. */
+    if (conn->tx_armed == FALSE && (post == TRUE || pthread_equal(pthread_self(), conn->reactor->thread)))
+    {
+        defer_flush(conn);
+    }
+    else if (conn->tx_armed == FALSE && flush_connection(conn) != RETURN_OK)
+    {
+        LOGERROR("Failed to send the response message over socket fd %d \n", sockfd);
+        ret = RETURN_ERR;
+    }
+    watermark = update_watermark(serverdata, conn);
+    queued = queued_bytes(conn);
+
+EXIT:
+    pthread_mutex_unlock(&gm_connection_lock);
+    notify_watermark(serverdata, sockfd, watermark, queued);
+#ifdef DEBUG_ENABLED
+    if (ret == RETURN_OK && type == RPC_FRAME_TYPE_JSON)
+    {
+        LOGINFO("Response json message = %.*s", (int)len, buffer);
+    }
+#endif
+    return ret;
+}
+
+int json_rpc_server_get_stats(rpc_server_stats_t *stats)
+{
+    POINTER_ASSERT(stats != NULL);
+
+    pthread_mutex_lock(&gm_connection_lock);
+    *stats = g_server_stats;
+    pthread_mutex_unlock(&gm_connection_lock);
+    return RETURN_OK;
+}
+
+static int enqueue_message(rpc_connection_t *conn, rpc_lane_t lane, uint8_t type, const char *buffer, size_t len)
+{
+    rpc_frame_buffer_t *queue = (lane == RPC_LANE_CONTROL) ? &conn->tx_control : &conn->tx;
+    uint32_t message_len = (uint32_t)(len + ((g_rpc_server_framing == TRUE) ? RPC_FRAME_HEADER_SIZE : 0));
+    int ret;
+
+    if (g_rpc_server_framing == TRUE)
+    {
+        ret = json_rpc_frame_encode(queue, type, RPC_FRAME_FLAG_NONE, buffer, len);
+    }
+    else
+    {
+        ret = json_rpc_frame_buffer_append(queue, buffer, len);
+    }
+    /* Control messages only cut in between two bulk messages, their lengths tell where. */
+    if (ret == RETURN_OK && lane == RPC_LANE_BULK &&
+        json_rpc_frame_buffer_append(&conn->tx_lengths, (const char *)&message_len, sizeof(message_len)) != RETURN_OK)
+    {
+        queue->len -= message_len;
+        ret = RETURN_ERR;
+    }
+    if (ret != RETURN_OK)
+    {
+        return ret;
+    }
+
+    g_server_stats.lane_messages[lane]++;
+    g_server_stats.lane_queued[lane] += message_len;
+    if (g_server_stats.lane_queued[lane] > g_server_stats.lane_max_queued[lane])
+    {
+        g_server_stats.lane_max_queued[lane] = g_server_stats.lane_queued[lane];
+    }
+    return RETURN_OK;
+}
+
+static size_t queued_bytes(const rpc_connection_t *conn)
+{
+    return (conn->tx.len - conn->tx_offset) + (conn->tx_control.len - conn->tx_control_offset);
+}
+
+static void consume_queue(rpc_connection_t *conn, rpc_lane_t lane, size_t bytes)
+{
+    uint32_t head;
+
+    g_server_stats.lane_queued[lane] -= bytes;
+    if (lane == RPC_LANE_CONTROL)
+    {
+        conn->tx_control_offset += bytes;
+        return;
+    }
+
+    conn->tx_offset += bytes;
+    bytes += conn->tx_head_sent;
+    while (conn->tx_lengths_offset < conn->tx_lengths.len)
+    {
+        memcpy(&head, conn->tx_lengths.data + conn->tx_lengths_offset, sizeof(head));
+        if (bytes < head)
+        {
+            break;
+        }
+        bytes -= head;
+        conn->tx_lengths_offset += sizeof(head);
+    }
+    conn->tx_head_sent = bytes;
+}
+
+static void compact_queue(rpc_frame_buffer_t *buf, size_t *offset)
+{
+    if (*offset == buf->len)
+    {
+        buf->len = 0;
+        *offset = 0;
+        if (buf->size > RPC_FRAME_BUFFER_KEEP_SIZE)
+        {
+            json_rpc_frame_buffer_free(buf);
+        }
+    }
+    else if (*offset >= buf->len / 2)
+    {
+        /* Compact, so the queue does not keep growing while the client reads slowly. */
+        memmove(buf->data, buf->data + *offset, buf->len - *offset);
+        buf->len -= *offset;
+        *offset = 0;
+    }
+}
+
+static int flush_connection(rpc_connection_t *conn)
+{
+    struct epoll_event ev;
+    struct mmsghdr msgs[FLUSH_MAX_RECORDS];
+    struct iovec iov[FLUSH_MAX_RECORDS];
+    struct iovec segments[3];
+    rpc_lane_t lanes[3];
+    int ret = RETURN_OK;
+    ssize_t rc;
+
+    while (queued_bytes(conn) > 0)
+    {
+        size_t bulk = conn->tx_offset;
+        int segment_count = 0;
+        int count = 0;
+
+        /* A bulk message already started is completed before the control lane goes. */
+        if (conn->tx_head_sent > 0)
+        {
+            uint32_t head;
+            memcpy(&head, conn->tx_lengths.data + conn->tx_lengths_offset, sizeof(head));
+            segments[segment_count].iov_base = conn->tx.data + bulk;
+            segments[segment_count].iov_len = head - conn->tx_head_sent;
+            lanes[segment_count++] = RPC_LANE_BULK;
+            bulk += head - conn->tx_head_sent;
+        }
+        if (conn->tx_control_offset < conn->tx_control.len)
+        {
+            segments[segment_count].iov_base = conn->tx_control.data + conn->tx_control_offset;
+            segments[segment_count].iov_len = conn->tx_control.len - conn->tx_control_offset;
+            lanes[segment_count++] = RPC_LANE_CONTROL;
+        }
+        if (bulk < conn->tx.len)
+        {
+            segments[segment_count].iov_base = conn->tx.data + bulk;
+            segments[segment_count].iov_len = conn->tx.len - bulk;
+            lanes[segment_count++] = RPC_LANE_BULK;
+        }
+
+        if (g_rpc_server_data->socket_path[0] == '\0')
+        {
+            /* Stream socket, the whole queue goes out with one call. */
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = segments;
+            msg.msg_iovlen = segment_count;
+            rc = sendmsg(conn->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+            g_server_stats.send_calls++;
+        }
+        else
+        {
+            /* Keeps every SOCK_SEQPACKET record within the size the peer reads at once,
+             * and hands as many records as possible to a single call. */
+            memset(msgs, 0, sizeof(msgs));
+            for (int i = 0; i < segment_count && count < FLUSH_MAX_RECORDS; ++i)
+            {
+                size_t pos = 0;
+                while (count < FLUSH_MAX_RECORDS && pos < segments[i].iov_len)
+                {
+                    size_t chunk = segments[i].iov_len - pos;
+                    if (chunk > RPC_FRAME_MAX_RECORD)
+                    {
+                        chunk = RPC_FRAME_MAX_RECORD;
+                    }
+                    iov[count].iov_base = (char *)segments[i].iov_base + pos;
+                    iov[count].iov_len = chunk;
+                    msgs[count].msg_hdr.msg_iov = &iov[count];
+                    msgs[count].msg_hdr.msg_iovlen = 1;
+                    pos += chunk;
+                    count++;
+                }
+            }
+            rc = sendmmsg(conn->fd, msgs, count, MSG_DONTWAIT | MSG_NOSIGNAL);
+            g_server_stats.send_calls++;
+            if (rc > 0)
+            {
+                int sent = (int)rc;
+                rc = 0;
+                for (int i = 0; i < sent; ++i)
+                {
+                    rc += msgs[i].msg_len;
+                }
+            }
+        }
+        if (rc < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                /* Peer is gone, the owning reactor closes the connection on the hang up. */
+                LOGERROR("send() failed on fd %d, Error : %s", conn->fd, strerror(errno));
+                consume_queue(conn, RPC_LANE_CONTROL, conn->tx_control.len - conn->tx_control_offset);
+                consume_queue(conn, RPC_LANE_BULK, conn->tx.len - conn->tx_offset);
+                ret = RETURN_ERR;
+            }
+            break;
+        }
+        for (int i = 0; i < segment_count && rc > 0; ++i)
+        {
+            size_t written = ((size_t)rc < segments[i].iov_len) ? (size_t)rc : segments[i].iov_len;
+            consume_queue(conn, lanes[i], written);
+            rc -= written;
+        }
+    }
+
+    compact_queue(&conn->tx, &conn->tx_offset);
+    compact_queue(&conn->tx_lengths, &conn->tx_lengths_offset);
+    compact_queue(&conn->tx_control, &conn->tx_control_offset);
+
+    if (g_write_queue_waiters > 0)
+    {
+        pthread_cond_broadcast(&g_write_queue_cond);
+    }
+
+#ifdef JSON_HAL_IO_URING
+    if (conn->reactor->ring != NULL)
+    {
+        /* The poll is one shot, it is armed here and cleared when it completes. */
+        if (queued_bytes(conn) > 0 && conn->tx_armed == FALSE && uring_arm_pollout(conn) == RETURN_OK)
+        {
+            conn->tx_armed = TRUE;
+        }
+        return ret;
+    }
+#endif
+
+    /* Only ask for EPOLLOUT while there is something to write. */
+    if ((queued_bytes(conn) > 0) != (conn->tx_armed == TRUE))
+    {
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET | ((queued_bytes(conn) > 0) ? EPOLLOUT : 0);
+        ev.data.ptr = conn;
+        if (epoll_ctl(conn->reactor->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) == 0)
+        {
+            conn->tx_armed = (queued_bytes(conn) > 0) ? TRUE : FALSE;
+        }
+        else
+        {
+            perror("epoll_ctl() failed");
+        }
+    }
+    return ret;
+}
+
+static void defer_flush(rpc_connection_t *conn)
+{
+    rpc_reactor_t *reactor = conn->reactor;
+    uint64_t value = 1;
+
+    if (conn->flush_pending == FALSE)
+    {
+        /* A list that is not empty already gets written, the reactor is awake or woken up. */
+        if (reactor->flush_list == NULL && !pthread_equal(pthread_self(), reactor->thread) &&
+            write(reactor->notify_fd, &value, sizeof(value)) != sizeof(value))
+        {
+            LOGERROR("Failed to wake up reactor %d, Error : %s", reactor->index, strerror(errno));
+        }
+        conn->flush_pending = TRUE;
+        conn->flush_next = reactor->flush_list;
+        reactor->flush_list = conn;
+    }
+}
+
+static void read_notify(rpc_reactor_t *reactor)
+{
+    uint64_t value;
+
+    if (read(reactor->notify_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+    {
+        LOGERROR("Failed to read the notify eventfd of reactor %d, Error : %s", reactor->index, strerror(errno));
+    }
+}
+
+static void flush_pending_connections(rpc_reactor_t *reactor)
+{
+    rpc_server_data_t *serverdata = reactor->serverdata;
+    write_queue_watermark_t watermark;
+    rpc_connection_t *conn;
+    size_t queued;
+    int fd;
+
+    while (TRUE)
+    {
+        pthread_mutex_lock(&gm_connection_lock);
+        conn = reactor->flush_list;
+        if (conn == NULL)
+        {
+            pthread_mutex_unlock(&gm_connection_lock);
+            return;
+        }
+        reactor->flush_list = conn->flush_next;
+        conn->flush_next = NULL;
+        conn->flush_pending = FALSE;
+        if (conn->tx_armed == FALSE && conn->closing == FALSE)
+        {
+            flush_connection(conn);
+        }
+        watermark = update_watermark(serverdata, conn);
+        queued = queued_bytes(conn);
+        fd = conn->fd;
+        pthread_mutex_unlock(&gm_connection_lock);
+        notify_watermark(serverdata, fd, watermark, queued);
+    }
+}
+
+static write_queue_watermark_t update_watermark(rpc_server_data_t *serverdata, rpc_connection_t *conn)
+{
+    size_t queued = queued_bytes(conn);
+
+    if (conn->above_high_watermark == FALSE && serverdata->write_queue_high_watermark > 0 &&
+        queued > serverdata->write_queue_high_watermark)
+    {
+        conn->above_high_watermark = TRUE;
+        return WRITE_QUEUE_WATERMARK_HIGH;
+    }
+    if (conn->above_high_watermark == TRUE && queued <= serverdata->write_queue_low_watermark)
+    {
+        conn->above_high_watermark = FALSE;
+        return WRITE_QUEUE_WATERMARK_LOW;
+    }
+    return WRITE_QUEUE_WATERMARK_NONE;
+}
+
+static void notify_watermark(rpc_server_data_t *serverdata, int fd, write_queue_watermark_t watermark, size_t queued)
+{
+    if (watermark == WRITE_QUEUE_WATERMARK_HIGH && serverdata->func_high_watermark != NULL)
+    {
+        serverdata->func_high_watermark(fd, queued);
+    }
+    else if (watermark == WRITE_QUEUE_WATERMARK_LOW && serverdata->func_low_watermark != NULL)
+    {
+        serverdata->func_low_watermark(fd, queued);
+    }
+}
+
+static void write_connection(rpc_server_data_t *serverdata, rpc_connection_t *conn)
+{
+    write_queue_watermark_t watermark;
+    size_t queued;
+    int fd = conn->fd;
+
+    pthread_mutex_lock(&gm_connection_lock);
+    flush_connection(conn);
+    watermark = update_watermark(serverdata, conn);
+    queued = queued_bytes(conn);
+    pthread_mutex_unlock(&gm_connection_lock);
+    notify_watermark(serverdata, fd, watermark, queued);
+}
+
+static int is_reactor_thread(void)
+{
+    for (int i = 0; i < g_reactor_count; ++i)
+    {
+        if (pthread_equal(pthread_self(), g_reactors[i].thread))
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+int json_rpc_server_run(rpc_server_data_t *server)
+{
+    if (NULL == server)
+    {
+        LOGERROR("Invalid argument \n");
+        return RETURN_ERR;
+    }
+
+    int rc = RETURN_OK;
+    pthread_t socket_thread;
+    pthread_attr_t attributes;
+
+    if (server->socket_path[0] != '\0')
+    {
+        /* Records of a SOCK_SEQPACKET socket carry chunks of the frame stream. */
+        server->framing = TRUE;
+    }
+    g_rpc_server_framing = server->framing;
+    g_rpc_server_data = server;
+    server->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (server->wakeup_fd < 0)
+    {
+        LOGERROR("Failed to create server wakeup eventfd \n");
+        return RETURN_ERR;
+    }
+
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    rc = pthread_create(&socket_thread, &attributes, rpc_server_handler, (void *)server);
+    if (rc != RETURN_OK)
+    {
+        LOGERROR("Failed to create server socket handler thread \n");
+        close(server->wakeup_fd);
+        server->wakeup_fd = -1;
+    }
+    pthread_attr_destroy(&attributes);
+    return rc;
+}
+
+int json_rpc_server_stop(rpc_server_data_t *server)
+{
+    POINTER_ASSERT(server != NULL);
+    uint64_t value = 1;
+    int rc = RETURN_OK;
+
+    pthread_mutex_lock(&gm_wakeup_lock);
+    server->running = FALSE;
+    if (server->wakeup_fd >= 0)
+    {
+        if (write(server->wakeup_fd, &value, sizeof(value)) != sizeof(value))
+        {
+            LOGERROR("Failed to wake up server socket thread");
+            rc = RETURN_ERR;
+        }
+    }
+    pthread_mutex_unlock(&gm_wakeup_lock);
+    return rc;
+}
+
+static int remove_stale_socket(const struct sockaddr_un *addr)
+{
+    struct stat st;
+    int probe_sd = -1;
+    int rc = RETURN_OK;
+
+    if (lstat(addr->sun_path, &st) != 0)
+    {
+        return (errno == ENOENT) ? RETURN_OK : RETURN_ERR;
+    }
+    if (!S_ISSOCK(st.st_mode))
+    {
+        LOGERROR("Socket path %s exists and is not a socket \n", addr->sun_path);
+        return RETURN_ERR;
+    }
+
+    /* Non blocking, a server with a full backlog answers EAGAIN and is running still. */
+    probe_sd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (probe_sd < 0)
+    {
+        perror("socket() failed");
+        return RETURN_ERR;
+    }
+    if (connect(probe_sd, (const struct sockaddr *)addr, sizeof(*addr)) == 0)
+    {
+        LOGERROR("Another server is running on socket path %s \n", addr->sun_path);
+        rc = RETURN_ERR;
+    }
+    else if (errno == ECONNREFUSED)
+    {
+        /* Left behind by a previous instance. */
+        LOGINFO("Removing stale socket file %s \n", addr->sun_path);
+        if (unlink(addr->sun_path) != 0 && errno != ENOENT)
+        {
+            perror("unlink() failed");
+            rc = RETURN_ERR;
+        }
+    }
+    else if (errno != ENOENT)
+    {
+        /* ENOENT: removed meanwhile, the path is free. */
+        LOGERROR("Socket path %s is in use [%s] \n", addr->sun_path, strerror(errno));
+        rc = RETURN_ERR;
+    }
+    close(probe_sd);
+    return rc;
+}
+
+static int create_listen_socket(rpc_server_data_t *serverdata)
+{
+    int listen_sd = -1, rc, on = 1;
+
+    if (serverdata->socket_path[0] != '\0')
+    {
+        struct sockaddr_un addr;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(serverdata->socket_path) >= sizeof(addr.sun_path))
+        {
+            LOGERROR("Socket path %s is too long", serverdata->socket_path);
+            return RETURN_ERR;
+        }
+        strncpy(addr.sun_path, serverdata->socket_path, sizeof(addr.sun_path) - 1);
+
+        listen_sd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_sd < 0)
+        {
+            perror("socket() failed");
+            return RETURN_ERR;
+        }
+        if (remove_stale_socket(&addr) != RETURN_OK)
+        {
+            close(listen_sd);
+            return RETURN_ERR;
+        }
+        rc = bind(listen_sd, (struct sockaddr *)&addr, sizeof(addr));
+        if (rc < 0)
+        {
+            perror("bind() failed");
+            close(listen_sd);
+            return RETURN_ERR;
+        }
+        LOGINFO("server started at %s \n", serverdata->socket_path);
+        return listen_sd;
+    }
+
+    struct sockaddr_in addr;
+
+    listen_sd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_sd < 0)
+    {
+        perror("socket() failed");
+        return RETURN_ERR;
+    }
+    rc = setsockopt(listen_sd, SOL_SOCKET, SO_REUSEADDR, (char *)&on, sizeof(on));
+    if (rc < 0)
+    {
+        perror("setsockopt() failed");
+        close(listen_sd);
+        return RETURN_ERR;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    addr.sin_port = htons(serverdata->port);
+    rc = bind(listen_sd, (struct sockaddr *)&addr, sizeof(addr));
+    if (rc < 0)
+    {
+        perror("bind() failed");
+        close(listen_sd);
+        return RETURN_ERR;
+    }
+    LOGINFO("server started at port %d \n", serverdata->port);
+    return listen_sd;
+}
+
+static rpc_connection_t *add_connection(int fd, rpc_reactor_t *reactor)
+{
+    rpc_connection_t *conn;
+
+    pthread_mutex_lock(&gm_connection_lock);
+    conn = insert_connection(fd, reactor);
+    pthread_mutex_unlock(&gm_connection_lock);
+    return conn;
+}
+
+static rpc_connection_t *insert_connection(int fd, rpc_reactor_t *reactor)
+{
+    if (fd >= g_connection_table_size)
+    {
+        int new_size = g_connection_table_size ? g_connection_table_size : CONNECTION_TABLE_INITIAL_SIZE;
+        while (new_size <= fd)
+        {
+            new_size *= 2;
+        }
+        rpc_connection_t **table = (rpc_connection_t **)realloc(g_connection_table, new_size * sizeof(rpc_connection_t *));
+        if (table == NULL)
+        {
+            return NULL;
+        }
+        memset(table + g_connection_table_size, 0, (new_size - g_connection_table_size) * sizeof(rpc_connection_t *));
+        g_connection_table = table;
+        g_connection_table_size = new_size;
+    }
+
+    rpc_connection_t *conn = (rpc_connection_t *)calloc(1, sizeof(rpc_connection_t));
+    if (conn == NULL)
+    {
+        return NULL;
+    }
+    conn->fd = fd;
+    conn->reactor = reactor;
+    conn->id = ++g_connection_id;
+    g_connection_table[fd] = conn;
+    return conn;
+}
+
+static void close_connection(rpc_server_data_t *serverdata, rpc_connection_t *conn)
+{
+    int fd = conn->fd;
+
+    LOGINFO("Connection closed on fd %d\n", fd);
+    if (serverdata->func_disconnect != NULL)
+    {
+        serverdata->func_disconnect(fd);
+    }
+
+#ifdef JSON_HAL_IO_URING
+    if (conn->reactor->ring != NULL)
+    {
+        /* The requests in flight still refer to the connection. Shutting the socket
+         * down completes them, the last completion releases the connection. */
+        pthread_mutex_lock(&gm_connection_lock);
+        conn->closing = TRUE;
+        conn->closed = TRUE;
+        shutdown(fd, SHUT_RDWR);
+        if (conn->pending_ops == 0)
+        {
+            release_connection(conn);
+        }
+        else if (g_write_queue_waiters > 0)
+        {
+            pthread_cond_broadcast(&g_write_queue_cond);
+        }
+        pthread_mutex_unlock(&gm_connection_lock);
+        return;
+    }
+#endif
+
+    epoll_ctl(conn->reactor->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    if (conn->shm != NULL)
+    {
+        /* The doorbell is shared with the client, closing it does not unregister it. */
+        epoll_ctl(conn->reactor->epoll_fd, EPOLL_CTL_DEL, conn->shm->rx_doorbell, NULL);
+        /* Socket and doorbell events of the connection may both be in the current batch,
+         * the owning reactor is the one running it. */
+        for (int i = 0; i < conn->reactor->event_count; ++i)
+        {
+            if (((uintptr_t)conn->reactor->events[i].data.ptr & ~(uintptr_t)EPOLL_TAG_DOORBELL) == (uintptr_t)conn)
+            {
+                conn->reactor->events[i].data.ptr = NULL;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&gm_connection_lock);
+    release_connection(conn);
+    pthread_mutex_unlock(&gm_connection_lock);
+}
+
+static void release_connection(rpc_connection_t *conn)
+{
+    int fd = conn->fd;
+
+    /* Delete connection from the table once client got disconnected. The fd is closed
+     * under the lock, so no other thread writes to it once it got reused. */
+    close(fd);
+    if (fd < g_connection_table_size && g_connection_table[fd] == conn)
+    {
+        g_connection_table[fd] = NULL;
+    }
+    if (conn->flush_pending == TRUE)
+    {
+        rpc_connection_t **link = &conn->reactor->flush_list;
+        while (*link != conn)
+        {
+            link = &(*link)->flush_next;
+        }
+        *link = conn->flush_next;
+    }
+    free_connection(conn);
+    if (g_write_queue_waiters > 0)
+    {
+        pthread_cond_broadcast(&g_write_queue_cond);
+    }
+}
+
+static void free_connection(rpc_connection_t *conn)
+{
+    for (int i = 0; i < conn->passed_fd_count; ++i)
+    {
+        close(conn->passed_fds[i]);
+    }
+    if (conn->shm != NULL)
+    {
+        json_rpc_shm_close(conn->shm);
+        free(conn->shm);
+    }
+    /* Called with gm_connection_lock held, what is left is not queued any more. */
+    g_server_stats.lane_queued[RPC_LANE_CONTROL] -= conn->tx_control.len - conn->tx_control_offset;
+    g_server_stats.lane_queued[RPC_LANE_BULK] -= conn->tx.len - conn->tx_offset;
+    json_rpc_frame_buffer_free(&conn->rx);
+    json_rpc_frame_buffer_free(&conn->tx);
+    json_rpc_frame_buffer_free(&conn->tx_lengths);
+    json_rpc_frame_buffer_free(&conn->tx_control);
+    free(conn);
+}
+
+static void accept_connections(rpc_server_data_t *serverdata, int listen_sd)
+{
+    int new_sd;
+
+    /* Edge triggered, so accept until the backlog is empty. */
+    while (TRUE)
+    {
+        new_sd = accept4(listen_sd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (new_sd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            if (errno != EWOULDBLOCK && errno != EAGAIN)
+            {
+                perror("accept() failed");
+            }
+            return;
+        }
+        hand_out_connection(serverdata, new_sd);
+    }
+}
+
+static void hand_out_connection(rpc_server_data_t *serverdata, int new_sd)
+{
+    struct epoll_event ev;
+    rpc_connection_t *conn;
+    rpc_reactor_t *reactor;
+    int rc = RETURN_OK;
+
+    LOGINFO("New incoming connection - %d\r\n", new_sd);
+
+    /* Hand the connection out round robin, the reactor owns it until it is closed. */
+    reactor = &g_reactors[g_next_reactor];
+    g_next_reactor = (g_next_reactor + 1) % g_reactor_count;
+
+    /* Store the new client connection into the connection table. */
+    conn = add_connection(new_sd, reactor);
+    if (conn == NULL)
+    {
+        LOGERROR("Failed to store the client connection %d", new_sd);
+        close(new_sd);
+        return;
+    }
+    if (serverdata->socket_path[0] != '\0')
+    {
+        conn->rx.record_size = RPC_FRAME_MAX_RECORD;
+    }
+
+    /* Connect callback. */
+    if (serverdata->func_connect != NULL)
+    {
+        serverdata->func_connect(new_sd);
+    }
+
+    /* Start receiving, from here on the reactor may close the connection. */
+#ifdef JSON_HAL_IO_URING
+    if (reactor->ring != NULL)
+    {
+        pthread_mutex_lock(&gm_connection_lock);
+        rc = uring_arm_recv(conn);
+        pthread_mutex_unlock(&gm_connection_lock);
+    }
+    else
+#endif
+    {
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = conn;
+        if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, new_sd, &ev) < 0)
+        {
+            perror("epoll_ctl() failed");
+            rc = RETURN_ERR;
+        }
+    }
+    if (rc != RETURN_OK)
+    {
+        close_connection(serverdata, conn);
+    }
+}
+
+static int deliver_frames(rpc_server_data_t *serverdata, rpc_connection_t *conn)
+{
+    rpc_frame_header_t header;
+    int fd = conn->fd;
+    int rc;
+
+    /* Deliver every complete frame, a partial frame stays buffered. */
+    while ((rc = json_rpc_frame_next(&conn->rx, &header)) == TRUE)
+    {
+        if ((header.type == RPC_FRAME_TYPE_JSON || header.type == RPC_FRAME_TYPE_MSGPACK) && serverdata->func_process != NULL)
+        {
+            serverdata->func_process(fd, RPC_FRAME_PAYLOAD(&conn->rx), header.length, RPC_FRAME_TYPE_CODEC(header.type));
+        }
+        else if (header.type == RPC_FRAME_TYPE_SHM_OFFER)
+        {
+            accept_shm_offer(conn, RPC_FRAME_PAYLOAD(&conn->rx), header.length);
+        }
+        else if (header.type == RPC_FRAME_TYPE_CODEC_OFFER)
+        {
+            accept_codec_offer(serverdata, conn, RPC_FRAME_PAYLOAD(&conn->rx), header.length);
+        }
+        else if (header.type != RPC_FRAME_TYPE_JSON && header.type != RPC_FRAME_TYPE_MSGPACK)
+        {
+            LOGERROR("Unsupported frame type %d on fd %d", header.type, fd);
+        }
+        json_rpc_frame_consume(&conn->rx, &header);
+    }
+    if (rc == RETURN_ERR)
+    {
+        LOGERROR("Invalid frame received on fd %d", fd);
+        return RETURN_ERR;
+    }
+    return RETURN_OK;
+}
+
+static void read_framed_connection(rpc_server_data_t *serverdata, rpc_connection_t *conn)
+{
+    int fd = conn->fd;
+    int rc;
+
+    /* Edge triggered, so read until the socket is drained. */
+    while (TRUE)
+    {
+        if (serverdata->socket_path[0] != '\0')
+        {
+            /* Unix domain socket, the client may pass the fds of its shared memory. */
+            rc = json_rpc_frame_recv_fds(fd, &conn->rx, conn->passed_fds, &conn->passed_fd_count);
+        }
+        else
+        {
+            rc = json_rpc_frame_recv(fd, &conn->rx);
+        }
+        if (rc < 0)
+        {
+            if (errno != EWOULDBLOCK && errno != EAGAIN)
+            {
+                perror(" recv() failed");
+                close_connection(serverdata, conn);
+            }
+            return;
+        }
+        if (rc == 0)
+        {
+            close_connection(serverdata, conn);
+            return;
+        }
+        rc = deliver_frames(serverdata, conn);
+        /* Descriptors no frame claimed are not kept. */
+        for (int i = 0; i < conn->passed_fd_count; ++i)
+        {
+            close(conn->passed_fds[i]);
+        }
+        conn->passed_fd_count = 0;
+        if (rc != RETURN_OK)
+        {
+            close_connection(serverdata, conn);
+            return;
+        }
+    }
+}
+
+static void accept_shm_offer(rpc_connection_t *conn, const char *payload, uint32_t len)
+{
+    rpc_shm_channel_t *shm = NULL;
+    struct epoll_event ev;
+    uint32_t ring_size;
+    int rc;
+
+#ifdef JSON_HAL_IO_URING
+    if (conn->reactor->ring != NULL)
+    {
+        /* Multishot recv does not deliver passed fds. */
+        LOGINFO("Shared memory is not supported with io_uring, fd %d keeps using the socket", conn->fd);
+        return;
+    }
+#endif
+    if (conn->shm != NULL || conn->passed_fd_count != 3 || len != sizeof(ring_size))
+    {
+        LOGERROR("Invalid shared memory offer on fd %d", conn->fd);
+        return;
+    }
+    memcpy(&ring_size, payload, sizeof(ring_size));
+    ring_size = ntohl(ring_size);
+
+    shm = (rpc_shm_channel_t *)calloc(1, sizeof(rpc_shm_channel_t));
+    if (shm == NULL)
+    {
+        LOGERROR("Failed to allocate the shared memory channel of fd %d", conn->fd);
+        return;
+    }
+    if (json_rpc_shm_attach(shm, conn->passed_fds[0], conn->passed_fds[1], conn->passed_fds[2], ring_size) != RETURN_OK)
+    {
+        free(shm);
+        return;
+    }
+    /* The channel owns the fds now. */
+    conn->passed_fd_count = 0;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = (void *)((uintptr_t)conn | EPOLL_TAG_DOORBELL);
+    if (epoll_ctl(conn->reactor->epoll_fd, EPOLL_CTL_ADD, shm->rx_doorbell, &ev) < 0)
+    {
+        perror("epoll_ctl() failed");
+        json_rpc_shm_close(shm);
+        free(shm);
+        return;
+    }
+
+    pthread_mutex_lock(&gm_connection_lock);
+    conn->shm = shm;
+    rc = enqueue_message(conn, RPC_LANE_CONTROL, RPC_FRAME_TYPE_SHM_ACCEPT, "", 0);
+    if (rc == RETURN_OK && conn->tx_armed == FALSE)
+    {
+        rc = flush_connection(conn);
+    }
+    pthread_mutex_unlock(&gm_connection_lock);
+    if (rc != RETURN_OK)
+    {
+        LOGERROR("Failed to accept the shared memory offer on fd %d", conn->fd);
+        return;
+    }
+    LOGINFO("Client on fd %d uses shared memory rings of %u bytes", conn->fd, ring_size);
+}
+
+static void accept_codec_offer(rpc_server_data_t *serverdata, rpc_connection_t *conn, const char *payload, uint32_t len)
+{
+    unsigned char codec = RPC_CODEC_JSON;
+    int rc;
+
+    if (len == 1 && (unsigned char)payload[0] == serverdata->codec)
+    {
+        codec = serverdata->codec;
+    }
+
+    /* Every message carries its encoding, the replies queued before the answer may stay text json. */
+    pthread_mutex_lock(&gm_connection_lock);
+    conn->codec = codec;
+    rc = enqueue_message(conn, RPC_LANE_CONTROL, RPC_FRAME_TYPE_CODEC_ACCEPT, (const char *)&codec, sizeof(codec));
+    if (rc == RETURN_OK && conn->tx_armed == FALSE)
+    {
+        rc = flush_connection(conn);
+    }
+    pthread_mutex_unlock(&gm_connection_lock);
+    if (rc != RETURN_OK)
+    {
+        LOGERROR("Failed to answer the encoding offer on fd %d", conn->fd);
+        return;
+    }
+    LOGINFO("Client on fd %d uses %s messages", conn->fd, (codec == RPC_CODEC_MSGPACK) ? "MessagePack" : "text json");
+}
 
-/**
- * Global variable to store the server thread running status.
- */
-static int g_rpc_server_running_status = FALSE;
+static void read_shm_connection(rpc_server_data_t *serverdata, rpc_connection_t *conn)
+{
+    char *payload;
+    uint32_t len;
+    uint8_t type;
+    int rc;
 
-/**
- * @brief Server socket handler thread routine.
- * @param Received filled rpc_server_data_t structure object (typecasted to void*) contains socket port and the callback functions needs to be execute
- * once receive connection request, data from client side etc.
- * This thread will exit when the terminate api invoked.
- */
-static void *rpc_server_handler(void *arg);
+    do
+    {
+        while ((rc = json_rpc_shm_next(conn->shm, &type, &payload, &len)) == TRUE)
+        {
+            if (serverdata->func_process != NULL)
+            {
+                serverdata->func_process(conn->fd, payload, len, RPC_FRAME_TYPE_CODEC(type));
+            }
+            json_rpc_shm_consume(conn->shm);
+        }
+        if (rc == RETURN_ERR)
+        {
+            close_connection(serverdata, conn);
+            return;
+        }
+    } while (json_rpc_shm_prepare_wait(conn->shm) == FALSE);
+}
 
-int json_rpc_server_send_data(const int sockfd, const char *buffer)
+static void read_connection(rpc_server_data_t *serverdata, rpc_connection_t *conn, char *buffer)
 {
-    POINTER_ASSERT(buffer != NULL);
-    int total_bytes_sent = 0; // how many bytes we've sent
-    int total_bytes_left = 0; // how many we have left to send
-    int ret = RETURN_OK;
+    int fd = conn->fd;
+    int rc;
+
+    if (serverdata->framing == TRUE)
+    {
+        read_framed_connection(serverdata, conn);
+        return;
+    }
 
-    total_bytes_left = strlen(buffer);
-    while (total_bytes_sent < total_bytes_left)
+    /* Edge triggered, so read until the socket is drained. */
+    while (TRUE)
     {
-        ret = send(sockfd, buffer + total_bytes_sent, total_bytes_left, 0);
-        if (ret == RETURN_ERR)
+        /* Receive data from client. */
+        rc = recv(fd, buffer, MAX_BUFFER_SIZE - 1, 0);
+        if (rc < 0)
         {
-            LOGERROR("Failed to send the response message over socket, [%d] bytes left to send", total_bytes_left);
-            return RETURN_ERR;
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EWOULDBLOCK && errno != EAGAIN)
+            {
+                perror(" recv() failed");
+                close_connection(serverdata, conn);
+            }
+            return;
+        }
+        if (rc == 0)
+        {
+            close_connection(serverdata, conn);
+            return;
+        }
+
+        /**********************************************/
+        /* Data was received                          */
+        /**********************************************/
+        buffer[rc] = '\0';
+        if (serverdata->func_process != NULL)
+        {
+            serverdata->func_process(fd, buffer, rc, RPC_CODEC_JSON);
         }
-        total_bytes_sent += ret;
-        total_bytes_left -= ret;
     }
-#ifdef DEBUG_ENABLED
-    LOGINFO("Response json message = %.*s", total_bytes_sent, buffer);
+}
+
+static void reactor_loop(rpc_reactor_t *reactor, int listen_sd)
+{
+    rpc_server_data_t *serverdata = reactor->serverdata;
+    char buffer[MAX_BUFFER_SIZE] = {"\0"};
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int i, nfds;
+
+#ifdef JSON_HAL_IO_URING
+    if (reactor->ring != NULL)
+    {
+        uring_reactor_loop(reactor, listen_sd);
+        return;
+    }
 #endif
+
+    while (serverdata->running == TRUE)
+    {
+        /* Sleep until there is work, json_rpc_server_stop() wakes us up through the eventfd. */
+        nfds = epoll_wait(reactor->epoll_fd, events, MAX_EPOLL_EVENTS, -1);
+        if (nfds < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait() failed");
+            break;
+        }
+        reactor->events = events;
+        reactor->event_count = nfds;
+        for (i = 0; i < nfds; ++i)
+        {
+            rpc_connection_t *conn = (rpc_connection_t *)events[i].data.ptr;
+            if (conn == NULL)
+            {
+                /* Wakeup eventfd. It is level triggered and never read, so every reactor sees it.
+                 * Also left behind by a connection closed earlier in the batch. */
+                continue;
+            }
+            else if ((void *)conn == (void *)reactor)
+            {
+                accept_connections(serverdata, listen_sd);
+            }
+            else if ((uintptr_t)conn == ((uintptr_t)reactor | EPOLL_TAG_DOORBELL))
+            {
+                read_notify(reactor);
+            }
+            else if ((uintptr_t)conn & EPOLL_TAG_DOORBELL)
+            {
+                read_shm_connection(serverdata, (rpc_connection_t *)((uintptr_t)conn & ~(uintptr_t)EPOLL_TAG_DOORBELL));
+            }
+            else
+            {
+                if (events[i].events & EPOLLOUT)
+                {
+                    write_connection(serverdata, conn);
+                }
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                {
+                    read_connection(serverdata, conn, buffer);
+                }
+            }
+        } /* End of loop through ready descriptors */
+        reactor->event_count = 0;
+        flush_pending_connections(reactor);
+    }
+}
+
+static void *rpc_reactor_handler(void *arg)
+{
+    reactor_loop((rpc_reactor_t *)arg, -1);
+    return NULL;
+}
+
+#ifdef JSON_HAL_IO_URING
+static int uring_setup_reactors(rpc_reactor_t *reactors, int count)
+{
+    rpc_uring_t *ring;
+    int i;
+
+    if (json_rpc_uring_supported() == FALSE)
+    {
+        return RETURN_ERR;
+    }
+    for (i = 0; i < count; ++i)
+    {
+        ring = (rpc_uring_t *)calloc(1, sizeof(rpc_uring_t));
+        if (ring == NULL)
+        {
+            break;
+        }
+        if (json_rpc_uring_init(ring, URING_QUEUE_DEPTH) != RETURN_OK)
+        {
+            free(ring);
+            break;
+        }
+        if (json_rpc_uring_setup_buffers(ring, URING_BUFFER_GROUP, URING_BUFFER_COUNT, URING_BUFFER_SIZE) != RETURN_OK)
+        {
+            json_rpc_uring_free(ring);
+            free(ring);
+            break;
+        }
+        reactors[i].ring = ring;
+    }
+    if (i == count)
+    {
+        return RETURN_OK;
+    }
+
+    /* All the reactors run on the same backend. */
+    for (i = 0; i < count; ++i)
+    {
+        if (reactors[i].ring != NULL)
+        {
+            json_rpc_uring_free(reactors[i].ring);
+            free(reactors[i].ring);
+            reactors[i].ring = NULL;
+        }
+    }
+    return RETURN_ERR;
+}
+
+static int uring_arm_recv(rpc_connection_t *conn)
+{
+    rpc_reactor_t *reactor = conn->reactor;
+    struct io_uring_sqe sqe;
+
+    json_rpc_uring_prep_recv(&sqe, conn->fd, URING_BUFFER_GROUP, (uint64_t)(uintptr_t)conn | URING_TAG_RECV);
+    /* The reactor submits its own requests with its next wait, other threads submit right away. */
+    if (json_rpc_uring_queue(reactor->ring, &sqe, pthread_equal(pthread_self(), reactor->thread) ? FALSE : TRUE) != RETURN_OK)
+    {
+        return RETURN_ERR;
+    }
+    conn->pending_ops++;
     return RETURN_OK;
 }
 
-int json_rpc_server_run(rpc_server_data_t *server)
+static int uring_arm_pollout(rpc_connection_t *conn)
 {
-    if (NULL == server)
+    rpc_reactor_t *reactor = conn->reactor;
+    struct io_uring_sqe sqe;
+
+    json_rpc_uring_prep_poll(&sqe, conn->fd, POLLOUT, (uint64_t)(uintptr_t)conn | URING_TAG_POLLOUT);
+    if (json_rpc_uring_queue(reactor->ring, &sqe, pthread_equal(pthread_self(), reactor->thread) ? FALSE : TRUE) != RETURN_OK)
     {
-        LOGERROR("Invalid argument \n");
         return RETURN_ERR;
     }
+    conn->pending_ops++;
+    return RETURN_OK;
+}
 
-    int rc = RETURN_OK;
-    pthread_t socket_thread;
-    pthread_attr_t attributes;
+static void uring_handle_recv(rpc_reactor_t *reactor, rpc_connection_t *conn, const struct io_uring_cqe *cqe, char *buffer)
+{
+    rpc_server_data_t *serverdata = reactor->serverdata;
+    int more = (cqe->flags & IORING_CQE_F_MORE) ? TRUE : FALSE;
+    int disconnect = FALSE;
+    uint16_t bid;
+    char *data;
 
-    pthread_attr_init(&attributes);
-    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
-    rc = pthread_create(&socket_thread, &attributes, rpc_server_handler, (void *)server);
-    if (rc != RETURN_OK)
+    if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER))
     {
-        LOGERROR("Failed to create server socket handler thread \n");
+        bid = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        data = json_rpc_uring_buffer(reactor->ring, bid);
+        if (conn->closed == FALSE)
+        {
+            if (serverdata->framing == TRUE)
+            {
+                if (json_rpc_frame_buffer_append(&conn->rx, data, cqe->res) != RETURN_OK ||
+                    deliver_frames(serverdata, conn) != RETURN_OK)
+                {
+                    disconnect = TRUE;
+                }
+            }
+            else
+            {
+                /**********************************************/
+                /* Data was received                          */
+                /**********************************************/
+                memcpy(buffer, data, cqe->res);
+                buffer[cqe->res] = '\0';
+                if (serverdata->func_process != NULL)
+                {
+                    serverdata->func_process(conn->fd, buffer, cqe->res, RPC_CODEC_JSON);
+                }
+            }
+        }
+        json_rpc_uring_recycle_buffer(reactor->ring, bid);
+    }
+    else if (cqe->res < 0 && cqe->res != -ENOBUFS)
+    {
+        LOGERROR("recv() failed on fd %d, Error : %s", conn->fd, strerror(-cqe->res));
+        disconnect = TRUE;
+    }
+    else if (cqe->res == 0)
+    {
+        disconnect = TRUE;
+    }
+    /* -ENOBUFS: every provided buffer was in use, the recv is armed again below. */
+
+    if (disconnect == TRUE && conn->closed == FALSE)
+    {
+        /* This recv still counts as in flight, the connection is not released yet. */
+        close_connection(serverdata, conn);
+    }
+
+    pthread_mutex_lock(&gm_connection_lock);
+    if (more == FALSE)
+    {
+        conn->pending_ops--;
+        if (conn->closed == FALSE && uring_arm_recv(conn) != RETURN_OK)
+        {
+            LOGERROR("Failed to receive on fd %d any more", conn->fd);
+            disconnect = TRUE;
+        }
+    }
+    if (conn->closed == TRUE)
+    {
+        if (conn->pending_ops == 0)
+        {
+            release_connection(conn);
+        }
+        conn = NULL;
+    }
+    pthread_mutex_unlock(&gm_connection_lock);
+
+    if (conn != NULL && disconnect == TRUE)
+    {
+        close_connection(serverdata, conn);
+    }
+}
+
+static void uring_reactor_loop(rpc_reactor_t *reactor, int listen_sd)
+{
+    rpc_server_data_t *serverdata = reactor->serverdata;
+    char buffer[MAX_BUFFER_SIZE] = {"\0"};
+    struct io_uring_sqe sqe;
+    struct io_uring_cqe cqe;
+    rpc_connection_t *conn;
+    int closed;
+
+    json_rpc_uring_prep_poll(&sqe, serverdata->wakeup_fd, POLLIN, URING_TAG_WAKEUP);
+    json_rpc_uring_queue(reactor->ring, &sqe, FALSE);
+    json_rpc_uring_prep_poll(&sqe, reactor->notify_fd, POLLIN, (uint64_t)(uintptr_t)reactor | URING_TAG_WAKEUP);
+    json_rpc_uring_queue(reactor->ring, &sqe, FALSE);
+    if (listen_sd >= 0)
+    {
+        json_rpc_uring_prep_accept(&sqe, listen_sd, URING_TAG_ACCEPT);
+        json_rpc_uring_queue(reactor->ring, &sqe, FALSE);
+    }
+
+    while (serverdata->running == TRUE)
+    {
+        /* Submit the new requests and sleep until there is work, json_rpc_server_stop()
+         * wakes us up through the eventfd. */
+        if (json_rpc_uring_wait(reactor->ring) != RETURN_OK)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("io_uring_enter() failed");
+            break;
+        }
+        while (json_rpc_uring_next(reactor->ring, &cqe) == TRUE)
+        {
+            conn = (rpc_connection_t *)(uintptr_t)(cqe.user_data & ~(uint64_t)URING_TAG_MASK);
+            switch (cqe.user_data & URING_TAG_MASK)
+            {
+            case URING_TAG_WAKEUP:
+                if ((void *)conn == (void *)reactor)
+                {
+                    /* Notify eventfd, the poll is one shot. */
+                    read_notify(reactor);
+                    json_rpc_uring_prep_poll(&sqe, reactor->notify_fd, POLLIN, (uint64_t)(uintptr_t)reactor | URING_TAG_WAKEUP);
+                    json_rpc_uring_queue(reactor->ring, &sqe, FALSE);
+                }
+                /* Else the running flag is cleared, the loop ends. */
+                break;
+
+            case URING_TAG_ACCEPT:
+                if (cqe.res >= 0)
+                {
+                    hand_out_connection(serverdata, cqe.res);
+                }
+                else if (cqe.res != -EINTR && cqe.res != -ECONNABORTED)
+                {
+                    LOGERROR("accept() failed, Error : %s", strerror(-cqe.res));
+                }
+                if (!(cqe.flags & IORING_CQE_F_MORE) && serverdata->running == TRUE)
+                {
+                    json_rpc_uring_prep_accept(&sqe, listen_sd, URING_TAG_ACCEPT);
+                    json_rpc_uring_queue(reactor->ring, &sqe, FALSE);
+                }
+                break;
+
+            case URING_TAG_POLLOUT:
+                pthread_mutex_lock(&gm_connection_lock);
+                conn->pending_ops--;
+                conn->tx_armed = FALSE;
+                closed = conn->closed;
+                if (closed == TRUE && conn->pending_ops == 0)
+                {
+                    release_connection(conn);
+                }
+                pthread_mutex_unlock(&gm_connection_lock);
+                if (closed == FALSE)
+                {
+                    write_connection(serverdata, conn);
+                }
+                break;
+
+            default:
+                uring_handle_recv(reactor, conn, &cqe, buffer);
+                break;
+            }
+        }
+        flush_pending_connections(reactor);
     }
-    pthread_attr_destroy(&attributes);
-    return rc;
 }
+#endif
 
 static void *rpc_server_handler(void *arg)
 {
     rpc_server_data_t *serverdata = NULL;
-    int i, len, rc, on = 1;
-    int listen_sd, max_sd, new_sd;
-    int desc_ready = FALSE;
-    char buffer[MAX_BUFFER_SIZE] = {"\0"};
-    struct sockaddr_in addr;
-    struct timeval timeout;
-    fd_set master_set, working_set;
+    int i, rc;
+    int listen_sd = -1;
+    int reactor_count = 0;
+    int started = 1;
+    int use_uring = FALSE;
+    pthread_t reactor_thread;
+    rpc_reactor_t *reactors = NULL;
+    struct epoll_event ev;
 
     if (arg == NULL)
     {
@@ -117,168 +2045,185 @@ static void *rpc_server_handler(void *arg)
     pthread_detach(pthread_self());
 
     serverdata = (rpc_server_data_t *)arg;
-    g_client_list = NULL;
     serverdata->running = TRUE;
-    listen_sd = socket(AF_INET, SOCK_STREAM, 0);
+    listen_sd = create_listen_socket(serverdata);
     if (listen_sd < 0)
     {
-        perror("socket() failed");
         goto EXIT;
     }
-    rc = setsockopt(listen_sd, SOL_SOCKET, SO_REUSEADDR, (char *)&on, sizeof(on));
+
+    rc = listen(listen_sd, SOMAXCONN);
     if (rc < 0)
     {
-        perror("setsockopt() failed");
-        close(listen_sd);
+        perror("listen() failed");
         goto EXIT;
     }
-    rc = ioctl(listen_sd, FIONBIO, (char *)&on);
-    if (rc < 0)
+
+    reactor_count = serverdata->thread_count;
+    if (reactor_count < 1)
     {
-        perror("ioctl() failed");
-        close(listen_sd);
-        goto EXIT;
+        reactor_count = 1;
     }
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
-    addr.sin_port = htons(serverdata->port);
-    rc = bind(listen_sd, (struct sockaddr *)&addr, sizeof(addr));
-    if (rc < 0)
+    if (reactor_count > MAX_REACTOR_THREADS)
     {
-        perror("bind() failed");
-        close(listen_sd);
+        reactor_count = MAX_REACTOR_THREADS;
+    }
+    reactors = (rpc_reactor_t *)calloc(reactor_count, sizeof(rpc_reactor_t));
+    if (reactors == NULL)
+    {
+        LOGERROR("Failed to allocate the reactors \n");
         goto EXIT;
     }
+    for (i = 0; i < reactor_count; ++i)
+    {
+        reactors[i].index = i;
+        reactors[i].serverdata = serverdata;
+        reactors[i].epoll_fd = -1;
+        reactors[i].notify_fd = -1;
+    }
+    pthread_mutex_lock(&gm_connection_lock);
+    g_reactors = reactors;
+    g_reactor_count = reactor_count;
+    g_next_reactor = 0;
+    reactors[0].thread = pthread_self();
+    pthread_mutex_unlock(&gm_connection_lock);
 
-    LOGINFO("server started at port %d \n", serverdata->port);
-    rc = listen(listen_sd, 32);
-    if (rc < 0)
+    for (i = 0; i < reactor_count; ++i)
     {
-        perror("listen() failed");
-        close(listen_sd);
-        goto EXIT;
+        reactors[i].notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (reactors[i].notify_fd < 0)
+        {
+            perror("eventfd() failed");
+            goto EXIT;
+        }
     }
-    FD_ZERO(&master_set);
-    max_sd = listen_sd;
-    FD_SET(listen_sd, &master_set);
-    do
+
+#ifdef JSON_HAL_IO_URING
+    if (uring_setup_reactors(reactors, reactor_count) == RETURN_OK)
     {
-        g_rpc_server_running_status = TRUE;
+        use_uring = TRUE;
+    }
+    else
+    {
+        LOGINFO("io_uring is not available, falling back to epoll \n");
+    }
+#endif
 
-        memcpy(&working_set, &master_set, sizeof(master_set));
-        /* Wait up to 50 milliseconds */
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000;
-        rc = select(max_sd + 1, &working_set, NULL, NULL, &timeout);
-        if (rc < 0)
+    for (i = 0; i < reactor_count && use_uring == FALSE; ++i)
+    {
+        reactors[i].epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (reactors[i].epoll_fd < 0)
         {
-            perror("select() failed");
-            break;
+            perror("epoll_create1() failed");
+            goto EXIT;
         }
-        desc_ready = rc;
-        for (i = 0; i <= max_sd && desc_ready > 0; ++i)
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+        if (epoll_ctl(reactors[i].epoll_fd, EPOLL_CTL_ADD, serverdata->wakeup_fd, &ev) < 0)
         {
-            if (FD_ISSET(i, &working_set))
-            {
-                desc_ready -= 1;
-                if (i == listen_sd)
-                {
+            perror("epoll_ctl() failed");
+            goto EXIT;
+        }
+        ev.data.ptr = (void *)((uintptr_t)&reactors[i] | EPOLL_TAG_DOORBELL);
+        if (epoll_ctl(reactors[i].epoll_fd, EPOLL_CTL_ADD, reactors[i].notify_fd, &ev) < 0)
+        {
+            perror("epoll_ctl() failed");
+            goto EXIT;
+        }
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = &reactors[0];
+    if (use_uring == FALSE && epoll_ctl(reactors[0].epoll_fd, EPOLL_CTL_ADD, listen_sd, &ev) < 0)
+    {
+        perror("epoll_ctl() failed");
+        goto EXIT;
+    }
 
-                    new_sd = accept(listen_sd, NULL, NULL);
-                    if (new_sd < 0)
-                    {
-                        if (errno != EWOULDBLOCK)
-                        {
-                            perror("accept() failed");
-                        }
-                        continue;
-                    }
-                    LOGINFO("New incoming connection - %d\r\n", new_sd);
-                    /* Connect callback. */
-                    if (serverdata->func_connect != NULL)
-                    {
-                        serverdata->func_connect(new_sd);
-                    }
-                    /* Store all the new client connection data into the list and update it into
-                         * global list.
-                         */
-                    client_list_t *conn = NULL;
-                    conn = (client_list_t *)malloc(sizeof(client_list_t));
-                    conn->fd = new_sd;
-                    LL_APPEND(g_client_list, conn);
-                    /* Update client fd into reading set. */
-                    FD_SET(new_sd, &master_set);
-                    if (new_sd > max_sd)
-                        max_sd = new_sd;
-                }
-                else
-                {
-                    memset(buffer, 0, MAX_BUFFER_SIZE);
-                    /* Receive data from client. */
-                    rc = recv(i, buffer, sizeof(buffer), 0);
-                    if (rc < 0)
-                    {
-                        if (errno != EWOULDBLOCK)
-                        {
-                            perror(" recv() failed");
-                        }
-                        continue;
-                    }
-                    if (rc == 0)
-                    {
-                        LOGINFO("Connection closed on fd %d\n", i);
-                        if (serverdata->func_disconnect != NULL)
-                        {
-                            serverdata->func_disconnect(i);
-                        }
-
-                        close(i);
-                        FD_CLR(i, &master_set);
-                        if (i == max_sd)
-                        {
-                            while (FD_ISSET(max_sd, &master_set) == FALSE)
-                                max_sd -= 1;
-                        }
-                        /* Delete connection from the list once client got disconnected. */
-                        client_list_t *tmp, *conn;
-                        LL_FOREACH_SAFE(g_client_list, conn, tmp)
-                        {
-                            if (conn->fd == i)
-                            {
-                                LL_DELETE(g_client_list, conn);
-                                free(conn);
-                            }
-                        }
-                        continue;
-                    }
+    for (started = 1; started < reactor_count; ++started)
+    {
+        if (pthread_create(&reactor_thread, NULL, rpc_reactor_handler, &reactors[started]) != 0)
+        {
+            LOGERROR("Failed to create reactor thread %d, running with %d \n", started, started);
+            break;
+        }
+        pthread_mutex_lock(&gm_connection_lock);
+        reactors[started].thread = reactor_thread;
+        pthread_mutex_unlock(&gm_connection_lock);
+    }
+    pthread_mutex_lock(&gm_connection_lock);
+    g_reactor_count = started;
+    pthread_mutex_unlock(&gm_connection_lock);
 
-                    /**********************************************/
-                    /* Data was received                          */
-                    /**********************************************/
-                    len = rc;
-                    if (serverdata->func_process != NULL)
-                    {
-                        serverdata->func_process(i, buffer, len);
-                    }
-                } /* End of existing connection is readable */
-            }     /* End of if (FD_ISSET(i, &working_set)) */
-        }         /* End of loop through selectable descriptors */
+    LOGINFO("server running with %d %s reactor thread(s) \n", started, (use_uring == TRUE) ? "io_uring" : "epoll");
+    g_rpc_server_running_status = TRUE;
+    reactor_loop(&reactors[0], listen_sd);
 
-    } while (serverdata->running == TRUE);
+    for (i = 1; i < started; ++i)
+    {
+        pthread_join(reactors[i].thread, NULL);
+    }
 
-    for (i = 0; i <= max_sd; ++i)
+    pthread_mutex_lock(&gm_connection_lock);
+    for (i = 0; i < g_connection_table_size; ++i)
     {
-        if (FD_ISSET(i, &master_set))
+        if (g_connection_table[i] != NULL)
         {
             LOGINFO("Closing client [%d] connection", i);
             close(i);
+            free_connection(g_connection_table[i]);
+            g_connection_table[i] = NULL;
         }
     }
+    free(g_connection_table);
+    g_connection_table = NULL;
+    g_connection_table_size = 0;
+    pthread_cond_broadcast(&g_write_queue_cond);
+    pthread_mutex_unlock(&gm_connection_lock);
 
     g_rpc_server_running_status = FALSE;
 
 EXIT:
+    pthread_mutex_lock(&gm_connection_lock);
+    if (g_reactors != NULL)
+    {
+        for (i = 0; i < reactor_count; ++i)
+        {
+            if (g_reactors[i].epoll_fd >= 0)
+            {
+                close(g_reactors[i].epoll_fd);
+            }
+            if (g_reactors[i].notify_fd >= 0)
+            {
+                close(g_reactors[i].notify_fd);
+            }
+#ifdef JSON_HAL_IO_URING
+            if (g_reactors[i].ring != NULL)
+            {
+                /* Connections are closed already, their requests in flight get cancelled. */
+                json_rpc_uring_free(g_reactors[i].ring);
+                free(g_reactors[i].ring);
+            }
+#endif
+        }
+        free(g_reactors);
+        g_reactors = NULL;
+        g_reactor_count = 0;
+    }
+    pthread_mutex_unlock(&gm_connection_lock);
+    if (listen_sd >= 0)
+    {
+        close(listen_sd);
+        if (serverdata->socket_path[0] != '\0')
+        {
+            unlink(serverdata->socket_path);
+        }
+    }
+    pthread_mutex_lock(&gm_wakeup_lock);
+    close(serverdata->wakeup_fd);
+    serverdata->wakeup_fd = -1;
+    pthread_mutex_unlock(&gm_wakeup_lock);
     pthread_exit(0);
 }
 
@@ -21,15 +21,60 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include "json_rpc_common.h"
+#include "json_rpc_frame.h"
+#include "json_rpc_codec.h"
 
 /**
  * @brief Structure used to hold the details client connections to the server.
+ * Connections are kept in a table indexed by the client socket fd.
  */
-typedef struct client_list_t
+typedef struct rpc_connection_t
 {
   int fd;                            /* Client socket fd. */
-  struct client_list_t *next; /*  Pointer to the next node in the linked list. */
-}client_list_t;
+  uint64_t id;                       /* Unique connection id, tells a reused fd apart. */
+  struct rpc_reactor_t *reactor;     /* Reactor thread owning the connection. */
+  rpc_frame_buffer_t rx;             /* Receive buffer used to reassemble frames in framed mode. */
+  rpc_frame_buffer_t tx;             /* Outbound queue of the bulk lane, bytes not yet written to the socket. */
+  size_t tx_offset;                  /* Number of bytes of tx already written. */
+  rpc_frame_buffer_t tx_lengths;     /* Lengths (uint32_t) of the messages queued in tx, oldest first. */
+  size_t tx_lengths_offset;          /* Number of bytes of tx_lengths already consumed. */
+  size_t tx_head_sent;               /* Number of bytes written of the oldest message of tx. */
+  rpc_frame_buffer_t tx_control;     /* Outbound queue of the control lane, written before tx between two of its messages. */
+  size_t tx_control_offset;          /* Number of bytes of tx_control already written. */
+  unsigned char tx_armed;            /* Flag indicates EPOLLOUT is registered for the socket. */
+  unsigned char above_high_watermark;/* Flag indicates the high watermark callback was invoked. */
+  unsigned char closing;             /* Flag indicates the connection is being shut down. */
+  unsigned char closed;              /* Flag indicates the disconnect was reported, io_uring requests are still in flight. */
+  int pending_ops;                   /* Number of io_uring requests in flight for the connection. */
+  struct rpc_shm_channel_t *shm;     /* Shared memory rings accepted from the client, NULL if none. */
+  unsigned char codec;               /* Encoding agreed with the client, rpc_codec_t. */
+  int passed_fds[RPC_FRAME_MAX_FDS]; /* File descriptors received with the last record, not claimed yet. */
+  int passed_fd_count;               /* Number of entries in passed_fds. */
+  unsigned char flush_pending;       /* Flag indicates the connection is on its reactor's flush list. */
+  struct rpc_connection_t *flush_next; /* Next connection on the reactor's flush list. */
+}rpc_connection_t;
+
+/**
+ * @brief Action taken when a message does not fit the outbound queue of a connection.
+ */
+typedef enum rpc_write_queue_policy_t
+{
+  RPC_WRITE_QUEUE_POLICY_DROP = 0,   /* Message is dropped, send returns an error. */
+  RPC_WRITE_QUEUE_POLICY_BLOCK,      /* Sender waits until the message fits the queue. Reactors and posted messages do
+                                        not wait, they fill the queue up to twice its limit, then disconnect. */
+  RPC_WRITE_QUEUE_POLICY_DISCONNECT, /* Connection is shut down, send returns an error. */
+}rpc_write_queue_policy_t;
+
+/**
+ * @brief Priority class of an outbound message.
+ */
+typedef enum rpc_lane_t
+{
+  RPC_LANE_CONTROL = 0,              /* Events and control replies, they overtake the queued bulk messages. */
+  RPC_LANE_BULK,                     /* Other replies. */
+  RPC_LANE_COUNT
+}rpc_lane_t;
 
 /**
  * @brief Structure to hold the details of server and to define its
@@ -40,12 +85,43 @@ typedef struct rpc_server_t
   uint32_t port;                                        /* Server port number. */
   int (*func_disconnect)(int fd);                       /* Callback invoked when connection disconnected. */
   int (*func_connect)(int fd);                          /* Callback invoked when connection established. */
-  int (*func_process)(int fd, char *buf, uint32_t len); /* Callback invoked when receive message. */
+  int (*func_process)(int fd, char *buf, uint32_t len, rpc_codec_t codec); /* Callback invoked when receive message, in the encoding given. */
   unsigned char running;                                /* Flag indicates thread is running or not. */
+  int wakeup_fd;                                        /* eventfd used to wake up the reactor threads. */
+  unsigned char framing;                                /* Flag indicates messages are length prefixed frames. */
+  rpc_codec_t codec;                                    /* Encoding agreed to when a framed client offers it, RPC_CODEC_JSON to keep text json. */
+  int thread_count;                                     /* Number of reactor threads, connections are shared round robin. */
+  char socket_path[BUF_128];                            /* Unix domain socket path, TCP port is used if empty. */
+  size_t write_queue_size;                              /* Maximum bytes queued per connection, 0 for no limit. */
+  size_t write_queue_high_watermark;                    /* func_high_watermark is invoked once the queue grows above it. */
+  size_t write_queue_low_watermark;                     /* func_low_watermark is invoked once the queue drains below it. */
+  rpc_write_queue_policy_t write_queue_policy;          /* Action taken when the queue is full. */
+  int (*func_high_watermark)(int fd, size_t queued);    /* Optional callback, the client is not keeping up. */
+  int (*func_low_watermark)(int fd, size_t queued);     /* Optional callback, the client caught up again. */
 }rpc_server_data_t;
 
+/**
+ * @brief Counters of the messages written to the client sockets.
+ */
+typedef struct rpc_server_stats_t
+{
+  uint64_t messages;   /* Messages queued to be written to a client socket. */
+  uint64_t send_calls; /* System calls made to write them. */
+  uint64_t lane_messages[RPC_LANE_COUNT];   /* Messages queued, per lane. */
+  uint64_t lane_queued[RPC_LANE_COUNT];     /* Bytes waiting in the outbound queues of all the connections, per lane. */
+  uint64_t lane_max_queued[RPC_LANE_COUNT]; /* Highest value of lane_queued, per lane. */
+}rpc_server_stats_t;
+
 /**
  * @brief API will start the server socket and listen for the client connections.
+ * If socket_path is set the server listens on an AF_UNIX SOCK_SEQPACKET socket
+ * bound to that path instead of the loopback TCP port, framing is then always enabled.
+ * With thread_count above 1 the callbacks are invoked from several reactor threads
+ * at the same time, calls for one connection always come from the same thread.
+ * Built with JSON_HAL_IO_URING the reactors run on io_uring when the kernel supports
+ * it and fall back to epoll else.
+ * A client of the unix domain socket can offer shared memory rings, requests are then
+ * read from and replies written to the rings. Not supported on io_uring reactors.
  * @param Filled rpc_server_data_t structure contains the port number, callback
  * functions needs to be invoked when connect/disconnect connections or receive
  * message on socket.
@@ -54,14 +130,126 @@ typedef struct rpc_server_t
 int json_rpc_server_run(rpc_server_data_t *server);
 
 /**
- * @brief Send the data packet to the client
- * Make sure all the data packet has been successfully send over the socket.
+ * @brief Request the server socket thread to stop.
+ * Clears the running flag and wakes up the reactor threads so that they
+ * exit and the client connections get closed.
+ * @param Pointer to the rpc_server_data_t structure passed to json_rpc_server_run().
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_server_stop(rpc_server_data_t *server);
+
+/**
+ * @brief Send the data packet to the client, on the bulk lane.
+ * The message is appended to the outbound queue of the connection and written
+ * without blocking, whatever the socket does not accept is written by the reactor
+ * thread owning the connection once the socket becomes writable. Called from the reactor
+ * thread owning the connection, the write is delayed until the reactor handled all its
+ * ready events, so the replies to pipelined requests leave together. If the queue is full
+ * the configured write_queue_policy applies. Reactor threads never wait, with the block
+ * policy their replies are queued above the limit.
+ * Can be called from any thread.
  * @param socket file descriptor to use
  * @param buffer pointing to the json message
  * @return RETURN_OK on success , RETURN_ERR else.
  */
 int json_rpc_server_send_data(const int sockfd, const char *buffer);
 
+/**
+ * @brief Hand the data packet to the reactor thread owning the connection.
+ * The message is appended to the outbound queue of the connection like with
+ * json_rpc_server_send_data(), but the socket is only written by the reactor thread,
+ * which is woken up if needed. Messages posted while the reactor is busy leave together.
+ * Never waits for the queue to drain, the write_queue_policy block behaves like for the
+ * reactor threads. Meant for worker threads that must not do socket I/O themselves.
+ * Can be called from any thread.
+ * @param socket file descriptor to use
+ * @param buffer pointing to the json message
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_server_post_data(const int sockfd, const char *buffer);
+
+/**
+ * @brief json_rpc_server_send_data() on a given lane.
+ * Messages of the control lane are written before the queued messages of the bulk
+ * lane, as soon as the bulk message being written is complete.
+ * @param socket file descriptor to use
+ * @param buffer pointing to the json message
+ * @param lane of the message
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_server_send_data_lane(const int sockfd, const char *buffer, rpc_lane_t lane);
+
+/**
+ * @brief json_rpc_server_post_data() on a given lane, see json_rpc_server_send_data_lane().
+ * @param socket file descriptor to use
+ * @param buffer pointing to the json message
+ * @param lane of the message
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_server_post_data_lane(const int sockfd, const char *buffer, rpc_lane_t lane);
+
+/**
+ * @brief json_rpc_server_send_data_lane() of an encoded message, text json or MessagePack.
+ * @param socket file descriptor to use
+ * @param buffer pointing to the message
+ * @param message length
+ * @param encoding of the message, sent along with it
+ * @param lane of the message
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_server_send_message(const int sockfd, const char *buffer, size_t len, rpc_codec_t codec, rpc_lane_t lane);
+
+/**
+ * @brief json_rpc_server_post_data_lane() of an encoded message, text json or MessagePack.
+ * @param socket file descriptor to use
+ * @param buffer pointing to the message
+ * @param message length
+ * @param encoding of the message, sent along with it
+ * @param lane of the message
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_server_post_message(const int sockfd, const char *buffer, size_t len, rpc_codec_t codec, rpc_lane_t lane);
+
+/**
+ * @brief json_rpc_server_send_message() to a given connection.
+ * The message is dropped if the connection on the fd is not the one with the id,
+ * the client it was meant for disconnected and the fd got reused.
+ * @param socket file descriptor to use
+ * @param id of the connection, see json_rpc_server_get_connection_id()
+ * @param buffer pointing to the message
+ * @param message length
+ * @param encoding of the message, sent along with it
+ * @param lane of the message
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_server_send_message_to(const int sockfd, uint64_t conn_id, const char *buffer, size_t len, rpc_codec_t codec, rpc_lane_t lane);
+
+/**
+ * @brief Unique id of the connection on a fd, tells a reused fd apart.
+ * Can be called from any thread.
+ * @param socket file descriptor of the client
+ * @return connection id, 0 if there is no client on the fd.
+ */
+uint64_t json_rpc_server_get_connection_id(const int sockfd);
+
+/**
+ * @brief Encoding of the messages sent to a client, agreed when the client offered one.
+ * Can be called from any thread.
+ * @param socket file descriptor of the client
+ * @return encoding, RETURN_ERR if there is no client on the fd.
+ */
+int json_rpc_server_get_codec(const int sockfd);
+
+/**
+ * @brief Read the counters of the messages written to the client sockets.
+ * Replies sent from a reactor thread are gathered per connection while the reactor
+ * handles its ready events and written together afterwards, so send_calls / messages
+ * drops below 1 when clients pipeline their requests.
+ * @param (OUT) counters since the library was loaded
+ * @return RETURN_OK on success , RETURN_ERR else.
+ */
+int json_rpc_server_get_stats(rpc_server_stats_t *stats);
+
 /**
  * @brief Utility API used to verify server socket thread is running or not.
  * @return RETURN TRUE if server is running else FALSE returned.